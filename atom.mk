@@ -9,6 +9,7 @@ LOCAL_EXPORT_C_INCLUDES := $(LOCAL_PATH)/include
 LOCAL_CFLAGS := -DH264_API_EXPORTS -fvisibility=hidden -std=gnu99 -D_GNU_SOURCE
 LOCAL_SRC_FILES := \
 	src/h264.c \
+	src/h264_arena.c \
 	src/h264_bac.c \
 	src/h264_bitstream.c \
 	src/h264_cabac.c \
@@ -29,6 +30,9 @@ LOCAL_PRIVATE_LIBRARIES := \
 ifeq ("$(TARGET_OS)","windows")
   LOCAL_LDLIBS += -lws2_32
 endif
+ifneq ("$(TARGET_OS_FLAVOUR)","android")
+  LOCAL_LDLIBS += -lpthread
+endif
 
 include $(BUILD_LIBRARY)
 
@@ -44,3 +48,64 @@ LOCAL_LIBRARIES := \
 	libh264 \
 	libulog
 include $(BUILD_EXECUTABLE)
+
+include $(CLEAR_VARS)
+LOCAL_MODULE := h264-bac-bench
+LOCAL_DESCRIPTION := H.264 CABAC bypass decoding benchmark
+LOCAL_CATEGORY_PATH := libs/h264
+LOCAL_CFLAGS := -std=gnu99 -D_GNU_SOURCE
+LOCAL_C_INCLUDES := \
+	$(LOCAL_PATH)/include \
+	$(LOCAL_PATH)/src
+LOCAL_SRC_FILES := \
+	tools/h264_bac_bench.c \
+	src/h264_arena.c \
+	src/h264_bac.c \
+	src/h264_bitstream.c
+LOCAL_LIBRARIES := \
+	libulog
+include $(BUILD_EXECUTABLE)
+
+include $(CLEAR_VARS)
+LOCAL_MODULE := h264-test
+LOCAL_DESCRIPTION := H.264 library internal unit tests
+LOCAL_CATEGORY_PATH := libs/h264
+LOCAL_CFLAGS := -std=gnu99 -D_GNU_SOURCE
+LOCAL_C_INCLUDES := \
+	$(LOCAL_PATH)/include \
+	$(LOCAL_PATH)/src
+LOCAL_SRC_FILES := \
+	tests/h264_test.c \
+	tests/h264_test_au_end.c \
+	tests/h264_test_bac.c \
+	tests/h264_test_bitstream.c \
+	tests/h264_test_cabac_init.c \
+	tests/h264_test_cabac_pcm.c \
+	tests/h264_test_find_nalu.c \
+	tests/h264_test_fmo.c \
+	tests/h264_test_mb_table.c \
+	tests/h264_test_neighbours.c \
+	tests/h264_test_peek.c \
+	tests/h264_test_push.c \
+	tests/h264_test_sei.c \
+	tests/h264_test_unescape.c \
+	tests/h264_test_vlc.c \
+	tests/h264_test_writer.c \
+	src/h264.c \
+	src/h264_arena.c \
+	src/h264_bac.c \
+	src/h264_bitstream.c \
+	src/h264_cabac.c \
+	src/h264_cabac_ctx_tables.c \
+	src/h264_ctx.c \
+	src/h264_dump.c \
+	src/h264_fmo.c \
+	src/h264_macroblock.c \
+	src/h264_reader.c \
+	src/h264_slice_data.c \
+	src/h264_types.c \
+	src/h264_writer.c
+LOCAL_LIBRARIES := \
+	json \
+	libulog
+include $(BUILD_EXECUTABLE)
@@ -60,14 +60,48 @@ struct h264_bitstream {
 };
 
 
+/* NAL unit boundaries in a byte stream buffer */
+struct h264_nalu_info {
+	/* Offset of the NAL unit in the buffer (after the start code) */
+	size_t off;
+
+	/* Length of the NAL unit */
+	size_t len;
+
+	/* Size of the start code preceding the NAL unit (3 or 4) */
+	uint32_t start_code_size;
+
+	/* NAL unit type (0 if the NAL unit is empty) */
+	enum h264_nalu_type type;
+
+	/* 0 if no end code was found, i.e. the NAL unit ends with the
+	 * buffer and may be incomplete */
+	int complete;
+};
+
+
 H264_API
 int h264_find_nalu(const uint8_t *buf, size_t len, size_t *start, size_t *end);
 
 
+H264_API
+int h264_find_nalus(const uint8_t *buf,
+		    size_t len,
+		    struct h264_nalu_info *nalus,
+		    size_t max_count,
+		    size_t *count);
+
+
 H264_API
 int h264_bs_write_bits(struct h264_bitstream *bs, uint64_t v, uint32_t n);
 
 
+/* Internal: multi-byte path of the inline h264_bs_read_bits(), exported only
+ * for it; not part of the API, do not call directly */
+H264_API
+int _h264_bs_read_bits_word(struct h264_bitstream *bs, uint32_t *v, uint32_t n);
+
+
 H264_API
 int h264_bs_read_bits_ue(struct h264_bitstream *bs, uint32_t *v);
 
@@ -92,6 +126,10 @@ H264_API int
 h264_bs_next_bits(const struct h264_bitstream *bs, uint32_t *v, uint32_t n);
 
 
+H264_API int
+h264_bs_peek_bits(const struct h264_bitstream *bs, uint32_t *v, uint32_t n);
+
+
 H264_API
 int h264_bs_read_rbsp_trailing_bits(struct h264_bitstream *bs);
 
@@ -198,6 +236,17 @@ h264_bs_read_bits(struct h264_bitstream *bs, uint32_t *v, uint32_t n)
 	uint32_t mask = 0;
 	uint32_t part = 0;
 
+	/* All bits already in cache */
+	if (n > 0 && n <= bs->cachebits) {
+		bs->cachebits -= n;
+		*v = (bs->cache >> bs->cachebits) & ((1U << n) - 1);
+		return n;
+	}
+
+	/* More than one byte to fetch: refill from a 64-bit word */
+	if (n > bs->cachebits + 8u)
+		return _h264_bs_read_bits_word(bs, v, n);
+
 	*v = 0;
 	while (n > 0) {
 		/* Fetch data if needed */
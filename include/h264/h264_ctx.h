@@ -42,7 +42,11 @@ struct h264_ctx_cbs {
 	 * - then nalu_end(NALU 1 of frame n+1)
 	 * Warning: this function will not be called for the last AU of a
 	 * bitstream, as no subsequent NAL units are available for AU change
-	 * detection.
+	 * detection, unless h264_reader_flush() is called.
+	 * With H264_READER_FLAGS_EARLY_AU_END, it is instead called as soon
+	 * as the primary coded picture is complete, after the slice*()
+	 * callback functions and before the nalu_end() callback function for
+	 * its last slice NAL unit.
 	 */
 	void (*au_end)(struct h264_ctx *ctx, void *userdata);
 
@@ -149,6 +153,18 @@ struct h264_ctx_cbs {
 				   size_t len,
 				   const struct h264_sei_recovery_point *sei,
 				   void *userdata);
+
+	/* Optional: when set, a run of skipped macroblocks (mb_skip_run,
+	 * CAVLC only) is reported with a single call to this function
+	 * instead of one call to slice_data_mb() per macroblock; the
+	 * mb_count macroblocks follow first_mb_addr in decoding order
+	 * (consecutive addresses unless slice groups are used) */
+	void (*slice_data_mb_run)(struct h264_ctx *ctx,
+				  const struct h264_slice_header *sh,
+				  uint32_t first_mb_addr,
+				  uint32_t mb_count,
+				  enum h264_mb_type mb_type,
+				  void *userdata);
 };
 
 
@@ -32,7 +32,7 @@ struct json_object;
 struct h264_dump;
 
 
-/* Dump slice data (CAVLC only) */
+/* Dump slice data (CAVLC and CABAC) */
 #define H264_DUMP_FLAGS_SLICE_DATA 0x01
 
 
@@ -31,9 +31,24 @@
 struct h264_reader;
 
 
-/* Parse slice data (CAVLC only) */
+/* Parse slice data (CAVLC and CABAC) */
 #define H264_READER_FLAGS_SLICE_DATA 0x01
 
+/* Remove the emulation prevention bytes of each NAL unit into an internal
+ * buffer before parsing it; callbacks still get the original NAL unit data */
+#define H264_READER_FLAGS_UNESCAPE 0x02
+
+/* Do not copy the SEI payloads that contain no emulation prevention byte:
+ * their buffers (in the SEI callbacks and in the context SEI table) point
+ * into the NAL unit data and are only valid as long as it is */
+#define H264_READER_FLAGS_SEI_ZERO_COPY 0x04
+
+/* Call the au_end() callback function as soon as all the macroblocks of the
+ * primary coded picture have been parsed, instead of on the first NAL unit
+ * of the next access unit; requires H264_READER_FLAGS_SLICE_DATA, otherwise
+ * access units still end on the next access unit (or on flush) */
+#define H264_READER_FLAGS_EARLY_AU_END 0x08
+
 
 H264_API
 int h264_reader_new(const struct h264_ctx_cbs *cbs,
@@ -53,6 +68,20 @@ H264_API
 int h264_reader_stop(struct h264_reader *reader);
 
 
+/* Maximum length of the unfinished NAL unit kept by h264_reader_push()
+ * (4MB by default) */
+H264_API
+int h264_reader_set_stream_max_len(struct h264_reader *reader,
+				   size_t max_len);
+
+
+/* End of stream: parse the unfinished NAL unit kept by h264_reader_push(),
+ * then call the au_end() callback function for the last access unit if it
+ * has not been ended yet; the next NAL unit starts a new access unit */
+H264_API
+int h264_reader_flush(struct h264_reader *reader);
+
+
 H264_API
 int h264_reader_parse(struct h264_reader *reader,
 		      uint32_t flags,
@@ -61,6 +90,21 @@ int h264_reader_parse(struct h264_reader *reader,
 		      size_t *off);
 
 
+/* Parse a byte stream fed in buffers split at arbitrary positions: complete
+ * NAL units are parsed without copy, the unfinished NAL unit at the end of
+ * the buffer is copied and kept until its end is found in a next buffer or
+ * h264_reader_flush() is called. Returns -ENOBUFS if a NAL unit longer than
+ * the maximum length had to be dropped. If the reader is stopped, off is
+ * set after the last parsed NAL unit, the data after it has not been used
+ * and must be pushed again */
+H264_API
+int h264_reader_push(struct h264_reader *reader,
+		     uint32_t flags,
+		     const uint8_t *buf,
+		     size_t len,
+		     size_t *off);
+
+
 H264_API
 int h264_reader_parse_nalu(struct h264_reader *reader,
 			   uint32_t flags,
@@ -68,6 +112,18 @@ int h264_reader_parse_nalu(struct h264_reader *reader,
 			   size_t len);
 
 
+/* Read only the NAL unit header and the first slice header fields, using
+ * the parameter sets known by the reader; SPS and PPS NAL units are parsed to
+ * update the parameter sets of the context, without calling the callback
+ * functions nor changing the active parameter sets. The access unit change
+ * detection state is shared with h264_reader_parse_nalu() */
+H264_API
+int h264_reader_peek_nalu(struct h264_reader *reader,
+			  const uint8_t *buf,
+			  size_t len,
+			  struct h264_nalu_peek *info);
+
+
 H264_API
 int h264_parse_nalu_header(const uint8_t *buf,
 			   size_t len,
@@ -653,7 +653,7 @@ struct h264_sei {
 
 	/* Internal use only */
 	struct {
-		uint8_t *buf;
+		const uint8_t *buf;
 		size_t len;
 	} raw;
 };
@@ -764,6 +764,33 @@ struct h264_info {
 };
 
 
+/* NAL unit summary from h264_reader_peek_nalu() */
+struct h264_nalu_peek {
+	/* NAL unit type */
+	enum h264_nalu_type type;
+
+	/* NAL unit reference indicator */
+	uint32_t nal_ref_idc;
+
+	/* 1 if the NAL unit is an IDR picture slice, 0 otherwise */
+	int idr;
+
+	/* 1 if the previous access unit ends before this NAL unit (the
+	 * au_end callback would be called), 0 otherwise */
+	int au_start;
+
+	/* 1 if the NAL unit is the first VCL NAL unit of a primary coded
+	 * picture, 0 otherwise */
+	int first_vcl;
+
+	/* First slice header fields (only for slice NAL units) */
+	uint32_t first_mb_in_slice;
+	uint32_t slice_type;
+	uint32_t pic_parameter_set_id;
+	uint32_t frame_num;
+};
+
+
 H264_API
 const char *h264_nalu_type_str(enum h264_nalu_type val);
 
@@ -0,0 +1,148 @@
+/**
+ * Copyright (c) 2016 Parrot Drones SAS
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *   * Redistributions of source code must retain the above copyright
+ *     notice, this list of conditions and the following disclaimer.
+ *   * Redistributions in binary form must reproduce the above copyright
+ *     notice, this list of conditions and the following disclaimer in the
+ *     documentation and/or other materials provided with the distribution.
+ *   * Neither the name of the Parrot Drones SAS Company nor the
+ *     names of its contributors may be used to endorse or promote products
+ *     derived from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE PARROT DRONES SAS COMPANY BE LIABLE FOR
+ * ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+ * OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include "h264_priv.h"
+
+
+#define H264_ARENA_ALIGN 16
+#define H264_ARENA_DEFAULT_BLOCK_SIZE 4096
+#define H264_ARENA_ALIGN_UP(x)                                                 \
+	(((x) + (H264_ARENA_ALIGN - 1)) & ~(size_t)(H264_ARENA_ALIGN - 1))
+
+
+struct h264_arena_block {
+	struct h264_arena_block *next;
+	size_t size;
+	size_t used;
+};
+
+
+struct h264_arena {
+	/* Blocks are kept across resets, allocations are served from the
+	 * current block then from the following ones */
+	struct h264_arena_block *first;
+	struct h264_arena_block *cur;
+	size_t block_size;
+};
+
+
+static inline uint8_t *h264_arena_block_data(struct h264_arena_block *block)
+{
+	return (uint8_t *)block +
+	       H264_ARENA_ALIGN_UP(sizeof(struct h264_arena_block));
+}
+
+
+int h264_arena_new(size_t block_size, struct h264_arena **ret_obj)
+{
+	struct h264_arena *arena = NULL;
+
+	ULOG_ERRNO_RETURN_ERR_IF(ret_obj == NULL, EINVAL);
+	*ret_obj = NULL;
+
+	arena = calloc(1, sizeof(*arena));
+	if (arena == NULL)
+		return -ENOMEM;
+	arena->block_size = block_size != 0 ? block_size
+					    : H264_ARENA_DEFAULT_BLOCK_SIZE;
+
+	*ret_obj = arena;
+	return 0;
+}
+
+
+int h264_arena_destroy(struct h264_arena *arena)
+{
+	struct h264_arena_block *block = NULL;
+
+	if (arena == NULL)
+		return 0;
+
+	while (arena->first != NULL) {
+		block = arena->first;
+		arena->first = block->next;
+		free(block);
+	}
+	free(arena);
+	return 0;
+}
+
+
+int h264_arena_reset(struct h264_arena *arena)
+{
+	struct h264_arena_block *block = NULL;
+
+	ULOG_ERRNO_RETURN_ERR_IF(arena == NULL, EINVAL);
+
+	for (block = arena->first; block != NULL; block = block->next)
+		block->used = 0;
+	arena->cur = arena->first;
+	return 0;
+}
+
+
+void *h264_arena_alloc(struct h264_arena *arena, size_t size)
+{
+	struct h264_arena_block *block = NULL;
+	struct h264_arena_block *prev = NULL;
+	size_t block_size = 0;
+	void *ptr = NULL;
+
+	ULOG_ERRNO_RETURN_VAL_IF(arena == NULL, EINVAL, NULL);
+
+	size = H264_ARENA_ALIGN_UP(size);
+
+	/* Find a block with enough room, blocks that are skipped stay unused
+	 * until the next reset */
+	for (block = arena->cur; block != NULL; block = block->next) {
+		if (block->size - block->used >= size)
+			break;
+		prev = block;
+	}
+
+	if (block == NULL) {
+		/* Append a new block */
+		block_size = Max(arena->block_size, size);
+		block = malloc(H264_ARENA_ALIGN_UP(sizeof(*block)) +
+			       block_size);
+		if (block == NULL) {
+			ULOG_ERRNO("malloc", ENOMEM);
+			return NULL;
+		}
+		block->next = NULL;
+		block->size = block_size;
+		block->used = 0;
+		if (prev != NULL)
+			prev->next = block;
+		else
+			arena->first = block;
+	}
+
+	arena->cur = block;
+	ptr = h264_arena_block_data(block) + block->used;
+	block->used += size;
+	return ptr;
+}
@@ -43,7 +43,7 @@
  * Table 9-44 Specification of rangeTabLPS depending on pStateIdx and
  * qCodIRangeIdx
  */
-static const uint8_t s_h264_range_table_lps[64][4] = {
+const uint8_t h264_bac_range_table_lps[64][4] = {
 	[0]  = { 128, 176, 208, 240 },
 	[1]  = { 128, 167, 197, 227 },
 	[2]  = { 128, 158, 187, 216 },
@@ -114,7 +114,7 @@ static const uint8_t s_h264_range_table_lps[64][4] = {
 /**
  * Table 9-45 - State transition table
  */
-static const uint8_t s_h264_trans_table_lps[64] = {
+const uint8_t h264_bac_trans_table_lps[64] = {
 	 0,  0,  1,  2,  2,  4,  4,  5,
 	 6,  7,  8,  9,  9, 11, 11, 12,
 	13, 13, 15, 15, 16, 16, 18, 18,
@@ -129,7 +129,7 @@ static const uint8_t s_h264_trans_table_lps[64] = {
 /**
  * Table 9-45 - State transition table
  */
-static const uint8_t s_h264_trans_table_mps[64] = {
+const uint8_t h264_bac_trans_table_mps[64] = {
 	 1,  2,  3,  4,  5,  6,  7,  8,
 	 9, 10, 11, 12, 13, 14, 15, 16,
 	17, 18, 19, 20, 21, 22, 23, 24,
@@ -140,27 +140,60 @@ static const uint8_t s_h264_trans_table_mps[64] = {
 	57, 58, 59, 60, 61, 62, 62, 63,
 };
 
+
+/**
+ * 9.3.3.2.2 Renormalization process in the arithmetic decoding engine:
+ * number of shifts needed to bring codIRange (>= 6) back to at least 256,
+ * indexed by codIRange >> 3
+ */
+const uint8_t h264_bac_renorm_shift[64] = {
+	6, 5, 4, 4, 3, 3, 3, 3,
+	2, 2, 2, 2, 2, 2, 2, 2,
+	1, 1, 1, 1, 1, 1, 1, 1,
+	1, 1, 1, 1, 1, 1, 1, 1,
+	0, 0, 0, 0, 0, 0, 0, 0,
+	0, 0, 0, 0, 0, 0, 0, 0,
+	0, 0, 0, 0, 0, 0, 0, 0,
+	0, 0, 0, 0, 0, 0, 0, 0,
+};
+
 /* clang-format on */
 
 
 /**
- * 9.3.4.3 Renormalization process in the arithmetic encoding engine
- * Figure 9-9 - Flowchart of PutBit(B)
+ * Append a byte to the output word, the word is written to the bitstream
+ * once full.
  */
-static int h264_bac_encode_put_bit(struct h264_bac_enc *enc, int bit)
+static inline int h264_bac_encode_emit(struct h264_bac_enc *enc, uint32_t b)
 {
 	int res = 0;
 
-	if (enc->firstBitFlag)
-		enc->firstBitFlag = 0;
-	else
-		CHECK(h264_bs_write_bits(enc->bs, bit, 1));
-
-	while (enc->bitsOutstanding > 0) {
-		CHECK(h264_bs_write_bits(enc->bs, !bit, 1));
-		enc->bitsOutstanding--;
+	enc->word = (enc->word << 8) | b;
+	if (++enc->wordBytes == 8) {
+		res = h264_bs_write_bits(enc->bs, enc->word, 64);
+		enc->word = 0;
+		enc->wordBytes = 0;
 	}
 
+	return res < 0 ? res : 0;
+}
+
+
+/**
+ * Output the pending byte plus the given carry, followed by the outstanding
+ * 0xff bytes, which the carry turns into 0x00 bytes.
+ */
+static int h264_bac_encode_resolve(struct h264_bac_enc *enc, uint32_t carry)
+{
+	int res = 0;
+	uint32_t b = (0xff + carry) & 0xff;
+
+	if (enc->pending >= 0)
+		CHECK(h264_bac_encode_emit(enc, (enc->pending + carry) & 0xff));
+	for (; enc->bytesOutstanding > 0; enc->bytesOutstanding--)
+		CHECK(h264_bac_encode_emit(enc, b));
+	enc->pending = -1;
+
 out:
 	return res;
 }
@@ -168,24 +201,20 @@ out:
 
 /**
  * 9.3.4.3 Renormalization process in the arithmetic encoding engine
- * Figure 9-8 - Flowchart of renormalization in the encoder
+ * Figure 9-9 - Flowchart of PutBit(B)
+ * The bits are output a byte at a time. Instead of the outstanding bits of
+ * PutBit(), the last byte is kept pending as long as a carry (bit 8 of the
+ * next bytes) may modify it, i.e. as long as it is followed by 0xff bytes.
  */
-static int h264_bac_encode_renorm(struct h264_bac_enc *enc)
+static int h264_bac_encode_put_byte(struct h264_bac_enc *enc, uint32_t b)
 {
 	int res = 0;
 
-	while (enc->codIRange < 256) {
-		if (enc->codILow < 256) {
-			CHECK(h264_bac_encode_put_bit(enc, 0));
-		} else if (enc->codILow < 512) {
-			enc->codILow -= 256;
-			enc->bitsOutstanding++;
-		} else {
-			enc->codILow -= 512;
-			CHECK(h264_bac_encode_put_bit(enc, 1));
-		}
-		enc->codIRange <<= 1;
-		enc->codILow <<= 1;
+	if ((b & 0xff) == 0xff) {
+		enc->bytesOutstanding++;
+	} else {
+		CHECK(h264_bac_encode_resolve(enc, b >> 8));
+		enc->pending = b & 0xff;
 	}
 
 out:
@@ -193,6 +222,38 @@ out:
 }
 
 
+/**
+ * Take the complete byte above the 10 bits of codILow, with its carry
+ */
+static inline int h264_bac_encode_shift_out(struct h264_bac_enc *enc)
+{
+	uint32_t b = enc->codILow >> (enc->queue + 10);
+
+	enc->codILow &= (0x400 << enc->queue) - 1;
+	enc->queue -= 8;
+	return h264_bac_encode_put_byte(enc, b);
+}
+
+
+/**
+ * 9.3.4.3 Renormalization process in the arithmetic encoding engine
+ * Figure 9-8 - Flowchart of renormalization in the encoder
+ * All the shifts are done at once, the count is read from the decoder
+ * renormalization table; at most one byte can be completed.
+ */
+static inline int h264_bac_encode_renorm(struct h264_bac_enc *enc)
+{
+	uint32_t shift = h264_bac_renorm_shift[enc->codIRange >> 3];
+
+	enc->codIRange <<= shift;
+	enc->codILow <<= shift;
+	enc->queue += shift;
+	if (enc->queue >= 0)
+		return h264_bac_encode_shift_out(enc);
+	return 0;
+}
+
+
 /**
  * 9.3.4.5 Encoding process for a binary decision before termination
  * Figure 9-12 - Flowchart of flushing at termination
@@ -200,11 +261,36 @@ out:
 static int h264_bac_encode_flush(struct h264_bac_enc *enc)
 {
 	int res = 0;
+	uint32_t v = 0;
+	uint32_t n = 0;
+
+	/* Renormalization of codIRange = 2 is 7 shifts */
 	enc->codIRange = 2;
-	CHECK(h264_bac_encode_renorm(enc));
-	CHECK(h264_bac_encode_put_bit(enc, (enc->codILow >> 9) & 1));
-	/* Force last bit to 1 (rbsp_stop_one_bit) */
-	CHECK(h264_bs_write_bits(enc->bs, ((enc->codILow >> 7) & 3) | 1, 2));
+	enc->codILow <<= 7;
+	enc->queue += 7;
+	if (enc->queue >= 0)
+		CHECK(h264_bac_encode_shift_out(enc));
+
+	/* PutBit((codILow >> 9) & 1) and WriteBits(((codILow >> 7) & 3) | 1, 2)
+	 * with the last bit forced to 1 (rbsp_stop_one_bit): the remaining bits
+	 * are the queued ones and the bits 9 to 7 of codILow */
+	n = enc->queue + 11;
+	v = (enc->codILow | 0x80) >> 7;
+	if (n >= 8) {
+		n -= 8;
+		CHECK(h264_bac_encode_put_byte(enc, v >> n));
+		v &= (1 << n) - 1;
+	}
+	CHECK(h264_bac_encode_resolve(enc, v >> n));
+	if (enc->wordBytes > 0) {
+		CHECK(h264_bs_write_bits(
+			enc->bs, enc->word, 8 * enc->wordBytes));
+	}
+	CHECK(h264_bs_write_bits(enc->bs, v & ((1 << n) - 1), n));
+
+	enc->word = 0;
+	enc->wordBytes = 0;
+
 out:
 	return res;
 }
@@ -218,7 +304,7 @@ void h264_bac_state_init(struct h264_bac_state *state,
 			 int8_t m,
 			 int8_t n)
 {
-	int32_t qp = Clip3(1, 51, SliceQPLuma);
+	int32_t qp = Clip3(0, 51, SliceQPLuma);
 	int32_t idx = ((m * qp) >> 4) + n;
 	if (idx <= 63) {
 		state->idx = 63 - Max(1, idx);
@@ -234,14 +320,66 @@ void h264_bac_state_init(struct h264_bac_state *state,
  * 9.3.1.2 Initialisation process for the arithmetic decoding engine
  */
 int h264_bac_decode_init(struct h264_bac_dec *dec, struct h264_bitstream *bs)
+{
+	ULOG_ERRNO_RETURN_ERR_IF(!h264_bs_byte_aligned(bs), EIO);
+
+	dec->bs = bs;
+	dec->codIRange = 510;
+	dec->codIOffset = 0;
+	dec->bits = -9;
+	h264_bac_decode_refill(dec);
+
+	/* codIOffset shall not be 510 or 511 */
+	ULOG_ERRNO_RETURN_ERR_IF((dec->codIOffset >> dec->bits) >= 510, EIO);
+	return 0;
+}
+
+
+/**
+ * Append 16 bits to codIOffset; bits past the end of the bitstream are read
+ * as 0 so that the look-ahead never fails.
+ */
+void h264_bac_decode_refill(struct h264_bac_dec *dec)
+{
+	struct h264_bitstream *bs = dec->bs;
+	uint32_t v = 0;
+	uint32_t b = 0;
+
+	dec->refill_off = bs->off;
+	if (bs->len - bs->off >= 3) {
+		/* At most one emulation prevention byte in 3 bytes */
+		h264_bs_read_bits(bs, &v, 16);
+	} else {
+		for (uint32_t i = 0; i < 2; i++) {
+			b = 0;
+			h264_bs_read_bits(bs, &b, 8);
+			v = (v << 8) | b;
+		}
+	}
+
+	dec->codIOffset = (dec->codIOffset << 16) | v;
+	dec->bits += 16;
+}
+
+
+/**
+ * Move the bitstream back to the last bit actually consumed by the decoding
+ * engine, i.e. drop the look-ahead bits (before pcm_alignment_zero_bit).
+ */
+int h264_bac_decode_rewind(struct h264_bac_dec *dec)
 {
 	int res = 0;
 	uint32_t v = 0;
-	dec->bs = bs;
+	uint32_t n = 16 - dec->bits;
+	struct h264_bitstream *bs = dec->bs;
+
+	bs->off = dec->refill_off;
+	bs->cachebits = 0;
+	if (n > 0)
+		CHECK(h264_bs_read_bits(bs, &v, n));
+	dec->bits = 0;
 	dec->codIOffset = 0;
-	CHECK(h264_bs_read_bits(bs, &v, 9));
-	ULOG_ERRNO_RETURN_ERR_IF(v > 510, EIO);
-	dec->codIRange = v;
+
 out:
 	return res;
 }
@@ -257,8 +395,13 @@ int h264_bac_encode_init(struct h264_bac_enc *enc,
 	enc->bs = bs;
 	enc->codILow = 0;
 	enc->codIRange = 510;
-	enc->firstBitFlag = 1;
-	enc->bitsOutstanding = 0;
+	/* The first bit (firstBitFlag) is dropped as a carry of a byte that
+	 * does not exist */
+	enc->queue = -9;
+	enc->pending = -1;
+	enc->bytesOutstanding = 0;
+	enc->word = 0;
+	enc->wordBytes = 0;
 	if (first_slice)
 		enc->BinCountsInNALunits = 0;
 	return 0;
@@ -281,18 +424,18 @@ int h264_bac_encode_bin(struct h264_bac_enc *enc,
 		 bin);
 	uint32_t qCodIRangeIdx = (enc->codIRange >> 6) & 3;
 	uint32_t codIRangeLPS =
-		s_h264_range_table_lps[state->idx][qCodIRangeIdx];
+		h264_bac_range_table_lps[state->idx][qCodIRangeIdx];
 	enc->codIRange -= codIRangeLPS;
 
 	bin = !!bin;
 	if (bin == state->mps) {
-		state->idx = s_h264_trans_table_mps[state->idx];
+		state->idx = h264_bac_trans_table_mps[state->idx];
 	} else {
 		enc->codILow = enc->codILow + enc->codIRange;
 		enc->codIRange = codIRangeLPS;
 		if (state->idx == 0)
 			state->mps = !state->mps;
-		state->idx = s_h264_trans_table_lps[state->idx];
+		state->idx = h264_bac_trans_table_lps[state->idx];
 	}
 
 	CHECK(h264_bac_encode_renorm(enc));
@@ -315,16 +458,8 @@ int h264_bac_encode_bypass(struct h264_bac_enc *enc, int bin)
 	enc->codILow <<= 1;
 	if (bin)
 		enc->codILow += enc->codIRange;
-
-	if (enc->codILow >= 1024) {
-		CHECK(h264_bac_encode_put_bit(enc, 1));
-		enc->codILow -= 1024;
-	} else if (enc->codILow >= 512) {
-		enc->codILow -= 512;
-		enc->bitsOutstanding++;
-	} else {
-		CHECK(h264_bac_encode_put_bit(enc, 0));
-	}
+	if (++enc->queue >= 0)
+		CHECK(h264_bac_encode_shift_out(enc));
 
 	enc->BinCountsInNALunits++;
 
@@ -38,25 +38,53 @@ struct h264_bac_state {
 };
 
 
-/* Binary arithmetic code, decoding context */
+/* Binary arithmetic code, decoding context; codIOffset holds 'bits'
+ * look-ahead bits below the 9-bit offset of the spec, refilled 16 bits at a
+ * time from the byte-aligned bitstream */
 struct h264_bac_dec {
 	struct h264_bitstream *bs;
 	uint32_t codIRange;
 	uint32_t codIOffset;
+	int32_t bits;
+
+	/* Bitstream offset before the last refill */
+	size_t refill_off;
 };
 
 
-/* Binary arithmetic code, encoding context */
+/* Binary arithmetic code, encoding context; codILow holds 'queue' + 8 bits
+ * above the 10 bits of the spec, taken out a byte at a time */
 struct h264_bac_enc {
 	struct h264_bitstream *bs;
 	uint32_t codIRange;
 	uint32_t codILow;
-	int firstBitFlag;
-	uint32_t bitsOutstanding;
+	int32_t queue;
+
+	/* Last byte that can still be modified by a carry (-1 if none),
+	 * and number of 0xff bytes following it */
+	int32_t pending;
+	uint32_t bytesOutstanding;
+
+	/* Resolved bytes not yet written to the bitstream */
+	uint64_t word;
+	uint32_t wordBytes;
+
 	uint32_t BinCountsInNALunits;
 };
 
 
+extern const uint8_t h264_bac_range_table_lps[64][4];
+
+
+extern const uint8_t h264_bac_trans_table_lps[64];
+
+
+extern const uint8_t h264_bac_trans_table_mps[64];
+
+
+extern const uint8_t h264_bac_renorm_shift[64];
+
+
 void h264_bac_state_init(struct h264_bac_state *state,
 			 int32_t SliceQPLuma,
 			 int8_t m,
@@ -66,6 +94,122 @@ void h264_bac_state_init(struct h264_bac_state *state,
 int h264_bac_decode_init(struct h264_bac_dec *dec, struct h264_bitstream *bs);
 
 
+void h264_bac_decode_refill(struct h264_bac_dec *dec);
+
+
+int h264_bac_decode_rewind(struct h264_bac_dec *dec);
+
+
+/**
+ * 9.3.3.2.1 Arithmetic decoding process for a binary decision
+ * The decision and the renormalization (9.3.3.2.2) are branchless: the LPS
+ * path is selected with a mask and the renormalization shift is read from a
+ * table indexed by the new codIRange.
+ */
+static inline int h264_bac_decode_bin(struct h264_bac_dec *dec,
+				      struct h264_bac_state *state)
+{
+	uint32_t idx = state->idx;
+	uint32_t codIRangeLPS =
+		h264_bac_range_table_lps[idx][(dec->codIRange >> 6) & 3];
+	uint32_t range = dec->codIRange - codIRangeLPS;
+	uint32_t scaled = range << dec->bits;
+	uint32_t lps = dec->codIOffset >= scaled;
+	uint32_t mask = -lps;
+	uint32_t shift = 0;
+	int bin = state->mps ^ lps;
+
+	dec->codIOffset -= scaled & mask;
+	range ^= (range ^ codIRangeLPS) & mask;
+	state->mps ^= lps & (idx == 0);
+	state->idx = lps ? h264_bac_trans_table_lps[idx]
+			 : h264_bac_trans_table_mps[idx];
+
+	shift = h264_bac_renorm_shift[range >> 3];
+	dec->codIRange = range << shift;
+	dec->bits -= shift;
+	if (dec->bits < 0)
+		h264_bac_decode_refill(dec);
+
+	return bin;
+}
+
+
+/**
+ * 9.3.3.2.3 Bypass decoding process for binary decisions
+ */
+static inline int h264_bac_decode_bypass(struct h264_bac_dec *dec)
+{
+	uint32_t scaled = 0;
+	int bin = 0;
+
+	if (--dec->bits < 0)
+		h264_bac_decode_refill(dec);
+
+	scaled = dec->codIRange << dec->bits;
+	bin = dec->codIOffset >= scaled;
+	dec->codIOffset -= scaled & -(uint32_t)bin;
+	return bin;
+}
+
+
+/**
+ * Decode n (n <= 32) consecutive bypass bins at once, the first bin being the
+ * most significant bit of the returned value. Decoding n bypass bins is the
+ * long division of codIOffset, extended with the next n bits, by codIRange:
+ * the quotient gives the bins and the remainder the new codIOffset. The
+ * division is done on the look-ahead bits already in codIOffset, with one
+ * more step each time a refill is needed.
+ */
+static inline uint32_t h264_bac_decode_bypass_bits(struct h264_bac_dec *dec,
+						   uint32_t n)
+{
+	uint32_t v = 0;
+	uint32_t m = 0;
+	uint32_t q = 0;
+	uint32_t scaled = 0;
+
+	/* The division does not pay off for very short runs */
+	if (n <= 2) {
+		while (n-- > 0)
+			v = (v << 1) | h264_bac_decode_bypass(dec);
+		return v;
+	}
+
+	while (n > 0) {
+		if (dec->bits == 0)
+			h264_bac_decode_refill(dec);
+		m = n < (uint32_t)dec->bits ? n : (uint32_t)dec->bits;
+		dec->bits -= m;
+		scaled = dec->codIRange << dec->bits;
+		q = dec->codIOffset / scaled;
+		dec->codIOffset -= q * scaled;
+		v = (v << m) | q;
+		n -= m;
+	}
+
+	return v;
+}
+
+
+/**
+ * 9.3.3.2.2.3 Decoding process for binary decisions before termination
+ */
+static inline int h264_bac_decode_terminate(struct h264_bac_dec *dec)
+{
+	dec->codIRange -= 2;
+	if (dec->codIOffset >= (dec->codIRange << dec->bits))
+		return 1;
+
+	if (dec->codIRange < 256) {
+		dec->codIRange <<= 1;
+		if (--dec->bits < 0)
+			h264_bac_decode_refill(dec);
+	}
+	return 0;
+}
+
+
 int h264_bac_encode_init(struct h264_bac_enc *enc,
 			 struct h264_bitstream *bs,
 			 int first_slice);
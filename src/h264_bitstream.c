@@ -26,6 +26,12 @@
 
 #include "h264_priv.h"
 
+#if defined(__SSE2__)
+#	include <emmintrin.h>
+#elif defined(__ARM_NEON)
+#	include <arm_neon.h>
+#endif
+
 
 static int h264_bs_ensure_capacity(struct h264_bitstream *bs, size_t capacity)
 {
@@ -81,18 +87,203 @@ static int h264_bs_flush(struct h264_bitstream *bs)
 }
 
 
+/**
+ * Get the offset of the first 0x00 byte in buf, or len if there is none.
+ * Start and end codes can only begin on a 0x00 byte, so NAL unit payload is
+ * skipped 16 bytes at a time with SSE2/NEON when the target has it, then 8
+ * bytes at a time with a has-zero-byte test on a 64-bit word.
+ */
+static size_t h264_find_zero_byte(const uint8_t *buf, size_t len)
+{
+	size_t i = 0;
+	uint64_t w = 0;
+
+#if defined(__SSE2__)
+	const __m128i zero = _mm_setzero_si128();
+	for (; i + 16 <= len; i += 16) {
+		__m128i v = _mm_loadu_si128((const __m128i *)(buf + i));
+		int mask = _mm_movemask_epi8(_mm_cmpeq_epi8(v, zero));
+		if (mask != 0)
+			return i + __builtin_ctz(mask);
+	}
+#elif defined(__ARM_NEON)
+	for (; i + 16 <= len; i += 16) {
+		uint64x2_t m = vreinterpretq_u64_u8(
+			vceqq_u8(vld1q_u8(buf + i), vdupq_n_u8(0)));
+		if ((vgetq_lane_u64(m, 0) | vgetq_lane_u64(m, 1)) != 0)
+			break;
+	}
+#endif
+
+	for (; i + 8 <= len; i += 8) {
+		memcpy(&w, buf + i, sizeof(w));
+		if (((w - 0x0101010101010101ULL) & ~w &
+		     0x8080808080808080ULL) != 0)
+			break;
+	}
+
+	for (; i < len; i++) {
+		if (buf[i] == 0x00)
+			return i;
+	}
+
+	return len;
+}
+
+
+/**
+ * 7.4.1 NAL unit semantics: remove the emulation_prevention_three_byte of
+ * 0x000003 sequences. Runs of bytes without 0x00 are copied at once. The
+ * RBSP offset following each removed byte is stored in esc, which must be
+ * able to hold len / 3 entries; rbsp must be able to hold len bytes.
+ * Returns the RBSP length.
+ */
+size_t h264_bs_unescape(const uint8_t *buf,
+			size_t len,
+			uint8_t *rbsp,
+			size_t *esc,
+			size_t *esc_count)
+{
+	size_t i = 0, o = 0, n = 0;
+
+	*esc_count = 0;
+	while (i < len) {
+		/* Copy up to the next 0x00 byte */
+		n = h264_find_zero_byte(buf + i, len - i);
+		memcpy(rbsp + o, buf + i, n);
+		i += n;
+		o += n;
+		if (i >= len)
+			break;
+
+		/* Is it a 00 00 03 sequence? */
+		if (i + 2 < len && buf[i + 1] == 0x00 && buf[i + 2] == 0x03) {
+			rbsp[o++] = 0x00;
+			rbsp[o++] = 0x00;
+			i += 3;
+			esc[(*esc_count)++] = o;
+			continue;
+		}
+
+		rbsp[o++] = buf[i++];
+	}
+
+	return o;
+}
+
+
+/**
+ * Read len bytes, removing the emulation prevention bytes if enabled. On a
+ * byte-aligned bitstream, runs of bytes up to the next 0x00 are copied at once
+ * (an emulation prevention byte can only follow two 0x00 bytes).
+ */
+int h264_bs_read_bytes(struct h264_bitstream *bs, uint8_t *buf, size_t len)
+{
+	int res = 0;
+	size_t o = 0, n = 0, m = 0;
+	uint32_t v = 0;
+
+	if (bs->cachebits != 0) {
+		for (o = 0; o < len; o++) {
+			res = h264_bs_read_bits(bs, &v, 8);
+			if (res < 0)
+				return res;
+			buf[o] = v;
+		}
+		return 0;
+	}
+
+	if (!bs->emulation_prevention) {
+		if (bs->len - bs->off < len)
+			return -EIO;
+		memcpy(buf, bs->cdata + bs->off, len);
+		bs->off += len;
+		return 0;
+	}
+
+	while (o < len) {
+		if (bs->off >= bs->len)
+			return -EIO;
+
+		/* Skip an emulation prevention byte (see h264_bs_fetch) */
+		if (bs->off >= 2 && bs->cdata[bs->off - 2] == 0x00 &&
+		    bs->cdata[bs->off - 1] == 0x00 &&
+		    bs->cdata[bs->off] == 0x03) {
+			if (bs->off + 1 >= bs->len)
+				return -EIO;
+			bs->off++;
+			buf[o++] = bs->cdata[bs->off++];
+			continue;
+		}
+
+		/* Copy up to and including the next 0x00 byte */
+		m = Min(len - o, bs->len - bs->off);
+		n = h264_find_zero_byte(bs->cdata + bs->off, m);
+		if (n < m)
+			n++;
+		memcpy(buf + o, bs->cdata + bs->off, n);
+		bs->off += n;
+		o += n;
+	}
+
+	return 0;
+}
+
+
+/**
+ * Reference the next len bytes in the bitstream data without copy; *ref is
+ * set to NULL (and nothing is read) if the bitstream is not byte-aligned or
+ * if the bytes contain an emulation prevention byte.
+ */
+int h264_bs_ref_bytes(struct h264_bitstream *bs,
+		      size_t len,
+		      const uint8_t **ref)
+{
+	size_t i = 0, end = 0;
+
+	*ref = NULL;
+	if (bs->cachebits != 0)
+		return 0;
+	if (bs->len - bs->off < len)
+		return -EIO;
+
+	if (bs->emulation_prevention) {
+		/* Look for 0x000003 sequences ending in the bytes */
+		i = bs->off >= 2 ? bs->off - 2 : 0;
+		end = bs->off + len;
+		while (i < end) {
+			i += h264_find_zero_byte(bs->cdata + i, end - i);
+			if (i + 2 < end && bs->cdata[i + 1] == 0x00 &&
+			    bs->cdata[i + 2] == 0x03)
+				return 0;
+			i++;
+		}
+	}
+
+	*ref = bs->cdata + bs->off;
+	bs->off += len;
+	return 0;
+}
+
+
 /**
  * B.1 Byte stream NAL unit syntax and semantics
  */
-static int
-h264_find_start_code(const uint8_t *buf, size_t len, size_t *start, size_t *end)
+int h264_find_start_code(const uint8_t *buf,
+			 size_t len,
+			 size_t *start,
+			 size_t *end)
 {
 	const uint8_t *p = buf;
+	size_t skip = 0;
 
 	while (len >= 3) {
 		/* Search for the next 0x00 byte */
-		if (*p != 0x00)
-			goto next;
+		skip = h264_find_zero_byte(p, len - 2);
+		p += skip;
+		len -= skip;
+		if (len < 3)
+			break;
 
 		/* Is it a 00 00 00 01 sequence? */
 		if (len >= 4 && p[1] == 0x00 && p[2] == 0x00 && p[3] == 0x01) {
@@ -108,9 +299,6 @@ h264_find_start_code(const uint8_t *buf, size_t len, size_t *start, size_t *end)
 			return 0;
 		}
 
-		/* clang-format off */
-next:
-		/* clang-format on */
 		p++;
 		len--;
 	}
@@ -122,14 +310,18 @@ next:
 /**
  * B.1 Byte stream NAL unit syntax and semantics
  */
-static int h264_find_end_code(const uint8_t *buf, size_t len, size_t *end)
+int h264_find_end_code(const uint8_t *buf, size_t len, size_t *end)
 {
 	const uint8_t *p = buf;
+	size_t skip = 0;
 
 	while (len >= 3) {
 		/* Search next 0x00 byte */
-		if (*p != 0x00)
-			goto next;
+		skip = h264_find_zero_byte(p, len - 2);
+		p += skip;
+		len -= skip;
+		if (len < 3)
+			break;
 
 		/* Is it a 00 00 00 sequence? */
 		if (p[1] == 0x00 && p[2] == 0x00) {
@@ -143,9 +335,6 @@ static int h264_find_end_code(const uint8_t *buf, size_t len, size_t *end)
 			return 0;
 		}
 
-		/* clang-format off */
-next:
-		/* clang-format on */
 		p++;
 		len--;
 	}
@@ -184,6 +373,179 @@ int h264_find_nalu(const uint8_t *buf, size_t len, size_t *start, size_t *end)
 }
 
 
+/**
+ * B.1 Byte stream NAL unit syntax and semantics
+ * The search for a start code resumes where the end code of the previous NAL
+ * unit was found, so each byte of the buffer is only examined once.
+ */
+int h264_find_nalus(const uint8_t *buf,
+		    size_t len,
+		    struct h264_nalu_info *nalus,
+		    size_t max_count,
+		    size_t *count)
+{
+	int res = 0;
+	size_t off = 0, sc1 = 0, sc2 = 0, ec = 0;
+	struct h264_nalu_info *nalu = NULL;
+
+	ULOG_ERRNO_RETURN_ERR_IF(buf == NULL, EINVAL);
+	ULOG_ERRNO_RETURN_ERR_IF(nalus == NULL && max_count > 0, EINVAL);
+	ULOG_ERRNO_RETURN_ERR_IF(count == NULL, EINVAL);
+
+	*count = 0;
+	while (off < len && *count < max_count) {
+		/* Search for start code */
+		res = h264_find_start_code(buf + off, len - off, &sc1, &sc2);
+		if (res < 0)
+			break;
+
+		nalu = &nalus[*count];
+		nalu->off = off + sc2;
+		nalu->start_code_size = sc2 - sc1;
+
+		/* Search for end code */
+		res = h264_find_end_code(buf + nalu->off, len - nalu->off, &ec);
+		if (res < 0) {
+			/* End of buffer reached before finding next start
+			 * code */
+			nalu->len = len - nalu->off;
+			nalu->complete = 0;
+		} else {
+			nalu->len = ec;
+			nalu->complete = 1;
+		}
+		nalu->type = nalu->len > 0 ? (buf[nalu->off] & 0x1f) : 0;
+
+		off = nalu->off + nalu->len;
+		(*count)++;
+	}
+
+	return 0;
+}
+
+
+/* Load 8 bytes as a big-endian 64-bit word */
+static inline uint64_t h264_bs_load_word(const uint8_t *p)
+{
+	return ((uint64_t)p[0] << 56) | ((uint64_t)p[1] << 48) |
+	       ((uint64_t)p[2] << 40) | ((uint64_t)p[3] << 32) |
+	       ((uint64_t)p[4] << 24) | ((uint64_t)p[5] << 16) |
+	       ((uint64_t)p[6] << 8) | (uint64_t)p[7];
+}
+
+
+/* Store a 64-bit word as 8 big-endian bytes */
+static inline void h264_bs_store_word(uint8_t *p, uint64_t w)
+{
+	p[0] = w >> 56;
+	p[1] = w >> 48;
+	p[2] = w >> 40;
+	p[3] = w >> 32;
+	p[4] = w >> 24;
+	p[5] = w >> 16;
+	p[6] = w >> 8;
+	p[7] = w;
+}
+
+
+/* Mark with 0x80 the bytes of a word that start a 00 00 pair */
+static inline uint64_t h264_bs_zero_pairs(uint64_t w)
+{
+	const uint64_t lo7 = 0x7f7f7f7f7f7f7f7fULL;
+	uint64_t z = ~(((w & lo7) + lo7) | w | lo7);
+	return z & (z << 8);
+}
+
+
+/**
+ * Get a left-aligned window of the next bits without consuming them. The
+ * word is loaded at off - 2 so that the two bytes preceding each new byte
+ * can be checked for an emulation prevention sequence; the window stops
+ * before the first byte that follows a 00 00 pair. Returns the number of
+ * valid bits in the window, or 0 if the window can not be used.
+ */
+static inline uint32_t h264_bs_peek_window(const struct h264_bitstream *bs,
+					   uint64_t *win)
+{
+	uint64_t w = 0;
+	uint64_t pairs = 0;
+	uint32_t nbytes = 6;
+
+	if (bs->off < 2 || bs->off + 6 > bs->len)
+		return 0;
+
+	w = h264_bs_load_word(bs->cdata + bs->off - 2);
+	if (bs->emulation_prevention) {
+		pairs = h264_bs_zero_pairs(w) & 0xffffffffffff0000ULL;
+		if (pairs != 0)
+			nbytes = h264_clz64(pairs) / 8;
+	}
+
+	*win = ((uint64_t)(uint8_t)(bs->cache << (8 - bs->cachebits)) << 56) |
+	       ((w << 16) >> bs->cachebits);
+	return bs->cachebits + 8 * nbytes;
+}
+
+
+/**
+ * Consume n bits previously validated by h264_bs_peek_window(); the
+ * off/cache/cachebits state is left exactly as the byte-wise path would.
+ */
+static inline void h264_bs_skip_window(struct h264_bitstream *bs, uint32_t n)
+{
+	uint32_t need = 0;
+	uint32_t nbytes = 0;
+
+	if (n <= bs->cachebits) {
+		bs->cachebits -= n;
+		return;
+	}
+
+	need = n - bs->cachebits;
+	nbytes = (need + 7) / 8;
+	bs->off += nbytes;
+	bs->cache = bs->cdata[bs->off - 1];
+	bs->cachebits = nbytes * 8 - need;
+}
+
+
+int _h264_bs_read_bits_word(struct h264_bitstream *bs,
+			    uint32_t *v,
+			    uint32_t n)
+{
+	int res = 0;
+	uint64_t win = 0;
+	uint32_t bits = 0;
+	uint32_t mask = 0;
+	uint32_t part = 0;
+
+	/* Multi-byte refill, unless a 00 00 pair is in the window */
+	if (n > 0 && n <= 32 && h264_bs_peek_window(bs, &win) >= n) {
+		*v = (uint32_t)(win >> (64 - n));
+		h264_bs_skip_window(bs, n);
+		return n;
+	}
+
+	*v = 0;
+	while (n > 0) {
+		/* Fetch data if needed */
+		if (bs->cachebits == 0 && h264_bs_fetch(bs) < 0)
+			return -EIO;
+
+		/* Read as many bits from cache */
+		bits = n < bs->cachebits ? n : bs->cachebits;
+		mask = (1 << bits) - 1;
+		part = (bs->cache >> (bs->cachebits - bits)) & mask;
+		*v = (*v << bits) | part;
+		n -= bits;
+		bs->cachebits -= bits;
+		res += bits;
+	}
+
+	return res;
+}
+
+
 /**
  * 9.1 Parsing process for Exp-Golomb codes
  */
@@ -191,6 +553,21 @@ int h264_bs_read_bits_ue(struct h264_bitstream *bs, uint32_t *v)
 {
 	int leadingzeros = -1;
 	uint32_t bit = 0;
+	uint64_t win = 0;
+	uint32_t avail = 0;
+	uint32_t n = 0;
+
+	/* Fast path: the whole codeword is in the peek window, its value is
+	 * the codeword itself minus 1 */
+	avail = h264_bs_peek_window(bs, &win);
+	if (avail > 0 && win != 0) {
+		n = 2 * h264_clz64(win) + 1;
+		if (n <= avail) {
+			*v = (uint32_t)(win >> (64 - n)) - 1;
+			h264_bs_skip_window(bs, n);
+			return n;
+		}
+	}
 
 	for (bit = 0; !bit; leadingzeros++) {
 		if (h264_bs_read_bits(bs, &bit, 1) < 0)
@@ -208,6 +585,54 @@ int h264_bs_read_bits_ue(struct h264_bitstream *bs, uint32_t *v)
 }
 
 
+/**
+ * Append the bits to the cache in a 64-bit accumulator and store all the
+ * completed bytes at once. Emulation prevention is checked on the whole
+ * word: if none of the new bytes follows a 00 00 pair, no escape byte can
+ * be needed and the word is stored as is. Returns the number of bits
+ * written, or 0 if the byte-wise path must be used.
+ */
+static int h264_bs_write_word(struct h264_bitstream *bs, uint64_t v, uint32_t n)
+{
+	uint32_t total = bs->cachebits + n;
+	uint32_t nbytes = total / 8;
+	uint32_t i = 0;
+	uint64_t acc = 0;
+	uint64_t w = 0;
+
+	if (total > 48 || bs->off < 2)
+		return 0;
+
+	/* Left-aligned accumulator: cache bits followed by the new bits */
+	acc = ((uint64_t)(bs->cache >> (8 - bs->cachebits)) << n) |
+	      (v & ((1ULL << n) - 1));
+	acc <<= 64 - total;
+
+	if (bs->emulation_prevention) {
+		/* Previous 2 bytes followed by the new bytes; a pair starting
+		 * at any of the first nbytes positions precedes a new byte */
+		w = ((uint64_t)bs->data[bs->off - 2] << 56) |
+		    ((uint64_t)bs->data[bs->off - 1] << 48) | (acc >> 16);
+		if ((h264_bs_zero_pairs(w) >> (64 - 8 * nbytes)) != 0)
+			return 0;
+	}
+
+	if (h264_bs_ensure_capacity(bs, bs->off + 8) == 0) {
+		h264_bs_store_word(bs->data + bs->off, acc);
+	} else {
+		if (bs->off + nbytes > bs->len)
+			return 0;
+		for (i = 0; i < nbytes; i++)
+			bs->data[bs->off + i] = acc >> (56 - 8 * i);
+	}
+
+	bs->off += nbytes;
+	bs->cache = (acc << (8 * nbytes)) >> 56;
+	bs->cachebits = total % 8;
+	return n;
+}
+
+
 int h264_bs_write_bits(struct h264_bitstream *bs, uint64_t v, uint32_t n)
 {
 	int res = 0;
@@ -218,6 +643,13 @@ int h264_bs_write_bits(struct h264_bitstream *bs, uint64_t v, uint32_t n)
 	/* Ensure that 'n' is not larger than the number of digits of v */
 	ULOG_ERRNO_RETURN_ERR_IF(n > 64, EINVAL);
 
+	/* At least one byte completed: use the accumulator */
+	if (n > 0 && bs->cachebits + n >= 8) {
+		res = h264_bs_write_word(bs, v, n);
+		if (res > 0)
+			return res;
+	}
+
 	while (n > 0) {
 		/* Write as many bits to current byte */
 		bits = 8 - bs->cachebits;
@@ -239,6 +671,126 @@ int h264_bs_write_bits(struct h264_bitstream *bs, uint64_t v, uint32_t n)
 }
 
 
+/**
+ * Write len bytes, inserting the emulation prevention bytes if enabled. On a
+ * byte-aligned bitstream, a byte can only need an escape if the two previous
+ * bytes are 0x00: bytes following a non-zero byte are copied at once up to and
+ * including the next 0x00, the others are written one by one.
+ */
+int h264_bs_write_bytes(struct h264_bitstream *bs,
+			const uint8_t *buf,
+			size_t len)
+{
+	int res = 0;
+	size_t i = 0, n = 0;
+
+	if (bs->cachebits != 0) {
+		for (i = 0; i < len; i++) {
+			res = h264_bs_write_bits(bs, buf[i], 8);
+			if (res < 0)
+				return res;
+		}
+		return 0;
+	}
+
+	if (len == 0)
+		return 0;
+
+	if (!bs->emulation_prevention) {
+		res = h264_bs_ensure_capacity(bs, bs->off + len);
+		if (res < 0)
+			return res;
+		memcpy(bs->data + bs->off, buf, len);
+		bs->off += len;
+		return 0;
+	}
+
+	while (i < len) {
+		if (bs->off >= 2 && bs->data[bs->off - 1] == 0x00) {
+			/* Single byte, with an escape byte if needed */
+			res = h264_bs_ensure_capacity(bs, bs->off + 2);
+			if (res < 0)
+				return res;
+			if (bs->data[bs->off - 2] == 0x00 && buf[i] <= 0x03)
+				bs->data[bs->off++] = 0x03;
+			bs->data[bs->off++] = buf[i++];
+			continue;
+		}
+
+		/* Copy up to and including the next 0x00 byte */
+		n = h264_find_zero_byte(buf + i, len - i);
+		if (n < len - i)
+			n++;
+		res = h264_bs_ensure_capacity(bs, bs->off + n);
+		if (res < 0)
+			return res;
+		memcpy(bs->data + bs->off, buf + i, n);
+		bs->off += n;
+		i += n;
+	}
+
+	return 0;
+}
+
+
+/**
+ * Write count 0xFF bytes (filler data); they never need an emulation
+ * prevention byte.
+ */
+int h264_bs_write_ff_bytes(struct h264_bitstream *bs, size_t count)
+{
+	int res = 0;
+	size_t i;
+
+	if (bs->cachebits != 0) {
+		for (i = 0; i < count; i++) {
+			res = h264_bs_write_bits(bs, 0xff, 8);
+			if (res < 0)
+				return res;
+		}
+		return 0;
+	}
+
+	if (count == 0)
+		return 0;
+
+	res = h264_bs_ensure_capacity(bs, bs->off + count);
+	if (res < 0)
+		return res;
+	memset(bs->data + bs->off, 0xff, count);
+	bs->off += count;
+	return 0;
+}
+
+
+/**
+ * Skip the 0xFF bytes (filler data) of a byte-aligned bitstream, 8 bytes at a
+ * time; an emulation prevention byte (0x03) stops the run like any other
+ * byte. Returns the number of bytes skipped.
+ */
+size_t h264_bs_skip_ff_bytes(struct h264_bitstream *bs)
+{
+	const uint8_t *p = bs->cdata + bs->off;
+	size_t len = bs->len - bs->off;
+	size_t n = 0;
+	uint64_t w = 0;
+
+	if (bs->cachebits != 0)
+		return 0;
+
+	for (; n + 8 <= len; n += 8) {
+		memcpy(&w, p + n, sizeof(w));
+		if (w != UINT64_MAX)
+			break;
+	}
+	while (n < len && p[n] == 0xff)
+		n++;
+
+	bs->off += n;
+	return n;
+}
+
+
 /**
  * 9.1 Parsing process for Exp-Golomb codes
  */
@@ -322,7 +874,36 @@ int h264_bs_write_bits_ff_coded(struct h264_bitstream *bs, uint32_t v)
 /**
  * 7.2 Specification of syntax functions, categories, and descriptors
  */
-int h264_bs_more_rbsp_data(const struct h264_bitstream *bs)
+/**
+ * 7.2 more_rbsp_data(): locate the rbsp_stop_one_bit, i.e. the last bit
+ * equal to 1, skipping the trailing 0x00 bytes (trailing_zero_8bits or
+ * cabac_zero_word) and their emulation prevention bytes; return the bit
+ * offset following it, or 0 if not found.
+ */
+static size_t h264_bs_find_rbsp_end_bit(const struct h264_bitstream *bs)
+{
+	const uint8_t *buf = bs->cdata;
+	size_t i = bs->len;
+
+	if (buf == NULL)
+		return 0;
+
+	while (i > 0) {
+		if (buf[i - 1] == 0x00) {
+			i--;
+		} else if (bs->emulation_prevention && buf[i - 1] == 0x03 &&
+			   i >= 3 && buf[i - 2] == 0x00 && buf[i - 3] == 0x00) {
+			i--;
+		} else {
+			return i * 8 - __builtin_ctz(buf[i - 1]);
+		}
+	}
+
+	return 0;
+}
+
+
+static int h264_bs_more_rbsp_data_scan(const struct h264_bitstream *bs)
 {
 	/* Use a temp stream */
 	struct h264_bitstream bs2 = *bs;
@@ -355,6 +936,19 @@ int h264_bs_more_rbsp_data(const struct h264_bitstream *bs)
 }
 
 
+int h264_bs_more_rbsp_data(const struct h264_bitstream *bs)
+{
+	/* The search only goes through the trailing 0x00 bytes; the next bit
+	 * is at offset off * 8 - cachebits. Without a rbsp_stop_one_bit in
+	 * the data (e.g. a bitstream set up by h264_bs_init()), scan the
+	 * bits */
+	size_t end = h264_bs_find_rbsp_end_bit(bs);
+	if (end != 0)
+		return bs->off * 8 + 1 < end + bs->cachebits;
+	return h264_bs_more_rbsp_data_scan(bs);
+}
+
+
 int h264_bs_next_bits(const struct h264_bitstream *bs, uint32_t *v, uint32_t n)
 {
 	/* Use a temp stream */
@@ -364,6 +958,33 @@ int h264_bs_next_bits(const struct h264_bitstream *bs, uint32_t *v, uint32_t n)
 }
 
 
+int h264_bs_peek_bits(const struct h264_bitstream *bs, uint32_t *v, uint32_t n)
+{
+	struct h264_bitstream bs2 = *bs;
+	uint64_t win = 0;
+	uint32_t bit = 0;
+	uint32_t i = 0;
+
+	ULOG_ERRNO_RETURN_ERR_IF(n == 0 || n > 32, EINVAL);
+
+	if (h264_bs_peek_window(bs, &win) >= n) {
+		*v = (uint32_t)(win >> (64 - n));
+		return n;
+	}
+
+	/* Near the end of the buffer or an escape sequence: read bit by bit,
+	 * missing bits are returned as 0 */
+	*v = 0;
+	for (i = 0; i < n; i++) {
+		if (h264_bs_read_bits(&bs2, &bit, 1) < 0)
+			break;
+		*v |= bit << (n - 1 - i);
+	}
+
+	return i;
+}
+
+
 /**
  * 7.3.2.11 RBSP trailing bits syntax
  */
@@ -39,6 +39,34 @@
 #endif
 
 
+/* clang-format off */
+
+/**
+ * Table 9-34 - Syntax elements and associated types of binarization,
+ * maxBinIdxCtx, and ctxIdxOffset
+ * Table 9-40 - Assignment of ctxIdxBlockCatOffset to ctxBlockCat for
+ * syntax elements coded_block_flag
+ */
+static const uint16_t s_h264_coded_block_flag_offset[14][2] = {
+	[0] = {0, 85},
+	[1] = {4, 85},
+	[2] = {8, 85},
+	[3] = {12, 85},
+	[4] = {16, 85},
+	[5] = {0, 1012},
+	[6] = {0, 460},
+	[7] = {4, 460},
+	[8] = {8, 460},
+	[9] = {4, 1012},
+	[10] = {0, 472},
+	[11] = {4, 472},
+	[12] = {8, 472},
+	[13] = {8, 1012},
+};
+
+/* clang-format on */
+
+
 struct binstring {
 	uint8_t value;
 	uint8_t numbits;
@@ -169,20 +197,19 @@ get_ctx_idx_intra_chroma_pred_mode(const struct h264_macroblock *mb,
 /**
  * 9.3.3.1.1.9 Derivation process of ctxIdxInc for the syntax element
  * coded_block_flag
+ *
+ * transBlockFlag: coded_block_flag of transBlockN, -1 if transBlockN is not
+ * available.
  */
 static uint32_t
 get_ctx_idx_coded_block_flag_cond_term(const struct h264_ctx *ctx,
 				       const struct h264_macroblock *mb,
 				       const struct h264_macroblock_info *info,
-				       uint32_t ctxBlockCat)
+				       int transBlockFlag)
 {
-	/* TODO */
-	int transBlockAvailable = 0;
-	int transBlockCodedBlockFlag = 0;
-
 	if (info == NULL && h264_mb_type_is_inter(mb->mb_type)) {
 		return 0;
-	} else if (info != NULL && !transBlockAvailable &&
+	} else if (info != NULL && transBlockFlag < 0 &&
 		   info->mb_type != H264_MB_TYPE_I_PCM) {
 		return 0;
 	} else if (h264_mb_type_is_intra(mb->mb_type) &&
@@ -196,7 +223,7 @@ get_ctx_idx_coded_block_flag_cond_term(const struct h264_ctx *ctx,
 	} else if (info != NULL && info->mb_type == H264_MB_TYPE_I_PCM) {
 		return 1;
 	} else {
-		return transBlockCodedBlockFlag;
+		return transBlockFlag;
 	}
 }
 
@@ -211,10 +238,11 @@ static uint32_t get_ctx_idx_coded_block_flag(const struct h264_ctx *ctx,
 					     uint32_t ctxIdxBlockCatOffset,
 					     uint32_t ctxBlockCat)
 {
+	/* TODO: transBlockN derivation */
 	uint32_t condTermFlagA = get_ctx_idx_coded_block_flag_cond_term(
-		ctx, mb, mb->mbAddrAInfo, ctxBlockCat);
+		ctx, mb, mb->mbAddrAInfo, -1);
 	uint32_t condTermFlagB = get_ctx_idx_coded_block_flag_cond_term(
-		ctx, mb, mb->mbAddrBInfo, ctxBlockCat);
+		ctx, mb, mb->mbAddrBInfo, -1);
 	return ctxIdxOffset + ctxIdxBlockCatOffset + condTermFlagA +
 	       2 * condTermFlagB;
 }
@@ -261,7 +289,7 @@ static uint32_t get_ctx_idx(const struct h264_macroblock *mb,
 			return bins->ctxIdxOffset +
 			       (binstring_get_bit(bins, 3) != 0 ? 6 : 7);
 		default:
-			return 7;
+			return bins->ctxIdxOffset + 7;
 		}
 		break;
 
@@ -284,7 +312,7 @@ static uint32_t get_ctx_idx(const struct h264_macroblock *mb,
 			return bins->ctxIdxOffset + 1;
 		case 2:
 			return bins->ctxIdxOffset +
-			       (binstring_get_bit(bins, 1) != 0 ? 2 : 3);
+			       (binstring_get_bit(bins, 1) != 1 ? 2 : 3);
 		default:
 			break;
 		}
@@ -489,21 +517,24 @@ static uint32_t get_ctx_block_cat(uint32_t mode)
 		return 3;
 	case ChromaACLevel:
 		return 4;
-	/* TODO: case LumaLevel8x8: return 5; */
+	case LumaLevel8x8:
+		return 5;
 	case CbIntra16x16DCLevel:
 		return 6;
 	case CbIntra16x16ACLevel:
 		return 7;
 	case CbLevel4x4:
 		return 8;
-	/* TODO: case CbLevel8x8: return 9; */
+	case CbLevel8x8:
+		return 9;
 	case CrIntra16x16DCLevel:
 		return 10;
 	case CrIntra16x16ACLevel:
 		return 11;
 	case CrLevel4x4:
 		return 12;
-	/* TODO: case CrLevel8x8: return 13; */
+	case CrLevel8x8:
+		return 13;
 	default:
 		ULOGW("%s:%d: unsupported mode %u", __func__, __LINE__, mode);
 		return 0;
@@ -617,6 +648,7 @@ int h264_cabac_init_dec(struct h264_cabac *cabac,
 	int res = 0;
 	CHECK(h264_bac_decode_init(&cabac->dec, bs));
 	h264_cabac_init_states(cabac, ctx);
+	cabac->prev_mb_qp_delta = 0;
 out:
 	return res;
 }
@@ -868,27 +900,6 @@ int h264_cabac_write_coded_block_flag(struct h264_cabac *cabac,
 	uint32_t ctxIdx = 0;
 	struct binstring bins;
 
-	/* Table 9-34 - Syntax elements and associated types of binarization,
-	 * maxBinIdxCtx, and ctxIdxOffset
-	 * Table 9-40 - Assignment of ctxIdxBlockCatOffset to ctxBlockCat for
-	 * syntax elements coded_block_flag */
-	static const uint16_t table[14][2] = {
-		[0] = {0, 85},
-		[1] = {4, 85},
-		[2] = {8, 85},
-		[3] = {12, 85},
-		[4] = {16, 85},
-		[5] = {0, 1012},
-		[6] = {0, 460},
-		[7] = {4, 460},
-		[8] = {8, 460},
-		[9] = {4, 1012},
-		[10] = {0, 472},
-		[11] = {4, 472},
-		[12] = {8, 472},
-		[13] = {8, 1012},
-	};
-
 	CABAC_LOGV("%s", __func__);
 
 	bins.value = flag;
@@ -897,8 +908,8 @@ int h264_cabac_write_coded_block_flag(struct h264_cabac *cabac,
 	bins.maxBinIdxCtx = 0;
 
 	ctxBlockCat = get_ctx_block_cat(mode);
-	ctxIdxBlockCatOffset = table[ctxBlockCat][0];
-	bins.ctxIdxOffset = table[ctxBlockCat][1];
+	ctxIdxBlockCatOffset = s_h264_coded_block_flag_offset[ctxBlockCat][0];
+	bins.ctxIdxOffset = s_h264_coded_block_flag_offset[ctxBlockCat][1];
 
 	ctxIdx = get_ctx_idx_coded_block_flag(
 		ctx, mb, bins.ctxIdxOffset, ctxIdxBlockCatOffset, ctxBlockCat);
@@ -973,3 +984,1025 @@ int h264_cabac_write_end_of_slice_flag(struct h264_cabac *cabac,
 out:
 	return res;
 }
+
+
+/* clang-format off */
+
+/**
+ * Table 9-34 - ctxIdxOffset of significant_coeff_flag (frame coded and field
+ * coded blocks), last_significant_coeff_flag (frame coded and field coded
+ * blocks) and coeff_abs_level_minus1, with the ctxIdxBlockCatOffset of
+ * Table 9-40 included, indexed by ctxBlockCat
+ */
+static const uint16_t s_h264_sig_coeff_flag_offset[2][14] = {
+	{105, 120, 134, 149, 152, 402, 484, 499, 513, 660, 528, 543, 557, 718},
+	{277, 292, 306, 321, 324, 436, 776, 791, 805, 675, 820, 835, 849, 733},
+};
+
+static const uint16_t s_h264_last_sig_coeff_flag_offset[2][14] = {
+	{166, 181, 195, 210, 213, 417, 572, 587, 601, 690, 616, 631, 645, 748},
+	{338, 353, 367, 382, 385, 451, 864, 879, 893, 699, 908, 923, 937, 757},
+};
+
+static const uint16_t s_h264_coeff_abs_level_minus1_offset[14] = {
+	227, 237, 247, 257, 266, 426, 952, 962, 972, 708, 982, 992, 1002, 766,
+};
+
+
+/**
+ * Table 9-43 - Mapping of scanning position to ctxIdxInc for ctxBlockCat
+ * equal to 5, 9, or 13 (frame coded and field coded significant_coeff_flag,
+ * and last_significant_coeff_flag)
+ */
+static const uint8_t s_h264_sig_coeff_flag_inc_8x8[2][64] = {
+	{
+		 0,  1,  2,  3,  4,  5,  5,  4,  4,  3,  3,  4,  4,  4,  5,  5,
+		 4,  4,  4,  4,  3,  3,  6,  7,  7,  7,  8,  9, 10,  9,  8,  7,
+		 7,  6, 11, 12, 13, 11,  6,  7,  8,  9, 14, 10,  9,  8,  6, 11,
+		12, 13, 11,  6,  9, 14, 10,  9, 11, 12, 13, 11, 14, 10, 12,
+	},
+	{
+		 0,  1,  1,  2,  2,  3,  3,  4,  5,  6,  7,  7,  7,  8,  4,  5,
+		 6,  9, 10, 10,  8, 11, 12, 11,  9,  9, 10, 10,  8, 11, 12, 11,
+		 9,  9, 10, 10,  8, 11, 12, 11,  9,  9, 10, 10,  8, 13, 13,  9,
+		 9, 10, 10,  8, 13, 13,  9,  9, 10, 10, 14, 14, 14, 14, 14,
+	},
+};
+
+static const uint8_t s_h264_last_sig_coeff_flag_inc_8x8[64] = {
+	0, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1,
+	2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2,
+	3, 3, 3, 3, 3, 3, 3, 3, 4, 4, 4, 4, 4, 4, 4, 4,
+	5, 5, 5, 5, 6, 6, 6, 6, 7, 7, 7, 7, 8, 8, 8, 8,
+};
+
+
+/**
+ * 9.3.3.1.3 ctxIdxInc of significant_coeff_flag and
+ * last_significant_coeff_flag for all other ctxBlockCat: levelListIdx, or
+ * Min(levelListIdx / NumC8x8, 2) for ctxBlockCat equal to 3 (indexed by
+ * NumC8x8 - 1)
+ */
+static const uint8_t s_h264_sig_coeff_flag_inc_4x4[64] = {
+	 0,  1,  2,  3,  4,  5,  6,  7,  8,  9, 10, 11, 12, 13, 14, 15,
+};
+
+static const uint8_t s_h264_sig_coeff_flag_inc_chroma_dc[2][64] = {
+	{0, 1, 2, 2},
+	{0, 0, 1, 1, 2, 2, 2, 2},
+};
+
+
+/**
+ * 6.4.13.1 Derivation process for 4x4 luma block indices, indexed by the
+ * location in units of 4x4 blocks ([y][x])
+ */
+static const uint8_t s_h264_blk_idx[4][4] = {
+	{0, 1, 4, 5},
+	{2, 3, 6, 7},
+	{8, 9, 12, 13},
+	{10, 11, 14, 15},
+};
+
+/* clang-format on */
+
+
+static inline int
+decode_bin(struct h264_cabac *cabac, uint32_t ctxIdx)
+{
+	return h264_bac_decode_bin(&cabac->dec, &cabac->states[ctxIdx]);
+}
+
+
+static inline const struct h264_macroblock_info *
+get_info(struct h264_ctx *ctx, uint32_t mbAddr)
+{
+	return mbAddr == H264_MB_ADDR_INVALID ? NULL
+					      : h264_get_mb_info(ctx, mbAddr);
+}
+
+
+/**
+ * 6.4.11.1 Derivation process for neighbouring macroblocks
+ * (in MBAFF frames, mbAddrA/mbAddrB are the macroblocks containing the luma
+ * locations (-1, 0) and (0, -1))
+ */
+static void get_neighbouring_mb(struct h264_ctx *ctx,
+				struct h264_macroblock *mb,
+				const struct h264_macroblock_info **infoA,
+				const struct h264_macroblock_info **infoB)
+{
+	uint32_t mbAddrA, mbAddrB, idxA, idxB;
+
+	if (!ctx->derived.MbaffFrameFlag) {
+		*infoA = mb->mbAddrAInfo;
+		*infoB = mb->mbAddrBInfo;
+		return;
+	}
+
+	h264_get_neighbouring_luma_cb_cr_4x4(
+		ctx, mb, 0, &mbAddrA, &idxA, &mbAddrB, &idxB);
+	*infoA = get_info(ctx, mbAddrA);
+	*infoB = get_info(ctx, mbAddrB);
+}
+
+
+/**
+ * 6.4.2.1 Inverse macroblock partition scanning process
+ * 6.4.2.2 Inverse sub-macroblock partition scanning process
+ * Location and size of a partition, in units of 4x4 blocks
+ */
+static void get_partition(const struct h264_macroblock *mb,
+			  uint32_t mbPartIdx,
+			  uint32_t subMbPartIdx,
+			  uint32_t *x,
+			  uint32_t *y,
+			  uint32_t *w,
+			  uint32_t *h)
+{
+	if (mb->NumMbPart == 4) {
+		*x = (mbPartIdx % 2) * 2;
+		*y = (mbPartIdx / 2) * 2;
+		switch (mb->sub_mb_type[mbPartIdx]) {
+		case SubMbType_P_8x4: /* NO BREAK */
+		case SubMbType_B_8x4:
+			*w = 2;
+			*h = 1;
+			*y += subMbPartIdx;
+			break;
+		case SubMbType_P_4x8: /* NO BREAK */
+		case SubMbType_B_4x8:
+			*w = 1;
+			*h = 2;
+			*x += subMbPartIdx;
+			break;
+		case SubMbType_P_4x4: /* NO BREAK */
+		case SubMbType_B_4x4:
+			*w = 1;
+			*h = 1;
+			*x += subMbPartIdx % 2;
+			*y += subMbPartIdx / 2;
+			break;
+		default:
+			*w = 2;
+			*h = 2;
+			break;
+		}
+	} else if (mb->NumMbPart == 2 && (mb->mb_type == H264_MB_TYPE_P_16x8 ||
+					  mb->mb_type == H264_MB_TYPE_B_16x8)) {
+		*x = 0;
+		*y = mbPartIdx * 2;
+		*w = 4;
+		*h = 2;
+	} else if (mb->NumMbPart == 2) {
+		*x = mbPartIdx * 2;
+		*y = 0;
+		*w = 2;
+		*h = 4;
+	} else {
+		*x = 0;
+		*y = 0;
+		*w = 4;
+		*h = 4;
+	}
+}
+
+
+/**
+ * 9.3.3.1.1.1 Derivation process of ctxIdxInc for the syntax element
+ * mb_skip_flag
+ */
+int h264_cabac_read_mb_skip_flag(struct h264_cabac *cabac,
+				 struct h264_ctx *ctx,
+				 struct h264_macroblock *mb,
+				 int32_t *flag)
+{
+	const struct h264_macroblock_info *infoA, *infoB;
+	uint32_t ctxIdxOffset = ctx->slice.type == H264_SLICE_TYPE_B ? 24 : 11;
+
+	get_neighbouring_mb(ctx, mb, &infoA, &infoB);
+	*flag = decode_bin(cabac,
+			   ctxIdxOffset +
+				   get_ctx_idx_mb_skip_flag_cond_term(infoA) +
+				   get_ctx_idx_mb_skip_flag_cond_term(infoB));
+	return 0;
+}
+
+
+/**
+ * 9.3.3.1.1.2 Derivation process of ctxIdxInc for the syntax element
+ * mb_field_decoding_flag
+ */
+int h264_cabac_read_mb_field_decoding_flag(struct h264_cabac *cabac,
+					   struct h264_ctx *ctx,
+					   struct h264_macroblock *mb,
+					   int32_t *flag)
+{
+	uint32_t condTermFlagA =
+		mb->mbAddrAInfo != NULL && mb->mbAddrAInfo->field_flag;
+	uint32_t condTermFlagB =
+		mb->mbAddrBInfo != NULL && mb->mbAddrBInfo->field_flag;
+
+	*flag = decode_bin(cabac, 70 + condTermFlagA + condTermFlagB);
+	return 0;
+}
+
+
+/**
+ * 9.3.2.5 Binarization process for macroblock type and sub-macroblock type
+ * Table 9-36 - Binarization for macroblock types in I slices, decoded with
+ * the ctxIdxOffset of the prefix (3) or of the suffix (17 or 32)
+ */
+static uint32_t read_mb_type_i(struct h264_cabac *cabac,
+			       struct h264_ctx *ctx,
+			       struct h264_macroblock *mb,
+			       uint32_t ctxIdxOffset)
+{
+	const struct h264_macroblock_info *infoA, *infoB;
+	uint32_t luma, chroma, pred;
+
+	if (ctxIdxOffset == 3) {
+		get_neighbouring_mb(ctx, mb, &infoA, &infoB);
+		if (!decode_bin(cabac,
+				3 + get_ctx_idx_mb_type_cond_term(infoA, 3) +
+					get_ctx_idx_mb_type_cond_term(infoB,
+								      3)))
+			return 0;
+		if (h264_bac_decode_terminate(&cabac->dec))
+			return 25;
+		luma = decode_bin(cabac, 3 + 3);
+		chroma = decode_bin(cabac, 3 + 4);
+		if (chroma)
+			chroma += decode_bin(cabac, 3 + 5);
+		pred = decode_bin(cabac, 3 + 6) << 1;
+		pred |= decode_bin(cabac, 3 + 7);
+	} else {
+		if (!decode_bin(cabac, ctxIdxOffset))
+			return 0;
+		if (h264_bac_decode_terminate(&cabac->dec))
+			return 25;
+		luma = decode_bin(cabac, ctxIdxOffset + 1);
+		chroma = decode_bin(cabac, ctxIdxOffset + 2);
+		if (chroma)
+			chroma += decode_bin(cabac, ctxIdxOffset + 2);
+		pred = decode_bin(cabac, ctxIdxOffset + 3) << 1;
+		pred |= decode_bin(cabac, ctxIdxOffset + 3);
+	}
+
+	return 1 + pred + 4 * chroma + 12 * luma;
+}
+
+
+/**
+ * 9.3.2.5 Binarization process for macroblock type and sub-macroblock type
+ * Table 9-37 - Binarization for macroblock types in P, SP, and B slices
+ */
+int h264_cabac_read_mb_type(struct h264_cabac *cabac,
+			    struct h264_ctx *ctx,
+			    struct h264_macroblock *mb,
+			    uint32_t *type)
+{
+	const struct h264_macroblock_info *infoA, *infoB;
+	uint32_t bits = 0;
+
+	switch (ctx->slice.type) {
+	case H264_SLICE_TYPE_I:
+		*type = read_mb_type_i(cabac, ctx, mb, 3);
+		break;
+
+	case H264_SLICE_TYPE_SI:
+		get_neighbouring_mb(ctx, mb, &infoA, &infoB);
+		if (decode_bin(cabac,
+			       get_ctx_idx_mb_type_cond_term(infoA, 0) +
+				       get_ctx_idx_mb_type_cond_term(infoB, 0)))
+			*type = 1 + read_mb_type_i(cabac, ctx, mb, 3);
+		else
+			*type = 0;
+		break;
+
+	case H264_SLICE_TYPE_P: /* NO BREAK */
+	case H264_SLICE_TYPE_SP:
+		if (decode_bin(cabac, 14))
+			*type = 5 + read_mb_type_i(cabac, ctx, mb, 17);
+		else if (!decode_bin(cabac, 15))
+			*type = decode_bin(cabac, 16) ? 3 : 0;
+		else
+			*type = decode_bin(cabac, 17) ? 1 : 2;
+		break;
+
+	case H264_SLICE_TYPE_B:
+		get_neighbouring_mb(ctx, mb, &infoA, &infoB);
+		if (!decode_bin(cabac,
+				27 + get_ctx_idx_mb_type_cond_term(infoA, 27) +
+					get_ctx_idx_mb_type_cond_term(infoB,
+								      27))) {
+			*type = 0;
+			break;
+		}
+		if (!decode_bin(cabac, 27 + 3)) {
+			*type = 1 + decode_bin(cabac, 27 + 5);
+			break;
+		}
+		bits = decode_bin(cabac, 27 + 4) << 3;
+		bits |= decode_bin(cabac, 27 + 5) << 2;
+		bits |= decode_bin(cabac, 27 + 5) << 1;
+		bits |= decode_bin(cabac, 27 + 5);
+		if (bits < 8)
+			*type = bits + 3;
+		else if (bits == 13)
+			*type = 23 + read_mb_type_i(cabac, ctx, mb, 32);
+		else if (bits == 14)
+			*type = 11;
+		else if (bits == 15)
+			*type = 22;
+		else
+			*type = ((bits << 1) | decode_bin(cabac, 27 + 5)) - 4;
+		break;
+
+	default:
+		return -EIO;
+	}
+
+	return 0;
+}
+
+
+/**
+ * 9.3.2.5 Binarization process for macroblock type and sub-macroblock type
+ * Table 9-38 - Binarization for sub-macroblock types in P, SP, and B slices
+ */
+int h264_cabac_read_sub_mb_type(struct h264_cabac *cabac,
+				struct h264_ctx *ctx,
+				struct h264_macroblock *mb,
+				uint32_t *type)
+{
+	switch (ctx->slice.type) {
+	case H264_SLICE_TYPE_P: /* NO BREAK */
+	case H264_SLICE_TYPE_SP:
+		if (decode_bin(cabac, 21))
+			*type = 0;
+		else if (!decode_bin(cabac, 22))
+			*type = 1;
+		else if (decode_bin(cabac, 23))
+			*type = 2;
+		else
+			*type = 3;
+		break;
+
+	case H264_SLICE_TYPE_B:
+		if (!decode_bin(cabac, 36)) {
+			*type = 0;
+			break;
+		}
+		if (!decode_bin(cabac, 37)) {
+			*type = 1 + decode_bin(cabac, 39);
+			break;
+		}
+		*type = 3;
+		if (decode_bin(cabac, 38)) {
+			if (decode_bin(cabac, 39)) {
+				*type = 11 + decode_bin(cabac, 39);
+				break;
+			}
+			*type += 4;
+		}
+		*type += 2 * decode_bin(cabac, 39);
+		*type += decode_bin(cabac, 39);
+		break;
+
+	default:
+		return -EIO;
+	}
+
+	return 0;
+}
+
+
+/**
+ * 9.3.3.1.1.6 Derivation process of ctxIdxInc for the syntax elements
+ * ref_idx_l0 and ref_idx_l1
+ */
+static uint32_t
+get_ctx_idx_ref_idx_cond_term(struct h264_ctx *ctx,
+			      const struct h264_macroblock *mb,
+			      const struct h264_macroblock_info *info,
+			      uint32_t list,
+			      uint32_t idx)
+{
+	uint32_t refIdxZeroFlag;
+
+	if (info == NULL)
+		return 0;
+	refIdxZeroFlag = ctx->derived.MbaffFrameFlag &&
+			 !mb->mb_field_decoding_flag && info->field_flag;
+	return info->ref_idx[list][idx / 4] > refIdxZeroFlag;
+}
+
+
+/**
+ * 9.3.2.3 Unary binarization of ref_idx_l0 and ref_idx_l1
+ */
+int h264_cabac_read_ref_idx(struct h264_cabac *cabac,
+			    struct h264_ctx *ctx,
+			    struct h264_macroblock *mb,
+			    uint32_t list,
+			    uint32_t mbPartIdx,
+			    int32_t *ref_idx)
+{
+	struct h264_macroblock_info *info = h264_get_mb_info(ctx, mb->mbAddr);
+	uint32_t x, y, w, h;
+	uint32_t mbAddrA, mbAddrB, idxA, idxB;
+	uint32_t ctxIdxInc;
+	uint32_t v = 0;
+
+	get_partition(mb, mbPartIdx, 0, &x, &y, &w, &h);
+	h264_get_neighbouring_luma_cb_cr_4x4(ctx,
+					     mb,
+					     s_h264_blk_idx[y][x],
+					     &mbAddrA,
+					     &idxA,
+					     &mbAddrB,
+					     &idxB);
+	ctxIdxInc = get_ctx_idx_ref_idx_cond_term(
+			    ctx, mb, get_info(ctx, mbAddrA), list, idxA) +
+		    2 * get_ctx_idx_ref_idx_cond_term(
+				ctx, mb, get_info(ctx, mbAddrB), list, idxB);
+
+	while (decode_bin(cabac, 54 + ctxIdxInc)) {
+		v++;
+		ctxIdxInc = v == 1 ? 4 : 5;
+		ULOG_ERRNO_RETURN_ERR_IF(v >= 32, EIO);
+	}
+
+	/* Store the value in all the 8x8 blocks of the partition */
+	for (uint32_t j = y / 2; j < (y + h + 1) / 2; j++) {
+		for (uint32_t i = x / 2; i < (x + w + 1) / 2; i++)
+			info->ref_idx[list][2 * j + i] = v;
+	}
+
+	*ref_idx = v;
+	return 0;
+}
+
+
+/**
+ * 9.3.3.1.1.7 Derivation process of ctxIdxInc for the syntax elements
+ * mvd_l0 and mvd_l1
+ */
+static uint32_t
+get_ctx_idx_mvd_abs_comp(struct h264_ctx *ctx,
+			 const struct h264_macroblock *mb,
+			 const struct h264_macroblock_info *info,
+			 uint32_t list,
+			 uint32_t idx,
+			 uint32_t compIdx)
+{
+	uint32_t absMvdComp;
+
+	if (info == NULL)
+		return 0;
+	absMvdComp = info->abs_mvd[list][idx][compIdx];
+	if (compIdx == 1 && ctx->derived.MbaffFrameFlag) {
+		if (!mb->mb_field_decoding_flag && info->field_flag)
+			absMvdComp *= 2;
+		else if (mb->mb_field_decoding_flag && !info->field_flag)
+			absMvdComp /= 2;
+	}
+	return absMvdComp;
+}
+
+
+/**
+ * 9.3.2.3 Concatenated unary/k-th order Exp-Golomb (UEG3) binarization of
+ * mvd_l0 and mvd_l1
+ */
+int h264_cabac_read_mvd(struct h264_cabac *cabac,
+			struct h264_ctx *ctx,
+			struct h264_macroblock *mb,
+			uint32_t list,
+			uint32_t mbPartIdx,
+			uint32_t subMbPartIdx,
+			uint32_t compIdx,
+			int32_t *mvd)
+{
+	struct h264_macroblock_info *info = h264_get_mb_info(ctx, mb->mbAddr);
+	uint32_t ctxIdxOffset = compIdx == 0 ? 40 : 47;
+	uint32_t x, y, w, h;
+	uint32_t mbAddrA, mbAddrB, idxA, idxB;
+	uint32_t absMvdComp, ctxIdxInc;
+	uint32_t v = 0, k = 3, suffix = 0, sign = 0;
+
+	get_partition(mb, mbPartIdx, subMbPartIdx, &x, &y, &w, &h);
+	h264_get_neighbouring_luma_cb_cr_4x4(ctx,
+					     mb,
+					     s_h264_blk_idx[y][x],
+					     &mbAddrA,
+					     &idxA,
+					     &mbAddrB,
+					     &idxB);
+	absMvdComp = get_ctx_idx_mvd_abs_comp(
+			     ctx, mb, get_info(ctx, mbAddrA), list, idxA,
+			     compIdx) +
+		     get_ctx_idx_mvd_abs_comp(
+			     ctx, mb, get_info(ctx, mbAddrB), list, idxB,
+			     compIdx);
+	ctxIdxInc = absMvdComp < 3 ? 0 : absMvdComp <= 32 ? 1 : 2;
+
+	/* Prefix: TU with cMax = uCoff = 9 */
+	while (v < 9 && decode_bin(cabac, ctxIdxOffset + ctxIdxInc)) {
+		v++;
+		ctxIdxInc = v < 4 ? v + 2 : 6;
+	}
+
+	/* Suffix: EG3, the k suffix bits and the sign are decoded at once */
+	if (v >= 9) {
+		while (h264_bac_decode_bypass(&cabac->dec)) {
+			v += 1 << k;
+			k++;
+			ULOG_ERRNO_RETURN_ERR_IF(k > 24, EIO);
+		}
+		suffix = h264_bac_decode_bypass_bits(&cabac->dec, k + 1);
+		v += suffix >> 1;
+		sign = suffix & 1;
+	}
+
+	/* Store the (clipped) absolute value in all the 4x4 blocks of the
+	 * partition */
+	for (uint32_t j = y; j < y + h; j++) {
+		for (uint32_t i = x; i < x + w; i++) {
+			info->abs_mvd[list][s_h264_blk_idx[j][i]][compIdx] =
+				v < 127 ? v : 127;
+		}
+	}
+
+	if (v != 0 && v < 9)
+		sign = h264_bac_decode_bypass(&cabac->dec);
+	if (sign)
+		*mvd = -(int32_t)v;
+	else
+		*mvd = v;
+	return 0;
+}
+
+
+/**
+ * Table 9-34 - prev_intra4x4_pred_mode_flag and
+ * prev_intra8x8_pred_mode_flag (FL, cMax = 1)
+ */
+int h264_cabac_read_prev_intra_pred_mode_flag(struct h264_cabac *cabac,
+					      struct h264_ctx *ctx,
+					      struct h264_macroblock *mb,
+					      int32_t *flag)
+{
+	*flag = decode_bin(cabac, 68);
+	return 0;
+}
+
+
+/**
+ * Table 9-34 - rem_intra4x4_pred_mode and rem_intra8x8_pred_mode
+ * (FL, cMax = 7, least significant bit first)
+ */
+int h264_cabac_read_rem_intra_pred_mode(struct h264_cabac *cabac,
+					struct h264_ctx *ctx,
+					struct h264_macroblock *mb,
+					int32_t *mode)
+{
+	*mode = decode_bin(cabac, 69);
+	*mode |= decode_bin(cabac, 69) << 1;
+	*mode |= decode_bin(cabac, 69) << 2;
+	return 0;
+}
+
+
+/**
+ * Table 9-34 - intra_chroma_pred_mode (TU, cMax = 3)
+ */
+int h264_cabac_read_intra_chroma_pred_mode(struct h264_cabac *cabac,
+					   struct h264_ctx *ctx,
+					   struct h264_macroblock *mb,
+					   int32_t *mode)
+{
+	const struct h264_macroblock_info *infoA, *infoB;
+	uint32_t ctxIdxInc;
+
+	get_neighbouring_mb(ctx, mb, &infoA, &infoB);
+	ctxIdxInc = get_ctx_idx_intra_chroma_pred_mode_cond_term(infoA) +
+		    get_ctx_idx_intra_chroma_pred_mode_cond_term(infoB);
+
+	*mode = 0;
+	if (!decode_bin(cabac, 64 + ctxIdxInc))
+		return 0;
+	*mode = 1;
+	if (!decode_bin(cabac, 64 + 3))
+		return 0;
+	*mode = 2;
+	if (!decode_bin(cabac, 64 + 3))
+		return 0;
+	*mode = 3;
+	return 0;
+}
+
+
+/**
+ * 9.3.3.1.1.4 Derivation process of ctxIdxInc for the syntax element
+ * coded_block_pattern (prefix)
+ */
+static uint32_t
+get_ctx_idx_cbp_luma_cond_term(const struct h264_macroblock_info *info,
+			       const struct h264_macroblock_info *curr,
+			       uint32_t cbp,
+			       uint32_t b8)
+{
+	if (info == NULL || info->mb_type == H264_MB_TYPE_I_PCM)
+		return 0;
+	else if (info == curr)
+		return ((cbp >> b8) & 1) == 0;
+	else if (info->skipped)
+		return 1;
+	else
+		return ((info->coded_block_pattern >> b8) & 1) == 0;
+}
+
+
+/**
+ * 9.3.3.1.1.4 Derivation process of ctxIdxInc for the syntax element
+ * coded_block_pattern (suffix)
+ */
+static uint32_t
+get_ctx_idx_cbp_chroma_cond_term(const struct h264_macroblock_info *info,
+				 uint32_t binIdx)
+{
+	if (info == NULL || info->skipped)
+		return 0;
+	else if (info->mb_type == H264_MB_TYPE_I_PCM)
+		return 1;
+	else if (binIdx == 0)
+		return (info->coded_block_pattern >> 4) != 0;
+	else
+		return (info->coded_block_pattern >> 4) == 2;
+}
+
+
+/**
+ * 9.3.2.6 Binarization process for coded_block_pattern
+ */
+int h264_cabac_read_coded_block_pattern(struct h264_cabac *cabac,
+					struct h264_ctx *ctx,
+					struct h264_macroblock *mb,
+					uint32_t *cbp)
+{
+	const struct h264_macroblock_info *curr =
+		h264_get_mb_info(ctx, mb->mbAddr);
+	const struct h264_macroblock_info *infoA, *infoB;
+	uint32_t mbAddrA, mbAddrB, idxA, idxB;
+	uint32_t ctxIdxInc;
+	uint32_t v = 0;
+
+	/* Prefix: FL with cMax = 15, one bin per 8x8 luma block */
+	for (uint32_t b8 = 0; b8 < 4; b8++) {
+		h264_get_neighbouring_luma_cb_cr_4x4(
+			ctx, mb, 4 * b8, &mbAddrA, &idxA, &mbAddrB, &idxB);
+		ctxIdxInc = get_ctx_idx_cbp_luma_cond_term(
+				    get_info(ctx, mbAddrA), curr, v, idxA / 4) +
+			    2 * get_ctx_idx_cbp_luma_cond_term(
+					get_info(ctx, mbAddrB),
+					curr,
+					v,
+					idxB / 4);
+		v |= decode_bin(cabac, 73 + ctxIdxInc) << b8;
+	}
+
+	/* Suffix: TU with cMax = 2 */
+	if (ctx->sps_derived.ChromaArrayType == 1 ||
+	    ctx->sps_derived.ChromaArrayType == 2) {
+		get_neighbouring_mb(ctx, mb, &infoA, &infoB);
+		ctxIdxInc = get_ctx_idx_cbp_chroma_cond_term(infoA, 0) +
+			    2 * get_ctx_idx_cbp_chroma_cond_term(infoB, 0);
+		if (decode_bin(cabac, 77 + ctxIdxInc)) {
+			ctxIdxInc =
+				get_ctx_idx_cbp_chroma_cond_term(infoA, 1) +
+				2 * get_ctx_idx_cbp_chroma_cond_term(infoB, 1);
+			v |= (1 + decode_bin(cabac, 77 + 4 + ctxIdxInc)) << 4;
+		}
+	}
+
+	*cbp = v;
+	return 0;
+}
+
+
+/**
+ * 9.3.3.1.1.10 Derivation process of ctxIdxInc for the syntax element
+ * transform_size_8x8_flag
+ */
+int h264_cabac_read_transform_size_8x8_flag(struct h264_cabac *cabac,
+					    struct h264_ctx *ctx,
+					    struct h264_macroblock *mb,
+					    int32_t *flag)
+{
+	const struct h264_macroblock_info *infoA, *infoB;
+	uint32_t ctxIdxInc;
+
+	get_neighbouring_mb(ctx, mb, &infoA, &infoB);
+	ctxIdxInc = (infoA != NULL && infoA->transform_size_8x8_flag) +
+		    (infoB != NULL && infoB->transform_size_8x8_flag);
+	*flag = decode_bin(cabac, 399 + ctxIdxInc);
+	return 0;
+}
+
+
+/**
+ * 9.3.2.7 Binarization process for mb_qp_delta
+ * 9.3.3.1.1.5 Derivation process of ctxIdxInc for the syntax element
+ * mb_qp_delta
+ */
+int h264_cabac_read_mb_qp_delta(struct h264_cabac *cabac,
+				struct h264_ctx *ctx,
+				struct h264_macroblock *mb,
+				int32_t *mb_qp_delta)
+{
+	uint32_t ctxIdxInc = cabac->prev_mb_qp_delta != 0;
+	uint32_t v = 0;
+
+	while (decode_bin(cabac, 60 + ctxIdxInc)) {
+		v++;
+		ctxIdxInc = v == 1 ? 2 : 3;
+		ULOG_ERRNO_RETURN_ERR_IF(v > 128, EIO);
+	}
+
+	/* Table 9-3 - Assignment of syntax element to codeNum for signed
+	 * Exp-Golomb coded syntax elements */
+	*mb_qp_delta = (v & 1) ? (int32_t)((v + 1) / 2) : -(int32_t)(v / 2);
+	return 0;
+}
+
+
+/**
+ * 9.3.3.1.1.9 Derivation process of ctxIdxInc for the syntax element
+ * coded_block_flag, with the transBlockN of each ctxBlockCat
+ */
+static uint32_t
+get_ctx_idx_inc_coded_block_flag(struct h264_ctx *ctx,
+				 struct h264_macroblock *mb,
+				 uint32_t ctxBlockCat,
+				 uint32_t comp,
+				 uint32_t blkIdx)
+{
+	const struct h264_macroblock_info *infoA = NULL, *infoB = NULL;
+	uint32_t mbAddrA, mbAddrB, idxA = 0, idxB = 0;
+	int flagA = -1, flagB = -1;
+
+	switch (ctxBlockCat) {
+	case 0: /* NO BREAK */
+	case 6: /* NO BREAK */
+	case 10:
+		get_neighbouring_mb(ctx, mb, &infoA, &infoB);
+		if (infoA != NULL && infoA->mb_type == H264_MB_TYPE_I_16x16)
+			flagA = (infoA->coded_block_flag_dc >> comp) & 1;
+		if (infoB != NULL && infoB->mb_type == H264_MB_TYPE_I_16x16)
+			flagB = (infoB->coded_block_flag_dc >> comp) & 1;
+		break;
+
+	case 3:
+		get_neighbouring_mb(ctx, mb, &infoA, &infoB);
+		if (infoA != NULL && (infoA->coded_block_pattern >> 4) != 0)
+			flagA = (infoA->coded_block_flag_dc >> comp) & 1;
+		if (infoB != NULL && (infoB->coded_block_pattern >> 4) != 0)
+			flagB = (infoB->coded_block_flag_dc >> comp) & 1;
+		break;
+
+	case 4:
+		h264_get_neighbouring_chroma_4x4(
+			ctx, mb, blkIdx, &mbAddrA, &idxA, &mbAddrB, &idxB);
+		infoA = get_info(ctx, mbAddrA);
+		infoB = get_info(ctx, mbAddrB);
+		if (infoA != NULL && (infoA->coded_block_pattern >> 4) == 2)
+			flagA = infoA->nz_coeff[comp * 16 + idxA] != 0;
+		if (infoB != NULL && (infoB->coded_block_pattern >> 4) == 2)
+			flagB = infoB->nz_coeff[comp * 16 + idxB] != 0;
+		break;
+
+	case 5: /* NO BREAK */
+	case 9: /* NO BREAK */
+	case 13:
+		h264_get_neighbouring_luma_cb_cr_4x4(
+			ctx, mb, 4 * blkIdx, &mbAddrA, &idxA, &mbAddrB, &idxB);
+		infoA = get_info(ctx, mbAddrA);
+		infoB = get_info(ctx, mbAddrB);
+		if (infoA != NULL && infoA->transform_size_8x8_flag &&
+		    ((infoA->coded_block_pattern >> (idxA / 4)) & 1))
+			flagA = infoA->nz_coeff[comp * 16 + idxA] != 0;
+		if (infoB != NULL && infoB->transform_size_8x8_flag &&
+		    ((infoB->coded_block_pattern >> (idxB / 4)) & 1))
+			flagB = infoB->nz_coeff[comp * 16 + idxB] != 0;
+		break;
+
+	default:
+		h264_get_neighbouring_luma_cb_cr_4x4(
+			ctx, mb, blkIdx, &mbAddrA, &idxA, &mbAddrB, &idxB);
+		infoA = get_info(ctx, mbAddrA);
+		infoB = get_info(ctx, mbAddrB);
+		if (infoA != NULL &&
+		    ((infoA->coded_block_pattern >> (idxA / 4)) & 1))
+			flagA = infoA->nz_coeff[comp * 16 + idxA] != 0;
+		if (infoB != NULL &&
+		    ((infoB->coded_block_pattern >> (idxB / 4)) & 1))
+			flagB = infoB->nz_coeff[comp * 16 + idxB] != 0;
+		break;
+	}
+
+	return get_ctx_idx_coded_block_flag_cond_term(ctx, mb, infoA, flagA) +
+	       2 * get_ctx_idx_coded_block_flag_cond_term(
+			   ctx, mb, infoB, flagB);
+}
+
+
+/**
+ * 7.3.5.3.3 Residual block CABAC syntax
+ * 9.3.3.1.3 Assignment process of ctxIdxInc for syntax elements
+ * significant_coeff_flag, last_significant_coeff_flag, and
+ * coeff_abs_level_minus1
+ */
+int h264_cabac_read_residual_block(struct h264_cabac *cabac,
+				   struct h264_ctx *ctx,
+				   struct h264_macroblock *mb,
+				   int16_t coeffLevel[],
+				   uint32_t startIdx,
+				   uint32_t endIdx,
+				   uint32_t maxNumCoeff,
+				   uint32_t mode,
+				   uint32_t comp,
+				   uint32_t blkIdx)
+{
+	struct h264_macroblock_info *info = h264_get_mb_info(ctx, mb->mbAddr);
+	uint32_t ctxBlockCat = get_ctx_block_cat(mode);
+	uint32_t field = mb->mb_field_decoding_flag;
+	uint32_t numCoeff = endIdx + 1;
+	uint32_t NumC8x8 = 0;
+	uint32_t sigOffset, lastOffset, absOffset;
+	const uint8_t *sigInc, *lastInc;
+	uint8_t sigIdx[64];
+	uint32_t count = 0, last = 0;
+	uint32_t numDecodAbsLevelEq1 = 0, numDecodAbsLevelGt1 = 0;
+	uint32_t ctxIdxInc, maxGt1, v, k, suffix, sign;
+	int coded_block_flag = 1;
+	int res = 0;
+
+	memset(coeffLevel, 0, maxNumCoeff * sizeof(coeffLevel[0]));
+
+	if (maxNumCoeff != 64 || ctx->sps_derived.ChromaArrayType == 3) {
+		ctxIdxInc = get_ctx_idx_inc_coded_block_flag(
+			ctx, mb, ctxBlockCat, comp, blkIdx);
+		coded_block_flag = decode_bin(
+			cabac,
+			s_h264_coded_block_flag_offset[ctxBlockCat][1] +
+				s_h264_coded_block_flag_offset[ctxBlockCat][0] +
+				ctxIdxInc);
+	}
+
+	switch (ctxBlockCat) {
+	case 0: /* NO BREAK */
+	case 3: /* NO BREAK */
+	case 6: /* NO BREAK */
+	case 10:
+		info->coded_block_flag_dc |= coded_block_flag << comp;
+		break;
+	default:
+		break;
+	}
+
+	if (!coded_block_flag)
+		goto out;
+
+	/* Significance map */
+	sigOffset = s_h264_sig_coeff_flag_offset[field][ctxBlockCat];
+	lastOffset = s_h264_last_sig_coeff_flag_offset[field][ctxBlockCat];
+	if (maxNumCoeff == 64) {
+		sigInc = s_h264_sig_coeff_flag_inc_8x8[field];
+		lastInc = s_h264_last_sig_coeff_flag_inc_8x8;
+	} else if (ctxBlockCat == 3) {
+		NumC8x8 = 4 / (ctx->sps_derived.SubWidthC *
+			       ctx->sps_derived.SubHeightC);
+		ULOG_ERRNO_RETURN_ERR_IF(NumC8x8 < 1 || NumC8x8 > 2, EIO);
+		sigInc = s_h264_sig_coeff_flag_inc_chroma_dc[NumC8x8 - 1];
+		lastInc = sigInc;
+	} else {
+		sigInc = s_h264_sig_coeff_flag_inc_4x4;
+		lastInc = sigInc;
+	}
+	ULOG_ERRNO_RETURN_ERR_IF(numCoeff > maxNumCoeff || startIdx > endIdx,
+				 EIO);
+
+	for (uint32_t i = startIdx; i < numCoeff - 1; i++) {
+		if (!decode_bin(cabac, sigOffset + sigInc[i]))
+			continue;
+		sigIdx[count++] = i;
+		if (decode_bin(cabac, lastOffset + lastInc[i])) {
+			last = 1;
+			break;
+		}
+	}
+	if (!last)
+		sigIdx[count++] = numCoeff - 1;
+
+	/* Levels, in reverse scanning order */
+	absOffset = s_h264_coeff_abs_level_minus1_offset[ctxBlockCat];
+	maxGt1 = ctxBlockCat == 3 ? 3 : 4;
+	for (uint32_t n = count; n > 0; n--) {
+		/* Prefix: TU with cMax = uCoff = 14 */
+		ctxIdxInc = numDecodAbsLevelGt1 != 0
+				    ? 0
+				    : 1 + (numDecodAbsLevelEq1 < 3
+						   ? numDecodAbsLevelEq1
+						   : 3);
+		v = 0;
+		if (decode_bin(cabac, absOffset + ctxIdxInc)) {
+			ctxIdxInc = 5 + (numDecodAbsLevelGt1 < maxGt1
+						 ? numDecodAbsLevelGt1
+						 : maxGt1);
+			v = 1;
+			while (v < 14 &&
+			       decode_bin(cabac, absOffset + ctxIdxInc))
+				v++;
+		}
+
+		/* Suffix: EG0, the k suffix bits and coeff_sign_flag are
+		 * decoded at once */
+		if (v >= 14) {
+			k = 0;
+			while (h264_bac_decode_bypass(&cabac->dec)) {
+				v += 1 << k;
+				k++;
+				ULOG_ERRNO_RETURN_ERR_IF(k > 24, EIO);
+			}
+			suffix = h264_bac_decode_bypass_bits(&cabac->dec,
+							     k + 1);
+			v += suffix >> 1;
+			sign = suffix & 1;
+		} else {
+			sign = h264_bac_decode_bypass(&cabac->dec);
+		}
+
+		if (v == 0)
+			numDecodAbsLevelEq1++;
+		else
+			numDecodAbsLevelGt1++;
+
+		coeffLevel[sigIdx[n - 1]] =
+			sign ? -(int32_t)(v + 1) : (int32_t)(v + 1);
+	}
+
+out:
+	/* Save the number of non-zero coefficients for the coded_block_flag
+	 * context of the next blocks */
+	switch (ctxBlockCat) {
+	case 0: /* NO BREAK */
+	case 3: /* NO BREAK */
+	case 6: /* NO BREAK */
+	case 10:
+		break;
+	case 5: /* NO BREAK */
+	case 9: /* NO BREAK */
+	case 13:
+		for (uint32_t i = 0; i < 4; i++)
+			info->nz_coeff[comp * 16 + 4 * blkIdx + i] = count;
+		break;
+	default:
+		info->nz_coeff[comp * 16 + blkIdx] = count;
+		break;
+	}
+	return res;
+}
+
+
+/**
+ * 9.3.3.2.2.3 Decoding process for binary decisions before termination
+ */
+int h264_cabac_read_end_of_slice_flag(struct h264_cabac *cabac,
+				      struct h264_ctx *ctx,
+				      int32_t *flag)
+{
+	*flag = h264_bac_decode_terminate(&cabac->dec);
+	return 0;
+}
+
+
+/**
+ * 9.3.1.2 Before pcm_alignment_zero_bit, move the bitstream to the current
+ * position of the decoding engine
+ */
+int h264_cabac_read_pcm_begin(struct h264_cabac *cabac)
+{
+	return h264_bac_decode_rewind(&cabac->dec);
+}
+
+
+/**
+ * 9.3.1.2 After pcm_sample_chroma, initialise the decoding engine again
+ */
+int h264_cabac_read_pcm_end(struct h264_cabac *cabac,
+			    struct h264_bitstream *bs)
+{
+	return h264_bac_decode_init(&cabac->dec, bs);
+}
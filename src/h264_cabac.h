@@ -32,12 +32,34 @@ struct h264_cabac {
 	struct h264_bac_dec dec;
 	struct h264_bac_enc enc;
 	struct h264_bac_state states[1024];
+
+	/* mb_qp_delta of the previous macroblock in decoding order (0 if
+	 * not present), for the mb_qp_delta context selection */
+	int32_t prev_mb_qp_delta;
+};
+
+
+/* Initialized context variables, by table (I/SI slices, then cabac_init_idc
+ * 0 to 2 for the other slices) and by SliceQPLuma clipped to [0, 51];
+ * each entry is allocated on first use */
+#define H264_CABAC_INIT_TABLE_COUNT 4
+struct h264_cabac_init_cache {
+	struct h264_bac_state *states[H264_CABAC_INIT_TABLE_COUNT][52];
 };
 
 
+/* Compute the initialized context variables of a table without the cache */
+void h264_cabac_compute_states(struct h264_bac_state *states,
+			       uint32_t tableIdx,
+			       int32_t SliceQPLuma);
+
+
 void h264_cabac_init_states(struct h264_cabac *cabac, struct h264_ctx *ctx);
 
 
+void h264_cabac_clear_init_cache(struct h264_cabac_init_cache *cache);
+
+
 int h264_cabac_init_enc(struct h264_cabac *cabac,
 			struct h264_ctx *ctx,
 			struct h264_bitstream *bs);
@@ -82,4 +104,106 @@ int h264_cabac_write_end_of_slice_flag(struct h264_cabac *cabac,
 				       int flag);
 
 
+int h264_cabac_read_mb_skip_flag(struct h264_cabac *cabac,
+				 struct h264_ctx *ctx,
+				 struct h264_macroblock *mb,
+				 int32_t *flag);
+
+
+int h264_cabac_read_mb_field_decoding_flag(struct h264_cabac *cabac,
+					   struct h264_ctx *ctx,
+					   struct h264_macroblock *mb,
+					   int32_t *flag);
+
+
+int h264_cabac_read_mb_type(struct h264_cabac *cabac,
+			    struct h264_ctx *ctx,
+			    struct h264_macroblock *mb,
+			    uint32_t *type);
+
+
+int h264_cabac_read_sub_mb_type(struct h264_cabac *cabac,
+				struct h264_ctx *ctx,
+				struct h264_macroblock *mb,
+				uint32_t *type);
+
+
+int h264_cabac_read_ref_idx(struct h264_cabac *cabac,
+			    struct h264_ctx *ctx,
+			    struct h264_macroblock *mb,
+			    uint32_t list,
+			    uint32_t mbPartIdx,
+			    int32_t *ref_idx);
+
+
+int h264_cabac_read_mvd(struct h264_cabac *cabac,
+			struct h264_ctx *ctx,
+			struct h264_macroblock *mb,
+			uint32_t list,
+			uint32_t mbPartIdx,
+			uint32_t subMbPartIdx,
+			uint32_t compIdx,
+			int32_t *mvd);
+
+
+int h264_cabac_read_prev_intra_pred_mode_flag(struct h264_cabac *cabac,
+					      struct h264_ctx *ctx,
+					      struct h264_macroblock *mb,
+					      int32_t *flag);
+
+
+int h264_cabac_read_rem_intra_pred_mode(struct h264_cabac *cabac,
+					struct h264_ctx *ctx,
+					struct h264_macroblock *mb,
+					int32_t *mode);
+
+
+int h264_cabac_read_intra_chroma_pred_mode(struct h264_cabac *cabac,
+					   struct h264_ctx *ctx,
+					   struct h264_macroblock *mb,
+					   int32_t *mode);
+
+
+int h264_cabac_read_coded_block_pattern(struct h264_cabac *cabac,
+					struct h264_ctx *ctx,
+					struct h264_macroblock *mb,
+					uint32_t *cbp);
+
+
+int h264_cabac_read_transform_size_8x8_flag(struct h264_cabac *cabac,
+					    struct h264_ctx *ctx,
+					    struct h264_macroblock *mb,
+					    int32_t *flag);
+
+
+int h264_cabac_read_mb_qp_delta(struct h264_cabac *cabac,
+				struct h264_ctx *ctx,
+				struct h264_macroblock *mb,
+				int32_t *mb_qp_delta);
+
+
+int h264_cabac_read_residual_block(struct h264_cabac *cabac,
+				   struct h264_ctx *ctx,
+				   struct h264_macroblock *mb,
+				   int16_t coeffLevel[],
+				   uint32_t startIdx,
+				   uint32_t endIdx,
+				   uint32_t maxNumCoeff,
+				   uint32_t mode,
+				   uint32_t comp,
+				   uint32_t blkIdx);
+
+
+int h264_cabac_read_end_of_slice_flag(struct h264_cabac *cabac,
+				      struct h264_ctx *ctx,
+				      int32_t *flag);
+
+
+int h264_cabac_read_pcm_begin(struct h264_cabac *cabac);
+
+
+int h264_cabac_read_pcm_end(struct h264_cabac *cabac,
+			    struct h264_bitstream *bs);
+
+
 #endif /* !_H264_CABAC_H_ */
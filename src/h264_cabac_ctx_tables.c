@@ -4438,19 +4438,46 @@ static const struct pair s_h264_cabac_ctx_table_P_2[1024] = {
 /* clang-format on */
 
 
+static const struct pair
+	*const s_h264_cabac_ctx_tables[H264_CABAC_INIT_TABLE_COUNT] = {
+	s_h264_cabac_ctx_table_I,
+	s_h264_cabac_ctx_table_P_0,
+	s_h264_cabac_ctx_table_P_1,
+	s_h264_cabac_ctx_table_P_2,
+};
+
+
+void h264_cabac_compute_states(struct h264_bac_state *states,
+			       uint32_t tableIdx,
+			       int32_t SliceQPLuma)
+{
+	const struct pair *table = s_h264_cabac_ctx_tables[tableIdx];
+
+	for (uint32_t ctxIdx = 0; ctxIdx < 1024; ctxIdx++) {
+		h264_bac_state_init(&states[ctxIdx],
+				    SliceQPLuma,
+				    table[ctxIdx].m,
+				    table[ctxIdx].n);
+	}
+}
+
+
+/**
+ * The initialized states only depend on the table and on SliceQPLuma
+ * clipped to [0, 51] (see h264_bac_state_init()), they are computed once
+ * per context and copied afterwards.
+ */
 void h264_cabac_init_states(struct h264_cabac *cabac, struct h264_ctx *ctx)
 {
-	const struct pair *table = NULL;
+	uint32_t tableIdx = 0;
+	int32_t qp = Clip3(0, 51, ctx->derived.SliceQPLuma);
+	struct h264_bac_state **cached = NULL;
 
 	if (ctx->slice.type == H264_SLICE_TYPE_I ||
 	    ctx->slice.type == H264_SLICE_TYPE_SI) {
-		table = s_h264_cabac_ctx_table_I;
-	} else if (ctx->slice.hdr.cabac_init_idc == 0) {
-		table = s_h264_cabac_ctx_table_P_0;
-	} else if (ctx->slice.hdr.cabac_init_idc == 1) {
-		table = s_h264_cabac_ctx_table_P_1;
-	} else if (ctx->slice.hdr.cabac_init_idc == 2) {
-		table = s_h264_cabac_ctx_table_P_2;
+		tableIdx = 0;
+	} else if (ctx->slice.hdr.cabac_init_idc <= 2) {
+		tableIdx = 1 + ctx->slice.hdr.cabac_init_idc;
 	} else {
 		ULOGW("%s:%d: unsupported cabac_init_idc %u",
 		      __func__,
@@ -4459,10 +4486,26 @@ void h264_cabac_init_states(struct h264_cabac *cabac, struct h264_ctx *ctx)
 		return;
 	}
 
-	for (uint32_t ctxIdx = 0; ctxIdx < 1024; ctxIdx++) {
-		h264_bac_state_init(&cabac->states[ctxIdx],
-				    ctx->derived.SliceQPLuma,
-				    table[ctxIdx].m,
-				    table[ctxIdx].n);
+	cached = &ctx->cabac_init_cache.states[tableIdx][qp];
+	if (*cached == NULL) {
+		*cached = malloc(sizeof(cabac->states));
+		if (*cached == NULL) {
+			/* Compute the states in place */
+			h264_cabac_compute_states(cabac->states, tableIdx, qp);
+			return;
+		}
+		h264_cabac_compute_states(*cached, tableIdx, qp);
+	}
+
+	memcpy(cabac->states, *cached, sizeof(cabac->states));
+}
+
+
+void h264_cabac_clear_init_cache(struct h264_cabac_init_cache *cache)
+{
+	for (uint32_t i = 0; i < H264_CABAC_INIT_TABLE_COUNT; i++) {
+		for (uint32_t j = 0; j < ARRAY_SIZE(cache->states[i]); j++)
+			free(cache->states[i][j]);
 	}
+	memset(cache, 0, sizeof(*cache));
 }
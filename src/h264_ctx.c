@@ -118,61 +118,71 @@ static void h264_ctx_update_derived_vars_slice(struct h264_ctx *ctx)
 		Min(sh->slice_group_change_cycle *
 			    ctx->derived.SliceGroupChangeRate,
 		    ctx->sps_derived.PicSizeInMapUnits);
+}
+
 
-	if (pps->num_slice_groups_minus1 > 0)
-		h264_gen_slice_group_map(ctx);
+static void h264_slice_hdr_get_core(const struct h264_slice_header *sh,
+				    struct h264_slice_hdr_core *core)
+{
+	core->pic_parameter_set_id = sh->pic_parameter_set_id;
+	core->frame_num = sh->frame_num;
+	core->field_pic_flag = sh->field_pic_flag;
+	core->bottom_field_flag = sh->bottom_field_flag;
+	core->idr_pic_id = sh->idr_pic_id;
+	core->pic_order_cnt_lsb = sh->pic_order_cnt_lsb;
+	core->delta_pic_order_cnt_bottom = sh->delta_pic_order_cnt_bottom;
+	core->delta_pic_order_cnt[0] = sh->delta_pic_order_cnt[0];
+	core->delta_pic_order_cnt[1] = sh->delta_pic_order_cnt[1];
 }
 
 
 /**
  * 7.4.1.2.4 Detection of the first VCL NAL unit of a primary coded picture
  */
-static void h264_ctx_detect_first_vcl_nalu(struct h264_ctx *ctx)
+int h264_ctx_is_first_vcl_nalu(struct h264_ctx *ctx,
+			       const struct h264_sps *sps,
+			       const struct h264_nalu_header *nh,
+			       const struct h264_slice_hdr_core *sh)
 {
-	const struct h264_sps *sps = ctx->sps;
-	const struct h264_nalu_header *nh = &ctx->nalu.hdr;
-	const struct h264_slice_header *sh = &ctx->slice.hdr;
-
-	ctx->nalu.is_first_vcl = 0;
+	int is_first_vcl = 0;
+	struct h264_slice_hdr_core *prev = &ctx->slice.prev_slice_hdr;
 
 	if ((!ctx->nalu.is_prev_vcl) && (!ctx->nalu.is_prev_filler)) {
-		ctx->nalu.is_first_vcl = 1;
+		is_first_vcl = 1;
 		goto out;
 	}
 
 	/* frame_num differs in value. */
-	if (sh->frame_num != ctx->slice.prev_slice_hdr.frame_num) {
-		ctx->nalu.is_first_vcl = 1;
+	if (sh->frame_num != prev->frame_num) {
+		is_first_vcl = 1;
 		goto out;
 	}
 
 	/* pic_parameter_set_id differs in value. */
-	if (sh->pic_parameter_set_id !=
-	    ctx->slice.prev_slice_hdr.pic_parameter_set_id) {
-		ctx->nalu.is_first_vcl = 1;
+	if (sh->pic_parameter_set_id != prev->pic_parameter_set_id) {
+		is_first_vcl = 1;
 		goto out;
 	}
 
 	/* field_pic_flag differs in value. */
 	if (!sps->frame_mbs_only_flag &&
-	    (sh->field_pic_flag != ctx->slice.prev_slice_hdr.field_pic_flag)) {
-		ctx->nalu.is_first_vcl = 1;
+	    (sh->field_pic_flag != prev->field_pic_flag)) {
+		is_first_vcl = 1;
 		goto out;
 	}
 
 	/* bottom_field_flag is present in both and differs in value. */
 	if (!sps->frame_mbs_only_flag && sh->field_pic_flag &&
-	    ctx->slice.prev_slice_hdr.field_pic_flag &&
-	    (sh->bottom_field_flag !=
-	     ctx->slice.prev_slice_hdr.bottom_field_flag)) {
-		ctx->nalu.is_first_vcl = 1;
+	    prev->field_pic_flag &&
+	    (sh->bottom_field_flag != prev->bottom_field_flag)) {
+		is_first_vcl = 1;
 		goto out;
 	}
 
 	/* nal_ref_idc differs in value with one of the nal_ref_idc
 	 * values being equal to 0. */
 	if (!nh->nal_ref_idc != !ctx->slice.prev_slice_nalu_hdr.nal_ref_idc) {
-		ctx->nalu.is_first_vcl = 1;
+		is_first_vcl = 1;
 		goto out;
 	}
 
@@ -180,11 +190,10 @@ static void h264_ctx_detect_first_vcl_nalu(struct h264_ctx *ctx)
 	 * pic_order_cnt_lsb differs in value, or delta_pic_order_cnt_bottom
 	 * differs in value. */
 	if ((sps->pic_order_cnt_type == 0) &&
-	    ((sh->pic_order_cnt_lsb !=
-	      ctx->slice.prev_slice_hdr.pic_order_cnt_lsb) ||
+	    ((sh->pic_order_cnt_lsb != prev->pic_order_cnt_lsb) ||
 	     (sh->delta_pic_order_cnt_bottom !=
-	      ctx->slice.prev_slice_hdr.delta_pic_order_cnt_bottom))) {
-		ctx->nalu.is_first_vcl = 1;
+	      prev->delta_pic_order_cnt_bottom))) {
+		is_first_vcl = 1;
 		goto out;
 	}
 
@@ -192,11 +201,9 @@ static void h264_ctx_detect_first_vcl_nalu(struct h264_ctx *ctx)
 	 * delta_pic_order_cnt[ 0 ] differs in value, or
 	 * delta_pic_order_cnt[ 1 ] differs in value. */
 	if ((sps->pic_order_cnt_type == 1) &&
-	    ((sh->delta_pic_order_cnt[0] !=
-	      ctx->slice.prev_slice_hdr.delta_pic_order_cnt[0]) ||
-	     (sh->delta_pic_order_cnt[1] !=
-	      ctx->slice.prev_slice_hdr.delta_pic_order_cnt[1]))) {
-		ctx->nalu.is_first_vcl = 1;
+	    ((sh->delta_pic_order_cnt[0] != prev->delta_pic_order_cnt[0]) ||
+	     (sh->delta_pic_order_cnt[1] != prev->delta_pic_order_cnt[1]))) {
+		is_first_vcl = 1;
 		goto out;
 	}
 
@@ -204,7 +211,7 @@ static void h264_ctx_detect_first_vcl_nalu(struct h264_ctx *ctx)
 	if ((nh->nal_unit_type == H264_NALU_TYPE_SLICE_IDR) !=
 	    (ctx->slice.prev_slice_nalu_hdr.nal_unit_type ==
 	     H264_NALU_TYPE_SLICE_IDR)) {
-		ctx->nalu.is_first_vcl = 1;
+		is_first_vcl = 1;
 		goto out;
 	}
 
@@ -212,28 +219,103 @@ static void h264_ctx_detect_first_vcl_nalu(struct h264_ctx *ctx)
 	if ((nh->nal_unit_type == H264_NALU_TYPE_SLICE_IDR) &&
 	    (ctx->slice.prev_slice_nalu_hdr.nal_unit_type ==
 	     H264_NALU_TYPE_SLICE_IDR) &&
-	    (sh->idr_pic_id != ctx->slice.prev_slice_hdr.idr_pic_id)) {
-		ctx->nalu.is_first_vcl = 1;
+	    (sh->idr_pic_id != prev->idr_pic_id)) {
+		is_first_vcl = 1;
 		goto out;
 	}
 
 out:
 	ctx->slice.prev_slice_nalu_hdr = *nh;
-	ctx->slice.prev_slice_hdr = *sh;
+	*prev = *sh;
+	return is_first_vcl;
+}
+
+
+/**
+ * 7.4.1.2.3 Order of NAL units and coded pictures and association to access
+ * units: whether the previous access unit ends before a NAL unit
+ */
+int h264_ctx_is_au_start(const struct h264_ctx *ctx,
+			 enum h264_nalu_type type,
+			 int is_first_vcl)
+{
+	if (!ctx->nalu.is_prev_vcl && !ctx->nalu.is_prev_filler)
+		return 0;
+
+	return (type == H264_NALU_TYPE_AUD) || (type == H264_NALU_TYPE_SPS) ||
+	       (type == H264_NALU_TYPE_PPS) || (type == H264_NALU_TYPE_SEI) ||
+	       (((unsigned)type >= 14) && ((unsigned)type <= 18)) ||
+	       is_first_vcl;
+}
+
+
+void h264_ctx_set_prev_nalu_type(struct h264_ctx *ctx,
+				 enum h264_nalu_type type)
+{
+	ctx->nalu.is_prev_vcl = (type == H264_NALU_TYPE_SLICE) ||
+				(type == H264_NALU_TYPE_SLICE_IDR);
+	ctx->nalu.is_prev_filler = (type == H264_NALU_TYPE_FILLER);
+}
+
+
+/* Clear the slice header; the rplm, pwt and drpm lists (more than 3KB) are
+ * only cleared if the previous slice header used them */
+static void h264_ctx_clear_slice_header(struct h264_ctx *ctx)
+{
+	struct h264_slice_header *sh = &ctx->slice.hdr;
+	uint32_t lists = ctx->slice.hdr_lists;
+	size_t tail = offsetof(struct h264_slice_header, cabac_init_idc);
+
+	memset(sh, 0, offsetof(struct h264_slice_header, rplm));
+	memset(&sh->cabac_init_idc, 0, sizeof(*sh) - tail);
+
+	if (lists & H264_SLICE_HDR_LIST_RPLM) {
+		memset(&sh->rplm, 0, sizeof(sh->rplm));
+	} else {
+		sh->rplm.ref_pic_list_modification_flag_l0 = 0;
+		sh->rplm.ref_pic_list_modification_flag_l1 = 0;
+	}
+
+	if (lists & H264_SLICE_HDR_LIST_PWT) {
+		memset(&sh->pwt, 0, sizeof(sh->pwt));
+	} else {
+		sh->pwt.luma_log2_weight_denom = 0;
+		sh->pwt.chroma_log2_weight_denom = 0;
+	}
+
+	if (lists & H264_SLICE_HDR_LIST_DRPM) {
+		memset(&sh->drpm, 0, sizeof(sh->drpm));
+	} else {
+		sh->drpm.no_output_of_prior_pics_flag = 0;
+		sh->drpm.long_term_reference_flag = 0;
+		sh->drpm.adaptive_ref_pic_marking_mode_flag = 0;
+	}
+
+	ctx->slice.hdr_lists = 0;
 }
 
 
 int h264_ctx_new(struct h264_ctx **ret_obj)
 {
+	int res = 0;
 	struct h264_ctx *ctx = NULL;
 
 	ULOG_ERRNO_RETURN_ERR_IF(ret_obj == NULL, EINVAL);
 	*ret_obj = NULL;
 
+	/* Failure is not fatal, codes are then decoded bit by bit */
+	(void)h264_vlc_lut_init();
+
 	ctx = calloc(1, sizeof(*ctx));
 	if (ctx == NULL)
 		return -ENOMEM;
 
+	res = h264_arena_new(0, &ctx->sei_arena);
+	if (res < 0) {
+		free(ctx);
+		return res;
+	}
+
 	*ret_obj = ctx;
 	return 0;
 }
@@ -244,6 +326,9 @@ int h264_ctx_destroy(struct h264_ctx *ctx)
 	if (ctx == NULL)
 		return 0;
 	h264_ctx_clear(ctx);
+	h264_arena_destroy(ctx->sei_arena);
+	free(ctx->sei_scratch.buf);
+	h264_cabac_clear_init_cache(&ctx->cabac_init_cache);
 	free(ctx);
 	return 0;
 }
@@ -251,15 +336,32 @@ int h264_ctx_destroy(struct h264_ctx *ctx)
 
 int h264_ctx_clear(struct h264_ctx *ctx)
 {
+	struct h264_arena *sei_arena = NULL;
+	uint8_t *sei_scratch_buf = NULL;
+	size_t sei_scratch_size = 0;
+	struct h264_cabac_init_cache cabac_init_cache;
+
 	ULOG_ERRNO_RETURN_ERR_IF(ctx == NULL, EINVAL);
 	h264_ctx_clear_nalu(ctx);
 	for (size_t i = 0; i < ARRAY_SIZE(ctx->sps_table); i++)
 		free(ctx->sps_table[i]);
 	for (size_t i = 0; i < ARRAY_SIZE(ctx->pps_table); i++)
 		free(ctx->pps_table[i]);
-	free(ctx->slice.mb_table.info);
+	free(ctx->sei_table);
+	free(ctx->slice.mb_table.buf);
 	free(ctx->slice.group_map);
+	free(ctx->slice.group_next_mb);
+	h264_ctx_clear_slice_templates(ctx);
+	/* Keep the SEI memory and the CABAC init states for reuse */
+	sei_arena = ctx->sei_arena;
+	sei_scratch_buf = ctx->sei_scratch.buf;
+	sei_scratch_size = ctx->sei_scratch.size;
+	cabac_init_cache = ctx->cabac_init_cache;
 	memset(ctx, 0, sizeof(*ctx));
+	ctx->sei_arena = sei_arena;
+	ctx->sei_scratch.buf = sei_scratch_buf;
+	ctx->sei_scratch.size = sei_scratch_size;
+	ctx->cabac_init_cache = cabac_init_cache;
 	return 0;
 }
 
@@ -307,7 +409,11 @@ int h264_ctx_set_aud(struct h264_ctx *ctx, const struct h264_aud *aud)
 }
 
 
-int h264_ctx_set_sps(struct h264_ctx *ctx, const struct h264_sps *sps)
+/**
+ * Store a SPS in the table of the context without activating it; if it
+ * replaces the active SPS, the derived variables are updated
+ */
+int h264_ctx_store_sps(struct h264_ctx *ctx, const struct h264_sps *sps)
 {
 	struct h264_sps **p_sps = NULL;
 	ULOG_ERRNO_RETURN_ERR_IF(ctx == NULL, EINVAL);
@@ -321,17 +427,36 @@ int h264_ctx_set_sps(struct h264_ctx *ctx, const struct h264_sps *sps)
 		*p_sps = calloc(1, sizeof(**p_sps));
 		if (*p_sps == NULL)
 			return -ENOMEM;
+	} else if (memcmp(*p_sps, sps, sizeof(*sps)) != 0) {
+		h264_ctx_clear_slice_templates(ctx);
+		h264_clear_slice_group_map(ctx);
 	}
 	**p_sps = *sps;
-	ctx->sps = *p_sps;
-	h264_ctx_update_derived_vars_sps(ctx);
-	h264_ctx_update_derived_vars_slice(ctx);
+	if (ctx->sps == *p_sps) {
+		h264_ctx_update_derived_vars_sps(ctx);
+		h264_ctx_update_derived_vars_slice(ctx);
+	}
 
 	return 0;
 }
 
 
-int h264_ctx_set_pps(struct h264_ctx *ctx, const struct h264_pps *pps)
+int h264_ctx_set_sps(struct h264_ctx *ctx, const struct h264_sps *sps)
+{
+	int res = 0;
+
+	res = h264_ctx_store_sps(ctx, sps);
+	if (res < 0)
+		return res;
+	return h264_ctx_set_active_sps(ctx, sps->seq_parameter_set_id);
+}
+
+
+/**
+ * Store a PPS in the table of the context without activating it; if it
+ * replaces the active PPS, the derived variables are updated
+ */
+int h264_ctx_store_pps(struct h264_ctx *ctx, const struct h264_pps *pps)
 {
 	struct h264_pps **p_pps = NULL;
 	ULOG_ERRNO_RETURN_ERR_IF(ctx == NULL, EINVAL);
@@ -345,9 +470,28 @@ int h264_ctx_set_pps(struct h264_ctx *ctx, const struct h264_pps *pps)
 		*p_pps = calloc(1, sizeof(**p_pps));
 		if (*p_pps == NULL)
 			return -ENOMEM;
+	} else if (memcmp(*p_pps, pps, sizeof(*pps)) != 0) {
+		h264_ctx_clear_slice_templates(ctx);
+		h264_clear_slice_group_map(ctx);
 	}
 	**p_pps = *pps;
-	ctx->pps = *p_pps;
+	if (ctx->pps == *p_pps) {
+		h264_ctx_update_derived_vars_pps(ctx);
+		h264_ctx_update_derived_vars_slice(ctx);
+	}
+
+	return 0;
+}
+
+
+int h264_ctx_set_pps(struct h264_ctx *ctx, const struct h264_pps *pps)
+{
+	int res = 0;
+
+	res = h264_ctx_store_pps(ctx, pps);
+	if (res < 0)
+		return res;
+	ctx->pps = ctx->pps_table[pps->pic_parameter_set_id];
 	h264_ctx_update_derived_vars_pps(ctx);
 	h264_ctx_update_derived_vars_slice(ctx);
 
@@ -355,6 +499,14 @@ int h264_ctx_set_pps(struct h264_ctx *ctx, const struct h264_pps *pps)
 }
 
 
+void h264_ctx_clear_slice_templates(struct h264_ctx *ctx)
+{
+	for (uint32_t i = 0; i < H264_SLICE_TEMPLATE_COUNT; i++)
+		free(ctx->slice_templates.entries[i].data);
+	memset(&ctx->slice_templates, 0, sizeof(ctx->slice_templates));
+}
+
+
 int h264_ctx_set_filler(struct h264_ctx *ctx, size_t len)
 {
 	ULOG_ERRNO_RETURN_ERR_IF(ctx == NULL, EINVAL);
@@ -401,10 +553,9 @@ const struct h264_pps *h264_ctx_get_pps(struct h264_ctx *ctx)
 int h264_ctx_clear_sei_table(struct h264_ctx *ctx)
 {
 	ULOG_ERRNO_RETURN_ERR_IF(ctx == NULL, EINVAL);
-	for (uint32_t i = 0; i < ctx->sei_count; i++)
-		free(ctx->sei_table[i].raw.buf);
-	free(ctx->sei_table);
-	ctx->sei_table = NULL;
+	/* Raw buffers are all in the SEI arena */
+	h264_arena_reset(ctx->sei_arena);
+	/* Keep the table memory for reuse */
 	ctx->sei_count = 0;
 	return 0;
 }
@@ -414,17 +565,22 @@ int h264_ctx_add_sei_internal(struct h264_ctx *ctx, struct h264_sei **ret_obj)
 {
 	struct h264_sei *newtable = NULL;
 	struct h264_sei *sei = NULL;
+	uint32_t newsize = 0;
 
 	ULOG_ERRNO_RETURN_ERR_IF(ret_obj == NULL, EINVAL);
 	*ret_obj = NULL;
 	ULOG_ERRNO_RETURN_ERR_IF(ctx == NULL, EINVAL);
 
 	/* Increase table size */
-	newtable = realloc(ctx->sei_table,
-			   (ctx->sei_count + 1) * sizeof(struct h264_sei));
-	if (newtable == NULL)
-		return -ENOMEM;
-	ctx->sei_table = newtable;
+	if (ctx->sei_count >= ctx->sei_table_size) {
+		newsize = Max(2 * ctx->sei_table_size, 4);
+		newtable =
+			realloc(ctx->sei_table, newsize * sizeof(*newtable));
+		if (newtable == NULL)
+			return -ENOMEM;
+		ctx->sei_table = newtable;
+		ctx->sei_table_size = newsize;
+	}
 
 	/* Setup SEI pointer */
 	sei = &ctx->sei_table[ctx->sei_count];
@@ -440,43 +596,51 @@ int h264_ctx_add_sei(struct h264_ctx *ctx, const struct h264_sei *sei)
 	int res = 0;
 	struct h264_bitstream bs;
 	struct h264_sei *new_sei = NULL;
+	uint8_t *buf = NULL;
 
 	ULOG_ERRNO_RETURN_ERR_IF(ctx == NULL, EINVAL);
 	ULOG_ERRNO_RETURN_ERR_IF(sei == NULL, EINVAL);
 
-	/* Setup bitstream (without emulation prevention) */
+	/* Setup dynamic bitstream in the scratch buffer (without emulation
+	 * prevention) */
 	h264_bs_init(&bs, NULL, 0, 0);
+	bs.data = ctx->sei_scratch.buf;
+	bs.len = ctx->sei_scratch.size;
 
 	/* Allocate new SEI in internal table */
 	res = h264_ctx_add_sei_internal(ctx, &new_sei);
 	if (res < 0)
-		goto error;
+		goto out;
 	*new_sei = *sei;
 
 	/* Encode SEI payload in dynamic bitstream */
 	res = h264_write_one_sei(&bs, ctx, new_sei);
 	if (res < 0)
-		goto error;
+		goto out;
+	if (!h264_bs_byte_aligned(&bs)) {
+		res = -EIO;
+		goto out;
+	}
 
-	/* Acquire buffer of bitstream */
-	res = h264_bs_acquire_buf(&bs, &new_sei->raw.buf, &new_sei->raw.len);
-	if (res < 0)
-		goto error;
+	/* Copy the payload in the SEI arena */
+	buf = h264_arena_alloc(ctx->sei_arena, bs.off);
+	if (buf == NULL) {
+		res = -ENOMEM;
+		goto out;
+	}
+	memcpy(buf, bs.data, bs.off);
+	new_sei->raw.buf = buf;
+	new_sei->raw.len = bs.off;
 
 	/* Update internal buffer of SEI structures */
 	res = h264_sei_update_internal_buf(new_sei);
-	if (res < 0)
-		goto error;
 
-	h264_bs_clear(&bs);
-	return 0;
-
-error:
-	if (new_sei != NULL) {
-		free(new_sei->raw.buf);
+out:
+	if (res < 0 && new_sei != NULL)
 		ctx->sei_count--;
-	}
-	h264_bs_clear(&bs);
+	/* The scratch buffer may have been reallocated */
+	ctx->sei_scratch.buf = bs.data;
+	ctx->sei_scratch.size = bs.len;
 	return res;
 }
 
@@ -546,13 +710,13 @@ int h264_ctx_clear_slice(struct h264_ctx *ctx)
 {
 	ULOG_ERRNO_RETURN_ERR_IF(ctx == NULL, EINVAL);
 	ctx->slice.type = 0;
-	memset(&ctx->slice.hdr, 0, sizeof(ctx->slice.hdr));
+	h264_ctx_clear_slice_header(ctx);
 	ctx->slice.rawdata.partial = 0;
 	ctx->slice.rawdata.partialbits = 0;
 	ctx->slice.rawdata.buf = NULL;
 	ctx->slice.rawdata.len = 0;
+	ctx->slice.mb_count = 0;
 	h264_clear_macroblock_table(ctx);
-	h264_clear_slice_group_map(ctx);
 	memset(&ctx->_mb, 0, sizeof(ctx->_mb));
 	ctx->mb = NULL;
 	h264_ctx_update_derived_vars_slice(ctx);
@@ -566,14 +730,46 @@ int h264_ctx_set_slice_header(struct h264_ctx *ctx,
 	ULOG_ERRNO_RETURN_ERR_IF(ctx == NULL, EINVAL);
 	ULOG_ERRNO_RETURN_ERR_IF(sh == NULL, EINVAL);
 	h264_ctx_clear_slice(ctx);
-	ctx->slice.type = H264_SLICE_TYPE(sh->slice_type);
 	ctx->slice.hdr = *sh;
+	ctx->slice.hdr_lists = H264_SLICE_HDR_LIST_ALL;
+	return h264_ctx_update_slice(ctx);
+}
+
+
+int h264_ctx_update_slice(struct h264_ctx *ctx)
+{
+	const struct h264_slice_header *sh = NULL;
+	struct h264_slice_hdr_core core;
+
+	ULOG_ERRNO_RETURN_ERR_IF(ctx == NULL, EINVAL);
+	sh = &ctx->slice.hdr;
+	ctx->slice.type = H264_SLICE_TYPE(sh->slice_type);
 	h264_ctx_update_derived_vars_slice(ctx);
-	h264_ctx_detect_first_vcl_nalu(ctx);
+	h264_slice_hdr_get_core(sh, &core);
+	ctx->nalu.is_first_vcl = h264_ctx_is_first_vcl_nalu(
+		ctx, ctx->sps, &ctx->nalu.hdr, &core);
+	if (ctx->nalu.is_first_vcl)
+		ctx->au.mb_count = 0;
 	return 0;
 }
 
 
+/* Add the macroblocks of the current slice to the primary coded picture
+ * (redundant coded pictures are not counted) and return 1 if all of its
+ * macroblocks have now been parsed; only meaningful when the slice data
+ * is parsed */
+int h264_ctx_is_au_complete(struct h264_ctx *ctx)
+{
+	if (ctx->nalu.type != H264_NALU_TYPE_SLICE &&
+	    ctx->nalu.type != H264_NALU_TYPE_SLICE_IDR)
+		return 0;
+	if (ctx->slice.hdr.redundant_pic_cnt == 0)
+		ctx->au.mb_count += ctx->slice.mb_count;
+	return !ctx->au.ended && ctx->derived.PicSizeInMbs != 0 &&
+	       ctx->au.mb_count >= ctx->derived.PicSizeInMbs;
+}
+
+
 int h264_get_info_from_ps(struct h264_sps *sps,
 			  struct h264_pps *pps,
 			  struct h264_sps_derived *sps_derived,
@@ -239,17 +239,51 @@ static uint32_t h264_mb_to_slice_group(struct h264_ctx *ctx, uint32_t mbAddr)
 
 
 /**
- * 8.2.2 Decoding process for macroblock to slice group map
+ * Next macroblock of the same slice group for each macroblock (8.2.4),
+ * PicSizeInMbs when it is the last one of its slice group
+ */
+static void h264_gen_next_mb_addr(struct h264_ctx *ctx)
+{
+	uint32_t PicSizeInMbs = ctx->derived.PicSizeInMbs;
+	uint32_t next[8];
+
+	for (uint32_t grp = 0; grp < ARRAY_SIZE(next); grp++)
+		next[grp] = PicSizeInMbs;
+
+	for (uint32_t i = PicSizeInMbs; i > 0; i--) {
+		uint32_t grp = h264_mb_to_slice_group(ctx, i - 1) & 7;
+		ctx->slice.group_next_mb[i - 1] = next[grp];
+		next[grp] = i - 1;
+	}
+}
+
+
+/**
+ * 8.2.2 Decoding process for macroblock to slice group map; the map and
+ * the next macroblock addresses are only generated again when the PPS, the
+ * slice_group_change_cycle or the picture structure change
  */
 int h264_gen_slice_group_map(struct h264_ctx *ctx)
 {
 	uint32_t PicSizeInMapUnits = ctx->sps_derived.PicSizeInMapUnits;
+	uint32_t PicSizeInMbs = ctx->derived.PicSizeInMbs;
+	const struct h264_slice_header *sh = &ctx->slice.hdr;
 
 	/* Map not use if no group */
 	if (ctx->pps->num_slice_groups_minus1 == 0)
 		return 0;
 
-	/* Grow table if needed */
+	if (ctx->slice.group_map_key.valid &&
+	    ctx->slice.group_map_key.pps_id == ctx->pps->pic_parameter_set_id &&
+	    ctx->slice.group_map_key.slice_group_change_cycle ==
+		    sh->slice_group_change_cycle &&
+	    ctx->slice.group_map_key.field_pic_flag == sh->field_pic_flag &&
+	    ctx->slice.group_map_key.MbaffFrameFlag ==
+		    ctx->derived.MbaffFrameFlag)
+		return 0;
+	ctx->slice.group_map_key.valid = 0;
+
+	/* Grow tables if needed */
 	void *newmap = NULL;
 	if (PicSizeInMapUnits > ctx->slice.group_map_maxlen) {
 		newmap = realloc(ctx->slice.group_map,
@@ -260,6 +294,15 @@ int h264_gen_slice_group_map(struct h264_ctx *ctx)
 		ctx->slice.group_map = newmap;
 		ctx->slice.group_map_maxlen = PicSizeInMapUnits;
 	}
+	if (PicSizeInMbs > ctx->slice.group_next_mb_maxlen) {
+		newmap = realloc(ctx->slice.group_next_mb,
+				 /* codecheck_ignore[POINTER_LOCATION] */
+				 PicSizeInMbs * sizeof(uint32_t));
+		if (newmap == NULL)
+			return -ENOMEM;
+		ctx->slice.group_next_mb = newmap;
+		ctx->slice.group_next_mb_maxlen = PicSizeInMbs;
+	}
 
 	switch (ctx->pps->slice_group_map_type) {
 	case 0:
@@ -287,17 +330,22 @@ int h264_gen_slice_group_map(struct h264_ctx *ctx)
 		return -EIO;
 	}
 
+	h264_gen_next_mb_addr(ctx);
+
+	ctx->slice.group_map_key.valid = 1;
+	ctx->slice.group_map_key.pps_id = ctx->pps->pic_parameter_set_id;
+	ctx->slice.group_map_key.slice_group_change_cycle =
+		sh->slice_group_change_cycle;
+	ctx->slice.group_map_key.field_pic_flag = sh->field_pic_flag;
+	ctx->slice.group_map_key.MbaffFrameFlag = ctx->derived.MbaffFrameFlag;
+
 	return 0;
 }
 
 
 void h264_clear_slice_group_map(struct h264_ctx *ctx)
 {
-	if (ctx->slice.group_map != NULL) {
-		memset(ctx->slice.group_map,
-		       0,
-		       ctx->slice.group_map_maxlen * sizeof(uint32_t));
-	}
+	memset(&ctx->slice.group_map_key, 0, sizeof(ctx->slice.group_map_key));
 }
 
 
@@ -309,11 +357,8 @@ uint32_t h264_next_mb_addr(struct h264_ctx *ctx, uint32_t mbAddr)
 	if (ctx->pps->num_slice_groups_minus1 == 0)
 		return mbAddr + 1;
 
-	uint32_t group = h264_mb_to_slice_group(ctx, mbAddr);
-	uint32_t i = mbAddr + 1;
-	while (i < ctx->derived.PicSizeInMbs &&
-	       h264_mb_to_slice_group(ctx, i) != group) {
-		i++;
-	}
-	return i;
+	if (mbAddr >= ctx->derived.PicSizeInMbs)
+		return mbAddr + 1;
+
+	return ctx->slice.group_next_mb[mbAddr];
 }
@@ -27,274 +27,157 @@
 #include "h264_priv.h"
 
 
-/**
- * 6.4.3 Inverse 4x4 luma block scanning process
- * 6.4.4 Inverse 4x4 Cb or Cr block scanning process for ChromaArrayType
- *       equal to 3
- */
-static void h264_inv_luma_cb_cr_4x4(uint32_t idx, uint32_t *x, uint32_t *y)
-{
-	static const uint32_t table[16][2] = {
-		{0, 0},
-		{4, 0},
-		{0, 4},
-		{4, 4},
-		{8, 0},
-		{12, 0},
-		{8, 4},
-		{12, 4},
-		{0, 8},
-		{4, 8},
-		{0, 12},
-		{4, 12},
-		{8, 8},
-		{12, 8},
-		{8, 12},
-		{12, 12},
-	};
-	*x = table[idx][0];
-	*y = table[idx][1];
-}
+/* Neighbouring 4x4 block: macroblock (H264_NB_xxx) and block index */
+struct h264_nb_4x4 {
+	uint8_t mbA;
+	uint8_t idxA;
+	uint8_t mbB;
+	uint8_t idxB;
+};
 
 
-/**
- * 6.4.7 Inverse 4x4 chroma block scanning process
- */
-static void h264_inv_chroma_4x4(uint32_t idx, uint32_t *x, uint32_t *y)
-{
-	static const uint32_t table[8][2] = {
-		{0, 0},
-		{4, 0},
-		{0, 4},
-		{4, 4},
-		{0, 8},
-		{4, 8},
-		{0, 12},
-		{4, 12},
-	};
-	*x = table[idx][0];
-	*y = table[idx][1];
-}
+/* Macroblock and row of 4x4 blocks of a neighbour in MBAFF frames */
+struct h264_nb_row {
+	uint8_t mb;
+	uint8_t row;
+};
+
 
+/* clang-format off */
 
 /**
- * 6.4.12.1 Specification for neighbouring locations in fields and non-MBAFF
- *          frames
+ * 6.4.11.4 Neighbouring 4x4 luma (or Cb/Cr for ChromaArrayType 3) blocks in
+ * fields and non-MBAFF frames, indexed by luma4x4BlkIdx
  */
-static void
-h264_get_neighbouring_locations_non_mbaff(struct h264_ctx *ctx,
-					  struct h264_macroblock *mb,
-					  uint32_t maxW,
-					  uint32_t maxH,
-					  int32_t xN,
-					  int32_t yN,
-					  uint32_t *mbAddrN,
-					  uint32_t *xW,
-					  uint32_t *yW)
-{
-	if (xN < 0)
-		*mbAddrN = mb->mbAddrA;
-	else if (yN < 0)
-		*mbAddrN = mb->mbAddrB;
-	else
-		*mbAddrN = mb->mbAddr;
-
-	*xW = xN < 0 ? (uint32_t)(xN + maxW) : (uint32_t)xN;
-	*yW = yN < 0 ? (uint32_t)(yN + maxH) : (uint32_t)yN;
-}
+static const struct h264_nb_4x4 s_nb_luma_4x4[16] = {
+	{H264_NB_A, 5, H264_NB_B, 10},
+	{H264_NB_CURR, 0, H264_NB_B, 11},
+	{H264_NB_A, 7, H264_NB_CURR, 0},
+	{H264_NB_CURR, 2, H264_NB_CURR, 1},
+	{H264_NB_CURR, 1, H264_NB_B, 14},
+	{H264_NB_CURR, 4, H264_NB_B, 15},
+	{H264_NB_CURR, 3, H264_NB_CURR, 4},
+	{H264_NB_CURR, 6, H264_NB_CURR, 5},
+	{H264_NB_A, 13, H264_NB_CURR, 2},
+	{H264_NB_CURR, 8, H264_NB_CURR, 3},
+	{H264_NB_A, 15, H264_NB_CURR, 8},
+	{H264_NB_CURR, 10, H264_NB_CURR, 9},
+	{H264_NB_CURR, 9, H264_NB_CURR, 6},
+	{H264_NB_CURR, 12, H264_NB_CURR, 7},
+	{H264_NB_CURR, 11, H264_NB_CURR, 12},
+	{H264_NB_CURR, 14, H264_NB_CURR, 13},
+};
 
 
 /**
- * 6.4.12.2 Specification for neighbouring locations in MBAFF frames
+ * 6.4.11.5 Neighbouring 4x4 chroma blocks in fields and non-MBAFF frames,
+ * indexed by [MbHeightC == 16][chroma4x4BlkIdx]
  */
-static void h264_get_neighbouring_locations_mbaff(struct h264_ctx *ctx,
-						  struct h264_macroblock *mb,
-						  uint32_t maxW,
-						  uint32_t maxH,
-						  int32_t xN,
-						  int32_t yN,
-						  uint32_t *mbAddrN,
-						  uint32_t *xW,
-						  uint32_t *yW)
-{
-	int currMbFrameFlag = !mb->mb_field_decoding_flag;
-	int mbIsTopMbFlag = mb->mbAddr % 2 == 0;
-	int32_t yM = 0;
-	if (xN < 0) {
-		uint32_t mbAddrX = mb->mbAddrA;
-		if (mbAddrX == H264_MB_ADDR_INVALID) {
-			*mbAddrN = H264_MB_ADDR_INVALID;
-			*xW = *yW = 0;
-			return;
-		}
-		int mbAddrXFrameFlag = !mb->mbAddrAInfo->field_flag;
-		if (currMbFrameFlag) {
-			if (mbIsTopMbFlag) {
-				if (mbAddrXFrameFlag) {
-					*mbAddrN = mb->mbAddrA;
-					yM = yN;
-				} else {
-					if (yN % 2 == 0) {
-						*mbAddrN = mb->mbAddrA;
-						yM = yN >> 1;
-					} else {
-						*mbAddrN = mb->mbAddrA + 1;
-						yM = yN >> 1;
-					}
-				}
-			} else {
-				if (mbAddrXFrameFlag) {
-					*mbAddrN = mb->mbAddrA + 1;
-					yM = yN;
-				} else {
-					if (yN % 2 == 0) {
-						*mbAddrN = mb->mbAddrA;
-						yM = (yN + maxH) >> 1;
-					} else {
-						*mbAddrN = mb->mbAddrA + 1;
-						yM = (yN + maxH) >> 1;
-					}
-				}
-			}
-		} else {
-			if (mbIsTopMbFlag) {
-				if (mbAddrXFrameFlag) {
-					if ((uint32_t)yN < (maxH / 2)) {
-						*mbAddrN = mb->mbAddrA;
-						yM = yN << 1;
-					} else {
-						*mbAddrN = mb->mbAddrA + 1;
-						yM = (yN << 1) - maxH;
-					}
-				} else {
-					*mbAddrN = mb->mbAddrA;
-					yM = yN;
-				}
-			} else {
-				if (mbAddrXFrameFlag) {
-					if ((uint32_t)yN < (maxH / 2)) {
-						*mbAddrN = mb->mbAddrA;
-						yM = (yN << 1) + 1;
-					} else {
-						*mbAddrN = mb->mbAddrA + 1;
-						yM = (yN << 1) + 1 - maxH;
-					}
-				} else {
-					*mbAddrN = mb->mbAddrA + 1;
-					yM = yN;
-				}
-			}
-		}
-	} else if (yN < 0) {
-		if (currMbFrameFlag) {
-			if (mbIsTopMbFlag) {
-				uint32_t mbAddrX = mb->mbAddrB;
-				if (mbAddrX == H264_MB_ADDR_INVALID) {
-					*mbAddrN = H264_MB_ADDR_INVALID;
-					*xW = *yW = 0;
-					return;
-				}
-				*mbAddrN = mb->mbAddrB + 1;
-				yM = yN;
-			} else {
-				*mbAddrN = mb->mbAddr - 1;
-				yM = yN;
-			}
-		} else {
-			uint32_t mbAddrX = mb->mbAddrB;
-			if (mbAddrX == H264_MB_ADDR_INVALID) {
-				*mbAddrN = H264_MB_ADDR_INVALID;
-				*xW = *yW = 0;
-				return;
-			}
-			int mbAddrXFrameFlag = !mb->mbAddrBInfo->field_flag;
-			if (mbIsTopMbFlag) {
-				if (mbAddrXFrameFlag) {
-					*mbAddrN = mb->mbAddrB + 1;
-					yM = 2 * yN;
-				} else {
-					*mbAddrN = mb->mbAddrB;
-					yM = yN;
-				}
-			} else {
-				*mbAddrN = mb->mbAddrB + 1;
-				yM = yN;
-			}
-		}
-	} else {
-		*mbAddrN = mb->mbAddr;
-		yM = yN;
-	}
-
-	*xW = xN < 0 ? (uint32_t)(xN + maxW) : (uint32_t)xN;
-	*yW = yM < 0 ? (uint32_t)(yM + maxH) : (uint32_t)yM;
-}
+static const struct h264_nb_4x4 s_nb_chroma_4x4[2][8] = {
+	{
+		{H264_NB_A, 1, H264_NB_B, 2},
+		{H264_NB_CURR, 0, H264_NB_B, 3},
+		{H264_NB_A, 3, H264_NB_CURR, 0},
+		{H264_NB_CURR, 2, H264_NB_CURR, 1},
+	},
+	{
+		{H264_NB_A, 1, H264_NB_B, 6},
+		{H264_NB_CURR, 0, H264_NB_B, 7},
+		{H264_NB_A, 3, H264_NB_CURR, 0},
+		{H264_NB_CURR, 2, H264_NB_CURR, 1},
+		{H264_NB_A, 5, H264_NB_CURR, 2},
+		{H264_NB_CURR, 4, H264_NB_CURR, 3},
+		{H264_NB_A, 7, H264_NB_CURR, 4},
+		{H264_NB_CURR, 6, H264_NB_CURR, 5},
+	},
+};
 
 
 /**
- * 6.4.12 Derivation process for neighbouring locations
- *
- * (xN, yN): luma or chroma location expressed relative to the upper left corner
- *           of the current macroblock.
- * (maxW, maxH): maximum values of the location components xN, xW, and yN, yW.
- * mbAddrN: CurrMbAddr or to the address of neighbouring macroblock that
- *          contains (xN, yN) and its availability status.
- * (xW, yW): the location (xN, yN) expressed relative to the upper-left corner
- *           of the macroblock mbAddrN (rather than relative to the upper-left
- *           corner of the current macroblock).
+ * 6.4.12.2 Neighbour A of the 4x4 blocks of the left column in MBAFF frames:
+ * macroblock of the left pair and row of 4x4 blocks in it, indexed by
+ * [maxH == 16][currMbFieldFlag][mbIsBottomMbFlag][mbAddrXFieldFlag][row]
  */
-static void h264_get_neighbouring_locations(struct h264_ctx *ctx,
-					    struct h264_macroblock *mb,
-					    uint32_t maxW,
-					    uint32_t maxH,
-					    int32_t xN,
-					    int32_t yN,
-					    uint32_t *mbAddrN,
-					    uint32_t *xW,
-					    uint32_t *yW)
-{
-	if (!ctx->derived.MbaffFrameFlag) {
-		h264_get_neighbouring_locations_non_mbaff(
-			ctx, mb, maxW, maxH, xN, yN, mbAddrN, xW, yW);
-	} else {
-		h264_get_neighbouring_locations_mbaff(
-			ctx, mb, maxW, maxH, xN, yN, mbAddrN, xW, yW);
-	}
-}
+static const struct h264_nb_row s_nb_mbaff_a[2][2][2][2][4] = {
+	{
+		{
+			{
+				{{H264_NB_A, 0}, {H264_NB_A, 1}},
+				{{H264_NB_A, 0}, {H264_NB_A, 0}},
+			},
+			{
+				{{H264_NB_A_BOTTOM, 0}, {H264_NB_A_BOTTOM, 1}},
+				{{H264_NB_A, 1}, {H264_NB_A, 1}},
+			},
+		},
+		{
+			{
+				{{H264_NB_A, 0}, {H264_NB_A_BOTTOM, 0}},
+				{{H264_NB_A, 0}, {H264_NB_A, 1}},
+			},
+			{
+				{{H264_NB_A, 0}, {H264_NB_A_BOTTOM, 0}},
+				{{H264_NB_A_BOTTOM, 0}, {H264_NB_A_BOTTOM, 1}},
+			},
+		},
+	},
+	{
+		{
+			{
+				{{H264_NB_A, 0}, {H264_NB_A, 1},
+				 {H264_NB_A, 2}, {H264_NB_A, 3}},
+				{{H264_NB_A, 0}, {H264_NB_A, 0},
+				 {H264_NB_A, 1}, {H264_NB_A, 1}},
+			},
+			{
+				{{H264_NB_A_BOTTOM, 0}, {H264_NB_A_BOTTOM, 1},
+				 {H264_NB_A_BOTTOM, 2}, {H264_NB_A_BOTTOM, 3}},
+				{{H264_NB_A, 2}, {H264_NB_A, 2},
+				 {H264_NB_A, 3}, {H264_NB_A, 3}},
+			},
+		},
+		{
+			{
+				{{H264_NB_A, 0}, {H264_NB_A, 2},
+				 {H264_NB_A_BOTTOM, 0}, {H264_NB_A_BOTTOM, 2}},
+				{{H264_NB_A, 0}, {H264_NB_A, 1},
+				 {H264_NB_A, 2}, {H264_NB_A, 3}},
+			},
+			{
+				{{H264_NB_A, 0}, {H264_NB_A, 2},
+				 {H264_NB_A_BOTTOM, 0}, {H264_NB_A_BOTTOM, 2}},
+				{{H264_NB_A_BOTTOM, 0}, {H264_NB_A_BOTTOM, 1},
+				 {H264_NB_A_BOTTOM, 2}, {H264_NB_A_BOTTOM, 3}},
+			},
+		},
+	},
+};
 
 
 /**
- * 6.4.13.1 Derivation process for 4x4 luma block indices
- * Derivation process for 4x4 Cb or Cr block indices for ChromaArrayType
- *  equal to 3
- *
- * (xP, yP): luma/cb/cr location relative to the upper-left luma sample of a
- *           macroblock
- * idx: 4x4 luma/cb/cr block index
+ * 6.4.12.2 Neighbour B of the 4x4 blocks of the top row in MBAFF frames (the
+ * bottom row of 4x4 blocks of the macroblock), indexed by
+ * [currMbFieldFlag][mbIsBottomMbFlag][mbAddrXFieldFlag]
  */
-static void h264_idx_luma_cb_cr_4x4(uint32_t xP, uint32_t yP, uint32_t *idx)
-{
-	static const uint32_t table[4][4] = {
-		{0, 2, 8, 10},
-		{1, 3, 9, 11},
-		{4, 6, 12, 14},
-		{5, 7, 13, 15},
-	};
-	*idx = table[xP / 4][yP / 4];
-}
+static const uint8_t s_nb_mbaff_b[2][2][2] = {
+	{
+		{H264_NB_B_BOTTOM, H264_NB_B_BOTTOM},
+		{H264_NB_CURR_TOP, H264_NB_CURR_TOP},
+	},
+	{
+		{H264_NB_B_BOTTOM, H264_NB_B},
+		{H264_NB_B_BOTTOM, H264_NB_B_BOTTOM},
+	},
+};
 
 
-/**
- * 6.4.13.2 Derivation process for 4x4 chroma block indices
- *
- * (xP, yP): chroma location relative to the upper-left chroma sample of a
- *           macroblock
- * idx: chroma block index
- */
-static void h264_idx_chroma_4x4(uint32_t xP, uint32_t yP, uint32_t *idx)
-{
-	*idx = 2 * (yP / 4) + (xP / 4);
-}
+/* Index of the 4x4 luma blocks of the right column, by row */
+static const uint8_t s_luma_4x4_right_col[4] = {5, 7, 13, 15};
+
+/* Index of the 4x4 chroma blocks of the right column, by row */
+static const uint8_t s_chroma_4x4_right_col[4] = {1, 3, 5, 7};
+
+/* clang-format on */
 
 
 /**
@@ -313,6 +196,8 @@ void h264_compute_neighbouring_macroblocks(struct h264_ctx *ctx,
 	mb->mbAddrB = H264_MB_ADDR_INVALID;
 	mb->mbAddrAInfo = NULL;
 	mb->mbAddrBInfo = NULL;
+	mb->mbAddrN[H264_NB_CURR] = mb->mbAddr;
+	mb->mbAddrN[H264_NB_CURR_TOP] = mb->mbAddr - 1;
 
 	/* Determine left and top macroblock */
 	if (!ctx->derived.MbaffFrameFlag) {
@@ -333,20 +218,68 @@ void h264_compute_neighbouring_macroblocks(struct h264_ctx *ctx,
 			mb->mbAddrB = 2 * (half_addr - PicWidthInMbs);
 	}
 
-	/* Check availability and determine field flag */
+	/* Check availability (same slice) */
 	if (mb->mbAddrA != H264_MB_ADDR_INVALID) {
-		uint32_t offA = h264_get_mb_addr_off(ctx, mb->mbAddrA);
-		if (!ctx->slice.mb_table.info[offA].available)
+		const struct h264_macroblock_info *infoA =
+			h264_get_mb_info(ctx, mb->mbAddrA);
+		if (infoA->slice_id != ctx->slice.mb_table.slice_id)
 			mb->mbAddrA = H264_MB_ADDR_INVALID;
 		else
-			mb->mbAddrAInfo = &ctx->slice.mb_table.info[offA];
+			mb->mbAddrAInfo = infoA;
 	}
 	if (mb->mbAddrB != H264_MB_ADDR_INVALID) {
-		uint32_t offB = h264_get_mb_addr_off(ctx, mb->mbAddrB);
-		if (!ctx->slice.mb_table.info[offB].available)
+		const struct h264_macroblock_info *infoB =
+			h264_get_mb_info(ctx, mb->mbAddrB);
+		if (infoB->slice_id != ctx->slice.mb_table.slice_id)
 			mb->mbAddrB = H264_MB_ADDR_INVALID;
 		else
-			mb->mbAddrBInfo = &ctx->slice.mb_table.info[offB];
+			mb->mbAddrBInfo = infoB;
+	}
+
+	mb->mbAddrN[H264_NB_A] = mb->mbAddrA;
+	mb->mbAddrN[H264_NB_A_BOTTOM] = mb->mbAddrA != H264_MB_ADDR_INVALID
+						? mb->mbAddrA + 1
+						: H264_MB_ADDR_INVALID;
+	mb->mbAddrN[H264_NB_B] = mb->mbAddrB;
+	mb->mbAddrN[H264_NB_B_BOTTOM] = mb->mbAddrB != H264_MB_ADDR_INVALID
+						? mb->mbAddrB + 1
+						: H264_MB_ADDR_INVALID;
+}
+
+
+/**
+ * 6.4.12.2 Neighbouring 4x4 blocks in MBAFF frames: the neighbours of the
+ * blocks of the left column and of the top row of the macroblock depend on
+ * the field decoding flags of the current and neighbouring pairs
+ *
+ * row: row of the 4x4 block in the macroblock.
+ * maxH16: whether the macroblock is 16 samples high (4 rows of blocks).
+ * right_col: index of the 4x4 blocks of the right column, by row.
+ */
+static void h264_get_neighbouring_4x4_mbaff(const struct h264_macroblock *mb,
+					    const struct h264_nb_4x4 *nb,
+					    uint32_t row,
+					    int maxH16,
+					    const uint8_t *right_col,
+					    uint32_t *mbAddrA,
+					    uint32_t *idxA,
+					    uint32_t *mbAddrB)
+{
+	int field = mb->mb_field_decoding_flag;
+	int bottom = mb->mbAddr % 2;
+	int fieldN = 0;
+	const struct h264_nb_row *nbA = NULL;
+
+	if (nb->mbA == H264_NB_A && mb->mbAddrA != H264_MB_ADDR_INVALID) {
+		fieldN = mb->mbAddrAInfo->field_flag;
+		nbA = &s_nb_mbaff_a[maxH16][field][bottom][fieldN][row];
+		*mbAddrA = mb->mbAddrN[nbA->mb];
+		*idxA = right_col[nbA->row];
+	}
+	if (nb->mbB == H264_NB_B) {
+		fieldN = mb->mbAddrB != H264_MB_ADDR_INVALID &&
+			 mb->mbAddrBInfo->field_flag;
+		*mbAddrB = mb->mbAddrN[s_nb_mbaff_b[field][bottom][fieldN]];
 	}
 }
 
@@ -374,15 +307,25 @@ void h264_get_neighbouring_luma_cb_cr_4x4(struct h264_ctx *ctx,
 					  uint32_t *mbAddrB,
 					  uint32_t *idxB)
 {
-	uint32_t x = 0, y = 0;
-	uint32_t xW = 0, yW = 0;
-	h264_inv_luma_cb_cr_4x4(idx, &x, &y);
-	h264_get_neighbouring_locations(
-		ctx, mb, 16, 16, (int32_t)x - 1, y, mbAddrA, &xW, &yW);
-	h264_idx_luma_cb_cr_4x4(xW, yW, idxA);
-	h264_get_neighbouring_locations(
-		ctx, mb, 16, 16, x, (int32_t)y - 1, mbAddrB, &xW, &yW);
-	h264_idx_luma_cb_cr_4x4(xW, yW, idxB);
+	const struct h264_nb_4x4 *nb = &s_nb_luma_4x4[idx];
+
+	*mbAddrA = mb->mbAddrN[nb->mbA];
+	*idxA = nb->idxA;
+	*mbAddrB = mb->mbAddrN[nb->mbB];
+	*idxB = nb->idxB;
+
+	if (ctx->derived.MbaffFrameFlag) {
+		/* Row of the 4x4 block (6.4.3) */
+		uint32_t row = ((idx >> 2) & 2) | ((idx >> 1) & 1);
+		h264_get_neighbouring_4x4_mbaff(mb,
+						nb,
+						row,
+						1,
+						s_luma_4x4_right_col,
+						mbAddrA,
+						idxA,
+						mbAddrB);
+	}
 }
 
 
@@ -407,27 +350,23 @@ void h264_get_neighbouring_chroma_4x4(struct h264_ctx *ctx,
 				      uint32_t *mbAddrB,
 				      uint32_t *idxB)
 {
-	uint32_t x = 0, y = 0;
-	uint32_t xW = 0, yW = 0;
-	h264_inv_chroma_4x4(idx, &x, &y);
-	h264_get_neighbouring_locations(ctx,
-					mb,
-					ctx->sps_derived.MbWidthC,
-					ctx->sps_derived.MbHeightC,
-					(int32_t)x - 1,
-					y,
-					mbAddrA,
-					&xW,
-					&yW);
-	h264_idx_chroma_4x4(xW, yW, idxA);
-	h264_get_neighbouring_locations(ctx,
-					mb,
-					ctx->sps_derived.MbWidthC,
-					ctx->sps_derived.MbHeightC,
-					x,
-					(int32_t)y - 1,
-					mbAddrB,
-					&xW,
-					&yW);
-	h264_idx_chroma_4x4(xW, yW, idxB);
+	int maxH16 = ctx->sps_derived.MbHeightC == 16;
+	const struct h264_nb_4x4 *nb = &s_nb_chroma_4x4[maxH16][idx];
+
+	*mbAddrA = mb->mbAddrN[nb->mbA];
+	*idxA = nb->idxA;
+	*mbAddrB = mb->mbAddrN[nb->mbB];
+	*idxB = nb->idxB;
+
+	if (ctx->derived.MbaffFrameFlag) {
+		/* Row of the 4x4 block (6.4.7) */
+		h264_get_neighbouring_4x4_mbaff(mb,
+						nb,
+						idx / 2,
+						maxH16,
+						s_chroma_4x4_right_col,
+						mbAddrA,
+						idxA,
+						mbAddrB);
+	}
 }
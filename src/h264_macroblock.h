@@ -29,6 +29,32 @@
 
 #define H264_MB_ADDR_INVALID ((uint32_t)-1)
 
+/* Groups of sample and coefficient arrays of struct h264_macroblock */
+#define H264_MB_LEVELS_PCM (1 << 0)
+#define H264_MB_LEVELS_LUMA (1 << 1)
+#define H264_MB_LEVELS_CHROMA (1 << 2)
+#define H264_MB_LEVELS_CB (1 << 3)
+#define H264_MB_LEVELS_CR (1 << 4)
+
+
+/* Macroblocks containing the neighbouring blocks (6.4.11) */
+enum h264_nb {
+	/* Current macroblock */
+	H264_NB_CURR = 0,
+	/* Top macroblock of the current pair (MBAFF) */
+	H264_NB_CURR_TOP,
+	/* Macroblock A, or top macroblock of pair A (MBAFF) */
+	H264_NB_A,
+	/* Bottom macroblock of pair A (MBAFF) */
+	H264_NB_A_BOTTOM,
+	/* Macroblock B, or top macroblock of pair B (MBAFF) */
+	H264_NB_B,
+	/* Bottom macroblock of pair B (MBAFF) */
+	H264_NB_B_BOTTOM,
+
+	H264_NB_COUNT,
+};
+
 
 /**
  * 7.4.5.2 Sub-macroblock prediction semantics
@@ -72,6 +98,9 @@ enum Level {
 	CrLevel4x4,
 	ChromaDCLevel,
 	ChromaACLevel,
+	LumaLevel8x8,
+	CbLevel8x8,
+	CrLevel8x8,
 };
 
 
@@ -92,12 +121,22 @@ enum IntraChroma {
 
 /* clang-format off */
 struct h264_macroblock_info {
-	uint32_t mb_type:4;
+	/* Slice the macroblock belongs to, the macroblock is available for
+	 * the current slice if it matches ctx->slice.mb_table.slice_id */
+	uint32_t slice_id;
+	uint32_t mb_type:5;
 	uint32_t intra_chroma_pred_mode:2;
-	uint32_t available:1;
 	uint32_t skipped:1;
 	uint32_t field_flag:1;
+	uint32_t transform_size_8x8_flag:1;
+	uint32_t coded_block_pattern:6;
+	/* CABAC: coded_block_flag of the DC blocks (one bit per component) */
+	uint32_t coded_block_flag_dc:3;
 	uint8_t nz_coeff[3 * 16];
+	/* CABAC: ref_idx per 8x8 block (0 when not present) and absolute
+	 * mvd per 4x4 block (clipped) */
+	uint8_t ref_idx[2][4];
+	uint8_t abs_mvd[2][16][2];
 };
 /* clang-format on */
 
@@ -111,6 +150,8 @@ struct h264_macroblock {
 	uint32_t mbAddrB;
 	const struct h264_macroblock_info *mbAddrAInfo;
 	const struct h264_macroblock_info *mbAddrBInfo;
+	/* Neighbouring macroblock addresses by H264_NB_xxx */
+	uint32_t mbAddrN[H264_NB_COUNT];
 
 	enum h264_mb_type mb_type;
 	uint32_t raw_mb_type;
@@ -125,10 +166,6 @@ struct h264_macroblock {
 	int transform_size_8x8_flag;
 	int32_t mb_qp_delta;
 
-	/* PCM MB only (BitDepthLuma and BitDepthChroma 8-14 bits) */
-	uint16_t pcm_sample_luma[256];
-	uint16_t pcm_sample_chroma[2][256];
-
 	/* Intra MB only */
 	int8_t intra4x4_pred_mode[16];
 	int8_t intra8x8_pred_mode[4];
@@ -148,6 +185,16 @@ struct h264_macroblock {
 	uint8_t CodedBlockPatternLuma;
 	uint8_t CodedBlockPatternChroma;
 
+	/* Sample and coefficient storage: only the header above is reset for
+	 * each macroblock, the groups of arrays below are cleared when the
+	 * previous macroblock has written them (H264_MB_LEVELS_xxx bits in
+	 * levels_dirty, see h264_new_macroblock) */
+	uint32_t levels_dirty;
+
+	/* PCM MB only (BitDepthLuma and BitDepthChroma 8-14 bits) */
+	uint16_t pcm_sample_luma[256];
+	uint16_t pcm_sample_chroma[2][256];
+
 	int16_t Intra16x16DCLevel[16];
 	int16_t Intra16x16ACLevel[16][15];
 	int16_t LumaLevel4x4[16][16];
@@ -31,11 +31,14 @@
 #include <errno.h>
 #include <inttypes.h>
 #include <stdarg.h>
+#include <stddef.h>
 #include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 
+#include <pthread.h>
+
 #ifdef _WIN32
 #	include <winsock2.h>
 #else /* !_WIN32 */
@@ -64,6 +67,58 @@
 #define ARRAY_SIZE(x) (sizeof(x) / sizeof((x)[0]))
 
 
+/* Number of cached slice data templates, see h264_writer.c */
+#define H264_SLICE_TEMPLATE_COUNT 4
+
+
+/* Largest picture whose slice data can be parsed or written, in macroblocks
+ * (16384x16384 pixels, 128 MiB of macroblock table); larger parameter sets
+ * are still accepted */
+#define H264_MB_TABLE_MAX_LEN (1024 * 1024)
+
+
+/* Slice data of a generated (grey I or skipped P) slice: RBSP bits after
+ * cabac_alignment_one_bit if CABAC, before rbsp_trailing_bits if CAVLC */
+struct h264_slice_template {
+	/* Key */
+	int grey_i;
+	enum h264_slice_type slice_type;
+	uint32_t pic_parameter_set_id;
+	uint32_t first_mb_in_slice;
+	uint32_t mb_count;
+	int32_t SliceQPLuma;
+	uint32_t cabac_init_idc;
+
+	/* Data, NULL if the template is not used */
+	uint8_t *data;
+	size_t bits;
+};
+
+
+/* Lists of the current slice header that may hold data from a previous
+ * slice and must be cleared with the next one */
+#define H264_SLICE_HDR_LIST_RPLM (1u << 0)
+#define H264_SLICE_HDR_LIST_PWT (1u << 1)
+#define H264_SLICE_HDR_LIST_DRPM (1u << 2)
+#define H264_SLICE_HDR_LIST_ALL                                                \
+	(H264_SLICE_HDR_LIST_RPLM | H264_SLICE_HDR_LIST_PWT |                  \
+	 H264_SLICE_HDR_LIST_DRPM)
+
+
+/* Slice header fields used for the detection of the first VCL NAL unit of a
+ * primary coded picture (7.4.1.2.4) */
+struct h264_slice_hdr_core {
+	uint32_t pic_parameter_set_id;
+	uint32_t frame_num;
+	int field_pic_flag;
+	int bottom_field_flag;
+	uint32_t idr_pic_id;
+	uint32_t pic_order_cnt_lsb;
+	int32_t delta_pic_order_cnt_bottom;
+	int32_t delta_pic_order_cnt[2];
+};
+
+
 struct h264_ctx {
 	struct {
 		enum h264_nalu_type type;
@@ -74,6 +129,15 @@ struct h264_ctx {
 		int is_prev_filler;
 	} nalu;
 
+	/* Current access unit, for H264_READER_FLAGS_EARLY_AU_END; not
+	 * cleared between NAL units */
+	struct {
+		/* Macroblocks parsed in the primary coded picture */
+		uint32_t mb_count;
+		/* The au_end() callback function has already been called */
+		int ended;
+	} au;
+
 	struct h264_aud aud;
 
 	struct h264_sps *sps;
@@ -84,12 +148,24 @@ struct h264_ctx {
 
 	struct h264_sei *sei_table;
 	uint32_t sei_count;
+	uint32_t sei_table_size;
+
+	/* SEI raw buffers, reset with the SEI table */
+	struct h264_arena *sei_arena;
+
+	/* Buffer in which h264_ctx_add_sei() encodes the SEI payloads before
+	 * copying them in the SEI arena, kept for reuse */
+	struct {
+		uint8_t *buf;
+		size_t size;
+	} sei_scratch;
 
 	size_t filler_len;
 
 	struct {
 		enum h264_slice_type type;
 		struct h264_slice_header hdr;
+		uint32_t hdr_lists;
 		size_t hdr_len;
 		struct h264_slice_header saved_hdr;
 		struct {
@@ -99,24 +175,54 @@ struct h264_ctx {
 			size_t len;
 		} rawdata;
 
+		/* Macroblocks parsed in the slice data */
+		uint32_t mb_count;
+
+		/* Picture-wide, indexed by mbAddr; allocated with the first
+		 * slice data of the active SPS, not cleared between slices */
 		struct {
 			struct h264_macroblock_info *info;
 			size_t len;
-			size_t maxlen;
+			void *buf;
+			uint32_t slice_id;
 		} mb_table;
 
-		/* Count is PicSizeInMapUnits */
+		/* Slice group of each map unit (count is PicSizeInMapUnits)
+		 * and next macroblock of the same slice group for each
+		 * macroblock (count is PicSizeInMbs); kept between slices
+		 * while the key matches, cleared when a SPS or PPS changes */
 		uint32_t *group_map;
 		size_t group_map_maxlen;
+		uint32_t *group_next_mb;
+		size_t group_next_mb_maxlen;
+		struct {
+			int valid;
+			uint32_t pps_id;
+			uint32_t slice_group_change_cycle;
+			int field_pic_flag;
+			int MbaffFrameFlag;
+		} group_map_key;
 
 		/* For AU change detection */
 		struct h264_nalu_header prev_slice_nalu_hdr;
-		struct h264_slice_header prev_slice_hdr;
+		struct h264_slice_hdr_core prev_slice_hdr;
 	} slice;
 
 	struct h264_macroblock _mb;
 	struct h264_macroblock *mb;
 
+	/* CABAC slice data parsing */
+	struct h264_cabac cabac;
+
+	/* Kept when the context is cleared */
+	struct h264_cabac_init_cache cabac_init_cache;
+
+	/* Cleared when a SPS or PPS changes */
+	struct {
+		struct h264_slice_template entries[H264_SLICE_TEMPLATE_COUNT];
+		uint32_t next;
+	} slice_templates;
+
 	struct h264_sps_derived sps_derived;
 
 	struct {
@@ -140,6 +246,12 @@ struct h264_ctx {
 };
 
 
+int h264_ctx_store_sps(struct h264_ctx *ctx, const struct h264_sps *sps);
+
+
+int h264_ctx_store_pps(struct h264_ctx *ctx, const struct h264_pps *pps);
+
+
 int h264_ctx_set_active_sps(struct h264_ctx *ctx, uint32_t sps_id);
 
 
@@ -155,6 +267,30 @@ int h264_ctx_add_sei_internal(struct h264_ctx *ctx, struct h264_sei **ret_obj);
 int h264_ctx_clear_slice(struct h264_ctx *ctx);
 
 
+int h264_ctx_update_slice(struct h264_ctx *ctx);
+
+
+int h264_ctx_is_au_complete(struct h264_ctx *ctx);
+
+
+int h264_ctx_is_first_vcl_nalu(struct h264_ctx *ctx,
+			       const struct h264_sps *sps,
+			       const struct h264_nalu_header *nh,
+			       const struct h264_slice_hdr_core *sh);
+
+
+int h264_ctx_is_au_start(const struct h264_ctx *ctx,
+			 enum h264_nalu_type type,
+			 int is_first_vcl);
+
+
+void h264_ctx_set_prev_nalu_type(struct h264_ctx *ctx,
+				 enum h264_nalu_type type);
+
+
+void h264_ctx_clear_slice_templates(struct h264_ctx *ctx);
+
+
 int h264_get_info_from_ps(struct h264_sps *sps,
 			  struct h264_pps *pps,
 			  struct h264_sps_derived *sps_derived,
@@ -169,6 +305,55 @@ int h264_write_one_sei(struct h264_bitstream *bs,
 int h264_sei_update_internal_buf(struct h264_sei *sei);
 
 
+/* Memory arena: allocations are released all at once by h264_arena_reset(),
+ * which keeps the memory for reuse */
+int h264_arena_new(size_t block_size, struct h264_arena **ret_obj);
+
+
+int h264_arena_destroy(struct h264_arena *arena);
+
+
+int h264_arena_reset(struct h264_arena *arena);
+
+
+void *h264_arena_alloc(struct h264_arena *arena, size_t size);
+
+
+size_t h264_bs_unescape(const uint8_t *buf,
+			size_t len,
+			uint8_t *rbsp,
+			size_t *esc,
+			size_t *esc_count);
+
+
+int h264_bs_read_bytes(struct h264_bitstream *bs, uint8_t *buf, size_t len);
+
+
+int h264_bs_ref_bytes(struct h264_bitstream *bs,
+		      size_t len,
+		      const uint8_t **ref);
+
+
+int h264_bs_write_bytes(struct h264_bitstream *bs,
+			const uint8_t *buf,
+			size_t len);
+
+
+int h264_bs_write_ff_bytes(struct h264_bitstream *bs, size_t count);
+
+
+size_t h264_bs_skip_ff_bytes(struct h264_bitstream *bs);
+
+
+int h264_find_start_code(const uint8_t *buf,
+			 size_t len,
+			 size_t *start,
+			 size_t *end);
+
+
+int h264_find_end_code(const uint8_t *buf, size_t len, size_t *end);
+
+
 int h264_gen_slice_group_map(struct h264_ctx *ctx);
 
 
@@ -193,11 +378,17 @@ static inline uint32_t h264_intlog2(uint32_t x)
 }
 
 
-static inline uint32_t h264_get_mb_addr_off(struct h264_ctx *ctx,
-					    uint32_t mbAddr)
+/* Count leading zero bits, x must not be 0 */
+static inline uint32_t h264_clz64(uint64_t x)
+{
+	return __builtin_clzll(x);
+}
+
+
+static inline struct h264_macroblock_info *
+h264_get_mb_info(struct h264_ctx *ctx, uint32_t mbAddr)
 {
-	return mbAddr - ctx->slice.hdr.first_mb_in_slice *
-				(1 + ctx->derived.MbaffFrameFlag);
+	return &ctx->slice.mb_table.info[mbAddr];
 }
 
 
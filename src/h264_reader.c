@@ -27,15 +27,139 @@
 #include "h264_priv.h"
 
 
+/* Number of NAL unit boundaries searched at once by h264_reader_parse() */
+#define H264_READER_NALU_BATCH 16
+
+/* Default maximum length of the unfinished NAL unit kept between two
+ * h264_reader_push() calls */
+#define H264_READER_STREAM_MAX_LEN (4 * 1024 * 1024)
+
+
 struct h264_reader {
 	struct h264_ctx_cbs cbs;
 	void *userdata;
 	int stop;
 	struct h264_ctx *ctx;
 	uint32_t flags;
+
+	/* NAL unit converted to RBSP (H264_READER_FLAGS_UNESCAPE) */
+	struct {
+		/* Original NAL unit, NULL if not unescaped */
+		const uint8_t *nalu;
+		size_t nalu_len;
+		uint8_t *buf;
+		size_t len;
+		size_t size;
+		/* RBSP offsets following each removed emulation prevention
+		 * byte, in increasing order */
+		size_t *esc;
+		size_t esc_count;
+		size_t esc_size;
+	} rbsp;
+
+	/* Data kept between two h264_reader_push() calls */
+	struct {
+		/* Unfinished NAL unit, without its start code */
+		int in_nalu;
+		uint8_t *buf;
+		size_t len;
+		size_t size;
+		size_t max_len;
+		/* The unfinished NAL unit is too long and is dropped; only its
+		 * last 2 bytes are kept for the end code detection */
+		int overflow;
+		/* Outside of a NAL unit, last bytes of the previous buffer,
+		 * where a start code may begin */
+		uint8_t prefix[3];
+		size_t prefix_len;
+	} stream;
 };
 
 
+/**
+ * Get the offset in the original NAL unit of the current position of the
+ * bitstream; when the NAL unit has been unescaped, add the number of
+ * emulation prevention bytes removed before the current RBSP offset.
+ */
+static size_t h264_reader_get_raw_off(const struct h264_bitstream *bs)
+{
+	const struct h264_reader *reader = bs->priv;
+	size_t lo = 0, hi = 0, mid = 0;
+
+	if (reader->rbsp.nalu == NULL)
+		return bs->off;
+
+	hi = reader->rbsp.esc_count;
+	while (lo < hi) {
+		mid = (lo + hi) / 2;
+		if (reader->rbsp.esc[mid] < bs->off)
+			lo = mid + 1;
+		else
+			hi = mid;
+	}
+
+	return bs->off + lo;
+}
+
+
+/**
+ * Get the original NAL unit data
+ */
+static const uint8_t *h264_reader_get_raw_buf(const struct h264_bitstream *bs,
+					      size_t *len)
+{
+	const struct h264_reader *reader = bs->priv;
+
+	if (reader->rbsp.nalu == NULL) {
+		*len = bs->len;
+		return bs->cdata;
+	}
+
+	*len = reader->rbsp.nalu_len;
+	return reader->rbsp.nalu;
+}
+
+
+/**
+ * Reference bytes of the bitstream in the original NAL unit data, see
+ * h264_bs_ref_bytes(); when the NAL unit has been unescaped, the bytes are
+ * only referenced if no emulation prevention byte was removed among them.
+ */
+static int h264_reader_ref_bytes(struct h264_bitstream *bs,
+				 size_t len,
+				 const uint8_t **ref)
+{
+	const struct h264_reader *reader = bs->priv;
+	size_t lo = 0, hi = 0, mid = 0;
+
+	if (reader->rbsp.nalu == NULL)
+		return h264_bs_ref_bytes(bs, len, ref);
+
+	*ref = NULL;
+	if (bs->cachebits != 0)
+		return 0;
+	if (bs->len - bs->off < len)
+		return -EIO;
+
+	/* Emulation prevention bytes removed before the first byte */
+	hi = reader->rbsp.esc_count;
+	while (lo < hi) {
+		mid = (lo + hi) / 2;
+		if (reader->rbsp.esc[mid] <= bs->off)
+			lo = mid + 1;
+		else
+			hi = mid;
+	}
+	if (lo < reader->rbsp.esc_count &&
+	    reader->rbsp.esc[lo] < bs->off + len)
+		return 0;
+
+	*ref = reader->rbsp.nalu + bs->off + lo;
+	bs->off += len;
+	return 0;
+}
+
+
 #define H264_SYNTAX_OP_NAME read
 #define H264_SYNTAX_OP_KIND H264_SYNTAX_OP_KIND_READ
 
@@ -74,6 +198,7 @@ int h264_reader_new(const struct h264_ctx_cbs *cbs,
 	/* Initialize structure */
 	reader->cbs = *cbs;
 	reader->userdata = userdata;
+	reader->stream.max_len = H264_READER_STREAM_MAX_LEN;
 	res = h264_ctx_new(&reader->ctx);
 	if (res < 0)
 		goto error;
@@ -95,6 +220,9 @@ int h264_reader_destroy(struct h264_reader *reader)
 		return 0;
 	if (reader->ctx != NULL)
 		h264_ctx_destroy(reader->ctx);
+	free(reader->rbsp.buf);
+	free(reader->rbsp.esc);
+	free(reader->stream.buf);
 	free(reader);
 	return 0;
 }
@@ -114,6 +242,47 @@ int h264_reader_stop(struct h264_reader *reader)
 }
 
 
+int h264_reader_set_stream_max_len(struct h264_reader *reader,
+				   size_t max_len)
+{
+	ULOG_ERRNO_RETURN_ERR_IF(reader == NULL, EINVAL);
+	ULOG_ERRNO_RETURN_ERR_IF(max_len == 0, EINVAL);
+	reader->stream.max_len = max_len;
+	return 0;
+}
+
+
+static void h264_reader_stream_end_nalu(struct h264_reader *reader,
+					uint32_t flags);
+
+
+int h264_reader_flush(struct h264_reader *reader)
+{
+	struct h264_ctx *ctx = NULL;
+
+	ULOG_ERRNO_RETURN_ERR_IF(reader == NULL, EINVAL);
+	ctx = reader->ctx;
+
+	/* The unfinished NAL unit of h264_reader_push() ends with the
+	 * stream */
+	if (reader->stream.in_nalu)
+		h264_reader_stream_end_nalu(reader, reader->flags);
+	reader->stream.prefix_len = 0;
+
+	/* An access unit is pending if VCL NAL units (possibly followed by
+	 * filler data) have been parsed since the last AU change */
+	if ((ctx->nalu.is_prev_vcl || ctx->nalu.is_prev_filler) &&
+	    !ctx->au.ended && reader->cbs.au_end != NULL)
+		(*reader->cbs.au_end)(ctx, reader->userdata);
+
+	ctx->nalu.is_prev_vcl = 0;
+	ctx->nalu.is_prev_filler = 0;
+	ctx->au.mb_count = 0;
+	ctx->au.ended = 0;
+	return 0;
+}
+
+
 int h264_reader_parse(struct h264_reader *reader,
 		      uint32_t flags,
 		      const uint8_t *buf,
@@ -121,7 +290,10 @@ int h264_reader_parse(struct h264_reader *reader,
 		      size_t *off)
 {
 	int res = 0;
-	size_t start = 0, end = 0;
+	size_t base = 0;
+	size_t count = 0;
+	size_t i = 0;
+	struct h264_nalu_info nalus[H264_READER_NALU_BATCH];
 
 	ULOG_ERRNO_RETURN_ERR_IF(reader == NULL, EINVAL);
 	ULOG_ERRNO_RETURN_ERR_IF(buf == NULL, EINVAL);
@@ -131,14 +303,365 @@ int h264_reader_parse(struct h264_reader *reader,
 	*off = 0;
 
 	while (*off < len && !reader->stop) {
-		res = h264_find_nalu(buf + *off, len - *off, &start, &end);
-		if (res < 0 && res != -EAGAIN)
+		/* Find the boundaries of the next batch of NAL units */
+		base = *off;
+		res = h264_find_nalus(buf + base,
+				      len - base,
+				      nalus,
+				      ARRAY_SIZE(nalus),
+				      &count);
+		if (res < 0 || count == 0)
 			break;
+
+		for (i = 0; i < count && !reader->stop; i++) {
+			h264_reader_parse_nalu(reader,
+					       flags,
+					       buf + base + nalus[i].off,
+					       nalus[i].len);
+			*off = base + nalus[i].off + nalus[i].len;
+		}
+	}
+
+	return 0;
+}
+
+
+static int h264_reader_stream_grow(struct h264_reader *reader, size_t size)
+{
+	uint8_t *newbuf = NULL;
+
+	if (size <= reader->stream.size)
+		return 0;
+	size = Max(size,
+		   Min(2 * reader->stream.size, reader->stream.max_len));
+	newbuf = realloc(reader->stream.buf, size);
+	if (newbuf == NULL)
+		return -ENOMEM;
+	reader->stream.buf = newbuf;
+	reader->stream.size = size;
+	return 0;
+}
+
+
+/**
+ * Append data to the unfinished NAL unit; if it becomes too long, it is
+ * dropped and only its last 2 bytes are kept until its end is found.
+ */
+static int h264_reader_stream_append(struct h264_reader *reader,
+				     const uint8_t *buf,
+				     size_t len)
+{
+	int res = 0;
+	size_t keep = 0;
+
+	if (len == 0)
+		return 0;
+
+	if (!reader->stream.overflow &&
+	    len <= reader->stream.max_len - reader->stream.len) {
+		res = h264_reader_stream_grow(reader, reader->stream.len + len);
+		if (res == 0) {
+			memcpy(reader->stream.buf + reader->stream.len,
+			       buf,
+			       len);
+			reader->stream.len += len;
+			return 0;
+		}
+	}
+
+	if (!reader->stream.overflow) {
+		if (res == 0) {
+			res = -ENOBUFS;
+			ULOGE("unfinished NAL unit longer than %zu bytes, "
+			      "dropped",
+			      reader->stream.max_len);
+		} else {
+			ULOG_ERRNO("h264_reader_stream_grow", -res);
+		}
+		reader->stream.overflow = 1;
+	}
+
+	if (h264_reader_stream_grow(reader, 2) < 0) {
+		/* Lose the end code detection across buffers */
+		reader->stream.len = 0;
+		return res;
+	}
+	if (len >= 2) {
+		memcpy(reader->stream.buf, buf + len - 2, 2);
+		reader->stream.len = 2;
+		return res;
+	}
+	if (reader->stream.len + len > 2) {
+		keep = 2 - len;
+		memmove(reader->stream.buf,
+			reader->stream.buf + reader->stream.len - keep,
+			keep);
+		reader->stream.len = keep;
+	}
+	memcpy(reader->stream.buf + reader->stream.len, buf, len);
+	reader->stream.len += len;
+	return res;
+}
+
+
+/**
+ * The end of the unfinished NAL unit has been found: parse it, unless it
+ * has been dropped or is empty.
+ */
+static void h264_reader_stream_end_nalu(struct h264_reader *reader,
+					uint32_t flags)
+{
+	if (!reader->stream.overflow && reader->stream.len > 0) {
 		h264_reader_parse_nalu(
-			reader, flags, buf + *off + start, end - start);
-		*off += end;
+			reader, flags, reader->stream.buf, reader->stream.len);
+	}
+	reader->stream.in_nalu = 0;
+	reader->stream.len = 0;
+	reader->stream.overflow = 0;
+}
+
+
+/**
+ * Keep the last bytes (at most 3) before the next start code.
+ */
+static void h264_reader_stream_keep(struct h264_reader *reader,
+				    const uint8_t *buf,
+				    size_t len)
+{
+	uint8_t *prefix = reader->stream.prefix;
+	size_t n = reader->stream.prefix_len;
+
+	if (len >= sizeof(reader->stream.prefix)) {
+		n = sizeof(reader->stream.prefix);
+		memcpy(prefix, buf + len - n, n);
+		reader->stream.prefix_len = n;
+		return;
 	}
+	if (n + len > sizeof(reader->stream.prefix)) {
+		memmove(prefix,
+			prefix + n + len - sizeof(reader->stream.prefix),
+			sizeof(reader->stream.prefix) - len);
+		n = sizeof(reader->stream.prefix) - len;
+	}
+	memcpy(prefix + n, buf, len);
+	reader->stream.prefix_len = n + len;
+}
 
+
+/**
+ * NAL unit starting at the beginning of the buffer (its start code has
+ * already been found): parse it without copy if its end is in the buffer,
+ * otherwise it becomes the unfinished NAL unit.
+ */
+static int h264_reader_stream_nalu(struct h264_reader *reader,
+				   uint32_t flags,
+				   const uint8_t *buf,
+				   size_t len,
+				   size_t *used)
+{
+	size_t end = 0;
+
+	if (h264_find_end_code(buf, len, &end) == 0) {
+		if (end > 0)
+			h264_reader_parse_nalu(reader, flags, buf, end);
+		*used = end;
+		return 0;
+	}
+
+	reader->stream.in_nalu = 1;
+	*used = len;
+	return h264_reader_stream_append(reader, buf, len);
+}
+
+
+/**
+ * Look for the end of the unfinished NAL unit; the end code can begin in
+ * its last 2 bytes.
+ */
+static int h264_reader_stream_finish(struct h264_reader *reader,
+				     uint32_t flags,
+				     const uint8_t *buf,
+				     size_t len,
+				     size_t *used)
+{
+	int res = 0;
+	uint8_t win[5];
+	size_t k = Min(reader->stream.len, 2);
+	size_t n = Min(len, 3);
+	size_t end = 0;
+
+	if (k > 0)
+		memcpy(win, reader->stream.buf + reader->stream.len - k, k);
+	memcpy(win + k, buf, n);
+	if (h264_find_end_code(win, k + n, &end) == 0 && end < k) {
+		/* The end code begins in the unfinished NAL unit, keep its
+		 * first bytes to find the next start code */
+		reader->stream.len -= k - end;
+		h264_reader_stream_end_nalu(reader, flags);
+		memcpy(reader->stream.prefix, win + end, k - end);
+		reader->stream.prefix_len = k - end;
+		*used = 0;
+		return 0;
+	}
+
+	if (h264_find_end_code(buf, len, &end) < 0) {
+		/* The NAL unit continues in the next buffer */
+		*used = len;
+		return h264_reader_stream_append(reader, buf, len);
+	}
+
+	res = h264_reader_stream_append(reader, buf, end);
+	h264_reader_stream_end_nalu(reader, flags);
+	*used = end;
+	return res;
+}
+
+
+/**
+ * Look for a start code beginning in the bytes kept from the previous
+ * buffer; start codes entirely in the buffer are left to h264_find_nalus().
+ */
+static int h264_reader_stream_start(struct h264_reader *reader,
+				    uint32_t flags,
+				    const uint8_t *buf,
+				    size_t len,
+				    size_t *used)
+{
+	int res = 0;
+	uint8_t win[6];
+	size_t k = reader->stream.prefix_len;
+	size_t n = Min(len, 3);
+	size_t start = 0, end = 0, nalu_used = 0;
+
+	*used = 0;
+	if (k == 0)
+		return 0;
+
+	memcpy(win, reader->stream.prefix, k);
+	memcpy(win + k, buf, n);
+	res = h264_find_start_code(win, k + n, &start, &end);
+	if (res < 0 || start >= k)
+		return 0;
+
+	reader->stream.prefix_len = 0;
+	res = h264_reader_stream_nalu(
+		reader, flags, buf + end - k, len - (end - k), &nalu_used);
+	*used = end - k + nalu_used;
+	return res;
+}
+
+
+int h264_reader_push(struct h264_reader *reader,
+		     uint32_t flags,
+		     const uint8_t *buf,
+		     size_t len,
+		     size_t *off)
+{
+	int res = 0, err = 0;
+	size_t pos = 0, used = 0;
+	size_t base = 0;
+	size_t count = 0;
+	size_t i = 0;
+	struct h264_nalu_info nalus[H264_READER_NALU_BATCH];
+
+	ULOG_ERRNO_RETURN_ERR_IF(reader == NULL, EINVAL);
+	ULOG_ERRNO_RETURN_ERR_IF(buf == NULL, EINVAL);
+	ULOG_ERRNO_RETURN_ERR_IF(off == NULL, EINVAL);
+
+	reader->stop = 0;
+	reader->flags = flags;
+	*off = 0;
+	if (len == 0)
+		return 0;
+
+	/* Finish the unfinished NAL unit or start code of the previous
+	 * buffer */
+	if (reader->stream.in_nalu) {
+		res = h264_reader_stream_finish(reader, flags, buf, len, &used);
+		err = res < 0 ? res : err;
+		pos += used;
+	}
+	if (!reader->stream.in_nalu && !reader->stop && pos < len) {
+		res = h264_reader_stream_start(
+			reader, flags, buf + pos, len - pos, &used);
+		err = res < 0 ? res : err;
+		pos += used;
+	}
+
+	/* Complete NAL units are parsed without copy */
+	while (pos < len && !reader->stop && !reader->stream.in_nalu) {
+		base = pos;
+		res = h264_find_nalus(buf + base,
+				      len - base,
+				      nalus,
+				      ARRAY_SIZE(nalus),
+				      &count);
+		if (res < 0)
+			break;
+		if (count == 0) {
+			h264_reader_stream_keep(reader, buf + base, len - base);
+			pos = len;
+			break;
+		}
+
+		reader->stream.prefix_len = 0;
+		for (i = 0; i < count && !reader->stop; i++) {
+			if (!nalus[i].complete) {
+				reader->stream.in_nalu = 1;
+				res = h264_reader_stream_append(
+					reader,
+					buf + base + nalus[i].off,
+					nalus[i].len);
+				err = res < 0 ? res : err;
+				pos = len;
+				break;
+			}
+			if (nalus[i].len > 0) {
+				h264_reader_parse_nalu(
+					reader,
+					flags,
+					buf + base + nalus[i].off,
+					nalus[i].len);
+			}
+			pos = base + nalus[i].off + nalus[i].len;
+		}
+	}
+
+	*off = pos;
+	return err;
+}
+
+
+static int h264_reader_unescape(struct h264_reader *reader,
+				const uint8_t *buf,
+				size_t len)
+{
+	uint8_t *newbuf = NULL;
+	size_t *newesc = NULL;
+
+	/* Grow the scratch buffers if needed */
+	if (len > reader->rbsp.size) {
+		newbuf = realloc(reader->rbsp.buf, len);
+		if (newbuf == NULL)
+			return -ENOMEM;
+		reader->rbsp.buf = newbuf;
+		reader->rbsp.size = len;
+	}
+	if (len / 3 > reader->rbsp.esc_size) {
+		newesc = realloc(reader->rbsp.esc, len / 3 * sizeof(*newesc));
+		if (newesc == NULL)
+			return -ENOMEM;
+		reader->rbsp.esc = newesc;
+		reader->rbsp.esc_size = len / 3;
+	}
+
+	reader->rbsp.len = h264_bs_unescape(buf,
+					    len,
+					    reader->rbsp.buf,
+					    reader->rbsp.esc,
+					    &reader->rbsp.esc_count);
+	reader->rbsp.nalu = buf;
+	reader->rbsp.nalu_len = len;
 	return 0;
 }
 
@@ -154,9 +677,218 @@ int h264_reader_parse_nalu(struct h264_reader *reader,
 	ULOG_ERRNO_RETURN_ERR_IF(buf == NULL, EINVAL);
 	reader->stop = 0;
 	reader->flags = flags;
-	h264_bs_cinit(&bs, buf, len, 1);
+	if (flags & H264_READER_FLAGS_UNESCAPE) {
+		res = h264_reader_unescape(reader, buf, len);
+		ULOG_ERRNO_RETURN_ERR_IF(res < 0, -res);
+		h264_bs_cinit(&bs, reader->rbsp.buf, reader->rbsp.len, 0);
+	} else {
+		h264_bs_cinit(&bs, buf, len, 1);
+	}
 	bs.priv = reader;
 	res = _h264_read_nalu(&bs, reader->ctx, &reader->cbs, reader->userdata);
+	h264_bs_clear(&bs);
+	reader->rbsp.nalu = NULL;
+	reader->rbsp.nalu_len = 0;
+	return res;
+}
+
+
+/**
+ * 7.3.3 Slice header syntax, up to the fields used by 7.4.1.2.4
+ */
+static int h264_reader_peek_slice_header(struct h264_bitstream *bs,
+					 struct h264_ctx *ctx,
+					 const struct h264_nalu_header *nh,
+					 struct h264_nalu_peek *info)
+{
+	int res = 0;
+	uint32_t v = 0;
+	const struct h264_pps *pps = NULL;
+	const struct h264_sps *sps = NULL;
+	struct h264_slice_hdr_core core;
+
+	memset(&core, 0, sizeof(core));
+
+	res = h264_bs_read_bits_ue(bs, &info->first_mb_in_slice);
+	if (res < 0)
+		return res;
+	res = h264_bs_read_bits_ue(bs, &info->slice_type);
+	if (res < 0)
+		return res;
+	res = h264_bs_read_bits_ue(bs, &core.pic_parameter_set_id);
+	if (res < 0)
+		return res;
+	info->pic_parameter_set_id = core.pic_parameter_set_id;
+
+	ULOG_ERRNO_RETURN_ERR_IF(
+		core.pic_parameter_set_id >= ARRAY_SIZE(ctx->pps_table),
+		EINVAL);
+	pps = ctx->pps_table[core.pic_parameter_set_id];
+	ULOG_ERRNO_RETURN_ERR_IF(pps == NULL, EINVAL);
+	ULOG_ERRNO_RETURN_ERR_IF(
+		pps->seq_parameter_set_id >= ARRAY_SIZE(ctx->sps_table),
+		EINVAL);
+	sps = ctx->sps_table[pps->seq_parameter_set_id];
+	ULOG_ERRNO_RETURN_ERR_IF(sps == NULL, EINVAL);
+
+	if (sps->separate_colour_plane_flag) {
+		res = h264_bs_read_bits(bs, &v, 2);
+		if (res < 0)
+			return res;
+	}
+
+	res = h264_bs_read_bits(
+		bs, &core.frame_num, sps->log2_max_frame_num_minus4 + 4);
+	if (res < 0)
+		return res;
+	info->frame_num = core.frame_num;
+
+	if (!sps->frame_mbs_only_flag) {
+		res = h264_bs_read_bits(bs, &v, 1);
+		if (res < 0)
+			return res;
+		core.field_pic_flag = v;
+		if (core.field_pic_flag) {
+			res = h264_bs_read_bits(bs, &v, 1);
+			if (res < 0)
+				return res;
+			core.bottom_field_flag = v;
+		}
+	}
+
+	if (info->idr) {
+		res = h264_bs_read_bits_ue(bs, &core.idr_pic_id);
+		if (res < 0)
+			return res;
+	}
+
+	if (sps->pic_order_cnt_type == 0) {
+		res = h264_bs_read_bits(
+			bs,
+			&core.pic_order_cnt_lsb,
+			sps->log2_max_pic_order_cnt_lsb_minus4 + 4);
+		if (res < 0)
+			return res;
+		if (pps->bottom_field_pic_order_in_frame_present_flag &&
+		    !core.field_pic_flag) {
+			res = h264_bs_read_bits_se(
+				bs, &core.delta_pic_order_cnt_bottom);
+			if (res < 0)
+				return res;
+		}
+	}
+
+	if (sps->pic_order_cnt_type == 1 &&
+	    !sps->delta_pic_order_always_zero_flag) {
+		res = h264_bs_read_bits_se(bs, &core.delta_pic_order_cnt[0]);
+		if (res < 0)
+			return res;
+		if (pps->bottom_field_pic_order_in_frame_present_flag &&
+		    !core.field_pic_flag) {
+			res = h264_bs_read_bits_se(
+				bs, &core.delta_pic_order_cnt[1]);
+			if (res < 0)
+				return res;
+		}
+	}
+
+	info->first_vcl = h264_ctx_is_first_vcl_nalu(ctx, sps, nh, &core);
+	return 0;
+}
+
+
+/**
+ * Store the parameter sets of a SPS or PPS NAL unit in the context, without
+ * calling the callback functions nor changing the active parameter sets
+ */
+static int h264_reader_peek_ps(struct h264_bitstream *bs,
+			       struct h264_ctx *ctx,
+			       const struct h264_nalu_header *nh)
+{
+	int res = 0;
+	struct h264_sps sps;
+	struct h264_pps pps;
+	struct h264_bitstream ids = *bs;
+	uint32_t pps_id = 0, sps_id = 0;
+
+	ULOG_ERRNO_RETURN_ERR_IF(nh->nal_ref_idc == 0, EIO);
+
+	if (nh->nal_unit_type == H264_NALU_TYPE_SPS) {
+		memset(&sps, 0, sizeof(sps));
+		/* 7.4.2.1.1 Sequence parameter set data semantics */
+		sps.chroma_format_idc = 1;
+		res = _h264_read_sps(bs, &sps);
+		if (res < 0)
+			return res;
+		return h264_ctx_store_sps(ctx, &sps);
+	}
+
+	/* The SPS referred to by the PPS, without activating it */
+	res = h264_bs_read_bits_ue(&ids, &pps_id);
+	if (res < 0)
+		return res;
+	res = h264_bs_read_bits_ue(&ids, &sps_id);
+	if (res < 0)
+		return res;
+	ULOG_ERRNO_RETURN_ERR_IF(sps_id >= ARRAY_SIZE(ctx->sps_table), EIO);
+	ULOG_ERRNO_RETURN_ERR_IF(ctx->sps_table[sps_id] == NULL, EIO);
+
+	memset(&pps, 0, sizeof(pps));
+	res = _h264_read_pps_with_sps(bs, ctx->sps_table[sps_id], &pps);
+	if (res < 0)
+		return res;
+	return h264_ctx_store_pps(ctx, &pps);
+}
+
+
+int h264_reader_peek_nalu(struct h264_reader *reader,
+			  const uint8_t *buf,
+			  size_t len,
+			  struct h264_nalu_peek *info)
+{
+	int res = 0;
+	struct h264_bitstream bs;
+	struct h264_nalu_header nh;
+	ULOG_ERRNO_RETURN_ERR_IF(reader == NULL, EINVAL);
+	ULOG_ERRNO_RETURN_ERR_IF(buf == NULL, EINVAL);
+	ULOG_ERRNO_RETURN_ERR_IF(info == NULL, EINVAL);
+	memset(info, 0, sizeof(*info));
+	memset(&nh, 0, sizeof(nh));
+
+	h264_bs_cinit(&bs, buf, len, 1);
+	res = _h264_read_nalu_header(&bs, &nh);
+	if (res < 0)
+		goto out;
+	info->type = nh.nal_unit_type;
+	info->nal_ref_idc = nh.nal_ref_idc;
+	info->idr = (info->type == H264_NALU_TYPE_SLICE_IDR);
+
+	switch (info->type) {
+	case H264_NALU_TYPE_SPS:
+	case H264_NALU_TYPE_PPS:
+		/* Needed to peek the following slices */
+		res = h264_reader_peek_ps(&bs, reader->ctx, &nh);
+		if (res < 0)
+			goto out;
+		break;
+
+	case H264_NALU_TYPE_SLICE:
+	case H264_NALU_TYPE_SLICE_IDR:
+		res = h264_reader_peek_slice_header(
+			&bs, reader->ctx, &nh, info);
+		if (res < 0)
+			goto out;
+		break;
+
+	default:
+		break;
+	}
+
+	info->au_start =
+		h264_ctx_is_au_start(reader->ctx, info->type, info->first_vcl);
+	h264_ctx_set_prev_nalu_type(reader->ctx, info->type);
+
+out:
 	h264_bs_clear(&bs);
 	return res;
 }
@@ -27,50 +27,6 @@
 #include "h264_priv.h"
 
 
-/**
- * Implementation of a read_vlc function with static parameters
- */
-#define _READ_VLC(_maxbits, _maxcode)                                          \
-	static int _h264_read_vlc_##_maxbits##_##_maxcode(                     \
-		struct h264_bitstream *bs,                                     \
-		const uint8_t(*table)[_maxbits + 1][_maxcode + 1],             \
-		uint32_t *code)                                                \
-	{                                                                      \
-		int res = 0;                                                   \
-		uint32_t bit = 0;                                              \
-		uint32_t numbits = 0;                                          \
-		uint32_t rawcode = 0;                                          \
-		while (numbits < _maxbits) {                                   \
-			/* Read one more bit */                                \
-			res = h264_bs_read_bits(bs, &bit, 1);                  \
-			ULOG_ERRNO_RETURN_ERR_IF(res < 0, -res);               \
-			rawcode = (rawcode << 1) | bit;                        \
-			numbits++;                                             \
-			ULOG_ERRNO_RETURN_ERR_IF(rawcode > _maxcode, EIO);     \
-			/* Are we done ? */                                    \
-			if ((*table)[numbits][rawcode] != 0) {                 \
-				*code = (*table)[numbits][rawcode];            \
-				return 0;                                      \
-			}                                                      \
-		}                                                              \
-		return -EIO;                                                   \
-	}
-
-
-/**
- * Call correct read_vlc function based on static parameters
- */
-#define READ_VLC(_table, _maxbits, _maxcode, _code)                            \
-	_h264_read_vlc_##_maxbits##_##_maxcode(bs, _table, _code)
-
-
-/* Declare all read_vlc functions with static parameters */
-_READ_VLC(16, 15)
-_READ_VLC(9, 7)
-_READ_VLC(3, 1)
-_READ_VLC(5, 7)
-_READ_VLC(11, 7)
-
 /* clang-format off */
 
 
@@ -833,6 +789,249 @@ static const uint8_t s_h264_run_before[8][12][8] = {
 /* clang-format on */
 
 
+/* VLC tables above, see enum h264_vlc_table */
+#define VLC_TABLE(_table, _maxbits, _maxcode)                                  \
+	{                                                                      \
+		&(_table)[0][0], _maxbits, _maxcode                            \
+	}
+
+static const struct {
+	/* table[numbits][code], 0 if no code */
+	const uint8_t *table;
+	uint8_t maxbits;
+	uint8_t maxcode;
+} s_h264_vlc_tables[H264_VLC_TABLE_COUNT] = {
+	/* coeff_token (Table 9-5) */
+	VLC_TABLE(s_h264_coeff_token_0, 16, 15),
+	VLC_TABLE(s_h264_coeff_token_1, 16, 15),
+	VLC_TABLE(s_h264_coeff_token_2, 16, 15),
+	VLC_TABLE(s_h264_coeff_token_3, 16, 15),
+	VLC_TABLE(s_h264_coeff_token_4, 16, 15),
+	/* total_zeros, 4x4 blocks (Tables 9-7 and 9-8) */
+	VLC_TABLE(s_h264_total_zeros_0[1], 9, 7),
+	VLC_TABLE(s_h264_total_zeros_0[2], 9, 7),
+	VLC_TABLE(s_h264_total_zeros_0[3], 9, 7),
+	VLC_TABLE(s_h264_total_zeros_0[4], 9, 7),
+	VLC_TABLE(s_h264_total_zeros_0[5], 9, 7),
+	VLC_TABLE(s_h264_total_zeros_0[6], 9, 7),
+	VLC_TABLE(s_h264_total_zeros_0[7], 9, 7),
+	VLC_TABLE(s_h264_total_zeros_0[8], 9, 7),
+	VLC_TABLE(s_h264_total_zeros_0[9], 9, 7),
+	VLC_TABLE(s_h264_total_zeros_0[10], 9, 7),
+	VLC_TABLE(s_h264_total_zeros_0[11], 9, 7),
+	VLC_TABLE(s_h264_total_zeros_0[12], 9, 7),
+	VLC_TABLE(s_h264_total_zeros_0[13], 9, 7),
+	VLC_TABLE(s_h264_total_zeros_0[14], 9, 7),
+	VLC_TABLE(s_h264_total_zeros_0[15], 9, 7),
+	/* total_zeros, chroma DC 2x2 (Table 9-9a) */
+	VLC_TABLE(s_h264_total_zeros_1[1], 3, 1),
+	VLC_TABLE(s_h264_total_zeros_1[2], 3, 1),
+	VLC_TABLE(s_h264_total_zeros_1[3], 3, 1),
+	/* total_zeros, chroma DC 2x4 (Table 9-9b) */
+	VLC_TABLE(s_h264_total_zeros_2[1], 5, 7),
+	VLC_TABLE(s_h264_total_zeros_2[2], 5, 7),
+	VLC_TABLE(s_h264_total_zeros_2[3], 5, 7),
+	VLC_TABLE(s_h264_total_zeros_2[4], 5, 7),
+	VLC_TABLE(s_h264_total_zeros_2[5], 5, 7),
+	VLC_TABLE(s_h264_total_zeros_2[6], 5, 7),
+	VLC_TABLE(s_h264_total_zeros_2[7], 5, 7),
+	/* run_before (Table 9-10) */
+	VLC_TABLE(s_h264_run_before[1], 11, 7),
+	VLC_TABLE(s_h264_run_before[2], 11, 7),
+	VLC_TABLE(s_h264_run_before[3], 11, 7),
+	VLC_TABLE(s_h264_run_before[4], 11, 7),
+	VLC_TABLE(s_h264_run_before[5], 11, 7),
+	VLC_TABLE(s_h264_run_before[6], 11, 7),
+	VLC_TABLE(s_h264_run_before[7], 11, 7),
+};
+
+
+/**
+ * Multi-bit lookup tables for the VLC tables above, built once by
+ * h264_vlc_lut_init(). The first level is indexed by the next 8 bits of the
+ * stream; codes longer than 8 bits go through a second level table indexed
+ * by the following 8 bits. An entry is either 0 (invalid code), a leaf
+ * holding the code length and the table value, or the index of a second
+ * level table (H264_VLC_SUB).
+ */
+#define H264_VLC_BITS 8
+#define H264_VLC_SUB 0x8000
+#define H264_VLC_LEAF(_len, _val) (((_len) << 8) | (_val))
+#define H264_VLC_MAX_SUB 32
+
+static uint16_t s_h264_vlc_lut[H264_VLC_TABLE_COUNT][1 << H264_VLC_BITS];
+static uint16_t s_h264_vlc_sub_lut[H264_VLC_MAX_SUB][1 << H264_VLC_BITS];
+static uint32_t s_h264_vlc_sub_count;
+
+/* Set once all the lookup tables are built; codes are decoded bit by bit
+ * otherwise */
+static int s_h264_vlc_lut_ready;
+static pthread_once_t s_h264_vlc_lut_once = PTHREAD_ONCE_INIT;
+
+
+static void h264_vlc_lut_fill(uint16_t *lut,
+			      uint32_t code,
+			      uint32_t numbits,
+			      uint32_t len,
+			      uint32_t value)
+{
+	uint32_t first = code << (H264_VLC_BITS - numbits);
+	uint32_t count = 1 << (H264_VLC_BITS - numbits);
+	uint32_t i;
+
+	/* Shorter codes have precedence, like in bit by bit decoding */
+	for (i = first; i < first + count; i++) {
+		if (lut[i] == 0)
+			lut[i] = H264_VLC_LEAF(len, value);
+	}
+}
+
+
+static int h264_vlc_lut_build(uint16_t *lut,
+			      const uint8_t *table,
+			      uint32_t maxbits,
+			      uint32_t maxcode)
+{
+	uint32_t numbits, code, value, idx;
+	uint16_t *sub = NULL;
+
+	for (numbits = 1; numbits <= maxbits; numbits++) {
+		for (code = 0; code <= maxcode && code < (1u << numbits);
+		     code++) {
+			value = table[numbits * (maxcode + 1) + code];
+			if (value == 0)
+				continue;
+			if (numbits <= H264_VLC_BITS) {
+				h264_vlc_lut_fill(
+					lut, code, numbits, numbits, value);
+				continue;
+			}
+
+			/* Second level table */
+			idx = code >> (numbits - H264_VLC_BITS);
+			if (lut[idx] == 0) {
+				if (s_h264_vlc_sub_count >= H264_VLC_MAX_SUB)
+					return -ENOMEM;
+				lut[idx] = H264_VLC_SUB | s_h264_vlc_sub_count;
+				s_h264_vlc_sub_count++;
+			} else if ((lut[idx] & H264_VLC_SUB) == 0) {
+				/* Already decoded by a shorter code */
+				continue;
+			}
+			sub = s_h264_vlc_sub_lut[lut[idx] & 0xff];
+			h264_vlc_lut_fill(
+				sub,
+				code & ((1 << (numbits - H264_VLC_BITS)) - 1),
+				numbits - H264_VLC_BITS,
+				numbits,
+				value);
+		}
+	}
+
+	return 0;
+}
+
+
+static void h264_vlc_lut_build_all(void)
+{
+	int res = 0;
+	uint32_t i;
+
+	for (i = 0; i < H264_VLC_TABLE_COUNT; i++) {
+		res = h264_vlc_lut_build(s_h264_vlc_lut[i],
+					 s_h264_vlc_tables[i].table,
+					 s_h264_vlc_tables[i].maxbits,
+					 s_h264_vlc_tables[i].maxcode);
+		if (res < 0) {
+			/* Incomplete tables are never used */
+			ULOG_ERRNO("h264_vlc_lut_build: too many second level "
+				   "tables, VLC lookup tables disabled",
+				   -res);
+			return;
+		}
+	}
+
+	s_h264_vlc_lut_ready = 1;
+}
+
+
+int h264_vlc_lut_init(void)
+{
+	int res = pthread_once(&s_h264_vlc_lut_once, &h264_vlc_lut_build_all);
+	if (res != 0)
+		return -res;
+	return s_h264_vlc_lut_ready ? 0 : -ENOMEM;
+}
+
+
+int h264_read_vlc_bitwise(struct h264_bitstream *bs,
+			  enum h264_vlc_table id,
+			  uint32_t *code)
+{
+	int res = 0;
+	uint32_t bit = 0;
+	uint32_t numbits = 0;
+	uint32_t rawcode = 0;
+	uint32_t value = 0;
+	uint32_t maxbits = s_h264_vlc_tables[id].maxbits;
+	uint32_t maxcode = s_h264_vlc_tables[id].maxcode;
+
+	while (numbits < maxbits) {
+		/* Read one more bit */
+		res = h264_bs_read_bits(bs, &bit, 1);
+		if (res < 0)
+			return res;
+		rawcode = (rawcode << 1) | bit;
+		numbits++;
+		if (rawcode > maxcode)
+			return -EIO;
+		/* Are we done ? */
+		value = s_h264_vlc_tables[id].table[numbits * (maxcode + 1) +
+						    rawcode];
+		if (value != 0) {
+			*code = value;
+			return 0;
+		}
+	}
+
+	return -EIO;
+}
+
+
+int h264_read_vlc(struct h264_bitstream *bs,
+		  enum h264_vlc_table id,
+		  uint32_t *code)
+{
+	int res = 0;
+	uint32_t bits = 0;
+	uint32_t entry = 0;
+	uint32_t len = 0;
+
+	if (!s_h264_vlc_lut_ready)
+		return h264_read_vlc_bitwise(bs, id, code);
+
+	res = h264_bs_peek_bits(bs, &bits, 2 * H264_VLC_BITS);
+	if (res <= 0)
+		return -EIO;
+
+	entry = s_h264_vlc_lut[id][bits >> H264_VLC_BITS];
+	if (entry & H264_VLC_SUB) {
+		entry = s_h264_vlc_sub_lut[entry & 0xff]
+					  [bits & ((1 << H264_VLC_BITS) - 1)];
+	}
+	len = entry >> 8;
+	if (entry == 0 || len > (uint32_t)res)
+		return -EIO;
+
+	res = h264_bs_read_bits(bs, &bits, len);
+	if (res < 0)
+		return res;
+
+	*code = entry & 0xff;
+	return 0;
+}
+
+
 /**
  * 7.4.5 Macroblock layer semantics
  */
@@ -842,7 +1041,6 @@ int h264_read_mb_type(struct h264_bitstream *bs,
 {
 	int res = 0;
 	uint32_t type = 0;
-	uint32_t off = h264_get_mb_addr_off(ctx, mb->mbAddr);
 
 	static const uint8_t table[][3] = {
 		{H264_MB_TYPE_B_16x8, PredMode_Pred_L0, PredMode_Pred_L0},
@@ -865,7 +1063,10 @@ int h264_read_mb_type(struct h264_bitstream *bs,
 		{H264_MB_TYPE_B_8x16, PredMode_BiPred, PredMode_BiPred},
 	};
 
-	res = h264_bs_read_bits_ue(bs, &type);
+	if (ctx->pps->entropy_coding_mode_flag)
+		res = h264_cabac_read_mb_type(&ctx->cabac, ctx, mb, &type);
+	else
+		res = h264_bs_read_bits_ue(bs, &type);
 	ULOG_ERRNO_RETURN_ERR_IF(res < 0, -res);
 	mb->raw_mb_type = type;
 
@@ -964,7 +1165,9 @@ type_i:
 		break;
 	}
 
-	ctx->slice.mb_table.info[off].mb_type = mb->mb_type;
+	h264_get_mb_info(ctx, mb->mbAddr)->mb_type = mb->mb_type;
+	h264_get_mb_info(ctx, mb->mbAddr)->coded_block_pattern =
+		mb->CodedBlockPatternLuma | (mb->CodedBlockPatternChroma << 4);
 	return 0;
 }
 
@@ -1002,7 +1205,12 @@ int h264_read_sub_mb_type(struct h264_bitstream *bs,
 	};
 
 	for (uint32_t mbPartIdx = 0; mbPartIdx < 4; mbPartIdx++) {
-		res = h264_bs_read_bits_ue(bs, &type);
+		if (ctx->pps->entropy_coding_mode_flag) {
+			res = h264_cabac_read_sub_mb_type(
+				&ctx->cabac, ctx, mb, &type);
+		} else {
+			res = h264_bs_read_bits_ue(bs, &type);
+		}
 		ULOG_ERRNO_RETURN_ERR_IF(res < 0, -res);
 		mb->raw_sub_mb_type[mbPartIdx] = type;
 
@@ -1046,6 +1254,15 @@ int h264_read_coded_block_pattern(struct h264_bitstream *bs,
 	uint32_t code = 0;
 	const uint8_t(*table)[][2] = NULL;
 
+	if (ctx->pps->entropy_coding_mode_flag) {
+		/* 9.3.2.6: the CABAC binarization gives the value directly */
+		res = h264_cabac_read_coded_block_pattern(
+			&ctx->cabac, ctx, mb, &code);
+		ULOG_ERRNO_RETURN_ERR_IF(res < 0, -res);
+		mb->coded_block_pattern = code;
+		goto out;
+	}
+
 	res = h264_bs_read_bits_ue(bs, &code);
 	ULOG_ERRNO_RETURN_ERR_IF(res < 0, -res);
 
@@ -1074,66 +1291,151 @@ int h264_read_coded_block_pattern(struct h264_bitstream *bs,
 		break;
 	}
 
+out:
 	mb->CodedBlockPatternLuma = mb->coded_block_pattern % 16;
 	mb->CodedBlockPatternChroma = mb->coded_block_pattern / 16;
+	h264_get_mb_info(ctx, mb->mbAddr)->coded_block_pattern =
+		mb->coded_block_pattern;
 	return 0;
 }
 
 
+/**
+ * Start a new slice in the macroblock table: the entries of the previous
+ * slices become unavailable by changing the current slice id
+ */
 void h264_clear_macroblock_table(struct h264_ctx *ctx)
 {
-	if (ctx->slice.mb_table.info != NULL) {
-		memset(ctx->slice.mb_table.info,
-		       0,
-		       ctx->slice.mb_table.maxlen *
-			       sizeof(*ctx->slice.mb_table.info));
+	ctx->slice.mb_table.slice_id++;
+	if (ctx->slice.mb_table.slice_id == 0) {
+		/* Wrap around, make sure no entry has the new id */
+		if (ctx->slice.mb_table.info != NULL) {
+			memset(ctx->slice.mb_table.info,
+			       0,
+			       ctx->slice.mb_table.len *
+				       sizeof(*ctx->slice.mb_table.info));
+		}
+		ctx->slice.mb_table.slice_id = 1;
 	}
-	ctx->slice.mb_table.len = 0;
+}
+
+
+/**
+ * Number of macroblock table entries used by the active SPS; the table can
+ * be larger if it was allocated for a previous, larger SPS
+ */
+static inline size_t h264_macroblock_table_len(const struct h264_ctx *ctx)
+{
+	return (size_t)ctx->sps_derived.PicWidthInMbs *
+	       ctx->sps_derived.FrameHeightInMbs;
+}
+
+
+/**
+ * Allocate the macroblock table for the active SPS, aligned on a cache line;
+ * it is only reallocated if the picture size grows. This is done when the
+ * first macroblock is parsed or written, not when the SPS is set, so that
+ * the parameter sets of pictures larger than H264_MB_TABLE_MAX_LEN
+ * macroblocks can still be parsed.
+ */
+int h264_alloc_macroblock_table(struct h264_ctx *ctx)
+{
+	void *buf = NULL;
+	size_t len = h264_macroblock_table_len(ctx);
+	size_t entry_size = sizeof(*ctx->slice.mb_table.info);
+
+	if (len <= ctx->slice.mb_table.len)
+		return 0;
+
+	/* Refuse absurd sizes (and the size_t overflow on 32-bit targets) */
+	ULOG_ERRNO_RETURN_ERR_IF(len > H264_MB_TABLE_MAX_LEN, EINVAL);
+	ULOG_ERRNO_RETURN_ERR_IF(len > (SIZE_MAX - 63) / entry_size, EINVAL);
+
+	buf = calloc(1, len * entry_size + 63);
+	if (buf == NULL)
+		return -ENOMEM;
+	free(ctx->slice.mb_table.buf);
+	ctx->slice.mb_table.buf = buf;
+	ctx->slice.mb_table.info =
+		(void *)(((uintptr_t)buf + 63) & ~(uintptr_t)63);
+	ctx->slice.mb_table.len = len;
+	ctx->slice.mb_table.slice_id = 1;
+	return 0;
 }
 
 
 /**
  * 7.4.4 Slice data semantics
  */
+static void h264_clear_macroblock_levels(struct h264_macroblock *mb)
+{
+	if (mb->levels_dirty & H264_MB_LEVELS_PCM) {
+		memset(mb->pcm_sample_luma, 0, sizeof(mb->pcm_sample_luma));
+		memset(mb->pcm_sample_chroma, 0, sizeof(mb->pcm_sample_chroma));
+	}
+	if (mb->levels_dirty & H264_MB_LEVELS_LUMA) {
+		memset(mb->Intra16x16DCLevel, 0, sizeof(mb->Intra16x16DCLevel));
+		memset(mb->Intra16x16ACLevel, 0, sizeof(mb->Intra16x16ACLevel));
+		memset(mb->LumaLevel4x4, 0, sizeof(mb->LumaLevel4x4));
+		memset(mb->LumaLevel8x8, 0, sizeof(mb->LumaLevel8x8));
+	}
+	if (mb->levels_dirty & H264_MB_LEVELS_CHROMA) {
+		memset(mb->ChromaDCLevel, 0, sizeof(mb->ChromaDCLevel));
+		memset(mb->ChromaACLevel, 0, sizeof(mb->ChromaACLevel));
+	}
+	if (mb->levels_dirty & H264_MB_LEVELS_CB) {
+		memset(mb->CbIntra16x16DCLevel,
+		       0,
+		       sizeof(mb->CbIntra16x16DCLevel));
+		memset(mb->CbIntra16x16ACLevel,
+		       0,
+		       sizeof(mb->CbIntra16x16ACLevel));
+		memset(mb->CbLevel4x4, 0, sizeof(mb->CbLevel4x4));
+		memset(mb->CbLevel8x8, 0, sizeof(mb->CbLevel8x8));
+	}
+	if (mb->levels_dirty & H264_MB_LEVELS_CR) {
+		memset(mb->CrIntra16x16DCLevel,
+		       0,
+		       sizeof(mb->CrIntra16x16DCLevel));
+		memset(mb->CrIntra16x16ACLevel,
+		       0,
+		       sizeof(mb->CrIntra16x16ACLevel));
+		memset(mb->CrLevel4x4, 0, sizeof(mb->CrLevel4x4));
+		memset(mb->CrLevel8x8, 0, sizeof(mb->CrLevel8x8));
+	}
+	mb->levels_dirty = 0;
+}
+
+
 int h264_new_macroblock(struct h264_ctx *ctx,
 			uint32_t mbAddr,
 			int skipped,
 			int field_flag)
 {
-	void *newinfo = NULL;
-	size_t newmaxlen = 0;
 	const struct h264_slice_header *sh = &ctx->slice.hdr;
 	struct h264_macroblock *mb = NULL;
-	uint32_t off = h264_get_mb_addr_off(ctx, mbAddr);
-
-	/* Grow internal array if needed */
-	if (off + 1 > ctx->slice.mb_table.maxlen) {
-		/* Alloc by step of 128 */
-		newmaxlen = (off + 1 + 127) & ~127;
-		newinfo =
-			realloc(ctx->slice.mb_table.info,
-				newmaxlen * sizeof(*ctx->slice.mb_table.info));
-		if (newinfo == NULL)
-			return -ENOMEM;
-		/* Reset at 0 newly allocated entries */
-		memset((uint8_t *)newinfo +
-			       ctx->slice.mb_table.maxlen *
-				       sizeof(*ctx->slice.mb_table.info),
-		       0,
-		       (newmaxlen - ctx->slice.mb_table.maxlen) *
-			       sizeof(*ctx->slice.mb_table.info));
-		ctx->slice.mb_table.info = newinfo;
-		ctx->slice.mb_table.maxlen = newmaxlen;
+	struct h264_macroblock_info *info = NULL;
+	struct h264_macroblock_info *top = NULL;
+
+	ULOG_ERRNO_RETURN_ERR_IF(mbAddr >= h264_macroblock_table_len(ctx), EIO);
+	if (mbAddr >= ctx->slice.mb_table.len) {
+		int res = h264_alloc_macroblock_table(ctx);
+		if (res < 0)
+			return res;
 	}
-	if (off + 1 >= ctx->slice.mb_table.len)
-		ctx->slice.mb_table.len = off + 1;
+	info = h264_get_mb_info(ctx, mbAddr);
+	if (mbAddr % 2 == 1)
+		top = info - 1;
 
-	ctx->slice.mb_table.info[off].available = 1;
-	ctx->slice.mb_table.info[off].skipped = skipped;
+	/* The entry may hold data from a previous slice */
+	memset(info, 0, sizeof(*info));
+	info->slice_id = ctx->slice.mb_table.slice_id;
+	info->skipped = skipped;
 
 	/* Setup new macroblock */
 	mb = ctx->mb = &ctx->_mb;
-	memset(ctx->mb, 0, sizeof(*ctx->mb));
+	memset(mb, 0, offsetof(struct h264_macroblock, levels_dirty));
+	h264_clear_macroblock_levels(mb);
 	ctx->mb->mbAddr = mbAddr;
 	ctx->mb->mb_type = !skipped ? H264_MB_TYPE_UNKNOWN
 			   : ctx->slice.type == H264_SLICE_TYPE_B
@@ -1150,10 +1452,10 @@ int h264_new_macroblock(struct h264_ctx *ctx,
 		if (mbAddr % 2 == 0) {
 			/* Need to wait for the bottom macroblock to make a
 			 * decision */
-		} else if (!ctx->slice.mb_table.info[off - 1].skipped) {
+		} else if (!top->skipped) {
 			/* Use same flag as top macroblock */
 			mb->mb_field_decoding_flag =
-				ctx->slice.mb_table.info[off - 1].field_flag;
+				top->field_flag;
 		} else {
 			/* Both top and bottom macroblock are skipped */
 			if (mb->mbAddrA != H264_MB_ADDR_INVALID) {
@@ -1168,7 +1470,7 @@ int h264_new_macroblock(struct h264_ctx *ctx,
 				mb->mb_field_decoding_flag = 0;
 			}
 			/* Update top macroblock info as well */
-			ctx->slice.mb_table.info[off - 1].field_flag =
+			top->field_flag =
 				mb->mb_field_decoding_flag;
 		}
 	} else if (mbAddr % 2 == 0) {
@@ -1181,19 +1483,20 @@ int h264_new_macroblock(struct h264_ctx *ctx,
 		 * skipped) */
 		mb->mb_field_decoding_flag = field_flag;
 		ULOG_ERRNO_RETURN_ERR_IF(
-			!ctx->slice.mb_table.info[off - 1].skipped, EINVAL);
-		ctx->slice.mb_table.info[off - 1].field_flag =
+			!top->skipped, EINVAL);
+		top->field_flag =
 			mb->mb_field_decoding_flag;
 	} else {
 		/* Bottom macroblock without an explicit field flag, use info
 		 * from top macroblock (that should not have been skipped) */
 		ULOG_ERRNO_RETURN_ERR_IF(
-			ctx->slice.mb_table.info[off - 1].skipped, EINVAL);
+			top->skipped, EINVAL);
 		mb->mb_field_decoding_flag =
-			ctx->slice.mb_table.info[off - 1].field_flag;
+			top->field_flag;
 	}
 
-	ctx->slice.mb_table.info[off].field_flag = mb->mb_field_decoding_flag;
+	info->field_flag = mb->mb_field_decoding_flag;
+	info->mb_type = mb->mb_type;
 
 	/* Setup some other variables */
 	if (!ctx->derived.MbaffFrameFlag || !mb->mb_field_decoding_flag) {
@@ -1208,14 +1511,145 @@ int h264_new_macroblock(struct h264_ctx *ctx,
 }
 
 
+/**
+ * Field decoding flag of a pair of skipped macroblocks, inferred from the
+ * left pair, then from the top pair (7.4.4)
+ */
+static int h264_infer_field_flag(struct h264_ctx *ctx, uint32_t mbAddr)
+{
+	uint32_t PicWidthInMbs = ctx->sps_derived.PicWidthInMbs;
+	uint32_t first_mb_in_slice = ctx->slice.hdr.first_mb_in_slice;
+	uint32_t half_addr = mbAddr / 2;
+	const struct h264_macroblock_info *info = NULL;
+
+	if (half_addr >= first_mb_in_slice + 1 &&
+	    half_addr % PicWidthInMbs != 0) {
+		info = h264_get_mb_info(ctx, 2 * (half_addr - 1));
+		if (info->slice_id == ctx->slice.mb_table.slice_id)
+			return info->field_flag;
+	}
+	if (half_addr >= first_mb_in_slice + PicWidthInMbs) {
+		info = h264_get_mb_info(ctx, 2 * (half_addr - PicWidthInMbs));
+		if (info->slice_id == ctx->slice.mb_table.slice_id)
+			return info->field_flag;
+	}
+	return 0;
+}
+
+
+/**
+ * Setup a run of skipped macroblocks (mb_skip_run): the macroblock table
+ * entries of the run are filled at once and only the last macroblock goes
+ * through h264_new_macroblock, so that ctx->mb is set to it on return; with
+ * slice groups in MBAFF frames the macroblocks are setup one by one
+ */
+int h264_new_skipped_macroblocks(struct h264_ctx *ctx,
+				 uint32_t mbAddr,
+				 uint32_t count)
+{
+	int res = 0;
+	uint32_t lastMbAddr = mbAddr + count - 1;
+	uint32_t i, addr;
+	struct h264_macroblock_info tmpl;
+	struct h264_macroblock_info *info = NULL;
+
+	ULOG_ERRNO_RETURN_ERR_IF(count == 0, EINVAL);
+
+	if (ctx->pps->num_slice_groups_minus1 != 0 &&
+	    ctx->derived.MbaffFrameFlag) {
+		for (i = 0; i < count - 1; i++) {
+			res = h264_new_macroblock(ctx, mbAddr, 1, -1);
+			if (res < 0)
+				return res;
+			mbAddr = h264_next_mb_addr(ctx, mbAddr);
+		}
+		return h264_new_macroblock(ctx, mbAddr, 1, -1);
+	}
+
+	/* Same entry as setup by h264_new_macroblock for all macroblocks
+	 * but the last one; in MBAFF frames the field decoding flag of a
+	 * skipped top macroblock is only known with the bottom one */
+	memset(&tmpl, 0, sizeof(tmpl));
+	tmpl.slice_id = ctx->slice.mb_table.slice_id;
+	tmpl.mb_type = ctx->slice.type == H264_SLICE_TYPE_B
+			       ? H264_MB_TYPE_B_SKIP
+			       : H264_MB_TYPE_P_SKIP;
+	tmpl.skipped = 1;
+	tmpl.field_flag =
+		ctx->derived.MbaffFrameFlag ? 0 : ctx->slice.hdr.field_pic_flag;
+
+	if (ctx->pps->num_slice_groups_minus1 != 0) {
+		/* The macroblocks of the run follow their slice group */
+		for (i = 0; i < count - 1; i++) {
+			ULOG_ERRNO_RETURN_ERR_IF(
+				mbAddr >= h264_macroblock_table_len(ctx), EIO);
+			*h264_get_mb_info(ctx, mbAddr) = tmpl;
+			mbAddr = h264_next_mb_addr(ctx, mbAddr);
+		}
+		return h264_new_macroblock(ctx, mbAddr, 1, -1);
+	}
+
+	ULOG_ERRNO_RETURN_ERR_IF(
+		lastMbAddr < mbAddr ||
+			lastMbAddr >= h264_macroblock_table_len(ctx),
+		EIO);
+
+	info = h264_get_mb_info(ctx, mbAddr);
+	for (i = 0; i < count - 1; i++)
+		info[i] = tmpl;
+
+	if (ctx->derived.MbaffFrameFlag) {
+		/* Pairs with a bottom macroblock in the run, in order so that
+		 * the left and top pairs are already known; the top
+		 * macroblock is either the last coded one or skipped */
+		for (addr = mbAddr | 1; addr < lastMbAddr; addr += 2) {
+			struct h264_macroblock_info *top =
+				h264_get_mb_info(ctx, addr - 1);
+			int field_flag = top->field_flag;
+			if (top->skipped)
+				field_flag = h264_infer_field_flag(ctx, addr);
+			top->field_flag = field_flag;
+			top[1].field_flag = field_flag;
+		}
+	}
+
+	return h264_new_macroblock(ctx, lastMbAddr, 1, -1);
+}
+
+
+/**
+ * Setup the next macroblock before its mb_skip_flag and
+ * mb_field_decoding_flag are known (CABAC): the neighbouring macroblocks are
+ * computed with the inferred field decoding flag (7.4.4)
+ */
+void h264_peek_macroblock(struct h264_ctx *ctx, uint32_t mbAddr)
+{
+	struct h264_macroblock *mb = ctx->mb = &ctx->_mb;
+
+	mb->mbAddr = mbAddr;
+	h264_compute_neighbouring_macroblocks(ctx, mb);
+
+	if (!ctx->derived.MbaffFrameFlag)
+		mb->mb_field_decoding_flag = ctx->slice.hdr.field_pic_flag;
+	else if (mbAddr % 2 == 1 && !h264_get_mb_info(ctx, mbAddr - 1)->skipped)
+		mb->mb_field_decoding_flag =
+			h264_get_mb_info(ctx, mbAddr - 1)->field_flag;
+	else if (mb->mbAddrA != H264_MB_ADDR_INVALID)
+		mb->mb_field_decoding_flag = mb->mbAddrAInfo->field_flag;
+	else if (mb->mbAddrB != H264_MB_ADDR_INVALID)
+		mb->mb_field_decoding_flag = mb->mbAddrBInfo->field_flag;
+	else
+		mb->mb_field_decoding_flag = 0;
+}
+
+
 int h264_set_nz_coeff(struct h264_ctx *ctx,
 		      uint32_t mbAddr,
 		      uint32_t comp,
 		      uint32_t idx,
 		      uint32_t n)
 {
-	uint32_t off = h264_get_mb_addr_off(ctx, mbAddr);
-	ctx->slice.mb_table.info[off].nz_coeff[comp * 16 + idx] = n;
+	h264_get_mb_info(ctx, mbAddr)->nz_coeff[comp * 16 + idx] = n;
 	return 0;
 }
 
@@ -1226,8 +1660,7 @@ static int h264_get_nz_coeff(struct h264_ctx *ctx,
 			     uint32_t idx,
 			     uint32_t *n)
 {
-	uint32_t off = h264_get_mb_addr_off(ctx, mbAddr);
-	*n = ctx->slice.mb_table.info[off].nz_coeff[comp * 16 + idx];
+	*n = h264_get_mb_info(ctx, mbAddr)->nz_coeff[comp * 16 + idx];
 	return 0;
 }
 
@@ -1296,11 +1729,11 @@ int h264_read_coeff_token(struct h264_bitstream *bs,
 
 	case ChromaDCLevel:
 		if (ctx->sps_derived.ChromaArrayType == 1) {
-			res = READ_VLC(
-				&s_h264_coeff_token_3, 16, 15, &coeff_token);
+			res = h264_read_vlc(
+				bs, H264_VLC_COEFF_TOKEN + 3, &coeff_token);
 		} else {
-			res = READ_VLC(
-				&s_h264_coeff_token_4, 16, 15, &coeff_token);
+			res = h264_read_vlc(
+				bs, H264_VLC_COEFF_TOKEN + 4, &coeff_token);
 		}
 		goto out;
 
@@ -1337,11 +1770,14 @@ int h264_read_coeff_token(struct h264_bitstream *bs,
 		nC = 0;
 
 	if (nC < 2) {
-		res = READ_VLC(&s_h264_coeff_token_0, 16, 15, &coeff_token);
+		res = h264_read_vlc(
+			bs, H264_VLC_COEFF_TOKEN + 0, &coeff_token);
 	} else if (nC < 4) {
-		res = READ_VLC(&s_h264_coeff_token_1, 16, 15, &coeff_token);
+		res = h264_read_vlc(
+			bs, H264_VLC_COEFF_TOKEN + 1, &coeff_token);
 	} else if (nC < 8) {
-		res = READ_VLC(&s_h264_coeff_token_2, 16, 15, &coeff_token);
+		res = h264_read_vlc(
+			bs, H264_VLC_COEFF_TOKEN + 2, &coeff_token);
 	} else {
 		res = h264_bs_read_bits(bs, &code, 6);
 		ULOG_ERRNO_RETURN_ERR_IF(res < 0, -res);
@@ -1375,13 +1811,17 @@ int h264_read_total_zeros(struct h264_bitstream *bs,
 		*total_zeros = 0;
 		return 0;
 	}
+	ULOG_ERRNO_RETURN_ERR_IF(tzVlcIndex == 0, EINVAL);
 
 	if (max_num_coeff == 4)
-		res = READ_VLC(&s_h264_total_zeros_1[tzVlcIndex], 3, 1, &code);
+		res = h264_read_vlc(
+			bs, H264_VLC_TOTAL_ZEROS_2X2 + tzVlcIndex - 1, &code);
 	else if (max_num_coeff == 8)
-		res = READ_VLC(&s_h264_total_zeros_2[tzVlcIndex], 5, 7, &code);
+		res = h264_read_vlc(
+			bs, H264_VLC_TOTAL_ZEROS_2X4 + tzVlcIndex - 1, &code);
 	else if (max_num_coeff <= 16)
-		res = READ_VLC(&s_h264_total_zeros_0[tzVlcIndex], 9, 7, &code);
+		res = h264_read_vlc(
+			bs, H264_VLC_TOTAL_ZEROS_4X4 + tzVlcIndex - 1, &code);
 	else
 		res = -EIO;
 	ULOG_ERRNO_RETURN_ERR_IF(res < 0, -res);
@@ -1405,9 +1845,10 @@ int h264_read_run_before(struct h264_bitstream *bs,
 		*run_before = 0;
 		return 0;
 	} else if (zeros_left <= 6) {
-		res = READ_VLC(&s_h264_run_before[zeros_left], 11, 7, &code);
+		res = h264_read_vlc(
+			bs, H264_VLC_RUN_BEFORE + zeros_left - 1, &code);
 	} else {
-		res = READ_VLC(&s_h264_run_before[7], 11, 7, &code);
+		res = h264_read_vlc(bs, H264_VLC_RUN_BEFORE + 6, &code);
 	}
 	ULOG_ERRNO_RETURN_ERR_IF(res < 0, -res);
 
@@ -31,12 +31,23 @@
 void h264_clear_macroblock_table(struct h264_ctx *ctx);
 
 
+int h264_alloc_macroblock_table(struct h264_ctx *ctx);
+
+
 int h264_new_macroblock(struct h264_ctx *ctx,
 			uint32_t mbAddr,
 			int skipped,
 			int field_flag);
 
 
+int h264_new_skipped_macroblocks(struct h264_ctx *ctx,
+				 uint32_t mbAddr,
+				 uint32_t count);
+
+
+void h264_peek_macroblock(struct h264_ctx *ctx, uint32_t mbAddr);
+
+
 int h264_set_nz_coeff(struct h264_ctx *ctx,
 		      uint32_t mbAddr,
 		      uint32_t comp,
@@ -44,6 +55,39 @@ int h264_set_nz_coeff(struct h264_ctx *ctx,
 		      uint32_t n);
 
 
+/* VLC tables of 9.2 */
+enum h264_vlc_table {
+	/* coeff_token (Table 9-5): 0 <= nC < 2, 2 <= nC < 4, 4 <= nC < 8,
+	 * nC == -1 and nC == -2 */
+	H264_VLC_COEFF_TOKEN = 0,
+	/* total_zeros for 4x4 blocks (Tables 9-7 and 9-8) and for chroma DC
+	 * 2x2 and 2x4 blocks (Table 9-9), indexed by tzVlcIndex - 1 */
+	H264_VLC_TOTAL_ZEROS_4X4 = H264_VLC_COEFF_TOKEN + 5,
+	H264_VLC_TOTAL_ZEROS_2X2 = H264_VLC_TOTAL_ZEROS_4X4 + 15,
+	H264_VLC_TOTAL_ZEROS_2X4 = H264_VLC_TOTAL_ZEROS_2X2 + 3,
+	/* run_before (Table 9-10), indexed by Min(zerosLeft, 7) - 1 */
+	H264_VLC_RUN_BEFORE = H264_VLC_TOTAL_ZEROS_2X4 + 7,
+	H264_VLC_TABLE_COUNT = H264_VLC_RUN_BEFORE + 7,
+};
+
+
+/* Build the VLC lookup tables, once for all contexts; on failure the codes
+ * are decoded bit by bit */
+int h264_vlc_lut_init(void);
+
+
+/* Decode a VLC code with the lookup tables; returns the table value */
+int h264_read_vlc(struct h264_bitstream *bs,
+		  enum h264_vlc_table id,
+		  uint32_t *code);
+
+
+/* Decode a VLC code bit by bit in the table */
+int h264_read_vlc_bitwise(struct h264_bitstream *bs,
+			  enum h264_vlc_table id,
+			  uint32_t *code);
+
+
 int h264_read_mb_type(struct h264_bitstream *bs,
 		      struct h264_ctx *ctx,
 		      struct h264_macroblock *mb);
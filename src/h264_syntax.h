@@ -714,6 +714,11 @@ static int H264_SYNTAX_FCT(sei_data)(struct h264_bitstream *bs,
 	ULOG_ERRNO_RETURN_ERR_IF(!h264_bs_byte_aligned(bs), EIO);
 	*buf = bs->cdata + bs->off;
 	*len = bs->len - bs->off;
+#elif H264_SYNTAX_OP_KIND == H264_SYNTAX_OP_KIND_WRITE
+	int res = 0;
+	ULOG_ERRNO_RETURN_ERR_IF(*len != 0 && *buf == NULL, EIO);
+	res = h264_bs_write_bytes(bs, *buf, *len);
+	ULOG_ERRNO_RETURN_ERR_IF(res < 0, -res);
 #else
 	ULOG_ERRNO_RETURN_ERR_IF(*len != 0 && *buf == NULL, EIO);
 	H264_BEGIN_ARRAY(data);
@@ -876,6 +881,7 @@ static int H264_SYNTAX_FCT(sei)(struct h264_bitstream *bs,
 #if H264_SYNTAX_OP_KIND == H264_SYNTAX_OP_KIND_READ
 
 	struct h264_bitstream bs2;
+	uint8_t *buf = NULL;
 	do {
 		H264_BEGIN_ARRAY_ITEM();
 
@@ -890,14 +896,21 @@ static int H264_SYNTAX_FCT(sei)(struct h264_bitstream *bs,
 		ULOG_ERRNO_RETURN_ERR_IF(res < 0, -res);
 		sei->type = payload_type;
 
-		/* Setup raw buffer */
-		sei->raw.buf = malloc(payload_size);
-		ULOG_ERRNO_RETURN_ERR_IF(sei->raw.buf == NULL, ENOMEM);
+		/* Setup raw buffer: reference the NAL unit data if possible,
+		 * otherwise copy the payload in the SEI arena */
+		if (H264_READ_FLAGS() & H264_READER_FLAGS_SEI_ZERO_COPY) {
+			res = H264_READ_REF_BYTES(payload_size, &sei->raw.buf);
+			ULOG_ERRNO_RETURN_ERR_IF(res < 0, -res);
+		}
+		if (sei->raw.buf == NULL) {
+			buf = h264_arena_alloc(ctx->sei_arena, payload_size);
+			ULOG_ERRNO_RETURN_ERR_IF(buf == NULL, ENOMEM);
+			res = h264_bs_read_bytes(bs, buf, payload_size);
+			ULOG_ERRNO_RETURN_ERR_IF(res < 0, -res);
+			sei->raw.buf = buf;
+		}
 		sei->raw.len = payload_size;
 
-		for (uint32_t i = 0; i < sei->raw.len; i++)
-			H264_BITS(sei->raw.buf[i], 8);
-
 		/* Notify callback */
 		H264_CB(ctx,
 			cbs,
@@ -936,8 +949,8 @@ static int H264_SYNTAX_FCT(sei)(struct h264_bitstream *bs,
 		ULOG_ERRNO_RETURN_ERR_IF(res < 0, -res);
 
 		/* Directly write raw buffer, SEI should already be encoded */
-		for (uint32_t i = 0; i < sei->raw.len; i++)
-			H264_BITS(sei->raw.buf[i], 8);
+		res = h264_bs_write_bytes(bs, sei->raw.buf, sei->raw.len);
+		ULOG_ERRNO_RETURN_ERR_IF(res < 0, -res);
 
 		H264_END_ARRAY_ITEM();
 	}
@@ -989,11 +1002,11 @@ static int H264_SYNTAX_FCT(aud)(struct h264_bitstream *bs,
 static int H264_SYNTAX_FCT(filler)(struct h264_bitstream *bs, size_t *len)
 {
 #if H264_SYNTAX_OP_KIND == H264_SYNTAX_OP_KIND_WRITE
-	uint32_t ff_byte = 0xFF;
-	for (size_t i = 0; i < *len; i++)
-		H264_BITS(ff_byte, 8);
+	int res = h264_bs_write_ff_bytes(bs, *len);
+	ULOG_ERRNO_RETURN_ERR_IF(res < 0, -res);
 #elif H264_SYNTAX_OP_KIND == H264_SYNTAX_OP_KIND_READ
-	*len = 0;
+	/* Bulk skip if byte-aligned, then bit reader for the rest */
+	*len = h264_bs_skip_ff_bytes(bs);
 	uint32_t ff_byte = 0;
 	int res = h264_bs_next_bits(bs, &ff_byte, 8);
 	while ((res == 8) && (ff_byte == 0xFF)) {
@@ -1221,6 +1234,9 @@ static int H264_SYNTAX_FCT(dec_ref_pic_marking)(
 	} else {
 		H264_BITS(drpm->adaptive_ref_pic_marking_mode_flag, 1);
 		if (drpm->adaptive_ref_pic_marking_mode_flag) {
+#if H264_SYNTAX_OP_KIND == H264_SYNTAX_OP_KIND_READ
+			ctx->slice.hdr_lists |= H264_SLICE_HDR_LIST_DRPM;
+#endif
 			H264_BEGIN_ARRAY(mm);
 			res = H264_SYNTAX_FCT(drpm_items)(
 				bs, drpm->mm, ARRAY_SIZE(drpm->mm));
@@ -1323,11 +1339,19 @@ static int H264_SYNTAX_FCT(slice_header)(
 	H264_BEGIN_STRUCT(rplm);
 	res = H264_SYNTAX_FCT(ref_pic_list_modification)(bs, sh);
 	H264_END_STRUCT(rplm);
+#if H264_SYNTAX_OP_KIND == H264_SYNTAX_OP_KIND_READ
+	if (sh->rplm.ref_pic_list_modification_flag_l0 ||
+	    sh->rplm.ref_pic_list_modification_flag_l1)
+		ctx->slice.hdr_lists |= H264_SLICE_HDR_LIST_RPLM;
+#endif
 	ULOG_ERRNO_RETURN_ERR_IF(res < 0, -res);
 
 	if ((ctx->pps->weighted_pred_flag &&
 	     (type == H264_SLICE_TYPE_P || type == H264_SLICE_TYPE_SP)) ||
 	    (ctx->pps->weighted_bipred_idc == 1 && type == H264_SLICE_TYPE_B)) {
+#if H264_SYNTAX_OP_KIND == H264_SYNTAX_OP_KIND_READ
+		ctx->slice.hdr_lists |= H264_SLICE_HDR_LIST_PWT;
+#endif
 		H264_BEGIN_STRUCT(pwt);
 		res = H264_SYNTAX_FCT(pred_weight_table)(bs, ctx, sh);
 		H264_END_STRUCT(pwt);
@@ -1379,6 +1403,8 @@ static int H264_SYNTAX_FCT(slice_header)(
 
 #if H264_SYNTAX_OP_KIND == H264_SYNTAX_OP_KIND_WRITE
 	ctx->slice.hdr_len = bs->off * 8 + bs->cachebits;
+#elif H264_SYNTAX_OP_KIND == H264_SYNTAX_OP_KIND_READ
+	ctx->slice.hdr_len = H264_READ_RAW_OFF() * 8 - bs->cachebits;
 #else
 	ctx->slice.hdr_len = bs->off * 8 - bs->cachebits;
 #endif
@@ -1402,20 +1428,15 @@ static int H264_SYNTAX_FCT(slice_layer)(struct h264_bitstream *bs,
 					void *userdata)
 {
 	int res = 0;
-#if H264_SYNTAX_OP_KIND == H264_SYNTAX_OP_KIND_READ
-	struct h264_slice_header _sh;
-	struct h264_slice_header *sh = &_sh;
-	memset(sh, 0, sizeof(*sh));
-#else
-	struct h264_slice_header *sh = &ctx->slice.hdr;
-#endif
 
+	/* When reading, the slice header is parsed in place (it has been
+	 * cleared with the NAL unit) */
 	H264_BEGIN_STRUCT(slice_header);
-	res = H264_SYNTAX_FCT(slice_header)(bs, ctx, sh);
+	res = H264_SYNTAX_FCT(slice_header)(bs, ctx, &ctx->slice.hdr);
 	H264_END_STRUCT(slice_header);
 	ULOG_ERRNO_RETURN_ERR_IF(res < 0, -res);
 #if H264_SYNTAX_OP_KIND == H264_SYNTAX_OP_KIND_READ
-	res = h264_ctx_set_slice_header(ctx, sh);
+	res = h264_ctx_update_slice(ctx);
 	ULOG_ERRNO_RETURN_ERR_IF(res < 0, -res);
 #endif
 
@@ -1453,8 +1474,7 @@ static int H264_SYNTAX_FCT(nalu)(struct h264_bitstream *bs,
 	size_t len = 0;
 
 #if H264_SYNTAX_OP_KIND == H264_SYNTAX_OP_KIND_READ
-	buf = bs->cdata + bs->off;
-	len = bs->len;
+	buf = H264_READ_RAW_BUF(&len);
 	res = h264_ctx_clear_nalu(ctx);
 	ULOG_ERRNO_RETURN_ERR_IF(res < 0, -res);
 #endif
@@ -1570,25 +1590,22 @@ static int H264_SYNTAX_FCT(nalu)(struct h264_bitstream *bs,
 	}
 
 #if H264_SYNTAX_OP_KIND == H264_SYNTAX_OP_KIND_READ
-	/* 7.4.1.2.4 Access unit change detection */
-	if (((ctx->nalu.is_prev_vcl) || (ctx->nalu.is_prev_filler)) &&
-	    ((ctx->nalu.type == H264_NALU_TYPE_AUD) ||
-	     (ctx->nalu.type == H264_NALU_TYPE_SPS) ||
-	     (ctx->nalu.type == H264_NALU_TYPE_PPS) ||
-	     (ctx->nalu.type == H264_NALU_TYPE_SEI) ||
-	     (((unsigned)ctx->nalu.type >= 14) &&
-	      ((unsigned)ctx->nalu.type <= 18)) ||
-	     (ctx->nalu.is_first_vcl))) {
-		H264_CB(ctx, cbs, userdata, au_end);
+	/* 7.4.1.2.4 Access unit change detection; the previous access unit
+	 * may already have been ended when its last slice was parsed */
+	if (h264_ctx_is_au_start(ctx, ctx->nalu.type, ctx->nalu.is_first_vcl)) {
+		if (!ctx->au.ended)
+			H264_CB(ctx, cbs, userdata, au_end);
+		ctx->au.ended = 0;
 	}
+	h264_ctx_set_prev_nalu_type(ctx, ctx->nalu.type);
 
-	if ((ctx->nalu.type != H264_NALU_TYPE_SLICE) &&
-	    (ctx->nalu.type != H264_NALU_TYPE_SLICE_IDR)) {
-		ctx->nalu.is_prev_vcl = 0;
-	} else {
-		ctx->nalu.is_prev_vcl = 1;
+	/* Early access unit end: all the macroblocks of the primary coded
+	 * picture have been parsed */
+	if ((H264_READ_FLAGS() & H264_READER_FLAGS_EARLY_AU_END) != 0 &&
+	    h264_ctx_is_au_complete(ctx)) {
+		H264_CB(ctx, cbs, userdata, au_end);
+		ctx->au.ended = 1;
 	}
-	ctx->nalu.is_prev_filler = !!(ctx->nalu.type == H264_NALU_TYPE_FILLER);
 #endif
 
 	H264_CB(ctx,
@@ -92,6 +92,9 @@
 #define H264_READ_BITS_TE(_f, _m) _H264_READ_BITS(te, uint32_t, _f, _m)
 
 #define H264_READ_FLAGS() (((struct h264_reader *)(bs->priv))->flags)
+#define H264_READ_RAW_BUF(_len) h264_reader_get_raw_buf(bs, _len)
+#define H264_READ_RAW_OFF() h264_reader_get_raw_off(bs)
+#define H264_READ_REF_BYTES(_len, _ref) h264_reader_ref_bytes(bs, _len, _ref)
 
 
 #define _H264_WRITE_BITS(_name, _type, _field, ...)                            \
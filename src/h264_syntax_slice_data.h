@@ -59,6 +59,22 @@
 #	define H264_BITS_TE(_f, _m) _H264_DUMP_BITS(TE, _f, _m)
 
 #endif /* H264_SYNTAX_OP_KIND == H264_SYNTAX_OP_KIND_DUMP */
+
+/* CABAC coded syntax elements, decoded with h264_cabac_read_<_fct>() */
+#define H264_CABAC_READ(_f, _fct, ...)                                         \
+	do {                                                                   \
+		int32_t _v = 0;                                                \
+		int _res = h264_cabac_read_##_fct(                             \
+			&ctx->cabac, ctx, mb, ##__VA_ARGS__, &_v);             \
+		ULOG_ERRNO_RETURN_ERR_IF(_res < 0, -_res);                     \
+		(_f) = _v;                                                     \
+	} while (0)
+
+#define H264_CABAC(_f, _fct, ...)                                              \
+	do {                                                                   \
+		H264_CABAC_READ(_f, _fct, ##__VA_ARGS__);                      \
+		H264_FIELD(_f, _f);                                            \
+	} while (0)
 /* clang-format on */
 
 
@@ -90,6 +106,12 @@ static const char *get_mode_str(uint32_t mode, uint32_t comp)
 		return comp == Cb ? "CbDC" : "CrDC";
 	case ChromaACLevel:
 		return comp == Cb ? "CbAC" : "CrAC";
+	case LumaLevel8x8:
+		return "Luma8x8";
+	case CbLevel8x8:
+		return "Cb8x8";
+	case CrLevel8x8:
+		return "Cr8x8";
 
 	default:
 		return "??";
@@ -126,6 +148,37 @@ static int H264_SYNTAX_FCT(residual_block)(struct h264_bitstream *bs,
 	int16_t levelVal[64];
 	int runVal[64];
 
+	if (ctx->pps->entropy_coding_mode_flag) {
+		res = h264_cabac_read_residual_block(&ctx->cabac,
+						     ctx,
+						     mb,
+						     coeffLevel,
+						     startIdx,
+						     endIdx,
+						     maxNumCoeff,
+						     mode,
+						     comp,
+						     blkIdx);
+		ULOG_ERRNO_RETURN_ERR_IF(res < 0, -res);
+		/* clang-format off */
+#if H264_SYNTAX_OP_KIND == H264_SYNTAX_OP_KIND_DUMP
+		for (uint32_t i = startIdx; i <= endIdx; i++) {
+			if (coeffLevel[i] == 0)
+				continue;
+			char field[32] = "";
+			snprintf(field,
+				 sizeof(field),
+				 "%s(%d,%d)",
+				 name,
+				 blkIdx,
+				 i);
+			H264_FIELD_S(field, coeffLevel[i]);
+		}
+#endif
+		/* clang-format on */
+		return 0;
+	}
+
 	for (uint32_t i = 0; i < maxNumCoeff; i++)
 		coeffLevel[i] = 0;
 
@@ -272,6 +325,11 @@ static int H264_SYNTAX_FCT(residual_luma)(struct h264_bitstream *bs,
 			[Cb] = CbLevel4x4,
 			[Cr] = CrLevel4x4,
 		},
+		[LumaLevel8x8] = {
+			[Luma] = LumaLevel8x8,
+			[Cb] = CbLevel8x8,
+			[Cr] = CrLevel8x8,
+		},
 	};
 
 	if (startIdx == 0 && mb->MbPartPredMode[0] == PredMode_Intra_16x16) {
@@ -287,6 +345,26 @@ static int H264_SYNTAX_FCT(residual_luma)(struct h264_bitstream *bs,
 	}
 
 	for (uint32_t i8x8 = 0; i8x8 < 4; i8x8++) {
+		if (mb->transform_size_8x8_flag &&
+				ctx->pps->entropy_coding_mode_flag) {
+			if (mb->CodedBlockPatternLuma & (1 << i8x8)) {
+				res = H264_SYNTAX_FCT(residual_block(
+						bs, ctx, mb,
+						level8x8[i8x8],
+						4 * startIdx,
+						4 * endIdx + 3,
+						64,
+						modes[LumaLevel8x8][comp],
+						comp,
+						i8x8));
+				ULOG_ERRNO_RETURN_ERR_IF(res < 0, -res);
+			} else {
+				for (uint32_t i = 0; i < 64; i++)
+					level8x8[i8x8][i] = 0;
+			}
+			continue;
+		}
+
 		for (uint32_t i4x4 = 0; i4x4 < 4; i4x4++) {
 			if (mb->CodedBlockPatternLuma & (1 << i8x8)) {
 				if (mb->MbPartPredMode[0] == PredMode_Intra_16x16) {
@@ -339,6 +417,8 @@ static int H264_SYNTAX_FCT(residual)(struct h264_bitstream *bs,
 {
 	int res = 0;
 
+	/* The arrays written here are cleared for the next macroblock */
+	mb->levels_dirty |= H264_MB_LEVELS_LUMA;
 	res = H264_SYNTAX_FCT(residual_luma(bs, ctx, mb,
 			mb->Intra16x16DCLevel,
 			mb->Intra16x16ACLevel,
@@ -353,6 +433,7 @@ static int H264_SYNTAX_FCT(residual)(struct h264_bitstream *bs,
 			ctx->sps_derived.ChromaArrayType == 2) {
 		uint32_t NumC8x8 = 4 / (ctx->sps_derived.SubWidthC *
 				ctx->sps_derived.SubHeightC);
+		mb->levels_dirty |= H264_MB_LEVELS_CHROMA;
 		for (uint32_t iCbCr = 0; iCbCr < 2; iCbCr++) {
 			if ((mb->CodedBlockPatternChroma & 3) && startIdx == 0) {
 				res = H264_SYNTAX_FCT(residual_block(
@@ -394,6 +475,7 @@ static int H264_SYNTAX_FCT(residual)(struct h264_bitstream *bs,
 			}
 		}
 	} else if (ctx->sps_derived.ChromaArrayType == 3) {
+		mb->levels_dirty |= H264_MB_LEVELS_CB | H264_MB_LEVELS_CR;
 		res = H264_SYNTAX_FCT(residual_luma(bs, ctx, mb,
 				mb->CbIntra16x16DCLevel,
 				mb->CbIntra16x16ACLevel,
@@ -424,6 +506,7 @@ static int H264_SYNTAX_FCT(sub_mb_pred)(struct h264_bitstream *bs,
 					struct h264_macroblock *mb)
 {
 	int res = 0;
+	int cabac = ctx->pps->entropy_coding_mode_flag;
 	struct h264_slice_header *sh = &ctx->slice.hdr;
 
 	res = h264_read_sub_mb_type(bs, ctx, mb);
@@ -441,7 +524,10 @@ static int H264_SYNTAX_FCT(sub_mb_pred)(struct h264_bitstream *bs,
 		for (uint32_t mbPartIdx = 0; mbPartIdx < 4; mbPartIdx++) {
 			if (mb->sub_mb_type[mbPartIdx] != SubMbType_B_Direct_8x8 &&
 					mb->SubMbPredMode[mbPartIdx] != PredMode_Pred_L1) {
-				H264_BITS_TE(mb->ref_idx_l0[mbPartIdx], mb->max_ref_idx_0);
+				if (cabac)
+					H264_CABAC(mb->ref_idx_l0[mbPartIdx], ref_idx, 0, mbPartIdx);
+				else
+					H264_BITS_TE(mb->ref_idx_l0[mbPartIdx], mb->max_ref_idx_0);
 			} else {
 				H264_FIELD(ref_idx_l0, 0);
 			}
@@ -455,7 +541,10 @@ static int H264_SYNTAX_FCT(sub_mb_pred)(struct h264_bitstream *bs,
 		for (uint32_t mbPartIdx = 0; mbPartIdx < 4; mbPartIdx++) {
 			if (mb->sub_mb_type[mbPartIdx] != SubMbType_B_Direct_8x8 &&
 					mb->SubMbPredMode[mbPartIdx] != PredMode_Pred_L0) {
-				H264_BITS_TE(mb->ref_idx_l1[mbPartIdx], mb->max_ref_idx_1);
+				if (cabac)
+					H264_CABAC(mb->ref_idx_l1[mbPartIdx], ref_idx, 1, mbPartIdx);
+				else
+					H264_BITS_TE(mb->ref_idx_l1[mbPartIdx], mb->max_ref_idx_1);
 			} else {
 				H264_FIELD(ref_idx_l1, 0);
 			}
@@ -472,8 +561,12 @@ static int H264_SYNTAX_FCT(sub_mb_pred)(struct h264_bitstream *bs,
 					subMbPartIdx < mb->NumSubMbPart[mbPartIdx];
 					subMbPartIdx++) {
 				H264_BEGIN_ARRAY(mvd_l0[mbPartIdx][subMbPartIdx]);
-				for (uint32_t compIdx = 0; compIdx < 2; compIdx++)
-					H264_BITS_SE(mb->mvd_l0[mbPartIdx][subMbPartIdx][compIdx]);
+				for (uint32_t compIdx = 0; compIdx < 2; compIdx++) {
+					if (cabac)
+						H264_CABAC(mb->mvd_l0[mbPartIdx][subMbPartIdx][compIdx], mvd, 0, mbPartIdx, subMbPartIdx, compIdx);
+					else
+						H264_BITS_SE(mb->mvd_l0[mbPartIdx][subMbPartIdx][compIdx]);
+				}
 				H264_END_ARRAY(mvd_l0[mbPartIdx][subMbPartIdx]);
 			}
 		}
@@ -490,8 +583,12 @@ static int H264_SYNTAX_FCT(sub_mb_pred)(struct h264_bitstream *bs,
 					subMbPartIdx < mb->NumSubMbPart[mbPartIdx];
 					subMbPartIdx++) {
 				H264_BEGIN_ARRAY(mvd_l1[mbPartIdx][subMbPartIdx]);
-				for (uint32_t compIdx = 0; compIdx < 2; compIdx++)
-					H264_BITS_SE(mb->mvd_l1[mbPartIdx][subMbPartIdx][compIdx]);
+				for (uint32_t compIdx = 0; compIdx < 2; compIdx++) {
+					if (cabac)
+						H264_CABAC(mb->mvd_l1[mbPartIdx][subMbPartIdx][compIdx], mvd, 1, mbPartIdx, subMbPartIdx, compIdx);
+					else
+						H264_BITS_SE(mb->mvd_l1[mbPartIdx][subMbPartIdx][compIdx]);
+				}
 				H264_END_ARRAY(mvd_l1[mbPartIdx][subMbPartIdx]);
 			}
 		}
@@ -509,6 +606,7 @@ static int H264_SYNTAX_FCT(mb_pred)(struct h264_bitstream *bs,
 {
 	struct h264_slice_header *sh = &ctx->slice.hdr;
 	uint32_t pred_mode_flag = 0;
+	int cabac = ctx->pps->entropy_coding_mode_flag;
 
 	if (mb->MbPartPredMode[0] == PredMode_Intra_4x4 ||
 			mb->MbPartPredMode[0] == PredMode_Intra_8x8 ||
@@ -516,11 +614,16 @@ static int H264_SYNTAX_FCT(mb_pred)(struct h264_bitstream *bs,
 		if (mb->MbPartPredMode[0] == PredMode_Intra_4x4) {
 			H264_BEGIN_ARRAY(intra4x4_pred_mode);
 			for (uint32_t luma4x4BlkIdx = 0; luma4x4BlkIdx < 16; luma4x4BlkIdx++) {
-				H264_READ_BITS(pred_mode_flag, 1);
-				if (!pred_mode_flag)
-					H264_READ_BITS(mb->intra4x4_pred_mode[luma4x4BlkIdx], 3);
+				if (cabac)
+					H264_CABAC_READ(pred_mode_flag, prev_intra_pred_mode_flag);
 				else
+					H264_READ_BITS(pred_mode_flag, 1);
+				if (pred_mode_flag)
 					mb->intra4x4_pred_mode[luma4x4BlkIdx] = -1;
+				else if (cabac)
+					H264_CABAC_READ(mb->intra4x4_pred_mode[luma4x4BlkIdx], rem_intra_pred_mode);
+				else
+					H264_READ_BITS(mb->intra4x4_pred_mode[luma4x4BlkIdx], 3);
 				H264_FIELD(pred_mode, mb->intra4x4_pred_mode[luma4x4BlkIdx]);
 			}
 			H264_END_ARRAY(intra4x4_pred_mode);
@@ -529,11 +632,16 @@ static int H264_SYNTAX_FCT(mb_pred)(struct h264_bitstream *bs,
 		if (mb->MbPartPredMode[0] == PredMode_Intra_8x8) {
 			H264_BEGIN_ARRAY(intra8x8_pred_mode);
 			for (uint32_t luma8x8BlkIdx = 0; luma8x8BlkIdx < 4; luma8x8BlkIdx++) {
-				H264_READ_BITS(pred_mode_flag, 1);
-				if (!pred_mode_flag)
-					H264_READ_BITS(mb->intra8x8_pred_mode[luma8x8BlkIdx], 3);
+				if (cabac)
+					H264_CABAC_READ(pred_mode_flag, prev_intra_pred_mode_flag);
 				else
+					H264_READ_BITS(pred_mode_flag, 1);
+				if (pred_mode_flag)
 					mb->intra8x8_pred_mode[luma8x8BlkIdx] = -1;
+				else if (cabac)
+					H264_CABAC_READ(mb->intra8x8_pred_mode[luma8x8BlkIdx], rem_intra_pred_mode);
+				else
+					H264_READ_BITS(mb->intra8x8_pred_mode[luma8x8BlkIdx], 3);
 				H264_FIELD(pred_mode, mb->intra8x8_pred_mode[luma8x8BlkIdx]);
 			}
 			H264_END_ARRAY(intra8x8_pred_mode);
@@ -541,18 +649,24 @@ static int H264_SYNTAX_FCT(mb_pred)(struct h264_bitstream *bs,
 
 		if (ctx->sps_derived.ChromaArrayType == 1 ||
 				ctx->sps_derived.ChromaArrayType == 2) {
-			/* TODO: set in mb table */
-			H264_BITS_UE(mb->intra_chroma_pred_mode);
+			if (cabac)
+				H264_CABAC(mb->intra_chroma_pred_mode, intra_chroma_pred_mode);
+			else
+				H264_BITS_UE(mb->intra_chroma_pred_mode);
+			h264_get_mb_info(ctx, mb->mbAddr)->intra_chroma_pred_mode =
+				mb->intra_chroma_pred_mode;
 		}
 	} else if (mb->MbPartPredMode[0] != PredMode_Direct) {
 		if (sh->num_ref_idx_l0_active_minus1 > 0 ||
 				mb->mb_field_decoding_flag != sh->field_pic_flag) {
 			H264_BEGIN_ARRAY(ref_idx_l0);
 			for (uint32_t mbPartIdx = 0; mbPartIdx < mb->NumMbPart; mbPartIdx++) {
-				if (mb->MbPartPredMode[mbPartIdx] != PredMode_Pred_L1)
-					H264_BITS_TE(mb->ref_idx_l0[mbPartIdx], mb->max_ref_idx_0);
-				else
+				if (mb->MbPartPredMode[mbPartIdx] == PredMode_Pred_L1)
 					H264_FIELD(ref_idx_l0, 0);
+				else if (cabac)
+					H264_CABAC(mb->ref_idx_l0[mbPartIdx], ref_idx, 0, mbPartIdx);
+				else
+					H264_BITS_TE(mb->ref_idx_l0[mbPartIdx], mb->max_ref_idx_0);
 			}
 			H264_END_ARRAY(ref_idx_l0);
 		}
@@ -561,10 +675,12 @@ static int H264_SYNTAX_FCT(mb_pred)(struct h264_bitstream *bs,
 				mb->mb_field_decoding_flag != sh->field_pic_flag) {
 			H264_BEGIN_ARRAY(ref_idx_l1);
 			for (uint32_t mbPartIdx = 0; mbPartIdx < mb->NumMbPart; mbPartIdx++) {
-				if (mb->MbPartPredMode[mbPartIdx] != PredMode_Pred_L0)
-					H264_BITS_TE(mb->ref_idx_l1[mbPartIdx], mb->max_ref_idx_1);
-				else
+				if (mb->MbPartPredMode[mbPartIdx] == PredMode_Pred_L0)
 					H264_FIELD(ref_idx_l1, 0);
+				else if (cabac)
+					H264_CABAC(mb->ref_idx_l1[mbPartIdx], ref_idx, 1, mbPartIdx);
+				else
+					H264_BITS_TE(mb->ref_idx_l1[mbPartIdx], mb->max_ref_idx_1);
 			}
 			H264_END_ARRAY(ref_idx_l1);
 		}
@@ -574,8 +690,12 @@ static int H264_SYNTAX_FCT(mb_pred)(struct h264_bitstream *bs,
 			H264_BEGIN_ARRAY(mvd_l0[mbPartIdx]);
 			if (mb->MbPartPredMode[mbPartIdx] != PredMode_Pred_L1) {
 				H264_BEGIN_ARRAY(mvd_l0[mbPartIdx][0]);
-				for (uint32_t compIdx = 0; compIdx < 2; compIdx++)
-					H264_BITS_SE(mb->mvd_l0[mbPartIdx][0][compIdx]);
+				for (uint32_t compIdx = 0; compIdx < 2; compIdx++) {
+					if (cabac)
+						H264_CABAC(mb->mvd_l0[mbPartIdx][0][compIdx], mvd, 0, mbPartIdx, 0, compIdx);
+					else
+						H264_BITS_SE(mb->mvd_l0[mbPartIdx][0][compIdx]);
+				}
 				H264_END_ARRAY(mvd_l0[mbPartIdx][0]);
 			}
 			H264_END_ARRAY(mvd_l0[mbPartIdx]);
@@ -587,8 +707,12 @@ static int H264_SYNTAX_FCT(mb_pred)(struct h264_bitstream *bs,
 			H264_BEGIN_ARRAY(mvd_l1[mbPartIdx]);
 			if (mb->MbPartPredMode[mbPartIdx] != PredMode_Pred_L0) {
 				H264_BEGIN_ARRAY(mvd_l1[mbPartIdx][0]);
-				for (uint32_t compIdx = 0; compIdx < 2; compIdx++)
-					H264_BITS_SE(mb->mvd_l1[mbPartIdx][0][compIdx]);
+				for (uint32_t compIdx = 0; compIdx < 2; compIdx++) {
+					if (cabac)
+						H264_CABAC(mb->mvd_l1[mbPartIdx][0][compIdx], mvd, 1, mbPartIdx, 0, compIdx);
+					else
+						H264_BITS_SE(mb->mvd_l1[mbPartIdx][0][compIdx]);
+				}
 
 				H264_END_ARRAY(mvd_l1[mbPartIdx][0]);
 			}
@@ -607,6 +731,7 @@ static int H264_SYNTAX_FCT(macroblock_layer)(struct h264_bitstream *bs,
 {
 	int res = 0;
 	uint32_t i = 0;
+	int cabac = ctx->pps->entropy_coding_mode_flag;
 
 	int transform_8x8_mode_flag = ctx->pps->transform_8x8_mode_flag;
 	int direct_8x8_inference_flag = ctx->sps->direct_8x8_inference_flag;
@@ -620,11 +745,16 @@ static int H264_SYNTAX_FCT(macroblock_layer)(struct h264_bitstream *bs,
 	H264_FIELD(mb_type, mb->raw_mb_type);
 
 	if (mb->mb_type == H264_MB_TYPE_I_PCM) {
+		if (cabac) {
+			res = h264_cabac_read_pcm_begin(&ctx->cabac);
+			ULOG_ERRNO_RETURN_ERR_IF(res < 0, -res);
+		}
 		while (!h264_bs_byte_aligned(bs)) {
 			H264_READ_BITS(pcm_alignment_zero_bit, 1);
 			ULOG_ERRNO_RETURN_ERR_IF(pcm_alignment_zero_bit != 0, EIO);
 		}
 
+		mb->levels_dirty |= H264_MB_LEVELS_PCM;
 		H264_BEGIN_ARRAY(pcm_sample_luma);
 		for (i = 0; i < 256; i++)
 			H264_BITS(mb->pcm_sample_luma[i], ctx->sps_derived.BitDepthLuma);
@@ -643,6 +773,11 @@ static int H264_SYNTAX_FCT(macroblock_layer)(struct h264_bitstream *bs,
 			for (uint32_t blkIdx = 0; blkIdx < 16; blkIdx++)
 				h264_set_nz_coeff(ctx, mb->mbAddr, comp, blkIdx, 16);
 		}
+
+		if (cabac) {
+			res = h264_cabac_read_pcm_end(&ctx->cabac, bs);
+			ULOG_ERRNO_RETURN_ERR_IF(res < 0, -res);
+		}
 	} else {
 		noSubMbPartSizeLessThan8x8Flag = 1;
 		if (mb->mb_type != H264_MB_TYPE_I_NxN &&
@@ -660,7 +795,10 @@ static int H264_SYNTAX_FCT(macroblock_layer)(struct h264_bitstream *bs,
 			}
 		} else {
 			if (transform_8x8_mode_flag && mb->mb_type == H264_MB_TYPE_I_NxN) {
-				H264_BITS(mb->transform_size_8x8_flag, 1);
+				if (cabac)
+					H264_CABAC(mb->transform_size_8x8_flag, transform_size_8x8_flag);
+				else
+					H264_BITS(mb->transform_size_8x8_flag, 1);
 				if (mb->transform_size_8x8_flag)
 					mb->MbPartPredMode[0] = PredMode_Intra_8x8;
 			}
@@ -677,14 +815,22 @@ static int H264_SYNTAX_FCT(macroblock_layer)(struct h264_bitstream *bs,
 					mb->mb_type != H264_MB_TYPE_I_NxN &&
 					noSubMbPartSizeLessThan8x8Flag &&
 					(mb->mb_type != H264_MB_TYPE_B_Direct_16x16 || direct_8x8_inference_flag)) {
-				H264_BITS(mb->transform_size_8x8_flag, 1);
+				if (cabac)
+					H264_CABAC(mb->transform_size_8x8_flag, transform_size_8x8_flag);
+				else
+					H264_BITS(mb->transform_size_8x8_flag, 1);
 			}
 		}
+		h264_get_mb_info(ctx, mb->mbAddr)->transform_size_8x8_flag =
+			mb->transform_size_8x8_flag;
 
 		if (mb->CodedBlockPatternLuma > 0 ||
 				mb->CodedBlockPatternChroma > 0 ||
 				mb->MbPartPredMode[0] == PredMode_Intra_16x16) {
-			H264_BITS_SE(mb->mb_qp_delta);
+			if (cabac)
+				H264_CABAC(mb->mb_qp_delta, mb_qp_delta);
+			else
+				H264_BITS_SE(mb->mb_qp_delta);
 			H264_BEGIN_STRUCT(residual);
 			res = H264_SYNTAX_FCT(residual(bs, ctx, mb, 0, 15));
 			H264_END_STRUCT(residual);
@@ -698,30 +844,59 @@ static int H264_SYNTAX_FCT(macroblock_layer)(struct h264_bitstream *bs,
 /* clang-format on */
 
 
-static int H264_SYNTAX_FCT(slice_data_internal)(struct h264_bitstream *bs,
-						struct h264_ctx *ctx,
-						const struct h264_ctx_cbs *cbs,
-						void *userdata)
+/**
+ * Report a run of skipped macroblocks, either at once to the consumers of
+ * slice_data_mb_run() or macroblock by macroblock to slice_data_mb()
+ */
+static void H264_SYNTAX_FCT(skip_run_cb)(struct h264_ctx *ctx,
+					 const struct h264_ctx_cbs *cbs,
+					 void *userdata,
+					 uint32_t mbAddr,
+					 uint32_t count)
+{
+	if (cbs == NULL)
+		return;
+
+	if (cbs->slice_data_mb_run != NULL) {
+		H264_CB(ctx,
+			cbs,
+			userdata,
+			slice_data_mb_run,
+			&ctx->slice.hdr,
+			mbAddr,
+			count,
+			ctx->mb->mb_type);
+		return;
+	}
+
+	if (cbs->slice_data_mb == NULL)
+		return;
+	for (uint32_t i = 0; i < count; i++) {
+		H264_CB(ctx,
+			cbs,
+			userdata,
+			slice_data_mb,
+			&ctx->slice.hdr,
+			mbAddr,
+			ctx->mb->mb_type);
+		mbAddr = h264_next_mb_addr(ctx, mbAddr);
+	}
+}
+
+
+static int H264_SYNTAX_FCT(slice_data_cavlc)(struct h264_bitstream *bs,
+					     struct h264_ctx *ctx,
+					     const struct h264_ctx_cbs *cbs,
+					     void *userdata,
+					     uint32_t *mb_count)
 {
 	int res = 0;
-	uint32_t i = 0;
 	uint32_t CurrMbAddr = 0;
 	int prev_mb_skipped = 0;
-	uint32_t mb_count = 0;
 	struct h264_slice_header *sh = &ctx->slice.hdr;
 	uint32_t mb_skip_run = 0;
 	int mb_field_decoding_flag = 0;
 
-	/* CABAC not supported for parsing */
-	if (ctx->pps->entropy_coding_mode_flag)
-		return 0;
-
-	/* Start of slice data, reset MB info table */
-	H264_CB(ctx, cbs, userdata, slice_data_begin, &ctx->slice.hdr);
-	h264_clear_macroblock_table(ctx);
-
-	h264_gen_slice_group_map(ctx);
-
 	CurrMbAddr = sh->first_mb_in_slice * (1 + ctx->derived.MbaffFrameFlag);
 	prev_mb_skipped = 0;
 	do {
@@ -732,17 +907,18 @@ static int H264_SYNTAX_FCT(slice_data_internal)(struct h264_bitstream *bs,
 			H264_BEGIN_ARRAY_ITEM();
 			H264_FIELD(mb_skip_run, mb_skip_run);
 			H264_END_ARRAY_ITEM();
-			for (i = 0; i < mb_skip_run; i++) {
-				h264_new_macroblock(ctx, CurrMbAddr, 1, -1);
-				H264_CB(ctx,
-					cbs,
-					userdata,
-					slice_data_mb,
-					&ctx->slice.hdr,
-					ctx->mb->mbAddr,
-					ctx->mb->mb_type);
-				CurrMbAddr = h264_next_mb_addr(ctx, CurrMbAddr);
-				mb_count++;
+			if (mb_skip_run > 0) {
+				res = h264_new_skipped_macroblocks(
+					ctx, CurrMbAddr, mb_skip_run);
+				ULOG_ERRNO_RETURN_ERR_IF(res < 0, -res);
+				H264_SYNTAX_FCT(skip_run_cb)(ctx,
+							     cbs,
+							     userdata,
+							     CurrMbAddr,
+							     mb_skip_run);
+				CurrMbAddr = h264_next_mb_addr(ctx,
+							       ctx->mb->mbAddr);
+				*mb_count += mb_skip_run;
 			}
 			if (mb_skip_run > 0 && !h264_bs_more_rbsp_data(bs))
 				break;
@@ -776,12 +952,136 @@ static int H264_SYNTAX_FCT(slice_data_internal)(struct h264_bitstream *bs,
 			ctx->mb->mb_type);
 
 		CurrMbAddr = h264_next_mb_addr(ctx, CurrMbAddr);
-		mb_count++;
+		(*mb_count)++;
 
 	} while (h264_bs_more_rbsp_data(bs));
 
+	return 0;
+}
+
+
+static int H264_SYNTAX_FCT(slice_data_cabac)(struct h264_bitstream *bs,
+					     struct h264_ctx *ctx,
+					     const struct h264_ctx_cbs *cbs,
+					     void *userdata,
+					     uint32_t *mb_count)
+{
+	int res = 0;
+	uint32_t CurrMbAddr = 0;
+	int prev_mb_skipped = 0;
+	struct h264_slice_header *sh = &ctx->slice.hdr;
+	struct h264_macroblock *mb = NULL;
+	int cabac_alignment_one_bit = 0;
+	int mb_skip_flag = 0;
+	int mb_field_decoding_flag = 0;
+	int end_of_slice_flag = 0;
+
+	while (!h264_bs_byte_aligned(bs)) {
+		H264_READ_BITS(cabac_alignment_one_bit, 1);
+		ULOG_ERRNO_RETURN_ERR_IF(cabac_alignment_one_bit != 1, EIO);
+	}
+
+	res = h264_cabac_init_dec(&ctx->cabac, ctx, bs);
+	ULOG_ERRNO_RETURN_ERR_IF(res < 0, -res);
+
+	CurrMbAddr = sh->first_mb_in_slice * (1 + ctx->derived.MbaffFrameFlag);
+	prev_mb_skipped = 0;
+	do {
+		ULOG_ERRNO_RETURN_ERR_IF(
+			CurrMbAddr >= ctx->derived.PicSizeInMbs, EIO);
+
+		/* Neighbours for the mb_skip_flag and mb_field_decoding_flag
+		 * contexts */
+		h264_peek_macroblock(ctx, CurrMbAddr);
+		mb = ctx->mb;
+
+		mb_skip_flag = 0;
+		if (ctx->slice.type != H264_SLICE_TYPE_I &&
+		    ctx->slice.type != H264_SLICE_TYPE_SI)
+			H264_CABAC_READ(mb_skip_flag, mb_skip_flag);
+
+		H264_BEGIN_ARRAY_ITEM();
+		H264_FIELD(mbAddr, CurrMbAddr);
+		H264_FIELD(MbaffFrameFlag, ctx->derived.MbaffFrameFlag);
+		H264_FIELD(mb_skip_flag, mb_skip_flag);
+
+		if (!mb_skip_flag) {
+			mb_field_decoding_flag = -1;
+			if (ctx->derived.MbaffFrameFlag &&
+			    (CurrMbAddr % 2 == 0 || prev_mb_skipped)) {
+				H264_CABAC(mb_field_decoding_flag,
+					   mb_field_decoding_flag);
+			}
+
+			h264_new_macroblock(
+				ctx, CurrMbAddr, 0, mb_field_decoding_flag);
+			res = H264_SYNTAX_FCT(
+				macroblock_layer(bs, ctx, ctx->mb));
+		} else {
+			h264_new_macroblock(ctx, CurrMbAddr, 1, -1);
+		}
+
+		H264_END_ARRAY_ITEM();
+
+		ULOG_ERRNO_RETURN_ERR_IF(res < 0, -res);
+
+		H264_CB(ctx,
+			cbs,
+			userdata,
+			slice_data_mb,
+			&ctx->slice.hdr,
+			ctx->mb->mbAddr,
+			ctx->mb->mb_type);
+
+		ctx->cabac.prev_mb_qp_delta = ctx->mb->mb_qp_delta;
+		prev_mb_skipped = mb_skip_flag;
+
+		if (ctx->derived.MbaffFrameFlag && CurrMbAddr % 2 == 0) {
+			end_of_slice_flag = 0;
+		} else {
+			res = h264_cabac_read_end_of_slice_flag(
+				&ctx->cabac, ctx, &end_of_slice_flag);
+			ULOG_ERRNO_RETURN_ERR_IF(res < 0, -res);
+		}
+
+		CurrMbAddr = h264_next_mb_addr(ctx, CurrMbAddr);
+		(*mb_count)++;
+
+	} while (!end_of_slice_flag);
+
+	return 0;
+}
+
+
+static int H264_SYNTAX_FCT(slice_data_internal)(struct h264_bitstream *bs,
+						struct h264_ctx *ctx,
+						const struct h264_ctx_cbs *cbs,
+						void *userdata)
+{
+	int res = 0;
+	uint32_t mb_count = 0;
+
+	/* Start of slice data, reset MB info table */
+	H264_CB(ctx, cbs, userdata, slice_data_begin, &ctx->slice.hdr);
+	res = h264_alloc_macroblock_table(ctx);
+	ULOG_ERRNO_RETURN_ERR_IF(res < 0, -res);
+	h264_clear_macroblock_table(ctx);
+
+	res = h264_gen_slice_group_map(ctx);
+	ULOG_ERRNO_RETURN_ERR_IF(res < 0, -res);
+
+	if (ctx->pps->entropy_coding_mode_flag) {
+		res = H264_SYNTAX_FCT(slice_data_cabac)(
+			bs, ctx, cbs, userdata, &mb_count);
+	} else {
+		res = H264_SYNTAX_FCT(slice_data_cavlc)(
+			bs, ctx, cbs, userdata, &mb_count);
+	}
+	ULOG_ERRNO_RETURN_ERR_IF(res < 0, -res);
+
 	/* End of slice data */
 	H264_CB(ctx, cbs, userdata, slice_data_end, &ctx->slice.hdr, mb_count);
+	ctx->slice.mb_count = mb_count;
 
 	return 0;
 }
@@ -800,10 +1100,14 @@ static int H264_SYNTAX_FCT(slice_data)(struct h264_bitstream *bs,
 #if H264_SYNTAX_OP_KIND == H264_SYNTAX_OP_KIND_READ
 
 	/* Save raw information about data, then parse if needed */
+	const uint8_t *buf = NULL;
+	size_t len = 0, off = 0;
+	buf = H264_READ_RAW_BUF(&len);
+	off = H264_READ_RAW_OFF();
 	ctx->slice.rawdata.partial = bs->cache;
 	ctx->slice.rawdata.partialbits = bs->cachebits;
-	ctx->slice.rawdata.buf = bs->cdata + bs->off;
-	ctx->slice.rawdata.len = bs->len - bs->off;
+	ctx->slice.rawdata.buf = buf + off;
+	ctx->slice.rawdata.len = len - off;
 	if ((H264_READ_FLAGS() & H264_READER_FLAGS_SLICE_DATA) != 0) {
 		res = H264_SYNTAX_FCT(slice_data_internal)(
 			bs, ctx, cbs, userdata);
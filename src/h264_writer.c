@@ -68,8 +68,8 @@ static int h264_setup_grey_i_macroblock(struct h264_ctx *ctx, uint32_t i)
 	mb->MbPartPredMode[0] = PredMode_Intra_16x16;
 	mb->intra_chroma_pred_mode = IntraChromaDC;
 
-	ctx->slice.mb_table.info[i].mb_type = mb->mb_type;
-	ctx->slice.mb_table.info[i].intra_chroma_pred_mode =
+	h264_get_mb_info(ctx, mbAddr)->mb_type = mb->mb_type;
+	h264_get_mb_info(ctx, mbAddr)->intra_chroma_pred_mode =
 		mb->intra_chroma_pred_mode;
 
 	return 0;
@@ -84,12 +84,6 @@ static int h264_write_grey_i_slice_cabac(struct h264_bitstream *bs,
 	struct h264_cabac cabac;
 	struct h264_macroblock *mb = NULL;
 
-	/* cabac_alignment_one_bit */
-	while (!h264_bs_byte_aligned(bs)) {
-		res = h264_bs_write_bits(bs, 1, 1);
-		ULOG_ERRNO_RETURN_ERR_IF(res < 0, -res);
-	}
-
 	/* Initialize cabac encoder */
 	memset(&cabac, 0, sizeof(cabac));
 	res = h264_cabac_init_enc(&cabac, ctx, bs);
@@ -166,10 +160,6 @@ static int h264_write_grey_i_slice_cavlc(struct h264_bitstream *bs,
 		ULOG_ERRNO_RETURN_ERR_IF(res < 0, -res);
 	}
 
-	/* Finish nalu */
-	res = h264_bs_write_rbsp_trailing_bits(bs);
-	ULOG_ERRNO_RETURN_ERR_IF(res < 0, -res);
-
 	return 0;
 }
 
@@ -182,12 +172,6 @@ static int h264_write_skipped_p_slice_cabac(struct h264_bitstream *bs,
 	struct h264_cabac cabac;
 	struct h264_macroblock *mb = NULL;
 
-	/* cabac_alignment_one_bit */
-	while (!h264_bs_byte_aligned(bs)) {
-		res = h264_bs_write_bits(bs, 1, 1);
-		ULOG_ERRNO_RETURN_ERR_IF(res < 0, -res);
-	}
-
 	/* Initialize cabac encoder */
 	memset(&cabac, 0, sizeof(cabac));
 	res = h264_cabac_init_enc(&cabac, ctx, bs);
@@ -229,8 +213,160 @@ static int h264_write_skipped_p_slice_cavlc(struct h264_bitstream *bs,
 	res = h264_bs_write_bits_ue(bs, mb_count);
 	ULOG_ERRNO_RETURN_ERR_IF(res < 0, -res);
 
-	/* Finish NALU */
-	res = h264_bs_write_rbsp_trailing_bits(bs);
+	return 0;
+}
+
+
+static void h264_slice_template_key(struct h264_ctx *ctx,
+				    uint32_t mb_count,
+				    int grey_i,
+				    struct h264_slice_template *key)
+{
+	memset(key, 0, sizeof(*key));
+	key->grey_i = grey_i;
+	key->slice_type = ctx->slice.type;
+	key->pic_parameter_set_id = ctx->slice.hdr.pic_parameter_set_id;
+	key->first_mb_in_slice = ctx->slice.hdr.first_mb_in_slice;
+	key->mb_count = mb_count;
+	if (ctx->pps->entropy_coding_mode_flag) {
+		key->SliceQPLuma = ctx->derived.SliceQPLuma;
+		key->cabac_init_idc = ctx->slice.hdr.cabac_init_idc;
+	}
+}
+
+
+static int h264_slice_template_match(const struct h264_slice_template *tmpl,
+				     const struct h264_slice_template *key)
+{
+	return tmpl->data != NULL && tmpl->grey_i == key->grey_i &&
+	       tmpl->slice_type == key->slice_type &&
+	       tmpl->pic_parameter_set_id == key->pic_parameter_set_id &&
+	       tmpl->first_mb_in_slice == key->first_mb_in_slice &&
+	       tmpl->mb_count == key->mb_count &&
+	       tmpl->SliceQPLuma == key->SliceQPLuma &&
+	       tmpl->cabac_init_idc == key->cabac_init_idc;
+}
+
+
+/**
+ * Encode the slice data of a grey I or skipped P slice in a new template;
+ * the data is encoded without emulation prevention, as it is escaped when
+ * copied to the final bitstream
+ */
+static int h264_slice_template_fill(struct h264_ctx *ctx,
+				    struct h264_slice_template *tmpl)
+{
+	int res = 0;
+	struct h264_bitstream bs;
+	size_t bits = 0;
+	size_t len = 0;
+
+	h264_bs_init(&bs, NULL, 0, 0);
+
+	if (tmpl->grey_i && ctx->pps->entropy_coding_mode_flag)
+		res = h264_write_grey_i_slice_cabac(&bs, ctx, tmpl->mb_count);
+	else if (tmpl->grey_i)
+		res = h264_write_grey_i_slice_cavlc(&bs, ctx, tmpl->mb_count);
+	else if (ctx->pps->entropy_coding_mode_flag)
+		res = h264_write_skipped_p_slice_cabac(
+			&bs, ctx, tmpl->mb_count);
+	else
+		res = h264_write_skipped_p_slice_cavlc(
+			&bs, ctx, tmpl->mb_count);
+	if (res < 0)
+		goto error;
+
+	/* Pad the last byte to be able to take the buffer */
+	bits = bs.off * 8 + bs.cachebits;
+	if (!h264_bs_byte_aligned(&bs)) {
+		res = h264_bs_write_bits(&bs, 0, 8 - bs.cachebits);
+		if (res < 0)
+			goto error;
+	}
+
+	res = h264_bs_acquire_buf(&bs, &tmpl->data, &len);
+	if (res < 0)
+		goto error;
+	tmpl->bits = bits;
+	return 0;
+
+error:
+	h264_bs_clear(&bs);
+	return res;
+}
+
+
+/**
+ * Copy the bits of a template, 64 bits at a time; the bitstream applies
+ * the emulation prevention according to the bytes already written
+ */
+static int h264_slice_template_copy(struct h264_bitstream *bs,
+				    const struct h264_slice_template *tmpl)
+{
+	int res = 0;
+	const uint8_t *data = tmpl->data;
+	size_t bits = tmpl->bits;
+	uint64_t v = 0;
+
+	for (; bits >= 64; bits -= 64, data += 8) {
+		v = 0;
+		for (uint32_t i = 0; i < 8; i++)
+			v = (v << 8) | data[i];
+		res = h264_bs_write_bits(bs, v, 64);
+		if (res < 0)
+			return res;
+	}
+	for (; bits >= 8; bits -= 8, data++) {
+		res = h264_bs_write_bits(bs, *data, 8);
+		if (res < 0)
+			return res;
+	}
+	if (bits > 0) {
+		res = h264_bs_write_bits(bs, *data >> (8 - bits), bits);
+		if (res < 0)
+			return res;
+	}
+
+	return 0;
+}
+
+
+/**
+ * Write the slice data of a grey I or skipped P slice: it only depends on
+ * the entries of the template key, not on the rest of the slice header, so
+ * it is encoded once and then copied after each new slice header
+ */
+static int h264_write_slice_template(struct h264_bitstream *bs,
+				     struct h264_ctx *ctx,
+				     uint32_t mb_count,
+				     int grey_i)
+{
+	int res = 0;
+	struct h264_slice_template key;
+	struct h264_slice_template *tmpl = NULL;
+
+	h264_slice_template_key(ctx, mb_count, grey_i, &key);
+	for (uint32_t i = 0; i < H264_SLICE_TEMPLATE_COUNT; i++) {
+		if (h264_slice_template_match(&ctx->slice_templates.entries[i],
+					      &key)) {
+			tmpl = &ctx->slice_templates.entries[i];
+			break;
+		}
+	}
+
+	if (tmpl == NULL) {
+		/* Replace the oldest template */
+		tmpl = &ctx->slice_templates
+				.entries[ctx->slice_templates.next];
+		ctx->slice_templates.next = (ctx->slice_templates.next + 1) %
+					    H264_SLICE_TEMPLATE_COUNT;
+		free(tmpl->data);
+		*tmpl = key;
+		res = h264_slice_template_fill(ctx, tmpl);
+		ULOG_ERRNO_RETURN_ERR_IF(res < 0, -res);
+	}
+
+	res = h264_slice_template_copy(bs, tmpl);
 	ULOG_ERRNO_RETURN_ERR_IF(res < 0, -res);
 
 	return 0;
@@ -268,11 +404,19 @@ int h264_write_grey_i_slice(struct h264_bitstream *bs,
 	res = h264_write_nalu(bs, ctx);
 	ULOG_ERRNO_RETURN_ERR_IF(res < 0, -res);
 
-	if (ctx->pps->entropy_coding_mode_flag) {
-		res = h264_write_grey_i_slice_cabac(bs, ctx, mb_count);
+	/* cabac_alignment_one_bit */
+	while (ctx->pps->entropy_coding_mode_flag &&
+	       !h264_bs_byte_aligned(bs)) {
+		res = h264_bs_write_bits(bs, 1, 1);
 		ULOG_ERRNO_RETURN_ERR_IF(res < 0, -res);
-	} else {
-		res = h264_write_grey_i_slice_cavlc(bs, ctx, mb_count);
+	}
+
+	res = h264_write_slice_template(bs, ctx, mb_count, 1);
+	ULOG_ERRNO_RETURN_ERR_IF(res < 0, -res);
+
+	/* Finish NALU (already done by the CABAC termination) */
+	if (!ctx->pps->entropy_coding_mode_flag) {
+		res = h264_bs_write_rbsp_trailing_bits(bs);
 		ULOG_ERRNO_RETURN_ERR_IF(res < 0, -res);
 	}
 
@@ -297,11 +441,19 @@ int h264_write_skipped_p_slice(struct h264_bitstream *bs,
 	res = h264_write_nalu(bs, ctx);
 	ULOG_ERRNO_RETURN_ERR_IF(res < 0, -res);
 
-	if (ctx->pps->entropy_coding_mode_flag) {
-		res = h264_write_skipped_p_slice_cabac(bs, ctx, mb_count);
+	/* cabac_alignment_one_bit */
+	while (ctx->pps->entropy_coding_mode_flag &&
+	       !h264_bs_byte_aligned(bs)) {
+		res = h264_bs_write_bits(bs, 1, 1);
 		ULOG_ERRNO_RETURN_ERR_IF(res < 0, -res);
-	} else {
-		res = h264_write_skipped_p_slice_cavlc(bs, ctx, mb_count);
+	}
+
+	res = h264_write_slice_template(bs, ctx, mb_count, 0);
+	ULOG_ERRNO_RETURN_ERR_IF(res < 0, -res);
+
+	/* Finish NALU (already done by the CABAC termination) */
+	if (!ctx->pps->entropy_coding_mode_flag) {
+		res = h264_bs_write_rbsp_trailing_bits(bs);
 		ULOG_ERRNO_RETURN_ERR_IF(res < 0, -res);
 	}
 
@@ -0,0 +1,208 @@
+/**
+ * Copyright (c) 2016 Parrot Drones SAS
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *   * Redistributions of source code must retain the above copyright
+ *     notice, this list of conditions and the following disclaimer.
+ *   * Redistributions in binary form must reproduce the above copyright
+ *     notice, this list of conditions and the following disclaimer in the
+ *     documentation and/or other materials provided with the distribution.
+ *   * Neither the name of the Parrot Drones SAS Company nor the
+ *     names of its contributors may be used to endorse or promote products
+ *     derived from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE PARROT DRONES SAS COMPANY BE LIABLE FOR
+ * ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+ * OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/*
+ * Unit tests of the internal functions of the library; each test compares
+ * an optimized code path with a straightforward implementation of the spec.
+ * Usage: h264-test [<test name>...], all tests are run by default.
+ */
+
+#include "h264_test.h"
+
+
+int h264_test_ctx_new(int cabac,
+		      uint32_t width,
+		      uint32_t height,
+		      struct h264_ctx **ret_obj)
+{
+	int res = 0;
+	struct h264_ctx *ctx = NULL;
+	struct h264_sps sps;
+	struct h264_pps pps;
+
+	res = h264_ctx_new(&ctx);
+	if (res < 0)
+		return res;
+
+	/* Main profile, 8-bit 4:2:0 progressive frames */
+	memset(&sps, 0, sizeof(sps));
+	sps.profile_idc = 77;
+	sps.level_idc = 40;
+	sps.chroma_format_idc = 1;
+	sps.log2_max_frame_num_minus4 = 4;
+	sps.pic_order_cnt_type = 2;
+	sps.max_num_ref_frames = 1;
+	sps.pic_width_in_mbs_minus1 = width - 1;
+	sps.pic_height_in_map_units_minus1 = height - 1;
+	sps.frame_mbs_only_flag = 1;
+	sps.direct_8x8_inference_flag = 1;
+	res = h264_ctx_set_sps(ctx, &sps);
+	if (res < 0)
+		goto error;
+
+	memset(&pps, 0, sizeof(pps));
+	pps.entropy_coding_mode_flag = cabac;
+	res = h264_ctx_set_pps(ctx, &pps);
+	if (res < 0)
+		goto error;
+
+	*ret_obj = ctx;
+	return 0;
+
+error:
+	h264_ctx_destroy(ctx);
+	return res;
+}
+
+
+int h264_test_stream_add(struct h264_test_stream *stream,
+			 const uint8_t *buf,
+			 size_t len)
+{
+	static const uint8_t start_code[] = {0x00, 0x00, 0x00, 0x01};
+	uint8_t *newbuf = NULL;
+	size_t size = stream->len + sizeof(start_code) + len;
+
+	if (size > stream->size) {
+		newbuf = realloc(stream->buf, 2 * size);
+		if (newbuf == NULL)
+			return -ENOMEM;
+		stream->buf = newbuf;
+		stream->size = 2 * size;
+	}
+
+	memcpy(stream->buf + stream->len, start_code, sizeof(start_code));
+	stream->len += sizeof(start_code);
+	memcpy(stream->buf + stream->len, buf, len);
+	stream->len += len;
+	return 0;
+}
+
+
+int h264_test_stream_add_ps(struct h264_test_stream *stream,
+			    struct h264_ctx *ctx)
+{
+	int res = 0;
+	struct h264_nalu_header nh;
+	struct h264_bitstream bs;
+	static const enum h264_nalu_type types[] = {
+		H264_NALU_TYPE_SPS,
+		H264_NALU_TYPE_PPS,
+	};
+	size_t i = 0;
+
+	for (i = 0; i < ARRAY_SIZE(types); i++) {
+		memset(&nh, 0, sizeof(nh));
+		nh.nal_ref_idc = 3;
+		nh.nal_unit_type = types[i];
+		res = h264_ctx_set_nalu_header(ctx, &nh);
+		if (res < 0)
+			return res;
+		h264_bs_init(&bs, NULL, 0, 1);
+		res = h264_write_nalu(&bs, ctx);
+		if (res == 0)
+			res = h264_test_stream_add(stream, bs.data, bs.off);
+		h264_bs_clear(&bs);
+		if (res < 0)
+			return res;
+	}
+
+	return 0;
+}
+
+
+void h264_test_stream_clear(struct h264_test_stream *stream)
+{
+	free(stream->buf);
+	memset(stream, 0, sizeof(*stream));
+}
+
+
+struct test {
+	const char *name;
+	int (*fn)(void);
+};
+
+
+static const struct test tests[] = {
+	{"bitstream", &h264_test_bitstream},
+	{"bitstream_write", &h264_test_bitstream_write},
+	{"vlc", &h264_test_vlc},
+	{"find_nalu", &h264_test_find_nalu},
+	{"find_nalus", &h264_test_find_nalus},
+	{"unescape", &h264_test_unescape},
+	{"sei_zero_copy", &h264_test_sei_zero_copy},
+	{"bac_enc", &h264_test_bac_enc},
+	{"bac_state_init", &h264_test_bac_state_init},
+	{"cabac_init_cache", &h264_test_cabac_init_cache},
+	{"cabac_pcm", &h264_test_cabac_pcm},
+	{"fmo", &h264_test_fmo},
+	{"neighbours", &h264_test_neighbours},
+	{"mb_table", &h264_test_mb_table},
+	{"writer", &h264_test_writer},
+	{"peek", &h264_test_peek},
+	{"push", &h264_test_push},
+	{"early_au_end", &h264_test_early_au_end},
+};
+
+
+static int run_test(const struct test *test)
+{
+	int res = (*test->fn)();
+	printf("%-20s %s\n", test->name, res < 0 ? "FAILED" : "OK");
+	return res;
+}
+
+
+int main(int argc, char *argv[])
+{
+	int failed = 0;
+	int found = 0;
+	int a = 0;
+	size_t i = 0;
+
+	if (argc < 2) {
+		for (i = 0; i < ARRAY_SIZE(tests); i++)
+			failed += run_test(&tests[i]) < 0;
+		return failed ? EXIT_FAILURE : EXIT_SUCCESS;
+	}
+
+	for (a = 1; a < argc; a++) {
+		found = 0;
+		for (i = 0; i < ARRAY_SIZE(tests); i++) {
+			if (strcmp(argv[a], tests[i].name) != 0)
+				continue;
+			failed += run_test(&tests[i]) < 0;
+			found = 1;
+		}
+		if (!found) {
+			fprintf(stderr, "unknown test: %s\n", argv[a]);
+			failed++;
+		}
+	}
+
+	return failed ? EXIT_FAILURE : EXIT_SUCCESS;
+}
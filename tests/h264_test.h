@@ -0,0 +1,139 @@
+/**
+ * Copyright (c) 2016 Parrot Drones SAS
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *   * Redistributions of source code must retain the above copyright
+ *     notice, this list of conditions and the following disclaimer.
+ *   * Redistributions in binary form must reproduce the above copyright
+ *     notice, this list of conditions and the following disclaimer in the
+ *     documentation and/or other materials provided with the distribution.
+ *   * Neither the name of the Parrot Drones SAS Company nor the
+ *     names of its contributors may be used to endorse or promote products
+ *     derived from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE PARROT DRONES SAS COMPANY BE LIABLE FOR
+ * ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+ * OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef _H264_TEST_H_
+#define _H264_TEST_H_
+
+#include "h264_priv.h"
+
+
+/* Check a condition, report and fail the current test if false */
+#define H264_TEST_CHECK(_cond, ...)                                            \
+	do {                                                                   \
+		if (!(_cond)) {                                                \
+			fprintf(stderr, "%s:%d: ", __FILE__, __LINE__);        \
+			fprintf(stderr, __VA_ARGS__);                          \
+			fputc('\n', stderr);                                   \
+			return -EPROTO;                                        \
+		}                                                              \
+	} while (0)
+
+
+/* Deterministic pseudo-random numbers (xorshift32), seed must not be 0 */
+static inline uint32_t h264_test_random(uint32_t *seed)
+{
+	*seed ^= *seed << 13;
+	*seed ^= *seed >> 17;
+	*seed ^= *seed << 5;
+	return *seed;
+}
+
+
+/* Byte stream (Annex B) built by the tests */
+struct h264_test_stream {
+	uint8_t *buf;
+	size_t len;
+	size_t size;
+};
+
+
+/* New context with an active Main profile SPS and a PPS (id 0 for both)
+ * for width x height macroblocks */
+int h264_test_ctx_new(int cabac,
+		      uint32_t width,
+		      uint32_t height,
+		      struct h264_ctx **ret_obj);
+
+
+/* Append a NAL unit with a 4-byte start code */
+int h264_test_stream_add(struct h264_test_stream *stream,
+			 const uint8_t *buf,
+			 size_t len);
+
+
+/* Append the SPS and PPS of the context */
+int h264_test_stream_add_ps(struct h264_test_stream *stream,
+			    struct h264_ctx *ctx);
+
+
+void h264_test_stream_clear(struct h264_test_stream *stream);
+
+
+int h264_test_bitstream(void);
+
+
+int h264_test_bitstream_write(void);
+
+
+int h264_test_vlc(void);
+
+
+int h264_test_find_nalu(void);
+
+
+int h264_test_find_nalus(void);
+
+
+int h264_test_unescape(void);
+
+
+int h264_test_sei_zero_copy(void);
+
+
+int h264_test_bac_enc(void);
+
+
+int h264_test_bac_state_init(void);
+
+
+int h264_test_cabac_init_cache(void);
+
+
+int h264_test_cabac_pcm(void);
+
+
+int h264_test_fmo(void);
+
+
+int h264_test_neighbours(void);
+
+
+int h264_test_mb_table(void);
+
+
+int h264_test_writer(void);
+
+
+int h264_test_peek(void);
+
+
+int h264_test_push(void);
+
+
+int h264_test_early_au_end(void);
+
+
+#endif /* !_H264_TEST_H_ */
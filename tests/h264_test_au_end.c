@@ -0,0 +1,434 @@
+/**
+ * Copyright (c) 2016 Parrot Drones SAS
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *   * Redistributions of source code must retain the above copyright
+ *     notice, this list of conditions and the following disclaimer.
+ *   * Redistributions in binary form must reproduce the above copyright
+ *     notice, this list of conditions and the following disclaimer in the
+ *     documentation and/or other materials provided with the distribution.
+ *   * Neither the name of the Parrot Drones SAS Company nor the
+ *     names of its contributors may be used to endorse or promote products
+ *     derived from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE PARROT DRONES SAS COMPANY BE LIABLE FOR
+ * ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+ * OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+/*
+ * Early access unit end: with H264_READER_FLAGS_EARLY_AU_END, au_end() must
+ * be called once per access unit, right after the slice_data_end() callback
+ * function of the last slice of the picture and before its nalu_end(), i.e.
+ * before the first NAL unit of the next access unit; the other callback
+ * functions and the count and order of the au_end() calls must be the same
+ * as without the flag. Without H264_READER_FLAGS_SLICE_DATA, the flag has
+ * no effect.
+ */
+
+#include "h264_test.h"
+
+
+#define WIDTH 5
+#define HEIGHT 3
+#define MB_COUNT (WIDTH * HEIGHT)
+#define FRAME_COUNT 12
+#define STREAM_COUNT 20
+#define TRACE_MAX_LEN 2048
+
+/* Trace events: kind in the high byte, NAL unit type or macroblock count in
+ * the low bytes */
+#define EV(_kind, _v) (((uint32_t)(_kind) << 24) | (uint32_t)(_v))
+#define EV_KIND(_ev) ((_ev) >> 24)
+#define EV_NALU_BEGIN 1
+#define EV_SLICE_DATA_END 2
+#define EV_AU_END 3
+#define EV_NALU_END 4
+
+
+struct trace {
+	uint32_t ev[TRACE_MAX_LEN];
+	size_t len;
+	int overflow;
+};
+
+
+/* Index of the first NAL unit and of the last slice NAL unit of each access
+ * unit in the stream */
+struct au_layout {
+	size_t first_nalu[FRAME_COUNT];
+	size_t last_slice_nalu[FRAME_COUNT];
+	size_t nalu_count;
+};
+
+
+static void trace_add(struct trace *trace, uint32_t ev)
+{
+	if (trace->len < TRACE_MAX_LEN)
+		trace->ev[trace->len++] = ev;
+	else
+		trace->overflow = 1;
+}
+
+
+static void au_end_cb(struct h264_ctx *ctx, void *userdata)
+{
+	trace_add(userdata, EV(EV_AU_END, 0));
+}
+
+
+static void nalu_begin_cb(struct h264_ctx *ctx,
+			  enum h264_nalu_type type,
+			  const uint8_t *buf,
+			  size_t len,
+			  const struct h264_nalu_header *nh,
+			  void *userdata)
+{
+	trace_add(userdata, EV(EV_NALU_BEGIN, type));
+}
+
+
+static void nalu_end_cb(struct h264_ctx *ctx,
+			enum h264_nalu_type type,
+			const uint8_t *buf,
+			size_t len,
+			const struct h264_nalu_header *nh,
+			void *userdata)
+{
+	trace_add(userdata, EV(EV_NALU_END, type));
+}
+
+
+static void slice_data_end_cb(struct h264_ctx *ctx,
+			      const struct h264_slice_header *sh,
+			      uint32_t mb_count,
+			      void *userdata)
+{
+	trace_add(userdata, EV(EV_SLICE_DATA_END, mb_count));
+}
+
+
+static int add_nalu(struct h264_test_stream *stream,
+		    struct h264_ctx *ctx,
+		    enum h264_nalu_type type,
+		    uint32_t nal_ref_idc)
+{
+	int res = 0;
+	struct h264_nalu_header nh;
+	struct h264_bitstream bs;
+
+	memset(&nh, 0, sizeof(nh));
+	nh.nal_ref_idc = nal_ref_idc;
+	nh.nal_unit_type = type;
+	res = h264_ctx_set_nalu_header(ctx, &nh);
+	if (res < 0)
+		return res;
+	h264_bs_init(&bs, NULL, 0, 1);
+	res = h264_write_nalu(&bs, ctx);
+	if (res == 0)
+		res = h264_test_stream_add(stream, bs.data, bs.off);
+	h264_bs_clear(&bs);
+	return res;
+}
+
+
+static int add_slice(struct h264_test_stream *stream,
+		     struct h264_ctx *ctx,
+		     uint32_t frame_num,
+		     uint32_t first_mb,
+		     uint32_t mb_count)
+{
+	int res = 0;
+	struct h264_nalu_header nh;
+	struct h264_slice_header sh;
+	struct h264_bitstream bs;
+
+	memset(&nh, 0, sizeof(nh));
+	nh.nal_ref_idc = 1;
+	nh.nal_unit_type = frame_num == 0 ? H264_NALU_TYPE_SLICE_IDR
+					  : H264_NALU_TYPE_SLICE;
+	res = h264_ctx_set_nalu_header(ctx, &nh);
+	if (res < 0)
+		return res;
+
+	memset(&sh, 0, sizeof(sh));
+	sh.first_mb_in_slice = first_mb;
+	sh.slice_type = frame_num == 0 ? H264_SLICE_TYPE_I : H264_SLICE_TYPE_P;
+	sh.frame_num = frame_num;
+	res = h264_ctx_set_slice_header(ctx, &sh);
+	if (res < 0)
+		return res;
+
+	h264_bs_init(&bs, NULL, 0, 1);
+	if (frame_num == 0)
+		res = h264_write_grey_i_slice(&bs, ctx, mb_count);
+	else
+		res = h264_write_skipped_p_slice(&bs, ctx, mb_count);
+	if (res == 0)
+		res = h264_test_stream_add(stream, bs.data, bs.off);
+	h264_bs_clear(&bs);
+	return res;
+}
+
+
+/* SPS, PPS, then a grey IDR frame and skipped P frames of one or more
+ * slices; some access units start with an access unit delimiter and some
+ * end with filler data after their last slice */
+static int make_stream(struct h264_test_stream *stream,
+		       int cabac,
+		       uint32_t *seed,
+		       struct au_layout *layout)
+{
+	int res = 0;
+	struct h264_ctx *ctx = NULL;
+	struct h264_aud aud;
+	uint32_t frame_num = 0, first_mb = 0, mb_count = 0;
+	uint32_t r = 0;
+
+	memset(layout, 0, sizeof(*layout));
+	res = h264_test_ctx_new(cabac, WIDTH, HEIGHT, &ctx);
+	if (res < 0)
+		return res;
+
+	for (frame_num = 0; frame_num < FRAME_COUNT; frame_num++) {
+		r = h264_test_random(seed);
+		layout->first_nalu[frame_num] = layout->nalu_count;
+		if (r % 3 == 0) {
+			memset(&aud, 0, sizeof(aud));
+			aud.primary_pic_type = 1;
+			res = h264_ctx_set_aud(ctx, &aud);
+			if (res < 0)
+				goto out;
+			res = add_nalu(stream, ctx, H264_NALU_TYPE_AUD, 0);
+			if (res < 0)
+				goto out;
+			layout->nalu_count++;
+		}
+		if (frame_num == 0) {
+			res = h264_test_stream_add_ps(stream, ctx);
+			if (res < 0)
+				goto out;
+			layout->nalu_count += 2;
+		}
+		for (first_mb = 0; first_mb < MB_COUNT; first_mb += mb_count) {
+			r = h264_test_random(seed);
+			mb_count = 1 + r % (MB_COUNT - first_mb);
+			if ((r >> 8) % 3 == 0)
+				mb_count = MB_COUNT - first_mb;
+			res = add_slice(
+				stream, ctx, frame_num, first_mb, mb_count);
+			if (res < 0)
+				goto out;
+			layout->last_slice_nalu[frame_num] =
+				layout->nalu_count++;
+		}
+		if ((r >> 16) % 3 == 0) {
+			res = h264_ctx_set_filler(ctx, (r >> 18) % 64);
+			if (res < 0)
+				goto out;
+			res = add_nalu(stream, ctx, H264_NALU_TYPE_FILLER, 0);
+			if (res < 0)
+				goto out;
+			layout->nalu_count++;
+		}
+	}
+
+out:
+	h264_ctx_destroy(ctx);
+	return res;
+}
+
+
+static int read_stream(const struct h264_test_stream *stream,
+		       uint32_t flags,
+		       struct trace *trace)
+{
+	int res = 0;
+	struct h264_reader *reader = NULL;
+	struct h264_ctx_cbs cbs;
+	size_t off = 0;
+
+	memset(&cbs, 0, sizeof(cbs));
+	cbs.au_end = &au_end_cb;
+	cbs.nalu_begin = &nalu_begin_cb;
+	cbs.nalu_end = &nalu_end_cb;
+	cbs.slice_data_end = &slice_data_end_cb;
+	memset(trace, 0, sizeof(*trace));
+
+	res = h264_reader_new(&cbs, trace, &reader);
+	if (res < 0)
+		return res;
+
+	res = h264_reader_parse(reader, flags, stream->buf, stream->len, &off);
+	if (res == 0 && off != stream->len)
+		res = -EPROTO;
+	if (res == 0)
+		res = h264_reader_flush(reader);
+	if (res == 0 && trace->overflow)
+		res = -ENOBUFS;
+
+	h264_reader_destroy(reader);
+	return res;
+}
+
+
+/* Check the position of each au_end() call: early ones in the last slice NAL
+ * unit of their access unit, after its slice data, others in the first NAL
+ * unit of the next access unit or on flush, before any nalu_end() */
+static int check_au_end(const struct trace *trace,
+			const struct au_layout *layout,
+			int early)
+{
+	size_t i = 0, nalu = 0, expected = 0, au_count = 0;
+	uint32_t prev = 0, next = 0;
+
+	for (i = 0; i < trace->len; i++) {
+		if (EV_KIND(trace->ev[i]) == EV_NALU_BEGIN)
+			nalu++;
+		if (EV_KIND(trace->ev[i]) != EV_AU_END)
+			continue;
+
+		H264_TEST_CHECK(au_count < FRAME_COUNT,
+				"au_end %zu: too many calls",
+				au_count);
+		prev = i > 0 ? EV_KIND(trace->ev[i - 1]) : 0;
+		next = i + 1 < trace->len ? EV_KIND(trace->ev[i + 1]) : 0;
+		if (early)
+			expected = layout->last_slice_nalu[au_count] + 1;
+		else if (au_count + 1 < FRAME_COUNT)
+			expected = layout->first_nalu[au_count + 1] + 1;
+		else
+			expected = layout->nalu_count;
+		H264_TEST_CHECK(nalu == expected,
+				"au_end %zu: called in NAL unit %zu, "
+				"expected %zu",
+				au_count,
+				nalu,
+				expected);
+		H264_TEST_CHECK(!early || prev == EV_SLICE_DATA_END,
+				"au_end %zu: not after the slice data",
+				au_count);
+		H264_TEST_CHECK(next == EV_NALU_END ||
+					(!early && i + 1 == trace->len),
+				"au_end %zu: not before nalu_end",
+				au_count);
+		au_count++;
+	}
+
+	H264_TEST_CHECK(au_count == FRAME_COUNT,
+			"%zu au_end calls, expected %d",
+			au_count,
+			FRAME_COUNT);
+	H264_TEST_CHECK(nalu == layout->nalu_count,
+			"%zu NAL units, expected %zu",
+			nalu,
+			layout->nalu_count);
+
+	return 0;
+}
+
+
+/* Same callback functions, ignoring the position of the au_end() calls */
+static int trace_equal_but_au_end(const struct trace *t1,
+				  const struct trace *t2)
+{
+	size_t i = 0, j = 0;
+
+	while (1) {
+		while (i < t1->len && EV_KIND(t1->ev[i]) == EV_AU_END)
+			i++;
+		while (j < t2->len && EV_KIND(t2->ev[j]) == EV_AU_END)
+			j++;
+		if (i == t1->len || j == t2->len)
+			return i == t1->len && j == t2->len;
+		if (t1->ev[i++] != t2->ev[j++])
+			return 0;
+	}
+}
+
+
+static int check_stream(const struct h264_test_stream *stream,
+			const struct au_layout *layout,
+			struct trace *ref,
+			struct trace *trace)
+{
+	int res = 0;
+
+	/* Slice data parsed: access units end early with the flag */
+	res = read_stream(stream, H264_READER_FLAGS_SLICE_DATA, ref);
+	if (res < 0)
+		return res;
+	res = check_au_end(ref, layout, 0);
+	if (res < 0)
+		return res;
+	res = read_stream(stream,
+			  H264_READER_FLAGS_SLICE_DATA |
+				  H264_READER_FLAGS_EARLY_AU_END,
+			  trace);
+	if (res < 0)
+		return res;
+	res = check_au_end(trace, layout, 1);
+	if (res < 0)
+		return res;
+	H264_TEST_CHECK(trace_equal_but_au_end(ref, trace),
+			"other callbacks differ with early au_end");
+
+	/* No slice data: the flag has no effect */
+	res = read_stream(stream, 0, ref);
+	if (res < 0)
+		return res;
+	res = read_stream(stream, H264_READER_FLAGS_EARLY_AU_END, trace);
+	if (res < 0)
+		return res;
+	H264_TEST_CHECK(trace->len == ref->len &&
+				memcmp(trace->ev,
+				       ref->ev,
+				       ref->len * sizeof(ref->ev[0])) == 0,
+			"callbacks differ without slice data");
+
+	return 0;
+}
+
+
+int h264_test_early_au_end(void)
+{
+	int res = 0;
+	uint32_t seed = 0x13579bdf;
+	struct h264_test_stream stream;
+	struct au_layout layout;
+	struct trace *ref = NULL, *trace = NULL;
+	uint32_t i = 0;
+
+	memset(&stream, 0, sizeof(stream));
+	ref = calloc(2, sizeof(*ref));
+	if (ref == NULL)
+		return -ENOMEM;
+	trace = &ref[1];
+
+	for (i = 0; i < STREAM_COUNT; i++) {
+		h264_test_stream_clear(&stream);
+		res = make_stream(&stream, i % 2, &seed, &layout);
+		if (res < 0)
+			goto out;
+		res = check_stream(&stream, &layout, ref, trace);
+		if (res < 0) {
+			fprintf(stderr,
+				"%s stream %u failed\n",
+				(i % 2) ? "CABAC" : "CAVLC",
+				i);
+			goto out;
+		}
+	}
+
+out:
+	h264_test_stream_clear(&stream);
+	free(ref);
+	return res;
+}
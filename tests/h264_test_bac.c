@@ -0,0 +1,306 @@
+/**
+ * Copyright (c) 2016 Parrot Drones SAS
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *   * Redistributions of source code must retain the above copyright
+ *     notice, this list of conditions and the following disclaimer.
+ *   * Redistributions in binary form must reproduce the above copyright
+ *     notice, this list of conditions and the following disclaimer in the
+ *     documentation and/or other materials provided with the distribution.
+ *   * Neither the name of the Parrot Drones SAS Company nor the
+ *     names of its contributors may be used to endorse or promote products
+ *     derived from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE PARROT DRONES SAS COMPANY BE LIABLE FOR
+ * ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+ * OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/*
+ * CABAC encoder: the byte-oriented arithmetic encoder of h264_bac.c against
+ * the bit-by-bit flowcharts of 9.3.4 (RenormE, PutBit, EncodeBypass,
+ * EncodeFlush), on random sequences of regular, bypass and terminating bins,
+ * with unaligned starts and several flushes in one bitstream.
+ */
+
+#include "h264_test.h"
+
+
+#define SEQ_COUNT 2000
+#define SEQ_MAX_BINS 4000
+#define STATE_COUNT 8
+#define BUF_SIZE (2 * SEQ_MAX_BINS)
+
+
+/* Reference encoder (9.3.4.1) writing into a bit buffer */
+struct ref_encoder {
+	uint32_t codILow;
+	uint32_t codIRange;
+	int firstBitFlag;
+	uint32_t bitsOutstanding;
+	uint8_t buf[BUF_SIZE];
+	size_t bitpos;
+};
+
+
+static void ref_write_bit(struct ref_encoder *ref, uint32_t b)
+{
+	uint8_t mask = 0x80 >> (ref->bitpos % 8);
+	if (b)
+		ref->buf[ref->bitpos / 8] |= mask;
+	else
+		ref->buf[ref->bitpos / 8] &= ~mask;
+	ref->bitpos++;
+}
+
+
+static void ref_init(struct ref_encoder *ref)
+{
+	ref->codILow = 0;
+	ref->codIRange = 510;
+	ref->firstBitFlag = 1;
+	ref->bitsOutstanding = 0;
+}
+
+
+/* Figure 9-10 - Flowchart of PutBit */
+static void ref_put_bit(struct ref_encoder *ref, uint32_t b)
+{
+	if (ref->firstBitFlag)
+		ref->firstBitFlag = 0;
+	else
+		ref_write_bit(ref, b);
+	while (ref->bitsOutstanding > 0) {
+		ref_write_bit(ref, 1 - b);
+		ref->bitsOutstanding--;
+	}
+}
+
+
+/* Figure 9-9 - Flowchart of renormalization in the encoding engine */
+static void ref_renorm(struct ref_encoder *ref)
+{
+	while (ref->codIRange < 256) {
+		if (ref->codILow < 256) {
+			ref_put_bit(ref, 0);
+		} else if (ref->codILow >= 512) {
+			ref->codILow -= 512;
+			ref_put_bit(ref, 1);
+		} else {
+			ref->codILow -= 256;
+			ref->bitsOutstanding++;
+		}
+		ref->codIRange <<= 1;
+		ref->codILow <<= 1;
+	}
+}
+
+
+/* Figure 9-7 - Flowchart for encoding a decision */
+static void
+ref_encode_bin(struct ref_encoder *ref, struct h264_bac_state *state, int bin)
+{
+	uint32_t q = (ref->codIRange >> 6) & 3;
+	uint32_t lps = h264_bac_range_table_lps[state->idx][q];
+
+	ref->codIRange -= lps;
+	if (bin != state->mps) {
+		ref->codILow += ref->codIRange;
+		ref->codIRange = lps;
+		if (state->idx == 0)
+			state->mps = 1 - state->mps;
+		state->idx = h264_bac_trans_table_lps[state->idx];
+	} else {
+		state->idx = h264_bac_trans_table_mps[state->idx];
+	}
+	ref_renorm(ref);
+}
+
+
+/* Figure 9-11 - Flowchart of encoding bypass */
+static void ref_encode_bypass(struct ref_encoder *ref, int bin)
+{
+	ref->codILow <<= 1;
+	if (bin)
+		ref->codILow += ref->codIRange;
+	if (ref->codILow >= 1024) {
+		ref_put_bit(ref, 1);
+		ref->codILow -= 1024;
+	} else if (ref->codILow < 512) {
+		ref_put_bit(ref, 0);
+	} else {
+		ref->codILow -= 512;
+		ref->bitsOutstanding++;
+	}
+}
+
+
+/* Figures 9-12 and 9-13 - Encoding a decision before termination and
+ * EncodeFlush, the last bit written being the rbsp_stop_one_bit */
+static void ref_encode_terminate(struct ref_encoder *ref, int bin)
+{
+	uint32_t v = 0;
+
+	ref->codIRange -= 2;
+	if (!bin) {
+		ref_renorm(ref);
+		return;
+	}
+	ref->codILow += ref->codIRange;
+	ref->codIRange = 2;
+	ref_renorm(ref);
+	ref_put_bit(ref, (ref->codILow >> 9) & 1);
+	v = ((ref->codILow >> 7) & 3) | 1;
+	ref_write_bit(ref, v >> 1);
+	ref_write_bit(ref, v & 1);
+}
+
+
+static int check_sequence(uint32_t *seed)
+{
+	int res = 0;
+	struct ref_encoder *ref = NULL;
+	struct h264_bitstream bs;
+	struct h264_bac_enc enc;
+	struct h264_bac_state states[STATE_COUNT];
+	struct h264_bac_state ref_states[STATE_COUNT];
+	uint32_t count = h264_test_random(seed) % SEQ_MAX_BINS + 1;
+	uint32_t i, r, n, bits;
+	int bin;
+
+	ref = calloc(1, sizeof(*ref));
+	if (ref == NULL)
+		return -ENOMEM;
+	h264_bs_init(&bs, NULL, 0, 0);
+
+	for (i = 0; i < STATE_COUNT; i++) {
+		r = h264_test_random(seed);
+		states[i].idx = r % 63;
+		states[i].mps = (r >> 8) & 1;
+		ref_states[i] = states[i];
+	}
+
+	/* Unaligned start, e.g. after a slice header */
+	n = h264_test_random(seed) % 8;
+	bits = h264_test_random(seed);
+	for (i = 0; i < n; i++)
+		ref_write_bit(ref, (bits >> (n - 1 - i)) & 1);
+	res = h264_bs_write_bits(&bs, bits & ((1 << n) - 1), n);
+	if (res < 0)
+		goto out;
+	ref_init(ref);
+	h264_bac_encode_init(&enc, &bs, 1);
+
+	for (i = 0; i < count; i++) {
+		r = h264_test_random(seed);
+		bin = (r >> 16) & 1;
+		switch (r % 16) {
+		case 0:
+		case 1:
+		case 2:
+		case 3:
+		case 4:
+			/* Mostly bypass bins of the same value, for long
+			 * runs of outstanding bits */
+			bin = (r >> 16) % 8 != 0;
+			ref_encode_bypass(ref, bin);
+			res = h264_bac_encode_bypass(&enc, bin);
+			break;
+		case 5:
+			ref_encode_terminate(ref, 0);
+			res = h264_bac_encode_terminate(&enc, 0);
+			break;
+		case 6:
+			if ((r >> 8) % 64 != 0) {
+				ref_encode_terminate(ref, 0);
+				res = h264_bac_encode_terminate(&enc, 0);
+				break;
+			}
+			/* Flush, then start again at a byte boundary, like
+			 * around I_PCM samples */
+			ref_encode_terminate(ref, 1);
+			res = h264_bac_encode_terminate(&enc, 1);
+			while (res >= 0 && !h264_bs_byte_aligned(&bs)) {
+				ref_write_bit(ref, 0);
+				res = h264_bs_write_bits(&bs, 0, 1);
+			}
+			ref_init(ref);
+			if (res >= 0)
+				res = h264_bac_encode_init(&enc, &bs, 0);
+			break;
+		default:
+			/* Mostly the most probable symbol */
+			n = (r >> 4) % STATE_COUNT;
+			if ((r >> 17) % 8 == 0)
+				bin = !states[n].mps;
+			else
+				bin = states[n].mps;
+			ref_encode_bin(ref, &ref_states[n], bin);
+			res = h264_bac_encode_bin(&enc, &states[n], bin);
+			break;
+		}
+		if (res < 0)
+			goto out;
+	}
+	ref_encode_terminate(ref, 1);
+	res = h264_bac_encode_terminate(&enc, 1);
+	if (res < 0)
+		goto out;
+
+	res = -EPROTO;
+	if (bs.off * 8 + bs.cachebits != ref->bitpos) {
+		fprintf(stderr,
+			"%u bins: %zu bits, expected %zu\n",
+			count,
+			bs.off * 8 + bs.cachebits,
+			ref->bitpos);
+		goto out;
+	}
+	for (i = 0; i < bs.off; i++) {
+		if (bs.data[i] != ref->buf[i]) {
+			fprintf(stderr,
+				"%u bins: byte %u is 0x%02x, expected 0x%02x\n",
+				count,
+				i,
+				bs.data[i],
+				ref->buf[i]);
+			goto out;
+		}
+	}
+	if (bs.cachebits > 0 &&
+	    bs.cache >> (8 - bs.cachebits) != ref->buf[bs.off] >>
+						      (8 - bs.cachebits)) {
+		fprintf(stderr, "%u bins: last bits differ\n", count);
+		goto out;
+	}
+	res = 0;
+
+out:
+	h264_bs_clear(&bs);
+	free(ref);
+	return res;
+}
+
+
+int h264_test_bac_enc(void)
+{
+	int res = 0;
+	uint32_t seed = 0x2468ace;
+	uint32_t i;
+
+	for (i = 0; i < SEQ_COUNT; i++) {
+		res = check_sequence(&seed);
+		if (res < 0)
+			return res;
+	}
+
+	return 0;
+}
@@ -0,0 +1,541 @@
+/**
+ * Copyright (c) 2016 Parrot Drones SAS
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *   * Redistributions of source code must retain the above copyright
+ *     notice, this list of conditions and the following disclaimer.
+ *   * Redistributions in binary form must reproduce the above copyright
+ *     notice, this list of conditions and the following disclaimer in the
+ *     documentation and/or other materials provided with the distribution.
+ *   * Neither the name of the Parrot Drones SAS Company nor the
+ *     names of its contributors may be used to endorse or promote products
+ *     derived from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE PARROT DRONES SAS COMPANY BE LIABLE FOR
+ * ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+ * OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/*
+ * Bit reader: the word-refill paths of h264_bs_read_bits() and
+ * h264_bs_read_bits_ue() against a bit-by-bit reader of the RBSP obtained by
+ * removing the emulation prevention bytes beforehand, on buffers with many
+ * 00 00 03 sequences; h264_bs_more_rbsp_data() against the position of the
+ * last bit equal to 1 in that RBSP.
+ *
+ * Bit writer: random sequences of bits, ff-coded values, byte runs at
+ * aligned and unaligned positions and 0xFF runs, written with and without
+ * emulation prevention, against a bit-by-bit writer followed by escaping by
+ * hand, then read back.
+ */
+
+#include "h264_test.h"
+
+
+#define BUF_COUNT 2000
+#define BUF_MAX_LEN 1024
+#define MAX_LEADING_ZEROS 30
+#define WRITE_COUNT 500
+#define WRITE_MAX_OPS 64
+#define WRITE_MAX_BYTES 40
+
+
+/* Reference reader: one bit at a time in the unescaped buffer */
+struct ref_reader {
+	uint8_t rbsp[BUF_MAX_LEN];
+	size_t len;
+	size_t bitpos;
+};
+
+
+static void ref_init(struct ref_reader *ref, const uint8_t *buf, size_t len)
+{
+	size_t i = 0;
+	uint32_t zeros = 0;
+
+	/* 7.4.1 emulation_prevention_three_byte after two 0x00 bytes */
+	ref->len = 0;
+	ref->bitpos = 0;
+	for (i = 0; i < len; i++) {
+		if (zeros >= 2 && buf[i] == 0x03) {
+			zeros = 0;
+			continue;
+		}
+		zeros = buf[i] == 0x00 ? zeros + 1 : 0;
+		ref->rbsp[ref->len++] = buf[i];
+	}
+}
+
+
+static size_t ref_rem(const struct ref_reader *ref)
+{
+	return ref->len * 8 - ref->bitpos;
+}
+
+
+static uint32_t ref_bit(struct ref_reader *ref)
+{
+	size_t pos = ref->bitpos++;
+	return (ref->rbsp[pos / 8] >> (7 - pos % 8)) & 1;
+}
+
+
+static int ref_read_bits(struct ref_reader *ref, uint32_t *v, uint32_t n)
+{
+	uint32_t i = 0;
+
+	if (ref_rem(ref) < n)
+		return -EIO;
+	*v = 0;
+	for (i = 0; i < n; i++)
+		*v = (*v << 1) | ref_bit(ref);
+	return n;
+}
+
+
+/* Number of leading zero bits of the next Exp-Golomb code, or -1 if the
+ * buffer ends before its first 1 bit */
+static int ref_leading_zeros(const struct ref_reader *ref)
+{
+	size_t pos = ref->bitpos;
+	int n = 0;
+
+	while (pos < ref->len * 8) {
+		if ((ref->rbsp[pos / 8] >> (7 - pos % 8)) & 1)
+			return n;
+		pos++;
+		n++;
+	}
+	return -1;
+}
+
+
+/* 9.1 Parsing process for Exp-Golomb codes */
+static int ref_read_ue(struct ref_reader *ref, uint32_t *v)
+{
+	int n = ref_leading_zeros(ref);
+	uint32_t suffix = 0;
+
+	if (n < 0 || ref_rem(ref) < 2 * (size_t)n + 1)
+		return -EIO;
+	ref->bitpos += n + 1;
+	ref_read_bits(ref, &suffix, n);
+	*v = (uint32_t)((1ull << n) - 1 + suffix);
+	return 2 * n + 1;
+}
+
+
+/* Random buffer biased towards zero bytes and escaped sequences; it never
+ * ends with an emulation prevention byte */
+static size_t gen_buf(uint8_t *buf, uint32_t *seed)
+{
+	size_t len = 1 + h264_test_random(seed) % BUF_MAX_LEN;
+	size_t i = 0;
+	uint32_t r = 0;
+
+	while (i < len) {
+		r = h264_test_random(seed);
+		switch (r % 8) {
+		case 0:
+		case 1:
+			buf[i++] = 0x00;
+			break;
+		case 2:
+			if (i + 4 < len) {
+				buf[i++] = 0x00;
+				buf[i++] = 0x00;
+				buf[i++] = 0x03;
+				buf[i++] = (r >> 8) % 4;
+			}
+			break;
+		case 3:
+			buf[i++] = 0x03;
+			break;
+		default:
+			buf[i++] = r >> 8;
+			break;
+		}
+	}
+	if (len >= 3 && buf[len - 3] == 0x00 && buf[len - 2] == 0x00 &&
+	    buf[len - 1] == 0x03)
+		buf[len - 1] = 0x01;
+	return len;
+}
+
+
+static int check_buf(const uint8_t *buf, size_t len, uint32_t *seed)
+{
+	int res = 0, ref_res = 0;
+	uint32_t op = 0, n = 0, v = 0, ref_v = 0;
+	int32_t sv = 0;
+	int lz = 0;
+	size_t end = 0;
+	struct h264_bitstream bs;
+	struct ref_reader ref;
+
+	h264_bs_cinit(&bs, buf, len, 1);
+	ref_init(&ref, buf, len);
+
+	/* Bit offset following the rbsp_stop_one_bit (last bit equal to 1) */
+	end = ref.len * 8;
+	while (end > 0 && ((ref.rbsp[(end - 1) / 8] >> (7 - (end - 1) % 8)) &
+			   1) == 0)
+		end--;
+
+	while (ref_rem(&ref) > 0) {
+		H264_TEST_CHECK(end == 0 ||
+					h264_bs_more_rbsp_data(&bs) ==
+						(ref.bitpos + 1 < end),
+				"at bit %zu: more_rbsp_data %d, end bit %zu",
+				ref.bitpos,
+				h264_bs_more_rbsp_data(&bs),
+				end);
+
+		op = h264_test_random(seed) % 4;
+		lz = ref_leading_zeros(&ref);
+		if (op >= 2 && (lz < 0 || lz > MAX_LEADING_ZEROS))
+			op = 0;
+
+		switch (op) {
+		case 0:
+		case 1:
+			/* Short reads stay in the cache, long ones refill */
+			n = op == 0 ? 1 + h264_test_random(seed) % 32
+				    : 1 + h264_test_random(seed) % 8;
+			ref_res = ref_read_bits(&ref, &ref_v, n);
+			res = h264_bs_read_bits(&bs, &v, n);
+			break;
+		case 2:
+			ref_res = ref_read_ue(&ref, &ref_v);
+			res = h264_bs_read_bits_ue(&bs, &v);
+			break;
+		default:
+			ref_res = ref_read_ue(&ref, &ref_v);
+			res = h264_bs_read_bits_se(&bs, &sv);
+			/* 9.1.1 Mapping process for signed Exp-Golomb codes */
+			ref_v = (ref_v & 1) ? (ref_v + 1) / 2
+					    : (uint32_t)(-(int64_t)(ref_v / 2));
+			v = (uint32_t)sv;
+			break;
+		}
+
+		H264_TEST_CHECK(res == ref_res,
+				"op %u at bit %zu: res %d, expected %d",
+				op,
+				ref.bitpos,
+				res,
+				ref_res);
+		if (ref_res < 0)
+			break;
+		H264_TEST_CHECK(v == ref_v,
+				"op %u at bit %zu: value 0x%08x, "
+				"expected 0x%08x",
+				op,
+				ref.bitpos,
+				v,
+				ref_v);
+		H264_TEST_CHECK(
+			h264_bs_rem_raw_bits(&bs) >= ref_rem(&ref),
+			"op %u at bit %zu: %zu raw bits left, expected %zu",
+			op,
+			ref.bitpos,
+			h264_bs_rem_raw_bits(&bs),
+			ref_rem(&ref));
+	}
+
+	return 0;
+}
+
+
+int h264_test_bitstream(void)
+{
+	int res = 0;
+	uint32_t seed = 0x1d872b41;
+	size_t len = 0;
+	uint32_t i = 0;
+	uint8_t buf[BUF_MAX_LEN];
+
+	/* Only escaped sequences */
+	for (len = 0; len + 4 <= sizeof(buf); len += 4) {
+		buf[len] = 0x00;
+		buf[len + 1] = 0x00;
+		buf[len + 2] = 0x03;
+		buf[len + 3] = len % 3;
+	}
+	res = check_buf(buf, len, &seed);
+	if (res < 0)
+		return res;
+
+	for (i = 0; i < BUF_COUNT; i++) {
+		len = gen_buf(buf, &seed);
+		res = check_buf(buf, len, &seed);
+		if (res < 0)
+			return res;
+	}
+
+	return 0;
+}
+
+
+enum write_op_type {
+	WRITE_OP_BITS,
+	WRITE_OP_FF_CODED,
+	WRITE_OP_BYTES,
+	WRITE_OP_FF_BYTES,
+};
+
+
+struct write_op {
+	enum write_op_type type;
+	uint32_t n;
+	uint32_t v;
+	uint8_t bytes[WRITE_MAX_BYTES];
+	size_t len;
+};
+
+
+/* Reference writer: one bit at a time in the RBSP */
+struct ref_writer {
+	uint8_t rbsp[WRITE_MAX_OPS * (WRITE_MAX_BYTES + 8)];
+	size_t bitpos;
+};
+
+
+static void ref_write_bits(struct ref_writer *ref, uint32_t v, uint32_t n)
+{
+	uint32_t i = 0;
+	size_t pos = 0;
+
+	for (i = n; i > 0; i--) {
+		pos = ref->bitpos++;
+		if (pos % 8 == 0)
+			ref->rbsp[pos / 8] = 0;
+		ref->rbsp[pos / 8] |= ((v >> (i - 1)) & 1) << (7 - pos % 8);
+	}
+}
+
+
+static void gen_write_op(struct write_op *op, uint32_t *seed)
+{
+	static const uint32_t ff_values[] = {
+		0, 1, 254, 255, 256, 509, 510, 511, 765, 1000};
+	uint32_t r = h264_test_random(seed);
+	size_t i = 0;
+
+	memset(op, 0, sizeof(*op));
+	op->type = r % 4;
+	switch (op->type) {
+	case WRITE_OP_BITS:
+		op->n = 1 + (r >> 8) % 32;
+		op->v = h264_test_random(seed);
+		if (op->n < 32)
+			op->v &= (1u << op->n) - 1;
+		break;
+	case WRITE_OP_FF_CODED:
+		op->v = ff_values[(r >> 8) % ARRAY_SIZE(ff_values)];
+		op->n = 8 * (op->v / 255 + 1);
+		break;
+	case WRITE_OP_BYTES:
+		/* Mostly zeros and small values */
+		op->len = (r >> 8) % (WRITE_MAX_BYTES + 1);
+		for (i = 0; i < op->len; i++) {
+			r = h264_test_random(seed);
+			op->bytes[i] = r % 3 ? 0x00 : (r >> 8) % 5;
+		}
+		break;
+	default:
+		op->len = (r >> 8) % (WRITE_MAX_BYTES + 1);
+		memset(op->bytes, 0xff, op->len);
+		break;
+	}
+}
+
+
+static int write_op(struct h264_bitstream *bs,
+		    struct ref_writer *ref,
+		    const struct write_op *op)
+{
+	int res = 0;
+	size_t i = 0;
+
+	switch (op->type) {
+	case WRITE_OP_BITS:
+		ref_write_bits(ref, op->v, op->n);
+		res = h264_bs_write_bits(bs, op->v, op->n);
+		break;
+	case WRITE_OP_FF_CODED:
+		for (i = 0; i < op->v / 255; i++)
+			ref_write_bits(ref, 0xff, 8);
+		ref_write_bits(ref, op->v % 255, 8);
+		res = h264_bs_write_bits_ff_coded(bs, op->v);
+		break;
+	case WRITE_OP_BYTES:
+		for (i = 0; i < op->len; i++)
+			ref_write_bits(ref, op->bytes[i], 8);
+		res = h264_bs_write_bytes(bs, op->bytes, op->len);
+		break;
+	default:
+		for (i = 0; i < op->len; i++)
+			ref_write_bits(ref, 0xff, 8);
+		res = h264_bs_write_ff_bytes(bs, op->len);
+		break;
+	}
+
+	H264_TEST_CHECK(res == (int)op->n,
+			"write op %d: res %d, expected %u",
+			op->type,
+			res,
+			op->n);
+	return 0;
+}
+
+
+static int read_op(struct h264_bitstream *bs, const struct write_op *op)
+{
+	int res = 0;
+	uint32_t v = 0;
+	uint8_t bytes[WRITE_MAX_BYTES];
+
+	switch (op->type) {
+	case WRITE_OP_BITS:
+		res = h264_bs_read_bits(bs, &v, op->n);
+		break;
+	case WRITE_OP_FF_CODED:
+		res = h264_bs_read_bits_ff_coded(bs, &v);
+		break;
+	default:
+		res = h264_bs_read_bytes(bs, bytes, op->len);
+		v = op->v;
+		break;
+	}
+
+	H264_TEST_CHECK(res == (int)op->n && v == op->v,
+			"read op %d: res %d, value %u, expected %u",
+			op->type,
+			res,
+			v,
+			op->v);
+	H264_TEST_CHECK(op->len == 0 || memcmp(bytes, op->bytes, op->len) == 0,
+			"read op %d: %zu bytes differ",
+			op->type,
+			op->len);
+	return 0;
+}
+
+
+static int check_write(const struct write_op *ops,
+		       uint32_t count,
+		       int emulation_prevention,
+		       uint32_t *unaligned)
+{
+	int res = 0;
+	struct h264_bitstream bs, rbs;
+	struct ref_writer *ref = NULL;
+	uint8_t *escaped = NULL;
+	size_t len = 0, i = 0, zeros = 0;
+	uint32_t k = 0;
+
+	h264_bs_init(&bs, NULL, 0, emulation_prevention);
+	ref = calloc(1, sizeof(*ref));
+	escaped = calloc(3, sizeof(ref->rbsp) / 2);
+	if (ref == NULL || escaped == NULL) {
+		res = -ENOMEM;
+		goto out;
+	}
+
+	for (k = 0; k < count; k++) {
+		if (ops[k].type == WRITE_OP_BYTES && ops[k].len != 0)
+			*unaligned += !h264_bs_byte_aligned(&bs);
+		res = write_op(&bs, ref, &ops[k]);
+		if (res < 0)
+			goto out;
+	}
+	/* Pad the last byte */
+	if (!h264_bs_byte_aligned(&bs)) {
+		ref_write_bits(ref, 0, 8 - ref->bitpos % 8);
+		res = h264_bs_write_bits(&bs, 0, 8 - bs.cachebits);
+		if (res < 0)
+			goto out;
+	}
+
+	/* 7.4.1: an emulation_prevention_three_byte before any 00, 01, 02 or
+	 * 03 byte following two 0x00 bytes */
+	for (i = 0; i < ref->bitpos / 8; i++) {
+		if (emulation_prevention && zeros >= 2 &&
+		    ref->rbsp[i] <= 0x03) {
+			escaped[len++] = 0x03;
+			zeros = 0;
+		}
+		escaped[len++] = ref->rbsp[i];
+		zeros = ref->rbsp[i] == 0x00 ? zeros + 1 : 0;
+	}
+	if (bs.off != len || memcmp(bs.data, escaped, len) != 0) {
+		fprintf(stderr,
+			"emulation prevention %d: %zu bytes written, "
+			"expected %zu\n",
+			emulation_prevention,
+			bs.off,
+			len);
+		res = -EPROTO;
+		goto out;
+	}
+
+	/* Read back */
+	h264_bs_cinit(&rbs, escaped, len, emulation_prevention);
+	for (k = 0; k < count; k++) {
+		res = read_op(&rbs, &ops[k]);
+		if (res < 0)
+			break;
+	}
+	h264_bs_clear(&rbs);
+
+out:
+	h264_bs_clear(&bs);
+	free(ref);
+	free(escaped);
+	return res;
+}
+
+
+int h264_test_bitstream_write(void)
+{
+	int res = 0;
+	uint32_t seed = 0x5eed0022;
+	struct write_op *ops = NULL;
+	uint32_t i = 0, k = 0, count = 0, unaligned = 0;
+
+	ops = calloc(WRITE_MAX_OPS, sizeof(*ops));
+	if (ops == NULL)
+		return -ENOMEM;
+
+	for (i = 0; i < WRITE_COUNT; i++) {
+		count = 1 + h264_test_random(&seed) % WRITE_MAX_OPS;
+		for (k = 0; k < count; k++)
+			gen_write_op(&ops[k], &seed);
+		res = check_write(ops, count, 1, &unaligned);
+		if (res < 0)
+			goto out;
+		res = check_write(ops, count, 0, &unaligned);
+		if (res < 0)
+			goto out;
+	}
+
+	/* Make sure that the bit-by-bit path of the byte runs has been
+	 * exercised */
+	if (unaligned == 0) {
+		fprintf(stderr, "no unaligned byte run\n");
+		res = -EPROTO;
+	}
+
+out:
+	free(ops);
+	return res;
+}
@@ -0,0 +1,182 @@
+/**
+ * Copyright (c) 2016 Parrot Drones SAS
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *   * Redistributions of source code must retain the above copyright
+ *     notice, this list of conditions and the following disclaimer.
+ *   * Redistributions in binary form must reproduce the above copyright
+ *     notice, this list of conditions and the following disclaimer in the
+ *     documentation and/or other materials provided with the distribution.
+ *   * Neither the name of the Parrot Drones SAS Company nor the
+ *     names of its contributors may be used to endorse or promote products
+ *     derived from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE PARROT DRONES SAS COMPANY BE LIABLE FOR
+ * ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+ * OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+/*
+ * CABAC context variables initialization: h264_bac_state_init() against
+ * equation 9-5 for all the (m, n) pairs of the context tables range and
+ * for SliceQPLuma values around [0, 51]; the states cached by table and
+ * SliceQPLuma against states computed without the cache.
+ */
+
+#include "h264_test.h"
+
+
+/* 9.3.1.1, equation 9-5 */
+static void ref_state_init(int32_t SliceQPLuma,
+			   int32_t m,
+			   int32_t n,
+			   uint32_t *pStateIdx,
+			   uint32_t *valMPS)
+{
+	int32_t preCtxState =
+		Clip3(1, 126, ((m * Clip3(0, 51, SliceQPLuma)) >> 4) + n);
+
+	if (preCtxState <= 63) {
+		*pStateIdx = 63 - preCtxState;
+		*valMPS = 0;
+	} else {
+		*pStateIdx = preCtxState - 64;
+		*valMPS = 1;
+	}
+}
+
+
+int h264_test_bac_state_init(void)
+{
+	struct h264_bac_state state;
+	uint32_t pStateIdx = 0, valMPS = 0;
+	int32_t qp = 0, m = 0, n = 0;
+
+	/* m < 0 at QP 0, e.g. ctxIdx 1019 with cabac_init_idc 2 */
+	h264_bac_state_init(&state, 0, -30, 127);
+	H264_TEST_CHECK(state.idx == 62 && state.mps == 1,
+			"QP 0, m -30, n 127: pStateIdx %u, valMPS %u, "
+			"expected 62, 1",
+			state.idx,
+			state.mps);
+
+	for (qp = -12; qp <= 63; qp++) {
+		for (m = -64; m <= 63; m++) {
+			for (n = -32; n <= 127; n++) {
+				h264_bac_state_init(&state, qp, m, n);
+				ref_state_init(qp, m, n, &pStateIdx, &valMPS);
+				H264_TEST_CHECK(
+					state.idx == pStateIdx &&
+						state.mps == valMPS,
+					"QP %d, m %d, n %d: pStateIdx %u, "
+					"valMPS %u, expected %u, %u",
+					qp,
+					m,
+					n,
+					state.idx,
+					state.mps,
+					pStateIdx,
+					valMPS);
+			}
+		}
+	}
+
+	return 0;
+}
+
+
+static int check_cached_states(struct h264_ctx *ctx,
+			       struct h264_cabac *cabac,
+			       struct h264_bac_state *ref,
+			       uint32_t tableIdx,
+			       int32_t qp)
+{
+	uint32_t ctxIdx = 0;
+
+	ctx->slice.type = tableIdx == 0 ? H264_SLICE_TYPE_I : H264_SLICE_TYPE_P;
+	ctx->slice.hdr.cabac_init_idc = tableIdx == 0 ? 0 : tableIdx - 1;
+	ctx->derived.SliceQPLuma = qp;
+	memset(cabac->states, 0xff, sizeof(cabac->states));
+	h264_cabac_init_states(cabac, ctx);
+	h264_cabac_compute_states(ref, tableIdx, qp);
+
+	for (ctxIdx = 0; ctxIdx < ARRAY_SIZE(cabac->states); ctxIdx++) {
+		H264_TEST_CHECK(cabac->states[ctxIdx].idx == ref[ctxIdx].idx &&
+					cabac->states[ctxIdx].mps ==
+						ref[ctxIdx].mps,
+				"table %u, QP %d, ctxIdx %u: pStateIdx %u, "
+				"valMPS %u, expected %u, %u",
+				tableIdx,
+				qp,
+				ctxIdx,
+				cabac->states[ctxIdx].idx,
+				cabac->states[ctxIdx].mps,
+				ref[ctxIdx].idx,
+				ref[ctxIdx].mps);
+	}
+
+	return 0;
+}
+
+
+int h264_test_cabac_init_cache(void)
+{
+	int res = 0;
+	struct h264_ctx *ctx = NULL;
+	struct h264_cabac *cabac = NULL;
+	struct h264_bac_state *ref = NULL;
+	uint32_t tableIdx = 0, pass = 0;
+	int32_t qp = 0;
+
+	cabac = calloc(1, sizeof(*cabac));
+	ref = calloc(ARRAY_SIZE(cabac->states), sizeof(*ref));
+	if (cabac == NULL || ref == NULL) {
+		res = -ENOMEM;
+		goto out;
+	}
+	res = h264_test_ctx_new(1, 2, 2, &ctx);
+	if (res < 0)
+		goto out;
+
+	/* The first pass fills the cache, the second one reads it; the out
+	 * of range QPs share the entries of 0 and 51 */
+	for (pass = 0; pass < 2 && res == 0; pass++) {
+		for (tableIdx = 0;
+		     tableIdx < H264_CABAC_INIT_TABLE_COUNT && res == 0;
+		     tableIdx++) {
+			for (qp = -2; qp <= 53 && res == 0; qp++) {
+				res = check_cached_states(
+					ctx, cabac, ref, tableIdx, qp);
+			}
+		}
+	}
+	if (res < 0)
+		goto out;
+
+	/* All the 4 x 52 entries have been filled */
+	for (tableIdx = 0; tableIdx < H264_CABAC_INIT_TABLE_COUNT; tableIdx++) {
+		for (qp = 0; qp <= 51; qp++) {
+			if (ctx->cabac_init_cache.states[tableIdx][qp] != NULL)
+				continue;
+			fprintf(stderr,
+				"table %u, QP %d: not cached\n",
+				tableIdx,
+				qp);
+			res = -EPROTO;
+			goto out;
+		}
+	}
+
+out:
+	h264_ctx_destroy(ctx);
+	free(cabac);
+	free(ref);
+	return res;
+}
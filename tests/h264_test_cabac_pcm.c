@@ -0,0 +1,322 @@
+/**
+ * Copyright (c) 2016 Parrot Drones SAS
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *   * Redistributions of source code must retain the above copyright
+ *     notice, this list of conditions and the following disclaimer.
+ *   * Redistributions in binary form must reproduce the above copyright
+ *     notice, this list of conditions and the following disclaimer in the
+ *     documentation and/or other materials provided with the distribution.
+ *   * Neither the name of the Parrot Drones SAS Company nor the
+ *     names of its contributors may be used to endorse or promote products
+ *     derived from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE PARROT DRONES SAS COMPANY BE LIABLE FOR
+ * ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+ * OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/*
+ * CABAC I_PCM macroblocks: slices mixing I_PCM and I_16x16 macroblocks are
+ * encoded with the arithmetic encoder flushed before the pcm_alignment_zero_bit
+ * and initialized again after the samples (9.3.1.2), then parsed back; the
+ * decoding engine must be rewound to the first byte of the samples by
+ * h264_bac_decode_rewind().
+ */
+
+#include "h264_test.h"
+
+
+#define WIDTH 4
+#define HEIGHT 3
+#define MB_COUNT (WIDTH * HEIGHT)
+#define PCM_SAMPLE_COUNT (256 + 2 * 64)
+#define SLICE_COUNT 50
+
+
+struct pcm_slice {
+	/* Bit n set if macroblock n is I_PCM */
+	uint32_t pcm_mask;
+	uint8_t samples[MB_COUNT][PCM_SAMPLE_COUNT];
+};
+
+
+struct pcm_check {
+	const struct pcm_slice *slice;
+	uint32_t mb_count;
+	uint32_t errors;
+};
+
+
+static int write_pcm_macroblock(struct h264_bitstream *bs,
+				struct h264_ctx *ctx,
+				struct h264_cabac *cabac,
+				const uint8_t *samples)
+{
+	int res = 0;
+	struct h264_macroblock *mb = ctx->mb;
+	uint32_t comp, blkIdx, i;
+
+	mb->raw_mb_type = 25;
+	mb->mb_type = H264_MB_TYPE_I_PCM;
+	h264_get_mb_info(ctx, mb->mbAddr)->mb_type = mb->mb_type;
+
+	/* The terminating bin of mb_type flushes the encoder */
+	res = h264_cabac_write_mb_type(cabac, ctx, mb);
+	if (res < 0)
+		return res;
+	while (!h264_bs_byte_aligned(bs)) {
+		res = h264_bs_write_bits(bs, 0, 1);
+		if (res < 0)
+			return res;
+	}
+	for (i = 0; i < PCM_SAMPLE_COUNT; i++) {
+		res = h264_bs_write_bits(bs, samples[i], 8);
+		if (res < 0)
+			return res;
+	}
+	for (comp = 0; comp < 3; comp++) {
+		for (blkIdx = 0; blkIdx < 16; blkIdx++)
+			h264_set_nz_coeff(ctx, mb->mbAddr, comp, blkIdx, 16);
+	}
+
+	return h264_bac_encode_init(&cabac->enc, bs, 0);
+}
+
+
+static int write_grey_macroblock(struct h264_ctx *ctx,
+				 struct h264_cabac *cabac)
+{
+	int res = 0;
+	struct h264_macroblock *mb = ctx->mb;
+
+	/* I_16x16_2_0_0, same as h264_write_grey_i_slice() */
+	mb->raw_mb_type = 3;
+	mb->mb_type = H264_MB_TYPE_I_16x16;
+	mb->NumMbPart = 1;
+	mb->MbPartPredMode[0] = PredMode_Intra_16x16;
+	mb->intra_chroma_pred_mode = IntraChromaDC;
+	h264_get_mb_info(ctx, mb->mbAddr)->mb_type = mb->mb_type;
+	h264_get_mb_info(ctx, mb->mbAddr)->intra_chroma_pred_mode =
+		mb->intra_chroma_pred_mode;
+
+	res = h264_cabac_write_mb_type(cabac, ctx, mb);
+	if (res < 0)
+		return res;
+	res = h264_cabac_write_intra_chroma_pred_mode(cabac, ctx, mb);
+	if (res < 0)
+		return res;
+	res = h264_cabac_write_mb_qp_delta(cabac, ctx, mb);
+	if (res < 0)
+		return res;
+	return h264_cabac_write_coded_block_flag(
+		cabac, ctx, mb, Intra16x16DCLevel, 0);
+}
+
+
+static int write_slice(struct h264_ctx *ctx,
+		       struct h264_test_stream *stream,
+		       const struct pcm_slice *slice)
+{
+	int res = 0;
+	struct h264_nalu_header nh;
+	struct h264_slice_header sh;
+	struct h264_bitstream bs;
+	struct h264_cabac cabac;
+	uint32_t i;
+
+	memset(&nh, 0, sizeof(nh));
+	nh.nal_ref_idc = 3;
+	nh.nal_unit_type = H264_NALU_TYPE_SLICE_IDR;
+	res = h264_ctx_set_nalu_header(ctx, &nh);
+	if (res < 0)
+		return res;
+	memset(&sh, 0, sizeof(sh));
+	sh.slice_type = H264_SLICE_TYPE_I;
+	res = h264_ctx_set_slice_header(ctx, &sh);
+	if (res < 0)
+		return res;
+	res = h264_ctx_set_active_pps(ctx, 0);
+	if (res < 0)
+		return res;
+
+	h264_bs_init(&bs, NULL, 0, 1);
+	res = h264_write_nalu(&bs, ctx);
+	if (res < 0)
+		goto out;
+	/* cabac_alignment_one_bit */
+	while (!h264_bs_byte_aligned(&bs)) {
+		res = h264_bs_write_bits(&bs, 1, 1);
+		if (res < 0)
+			goto out;
+	}
+
+	memset(&cabac, 0, sizeof(cabac));
+	res = h264_cabac_init_enc(&cabac, ctx, &bs);
+	if (res < 0)
+		goto out;
+	for (i = 0; i < MB_COUNT; i++) {
+		res = h264_new_macroblock(ctx, i, 0, -1);
+		if (res < 0)
+			goto out;
+		if (slice->pcm_mask & (1u << i)) {
+			res = write_pcm_macroblock(
+				&bs, ctx, &cabac, slice->samples[i]);
+		} else {
+			res = write_grey_macroblock(ctx, &cabac);
+		}
+		if (res < 0)
+			goto out;
+		res = h264_cabac_write_end_of_slice_flag(
+			&cabac, ctx, ctx->mb, i == MB_COUNT - 1);
+		if (res < 0)
+			goto out;
+	}
+	/* rbsp_stop_one_bit written by the last flush */
+	while (!h264_bs_byte_aligned(&bs)) {
+		res = h264_bs_write_bits(&bs, 0, 1);
+		if (res < 0)
+			goto out;
+	}
+
+	res = h264_test_stream_add(stream, bs.data, bs.off);
+
+out:
+	h264_bs_clear(&bs);
+	return res;
+}
+
+
+static void slice_data_mb_cb(struct h264_ctx *ctx,
+			     const struct h264_slice_header *sh,
+			     uint32_t mb_addr,
+			     enum h264_mb_type mb_type,
+			     void *userdata)
+{
+	struct pcm_check *check = userdata;
+	const struct pcm_slice *slice = check->slice;
+	const uint8_t *samples = NULL;
+	uint32_t i;
+
+	check->mb_count++;
+	if (mb_addr >= MB_COUNT) {
+		check->errors++;
+		return;
+	}
+	if (!(slice->pcm_mask & (1u << mb_addr))) {
+		check->errors += mb_type != H264_MB_TYPE_I_16x16;
+		return;
+	}
+	if (mb_type != H264_MB_TYPE_I_PCM) {
+		check->errors++;
+		return;
+	}
+
+	samples = slice->samples[mb_addr];
+	for (i = 0; i < 256; i++)
+		check->errors += ctx->mb->pcm_sample_luma[i] != samples[i];
+	for (i = 0; i < 64; i++) {
+		check->errors += ctx->mb->pcm_sample_chroma[0][i] !=
+				 samples[256 + i];
+		check->errors += ctx->mb->pcm_sample_chroma[1][i] !=
+				 samples[256 + 64 + i];
+	}
+}
+
+
+static int check_slice(const struct pcm_slice *slice)
+{
+	int res = 0;
+	struct h264_ctx *ctx = NULL;
+	struct h264_reader *reader = NULL;
+	struct h264_test_stream stream;
+	struct h264_ctx_cbs cbs;
+	struct pcm_check check;
+	size_t off = 0;
+
+	memset(&stream, 0, sizeof(stream));
+	memset(&cbs, 0, sizeof(cbs));
+	memset(&check, 0, sizeof(check));
+	cbs.slice_data_mb = &slice_data_mb_cb;
+	check.slice = slice;
+
+	res = h264_test_ctx_new(1, WIDTH, HEIGHT, &ctx);
+	if (res < 0)
+		goto out;
+	res = h264_test_stream_add_ps(&stream, ctx);
+	if (res < 0)
+		goto out;
+	res = write_slice(ctx, &stream, slice);
+	if (res < 0)
+		goto out;
+
+	res = h264_reader_new(&cbs, &check, &reader);
+	if (res < 0)
+		goto out;
+	res = h264_reader_parse(reader,
+				H264_READER_FLAGS_SLICE_DATA,
+				stream.buf,
+				stream.len,
+				&off);
+	if (res < 0)
+		goto out;
+	res = (check.mb_count == MB_COUNT && check.errors == 0) ? 0 : -EPROTO;
+	if (res < 0) {
+		fprintf(stderr,
+			"pcm_mask 0x%03x: %u macroblocks, %u errors\n",
+			slice->pcm_mask,
+			check.mb_count,
+			check.errors);
+	}
+
+out:
+	h264_reader_destroy(reader);
+	h264_ctx_destroy(ctx);
+	h264_test_stream_clear(&stream);
+	return res;
+}
+
+
+int h264_test_cabac_pcm(void)
+{
+	int res = 0;
+	uint32_t seed = 0x1234567;
+	uint32_t i, j, k, r;
+	struct pcm_slice *slice = NULL;
+
+	slice = calloc(1, sizeof(*slice));
+	if (slice == NULL)
+		return -ENOMEM;
+
+	for (i = 0; i < SLICE_COUNT; i++) {
+		/* First slices: all I_PCM, then none, then random */
+		if (i == 0)
+			slice->pcm_mask = (1u << MB_COUNT) - 1;
+		else if (i == 1)
+			slice->pcm_mask = 0;
+		else
+			slice->pcm_mask = h264_test_random(&seed) &
+					  ((1u << MB_COUNT) - 1);
+		/* Many zero samples for emulation prevention bytes */
+		for (j = 0; j < MB_COUNT; j++) {
+			for (k = 0; k < PCM_SAMPLE_COUNT; k++) {
+				r = h264_test_random(&seed);
+				slice->samples[j][k] = (r & 1) ? r >> 8 : 0;
+			}
+		}
+		res = check_slice(slice);
+		if (res < 0)
+			break;
+	}
+
+	free(slice);
+	return res;
+}
@@ -0,0 +1,339 @@
+/**
+ * Copyright (c) 2016 Parrot Drones SAS
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *   * Redistributions of source code must retain the above copyright
+ *     notice, this list of conditions and the following disclaimer.
+ *   * Redistributions in binary form must reproduce the above copyright
+ *     notice, this list of conditions and the following disclaimer in the
+ *     documentation and/or other materials provided with the distribution.
+ *   * Neither the name of the Parrot Drones SAS Company nor the
+ *     names of its contributors may be used to endorse or promote products
+ *     derived from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE PARROT DRONES SAS COMPANY BE LIABLE FOR
+ * ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+ * OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+/*
+ * Start code search: h264_find_nalu() against a byte-by-byte search, on
+ * random buffers biased towards 00, 01 and 03 bytes, at every offset of the
+ * buffers so that the lengths and the matches are not aligned on the words
+ * or vectors scanned at once; h264_find_nalus() against successive
+ * byte-by-byte searches.
+ */
+
+#include "h264_test.h"
+
+
+#define BUF_COUNT 500
+#define BUF_MAX_LEN 256
+#define NALU_MAX_COUNT (BUF_MAX_LEN / 3)
+
+
+/* B.1 byte-by-byte: 00 00 00 01 or 00 00 01 */
+static int ref_find_start_code(const uint8_t *buf,
+			       size_t len,
+			       size_t *start,
+			       size_t *end)
+{
+	size_t i = 0;
+
+	for (i = 0; i + 3 <= len; i++) {
+		if (i + 4 <= len && buf[i] == 0x00 && buf[i + 1] == 0x00 &&
+		    buf[i + 2] == 0x00 && buf[i + 3] == 0x01) {
+			*start = i;
+			*end = i + 4;
+			return 0;
+		}
+		if (buf[i] == 0x00 && buf[i + 1] == 0x00 &&
+		    buf[i + 2] == 0x01) {
+			*start = i;
+			*end = i + 3;
+			return 0;
+		}
+	}
+
+	return -ENOENT;
+}
+
+
+/* B.1 byte-by-byte: 00 00 00 or 00 00 01 */
+static int ref_find_end_code(const uint8_t *buf, size_t len, size_t *end)
+{
+	size_t i = 0;
+
+	for (i = 0; i + 3 <= len; i++) {
+		if (buf[i] == 0x00 && buf[i + 1] == 0x00 &&
+		    buf[i + 2] <= 0x01) {
+			*end = i;
+			return 0;
+		}
+	}
+
+	return -ENOENT;
+}
+
+
+static int
+ref_find_nalu(const uint8_t *buf, size_t len, size_t *start, size_t *end)
+{
+	int res = 0;
+	size_t sc1 = 0, sc2 = 0, ec = 0;
+
+	res = ref_find_start_code(buf, len, &sc1, &sc2);
+	if (res < 0)
+		return res;
+	*start = sc2;
+
+	res = ref_find_end_code(buf + *start, len - *start, &ec);
+	if (res < 0) {
+		*end = len;
+		return -EAGAIN;
+	}
+	*end = *start + ec;
+	return 0;
+}
+
+
+/* Random buffer, mostly made of 00, 01 and 03 bytes with runs of other
+ * bytes longer than the words and vectors */
+static size_t gen_buf(uint8_t *buf, uint32_t *seed)
+{
+	size_t len = h264_test_random(seed) % BUF_MAX_LEN;
+	size_t i = 0, n = 0;
+	uint32_t r = 0;
+
+	while (i < len) {
+		r = h264_test_random(seed);
+		switch (r % 8) {
+		case 0:
+		case 1:
+		case 2:
+			buf[i++] = 0x00;
+			break;
+		case 3:
+			buf[i++] = 0x01;
+			break;
+		case 4:
+			buf[i++] = 0x03;
+			break;
+		default:
+			for (n = (r >> 8) % 40; n > 0 && i < len; n--)
+				buf[i++] = 0x04 + (r >> 16) % 0xfc;
+			break;
+		}
+	}
+
+	return len;
+}
+
+
+int h264_test_find_nalu(void)
+{
+	int res = 0, ref_res = 0;
+	uint32_t seed = 0x5eed0004;
+	uint8_t src[BUF_MAX_LEN];
+	uint8_t *buf = NULL, *p = NULL;
+	size_t len = 0, k = 0;
+	size_t start = 0, end = 0, ref_start = 0, ref_end = 0;
+	uint32_t i = 0;
+
+	/* The searched bytes end with this heap buffer so that the
+	 * sanitizers catch reads past them */
+	buf = malloc(BUF_MAX_LEN);
+	if (buf == NULL)
+		return -ENOMEM;
+
+	for (i = 0; i < BUF_COUNT; i++) {
+		len = gen_buf(src, &seed);
+		for (k = 0; k <= len; k++) {
+			p = buf + BUF_MAX_LEN - (len - k);
+			memcpy(p, src + k, len - k);
+			ref_start = ref_end = start = end = SIZE_MAX;
+			ref_res = ref_find_nalu(
+				p, len - k, &ref_start, &ref_end);
+			res = h264_find_nalu(p, len - k, &start, &end);
+			if (res == ref_res &&
+			    (res == -ENOENT ||
+			     (start == ref_start && end == ref_end)))
+				continue;
+			fprintf(stderr,
+				"buffer %u at %zu (%zu bytes): res %d, "
+				"start %zu, end %zu, expected %d, %zu, %zu\n",
+				i,
+				k,
+				len - k,
+				res,
+				start,
+				end,
+				ref_res,
+				ref_start,
+				ref_end);
+			res = -EPROTO;
+			goto out;
+		}
+	}
+	res = 0;
+
+out:
+	free(buf);
+	return res;
+}
+
+
+/* Successive byte-by-byte searches, each one starting at the end of the
+ * previous NAL unit */
+static size_t ref_find_nalus(const uint8_t *buf,
+			     size_t len,
+			     struct h264_nalu_info *nalus,
+			     size_t max_count)
+{
+	size_t off = 0, sc1 = 0, sc2 = 0, ec = 0;
+	size_t count = 0;
+	struct h264_nalu_info *nalu = NULL;
+
+	while (off < len && count < max_count) {
+		if (ref_find_start_code(buf + off, len - off, &sc1, &sc2) < 0)
+			break;
+		nalu = &nalus[count++];
+		memset(nalu, 0, sizeof(*nalu));
+		nalu->off = off + sc2;
+		nalu->start_code_size = sc2 - sc1;
+		nalu->complete = ref_find_end_code(buf + nalu->off,
+						   len - nalu->off,
+						   &ec) == 0;
+		nalu->len = nalu->complete ? ec : len - nalu->off;
+		nalu->type = nalu->len > 0 ? (buf[nalu->off] & 0x1f) : 0;
+		off = nalu->off + nalu->len;
+	}
+
+	return count;
+}
+
+
+static int check_nalus(const uint8_t *buf,
+		       size_t len,
+		       size_t max_count,
+		       const char *name)
+{
+	int res = 0;
+	struct h264_nalu_info nalus[NALU_MAX_COUNT];
+	struct h264_nalu_info ref[NALU_MAX_COUNT];
+	size_t count = SIZE_MAX, ref_count = 0, i = 0;
+
+	memset(nalus, 0, sizeof(nalus));
+	ref_count = ref_find_nalus(buf, len, ref, max_count);
+	res = h264_find_nalus(buf, len, nalus, max_count, &count);
+	H264_TEST_CHECK(res == 0 && count == ref_count,
+			"%s (%zu bytes, max %zu): res %d, count %zu, "
+			"expected %zu",
+			name,
+			len,
+			max_count,
+			res,
+			count,
+			ref_count);
+
+	for (i = 0; i < count; i++) {
+		H264_TEST_CHECK(
+			nalus[i].off == ref[i].off &&
+				nalus[i].len == ref[i].len &&
+				nalus[i].start_code_size ==
+					ref[i].start_code_size &&
+				nalus[i].type == ref[i].type &&
+				nalus[i].complete == ref[i].complete,
+			"%s (%zu bytes, max %zu): NAL unit %zu: off %zu, "
+			"len %zu, start code %u, type %u, complete %d, "
+			"expected %zu, %zu, %u, %u, %d",
+			name,
+			len,
+			max_count,
+			i,
+			nalus[i].off,
+			nalus[i].len,
+			nalus[i].start_code_size,
+			nalus[i].type,
+			nalus[i].complete,
+			ref[i].off,
+			ref[i].len,
+			ref[i].start_code_size,
+			ref[i].type,
+			ref[i].complete);
+	}
+
+	return 0;
+}
+
+
+int h264_test_find_nalus(void)
+{
+	int res = 0;
+	uint32_t seed = 0x5eed0005;
+	uint8_t buf[BUF_MAX_LEN];
+	size_t len = 0, max_count = 0;
+	struct h264_nalu_info nalus[4];
+	size_t count = 0;
+	uint32_t i = 0;
+
+	/* 3-byte start code, 4-byte start code followed by an empty NAL
+	 * unit, then an unfinished NAL unit */
+	static const uint8_t stream[] = {
+		0x00, 0x00, 0x01, 0x65, 0xaa, 0x00, 0x00, 0x00,
+		0x01, 0x00, 0x00, 0x01, 0x41, 0xbb, 0x00, 0x00,
+	};
+
+	res = h264_find_nalus(
+		stream, sizeof(stream), nalus, ARRAY_SIZE(nalus), &count);
+	H264_TEST_CHECK(res == 0 && count == 3,
+			"res %d, count %zu, expected 3",
+			res,
+			count);
+	H264_TEST_CHECK(nalus[0].off == 3 && nalus[0].len == 2 &&
+				nalus[0].start_code_size == 3 &&
+				nalus[0].type == H264_NALU_TYPE_SLICE_IDR &&
+				nalus[0].complete,
+			"invalid first NAL unit");
+	H264_TEST_CHECK(nalus[1].off == 9 && nalus[1].len == 0 &&
+				nalus[1].start_code_size == 4 &&
+				nalus[1].type == 0 && nalus[1].complete,
+			"invalid empty NAL unit");
+	H264_TEST_CHECK(nalus[2].off == 12 && nalus[2].len == 4 &&
+				nalus[2].start_code_size == 3 &&
+				nalus[2].type == H264_NALU_TYPE_SLICE &&
+				!nalus[2].complete,
+			"invalid last NAL unit");
+
+	/* Truncated to max_count NAL units, the last one complete */
+	res = h264_find_nalus(stream, sizeof(stream), nalus, 2, &count);
+	H264_TEST_CHECK(res == 0 && count == 2 && nalus[1].complete,
+			"max_count 2: res %d, count %zu",
+			res,
+			count);
+	res = h264_find_nalus(stream, sizeof(stream), NULL, 0, &count);
+	H264_TEST_CHECK(res == 0 && count == 0,
+			"max_count 0: res %d, count %zu",
+			res,
+			count);
+
+	for (i = 0; i < BUF_COUNT; i++) {
+		len = gen_buf(buf, &seed);
+		max_count = h264_test_random(&seed) % 8;
+		res = check_nalus(buf, len, max_count, "random");
+		if (res < 0)
+			return res;
+		res = check_nalus(buf, len, NALU_MAX_COUNT, "random");
+		if (res < 0)
+			return res;
+	}
+
+	return 0;
+}
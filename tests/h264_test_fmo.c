@@ -0,0 +1,180 @@
+/**
+ * Copyright (c) 2016 Parrot Drones SAS
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *   * Redistributions of source code must retain the above copyright
+ *     notice, this list of conditions and the following disclaimer.
+ *   * Redistributions in binary form must reproduce the above copyright
+ *     notice, this list of conditions and the following disclaimer in the
+ *     documentation and/or other materials provided with the distribution.
+ *   * Neither the name of the Parrot Drones SAS Company nor the
+ *     names of its contributors may be used to endorse or promote products
+ *     derived from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE PARROT DRONES SAS COMPANY BE LIABLE FOR
+ * ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+ * OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+/*
+ * Slice group map cache: with the same PPS, the next macroblock addresses
+ * used for a slice must be those computed from scratch, whatever the
+ * slice_group_change_cycle, field_pic_flag and MbaffFrameFlag of the
+ * previous slices.
+ */
+
+#include "h264_test.h"
+
+
+/* Frames of WIDTH x (2 * HEIGHT) macroblocks, HEIGHT map units high */
+#define WIDTH 11
+#define HEIGHT 5
+#define MAP_UNITS (WIDTH * HEIGHT)
+#define SLICE_COUNT 400
+
+
+static void make_pps(struct h264_pps *pps, uint32_t type, uint32_t *seed)
+{
+	uint32_t i = 0, x0, x1, y0, y1;
+
+	memset(pps, 0, sizeof(*pps));
+	pps->slice_group_map_type = type;
+	pps->num_slice_groups_minus1 = 1 + h264_test_random(seed) % 7;
+
+	switch (type) {
+	case 0:
+		for (i = 0; i <= pps->num_slice_groups_minus1; i++)
+			pps->run_length_minus1[i] = h264_test_random(seed) % 6;
+		break;
+	case 2:
+		for (i = 0; i < pps->num_slice_groups_minus1; i++) {
+			x0 = h264_test_random(seed) % WIDTH;
+			x1 = x0 + h264_test_random(seed) % (WIDTH - x0);
+			y0 = h264_test_random(seed) % HEIGHT;
+			y1 = y0 + h264_test_random(seed) % (HEIGHT - y0);
+			pps->top_left[i] = y0 * WIDTH + x0;
+			pps->bottom_right[i] = y1 * WIDTH + x1;
+		}
+		break;
+	case 3:
+	case 4:
+	case 5:
+		pps->num_slice_groups_minus1 = 1;
+		pps->slice_group_change_direction_flag =
+			h264_test_random(seed) & 1;
+		pps->slice_group_change_rate_minus1 =
+			h264_test_random(seed) % 4;
+		break;
+	case 6:
+		pps->pic_size_in_map_units_minus1 = MAP_UNITS - 1;
+		for (i = 0; i < MAP_UNITS; i++) {
+			pps->slice_group_id[i] =
+				h264_test_random(seed) %
+				(pps->num_slice_groups_minus1 + 1);
+		}
+		break;
+	default:
+		break;
+	}
+}
+
+
+/* Slice with a random slice_group_change_cycle and picture structure */
+static int check_slice(struct h264_ctx *ctx, uint32_t *next, uint32_t *seed)
+{
+	static const uint32_t cycles[] = {0, 1, 7, 30, 1000};
+	int res = 0;
+	struct h264_slice_header sh;
+	uint32_t r = h264_test_random(seed);
+	uint32_t i = 0, count = 0;
+
+	memset(&sh, 0, sizeof(sh));
+	sh.slice_type = H264_SLICE_TYPE_P;
+	sh.slice_group_change_cycle = cycles[r % ARRAY_SIZE(cycles)];
+	sh.field_pic_flag = (r >> 8) & 1;
+	sh.bottom_field_flag = sh.field_pic_flag && ((r >> 9) & 1);
+	res = h264_ctx_set_slice_header(ctx, &sh);
+	if (res < 0)
+		return res;
+	/* MBAFF or not for frames, regardless of the SPS */
+	ctx->derived.MbaffFrameFlag = !sh.field_pic_flag && ((r >> 10) & 1);
+
+	/* Possibly cached */
+	res = h264_gen_slice_group_map(ctx);
+	if (res < 0)
+		return res;
+	count = ctx->derived.PicSizeInMbs;
+	memcpy(next, ctx->slice.group_next_mb, count * sizeof(*next));
+
+	/* From scratch */
+	h264_clear_slice_group_map(ctx);
+	res = h264_gen_slice_group_map(ctx);
+	if (res < 0)
+		return res;
+
+	for (i = 0; i < count; i++) {
+		H264_TEST_CHECK(next[i] == ctx->slice.group_next_mb[i],
+				"map type %u, cycle %u, field %d, MBAFF %d: "
+				"next of %u is %u, expected %u",
+				ctx->pps->slice_group_map_type,
+				sh.slice_group_change_cycle,
+				sh.field_pic_flag,
+				ctx->derived.MbaffFrameFlag,
+				i,
+				next[i],
+				ctx->slice.group_next_mb[i]);
+	}
+
+	return 0;
+}
+
+
+int h264_test_fmo(void)
+{
+	int res = 0;
+	uint32_t seed = 0x5eed0018;
+	struct h264_ctx *ctx = NULL;
+	struct h264_sps sps;
+	struct h264_pps pps;
+	uint32_t *next = NULL;
+	uint32_t type = 0, i = 0;
+
+	next = calloc(2 * MAP_UNITS, sizeof(*next));
+	if (next == NULL)
+		return -ENOMEM;
+	res = h264_test_ctx_new(0, WIDTH, HEIGHT, &ctx);
+	if (res < 0)
+		goto out;
+
+	/* Frames and fields, MBAFF */
+	sps = *ctx->sps;
+	sps.frame_mbs_only_flag = 0;
+	sps.mb_adaptive_frame_field_flag = 1;
+	res = h264_ctx_set_sps(ctx, &sps);
+	if (res < 0)
+		goto out;
+
+	for (type = 0; type <= 6; type++) {
+		make_pps(&pps, type, &seed);
+		res = h264_ctx_set_pps(ctx, &pps);
+		if (res < 0)
+			goto out;
+		for (i = 0; i < SLICE_COUNT; i++) {
+			res = check_slice(ctx, next, &seed);
+			if (res < 0)
+				goto out;
+		}
+	}
+
+out:
+	h264_ctx_destroy(ctx);
+	free(next);
+	return res;
+}
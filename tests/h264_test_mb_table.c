@@ -0,0 +1,234 @@
+/**
+ * Copyright (c) 2016 Parrot Drones SAS
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *   * Redistributions of source code must retain the above copyright
+ *     notice, this list of conditions and the following disclaimer.
+ *   * Redistributions in binary form must reproduce the above copyright
+ *     notice, this list of conditions and the following disclaimer in the
+ *     documentation and/or other materials provided with the distribution.
+ *   * Neither the name of the Parrot Drones SAS Company nor the
+ *     names of its contributors may be used to endorse or promote products
+ *     derived from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE PARROT DRONES SAS COMPANY BE LIABLE FOR
+ * ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+ * OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+/*
+ * Macroblock table: parameter sets of pictures too large for the table must
+ * be parsed and set without error, the table being only allocated with the
+ * first slice data parsed (or written) for the active SPS.
+ */
+
+#include "h264_test.h"
+
+
+#define WIDTH 4
+#define HEIGHT 3
+#define HUGE_SIZE 20001
+
+
+struct parse_check {
+	uint32_t sps_count;
+	uint32_t pps_count;
+	uint32_t mb_count;
+};
+
+
+static void sps_cb(struct h264_ctx *ctx,
+		   const uint8_t *buf,
+		   size_t len,
+		   const struct h264_sps *sps,
+		   void *userdata)
+{
+	struct parse_check *check = userdata;
+
+	check->sps_count++;
+}
+
+
+static void pps_cb(struct h264_ctx *ctx,
+		   const uint8_t *buf,
+		   size_t len,
+		   const struct h264_pps *pps,
+		   void *userdata)
+{
+	struct parse_check *check = userdata;
+
+	check->pps_count++;
+}
+
+
+static void slice_data_mb_cb(struct h264_ctx *ctx,
+			     const struct h264_slice_header *sh,
+			     uint32_t mb_addr,
+			     enum h264_mb_type mb_type,
+			     void *userdata)
+{
+	struct parse_check *check = userdata;
+
+	check->mb_count++;
+}
+
+
+/* Grey IDR slice covering the whole WIDTH x HEIGHT picture */
+static int add_slice(struct h264_test_stream *stream, struct h264_ctx *ctx)
+{
+	int res = 0;
+	struct h264_nalu_header nh;
+	struct h264_slice_header sh;
+	struct h264_bitstream bs;
+
+	memset(&nh, 0, sizeof(nh));
+	nh.nal_ref_idc = 1;
+	nh.nal_unit_type = H264_NALU_TYPE_SLICE_IDR;
+	res = h264_ctx_set_nalu_header(ctx, &nh);
+	if (res < 0)
+		return res;
+
+	memset(&sh, 0, sizeof(sh));
+	sh.slice_type = H264_SLICE_TYPE_I;
+	res = h264_ctx_set_slice_header(ctx, &sh);
+	if (res < 0)
+		return res;
+
+	h264_bs_init(&bs, NULL, 0, 1);
+	res = h264_write_grey_i_slice(&bs, ctx, WIDTH * HEIGHT);
+	if (res == 0)
+		res = h264_test_stream_add(stream, bs.data, bs.off);
+	h264_bs_clear(&bs);
+	return res;
+}
+
+
+static int parse(struct h264_reader *reader,
+		 uint32_t flags,
+		 const struct h264_test_stream *stream,
+		 struct parse_check *check)
+{
+	size_t off = 0;
+
+	memset(check, 0, sizeof(*check));
+	return h264_reader_parse(reader, flags, stream->buf, stream->len, &off);
+}
+
+
+int h264_test_mb_table(void)
+{
+	int res = 0;
+	struct h264_ctx *ctx = NULL;
+	struct h264_ctx *huge = NULL;
+	struct h264_ctx *rctx = NULL;
+	struct h264_reader *reader = NULL;
+	struct h264_test_stream stream;
+	struct h264_ctx_cbs cbs;
+	struct parse_check check;
+
+	memset(&stream, 0, sizeof(stream));
+	memset(&cbs, 0, sizeof(cbs));
+	cbs.sps = &sps_cb;
+	cbs.pps = &pps_cb;
+	cbs.slice_data_mb = &slice_data_mb_cb;
+
+	res = h264_test_ctx_new(0, WIDTH, HEIGHT, &ctx);
+	if (res < 0)
+		goto out;
+	res = h264_reader_new(&cbs, &check, &reader);
+	if (res < 0)
+		goto out;
+	rctx = h264_reader_get_ctx(reader);
+
+	/* Setting the huge SPS does not allocate anything; CABAC so that the
+	 * writer takes the macroblock table */
+	res = h264_test_ctx_new(1, HUGE_SIZE, HUGE_SIZE, &huge);
+	if (res < 0)
+		goto out;
+	if (huge->slice.mb_table.len != 0) {
+		fprintf(stderr, "table allocated by the SPS\n");
+		res = -EPROTO;
+		goto out;
+	}
+
+	/* The slice data of the huge picture cannot be written */
+	res = add_slice(&stream, huge);
+	h264_test_stream_clear(&stream);
+	if (res != -EINVAL) {
+		fprintf(stderr, "huge slice written: %d\n", res);
+		res = -EPROTO;
+		goto out;
+	}
+
+	/* Huge parameter sets followed by a slice: the parameter sets are
+	 * parsed and activated, the slice data is rejected */
+	res = h264_test_stream_add_ps(&stream, huge);
+	if (res < 0)
+		goto out;
+	res = add_slice(&stream, ctx);
+	if (res < 0)
+		goto out;
+	res = parse(reader, H264_READER_FLAGS_SLICE_DATA, &stream, &check);
+	if (res < 0)
+		goto out;
+	if (check.sps_count != 1 || check.pps_count != 1 ||
+	    check.mb_count != 0 ||
+	    rctx->sps_derived.PicWidthInMbs != HUGE_SIZE ||
+	    rctx->slice.mb_table.len != 0) {
+		fprintf(stderr,
+			"huge SPS: %u SPS, %u PPS, %u MB, width %u, "
+			"table length %zu\n",
+			check.sps_count,
+			check.pps_count,
+			check.mb_count,
+			rctx->sps_derived.PicWidthInMbs,
+			rctx->slice.mb_table.len);
+		res = -EPROTO;
+		goto out;
+	}
+	h264_test_stream_clear(&stream);
+
+	/* Small picture: no table without slice data parsing */
+	res = h264_test_stream_add_ps(&stream, ctx);
+	if (res < 0)
+		goto out;
+	res = add_slice(&stream, ctx);
+	if (res < 0)
+		goto out;
+	res = parse(reader, 0, &stream, &check);
+	if (res < 0)
+		goto out;
+	if (rctx->slice.mb_table.len != 0) {
+		fprintf(stderr, "table allocated without slice data\n");
+		res = -EPROTO;
+		goto out;
+	}
+
+	/* Then allocated for the whole picture */
+	res = parse(reader, H264_READER_FLAGS_SLICE_DATA, &stream, &check);
+	if (res < 0)
+		goto out;
+	if (check.mb_count != WIDTH * HEIGHT ||
+	    rctx->slice.mb_table.len != WIDTH * HEIGHT) {
+		fprintf(stderr,
+			"%u MB, table length %zu\n",
+			check.mb_count,
+			rctx->slice.mb_table.len);
+		res = -EPROTO;
+		goto out;
+	}
+
+out:
+	h264_reader_destroy(reader);
+	h264_ctx_destroy(ctx);
+	h264_ctx_destroy(huge);
+	h264_test_stream_clear(&stream);
+	return res;
+}
@@ -0,0 +1,307 @@
+/**
+ * Copyright (c) 2016 Parrot Drones SAS
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *   * Redistributions of source code must retain the above copyright
+ *     notice, this list of conditions and the following disclaimer.
+ *   * Redistributions in binary form must reproduce the above copyright
+ *     notice, this list of conditions and the following disclaimer in the
+ *     documentation and/or other materials provided with the distribution.
+ *   * Neither the name of the Parrot Drones SAS Company nor the
+ *     names of its contributors may be used to endorse or promote products
+ *     derived from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE PARROT DRONES SAS COMPANY BE LIABLE FOR
+ * ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+ * OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/*
+ * Neighbouring 4x4 blocks: the tables of h264_macroblock.c against the
+ * derivation of the spec (inverse block scanning, 6.4.12 neighbouring
+ * locations, 6.4.13 block indices), for luma and 4:2:0 / 4:2:2 chroma
+ * blocks, in non-MBAFF and MBAFF frames, for all the field decoding flags
+ * and neighbour availabilities.
+ */
+
+#include "h264_test.h"
+
+
+#define WIDTH 3
+#define HEIGHT 4
+
+
+/* 6.4.3 Inverse 4x4 luma block scanning process */
+static void ref_inv_luma_4x4(uint32_t idx, int32_t *x, int32_t *y)
+{
+	*x = ((idx / 4) % 2) * 8 + (idx % 2) * 4;
+	*y = ((idx / 4) / 2) * 8 + ((idx % 4) / 2) * 4;
+}
+
+
+/* 6.4.7 Inverse 4x4 chroma block scanning process */
+static void ref_inv_chroma_4x4(uint32_t idx, int32_t *x, int32_t *y)
+{
+	*x = (idx % 2) * 4;
+	*y = (idx / 2) * 4;
+}
+
+
+/* 6.4.12.1 Specification for neighbouring locations in fields and non-MBAFF
+ * frames */
+static uint32_t ref_location_non_mbaff(const struct h264_macroblock *mb,
+				       int32_t maxW,
+				       int32_t maxH,
+				       int32_t xN,
+				       int32_t yN,
+				       int32_t *xW,
+				       int32_t *yW)
+{
+	*xW = xN < 0 ? xN + maxW : xN;
+	*yW = yN < 0 ? yN + maxH : yN;
+	if (xN < 0)
+		return mb->mbAddrA;
+	if (yN < 0)
+		return mb->mbAddrB;
+	return mb->mbAddr;
+}
+
+
+/* 6.4.12.2 Specification for neighbouring locations in MBAFF frames,
+ * Table 6-4 for xN < 0 or yN < 0 (only xN < 0, yN >= 0 or xN >= 0, yN < 0
+ * for 4x4 blocks) */
+static uint32_t ref_location_mbaff(const struct h264_macroblock *mb,
+				   int32_t maxW,
+				   int32_t maxH,
+				   int32_t xN,
+				   int32_t yN,
+				   int32_t *xW,
+				   int32_t *yW)
+{
+	int currMbFrameFlag = !mb->mb_field_decoding_flag;
+	int mbIsTopMbFlag = mb->mbAddr % 2 == 0;
+	int mbAddrXFrameFlag = 0;
+	uint32_t mbAddrN = mb->mbAddr;
+	int32_t yM = yN;
+
+	if (xN < 0) {
+		if (mb->mbAddrA == H264_MB_ADDR_INVALID)
+			return H264_MB_ADDR_INVALID;
+		mbAddrXFrameFlag = !mb->mbAddrAInfo->field_flag;
+		if (currMbFrameFlag && mbIsTopMbFlag && mbAddrXFrameFlag) {
+			mbAddrN = mb->mbAddrA;
+		} else if (currMbFrameFlag && mbIsTopMbFlag) {
+			mbAddrN = mb->mbAddrA + yN % 2;
+			yM = yN >> 1;
+		} else if (currMbFrameFlag && mbAddrXFrameFlag) {
+			mbAddrN = mb->mbAddrA + 1;
+		} else if (currMbFrameFlag) {
+			mbAddrN = mb->mbAddrA + yN % 2;
+			yM = (yN + maxH) >> 1;
+		} else if (mbIsTopMbFlag && mbAddrXFrameFlag) {
+			mbAddrN = mb->mbAddrA + (yN >= maxH / 2);
+			yM = (yN << 1) - (yN >= maxH / 2 ? maxH : 0);
+		} else if (mbIsTopMbFlag) {
+			mbAddrN = mb->mbAddrA;
+		} else if (mbAddrXFrameFlag) {
+			mbAddrN = mb->mbAddrA + (yN >= maxH / 2);
+			yM = (yN << 1) + 1 - (yN >= maxH / 2 ? maxH : 0);
+		} else {
+			mbAddrN = mb->mbAddrA + 1;
+		}
+	} else if (yN < 0) {
+		if (currMbFrameFlag && !mbIsTopMbFlag) {
+			mbAddrN = mb->mbAddr - 1;
+		} else if (mb->mbAddrB == H264_MB_ADDR_INVALID) {
+			return H264_MB_ADDR_INVALID;
+		} else if (currMbFrameFlag || !mbIsTopMbFlag) {
+			mbAddrN = mb->mbAddrB + 1;
+		} else if (!mb->mbAddrBInfo->field_flag) {
+			mbAddrN = mb->mbAddrB + 1;
+			yM = 2 * yN;
+		} else {
+			mbAddrN = mb->mbAddrB;
+		}
+	}
+
+	*xW = xN < 0 ? xN + maxW : xN;
+	*yW = yM < 0 ? yM + maxH : yM;
+	return mbAddrN;
+}
+
+
+/* 6.4.12 Derivation process for neighbouring locations, then 6.4.13.1 or
+ * 6.4.13.2 for the index of the block containing the location */
+static uint32_t ref_block(struct h264_ctx *ctx,
+			  const struct h264_macroblock *mb,
+			  int chroma,
+			  int32_t xN,
+			  int32_t yN,
+			  uint32_t *idx)
+{
+	int32_t maxW = chroma ? ctx->sps_derived.MbWidthC : 16;
+	int32_t maxH = chroma ? ctx->sps_derived.MbHeightC : 16;
+	int32_t xW = 0, yW = 0;
+	uint32_t mbAddrN;
+
+	if (ctx->derived.MbaffFrameFlag)
+		mbAddrN = ref_location_mbaff(mb, maxW, maxH, xN, yN, &xW, &yW);
+	else
+		mbAddrN = ref_location_non_mbaff(
+			mb, maxW, maxH, xN, yN, &xW, &yW);
+
+	if (chroma)
+		*idx = 2 * (yW / 4) + (xW / 4);
+	else
+		*idx = 8 * (yW / 8) + 4 * (xW / 8) + 2 * ((yW % 8) / 4) +
+		       ((xW % 8) / 4);
+	return mbAddrN;
+}
+
+
+static int check_blocks(struct h264_ctx *ctx,
+			struct h264_macroblock *mb,
+			int chroma)
+{
+	uint32_t count = chroma ? ctx->sps_derived.MbHeightC / 2 : 16;
+	uint32_t idx, mbAddrA, idxA, mbAddrB, idxB, refA, refB, refIdxA,
+		refIdxB;
+	int32_t x, y;
+	int okA, okB;
+
+	for (idx = 0; idx < count; idx++) {
+		if (chroma) {
+			ref_inv_chroma_4x4(idx, &x, &y);
+			h264_get_neighbouring_chroma_4x4(
+				ctx, mb, idx, &mbAddrA, &idxA, &mbAddrB, &idxB);
+		} else {
+			ref_inv_luma_4x4(idx, &x, &y);
+			h264_get_neighbouring_luma_cb_cr_4x4(
+				ctx, mb, idx, &mbAddrA, &idxA, &mbAddrB, &idxB);
+		}
+		refA = ref_block(ctx, mb, chroma, x - 1, y, &refIdxA);
+		refB = ref_block(ctx, mb, chroma, x, y - 1, &refIdxB);
+
+		/* The block index is only meaningful if available */
+		okA = mbAddrA == refA &&
+		      (refA == H264_MB_ADDR_INVALID || idxA == refIdxA);
+		okB = mbAddrB == refB &&
+		      (refB == H264_MB_ADDR_INVALID || idxB == refIdxB);
+		H264_TEST_CHECK(
+			okA && okB,
+			"mbaff %d, mb %u (field %d), %s block %u: "
+			"A %d/%u B %d/%u, expected A %d/%u B %d/%u",
+			ctx->derived.MbaffFrameFlag,
+			mb->mbAddr,
+			mb->mb_field_decoding_flag,
+			chroma ? "chroma" : "luma",
+			idx,
+			(int)mbAddrA,
+			idxA,
+			(int)mbAddrB,
+			idxB,
+			(int)refA,
+			refIdxA,
+			(int)refB,
+			refIdxB);
+	}
+
+	return 0;
+}
+
+
+/* Neighbouring macroblocks or pairs: availability (same slice) and field
+ * decoding flag, from the bits of cfg */
+static void setup_neighbours(struct h264_ctx *ctx,
+			     struct h264_macroblock *mb,
+			     uint32_t cfg)
+{
+	uint32_t PicWidthInMbs = ctx->sps_derived.PicWidthInMbs;
+	int mbaff = ctx->derived.MbaffFrameFlag;
+	uint32_t pair = mbaff ? mb->mbAddr / 2 : mb->mbAddr;
+	uint32_t addr[2] = {pair - 1, pair - PicWidthInMbs};
+	struct h264_macroblock_info *info = NULL;
+	uint32_t i, j;
+
+	for (i = 0; i < 2; i++) {
+		/* Left or top neighbour, if in the picture */
+		if ((i == 0 && pair % PicWidthInMbs == 0) ||
+		    (i == 1 && pair < PicWidthInMbs))
+			continue;
+		for (j = 0; j < (mbaff ? 2u : 1u); j++) {
+			info = h264_get_mb_info(
+				ctx, mbaff ? 2 * addr[i] + j : addr[i]);
+			info->slice_id = (cfg >> (2 * i)) & 1
+						 ? ctx->slice.mb_table.slice_id
+						 : 0;
+			info->field_flag = (cfg >> (2 * i + 1)) & 1;
+		}
+	}
+	mb->mb_field_decoding_flag = mbaff ? (cfg >> 4) & 1 : 0;
+	if (mbaff && mb->mbAddr % 2 == 1) {
+		/* Same field decoding flag in a pair */
+		info = h264_get_mb_info(ctx, mb->mbAddr - 1);
+		info->slice_id = ctx->slice.mb_table.slice_id;
+		info->field_flag = mb->mb_field_decoding_flag;
+	}
+}
+
+
+int h264_test_neighbours(void)
+{
+	int res = 0;
+	struct h264_ctx *ctx = NULL;
+	struct h264_macroblock *mb = NULL;
+	uint32_t mbaff, mbAddr, cfg, chroma;
+
+	res = h264_test_ctx_new(0, WIDTH, HEIGHT, &ctx);
+	if (res < 0)
+		return res;
+	mb = calloc(1, sizeof(*mb));
+	if (mb == NULL) {
+		res = -ENOMEM;
+		goto out;
+	}
+	res = h264_alloc_macroblock_table(ctx);
+	if (res < 0)
+		goto out;
+	ctx->slice.hdr.first_mb_in_slice = 0;
+	ctx->slice.mb_table.slice_id = 1;
+
+	for (mbaff = 0; mbaff < 2; mbaff++) {
+		ctx->derived.MbaffFrameFlag = mbaff;
+		for (mbAddr = 0; mbAddr < WIDTH * HEIGHT; mbAddr++) {
+			for (cfg = 0; cfg < (mbaff ? 32u : 16u); cfg++) {
+				memset(mb, 0, sizeof(*mb));
+				mb->mbAddr = mbAddr;
+				setup_neighbours(ctx, mb, cfg);
+				h264_compute_neighbouring_macroblocks(ctx, mb);
+
+				res = check_blocks(ctx, mb, 0);
+				if (res < 0)
+					goto out;
+				/* 4:2:0 then 4:2:2 chroma */
+				for (chroma = 8; chroma <= 16; chroma += 8) {
+					ctx->sps_derived.MbHeightC = chroma;
+					res = check_blocks(ctx, mb, 1);
+					if (res < 0)
+						goto out;
+				}
+				ctx->sps_derived.MbHeightC = 8;
+			}
+		}
+	}
+
+out:
+	free(mb);
+	h264_ctx_destroy(ctx);
+	return res;
+}
@@ -0,0 +1,309 @@
+/**
+ * Copyright (c) 2016 Parrot Drones SAS
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *   * Redistributions of source code must retain the above copyright
+ *     notice, this list of conditions and the following disclaimer.
+ *   * Redistributions in binary form must reproduce the above copyright
+ *     notice, this list of conditions and the following disclaimer in the
+ *     documentation and/or other materials provided with the distribution.
+ *   * Neither the name of the Parrot Drones SAS Company nor the
+ *     names of its contributors may be used to endorse or promote products
+ *     derived from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE PARROT DRONES SAS COMPANY BE LIABLE FOR
+ * ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+ * OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+/*
+ * NAL unit peeking: peeking SPS and PPS NAL units must store the parameter
+ * sets in the context without calling any callback function (including
+ * au_end), and without changing the active parameter sets nor the state of
+ * the current slice.
+ */
+
+#include "h264_test.h"
+
+
+#define WIDTH 4
+#define HEIGHT 3
+
+
+/* Active parameter sets and slice state of a context */
+struct ctx_state {
+	const struct h264_sps *sps;
+	const struct h264_pps *pps;
+	struct h264_sps_derived sps_derived;
+	uint8_t derived[sizeof(((struct h264_ctx *)NULL)->derived)];
+	uint8_t au[sizeof(((struct h264_ctx *)NULL)->au)];
+	uint8_t slice[sizeof(((struct h264_ctx *)NULL)->slice)];
+};
+
+
+static void au_end_cb(struct h264_ctx *ctx, void *userdata)
+{
+	uint32_t *count = userdata;
+
+	(*count)++;
+}
+
+
+static void nalu_cb(struct h264_ctx *ctx,
+		    enum h264_nalu_type type,
+		    const uint8_t *buf,
+		    size_t len,
+		    const struct h264_nalu_header *nh,
+		    void *userdata)
+{
+	uint32_t *count = userdata;
+
+	(*count)++;
+}
+
+
+static void slice_cb(struct h264_ctx *ctx,
+		     const uint8_t *buf,
+		     size_t len,
+		     const struct h264_slice_header *sh,
+		     void *userdata)
+{
+	uint32_t *count = userdata;
+
+	(*count)++;
+}
+
+
+static void sps_cb(struct h264_ctx *ctx,
+		   const uint8_t *buf,
+		   size_t len,
+		   const struct h264_sps *sps,
+		   void *userdata)
+{
+	uint32_t *count = userdata;
+
+	(*count)++;
+}
+
+
+static void pps_cb(struct h264_ctx *ctx,
+		   const uint8_t *buf,
+		   size_t len,
+		   const struct h264_pps *pps,
+		   void *userdata)
+{
+	uint32_t *count = userdata;
+
+	(*count)++;
+}
+
+
+static void save_state(struct h264_ctx *ctx, struct ctx_state *state)
+{
+	state->sps = ctx->sps;
+	state->pps = ctx->pps;
+	memcpy(&state->sps_derived,
+	       &ctx->sps_derived,
+	       sizeof(state->sps_derived));
+	memcpy(state->derived, &ctx->derived, sizeof(state->derived));
+	memcpy(state->au, &ctx->au, sizeof(state->au));
+	memcpy(state->slice, &ctx->slice, sizeof(state->slice));
+}
+
+
+static int check_state(struct h264_ctx *ctx, const struct ctx_state *state)
+{
+	H264_TEST_CHECK(ctx->sps == state->sps && ctx->pps == state->pps,
+			"active parameter sets changed");
+	H264_TEST_CHECK(memcmp(&ctx->sps_derived,
+			       &state->sps_derived,
+			       sizeof(state->sps_derived)) == 0 &&
+				memcmp(&ctx->derived,
+				       state->derived,
+				       sizeof(state->derived)) == 0,
+			"derived variables changed");
+	H264_TEST_CHECK(
+		memcmp(&ctx->au, state->au, sizeof(state->au)) == 0 &&
+			memcmp(&ctx->slice,
+			       state->slice,
+			       sizeof(state->slice)) == 0,
+		"access unit or slice state changed");
+	return 0;
+}
+
+
+/* Parameter sets of the context, with the given ids and picture width */
+static int add_ps(struct h264_test_stream *stream,
+		  struct h264_ctx *ctx,
+		  uint32_t id,
+		  uint32_t width)
+{
+	int res = 0;
+	struct h264_sps sps = *ctx->sps;
+	struct h264_pps pps = *ctx->pps;
+
+	sps.seq_parameter_set_id = id;
+	sps.pic_width_in_mbs_minus1 = width - 1;
+	res = h264_ctx_set_sps(ctx, &sps);
+	if (res < 0)
+		return res;
+	pps.pic_parameter_set_id = id;
+	pps.seq_parameter_set_id = id;
+	res = h264_ctx_set_pps(ctx, &pps);
+	if (res < 0)
+		return res;
+	return h264_test_stream_add_ps(stream, ctx);
+}
+
+
+/* Grey IDR slice of a single macroblock, using the given PPS */
+static int add_slice(struct h264_test_stream *stream,
+		     struct h264_ctx *ctx,
+		     uint32_t pps_id)
+{
+	int res = 0;
+	struct h264_nalu_header nh;
+	struct h264_slice_header sh;
+	struct h264_bitstream bs;
+
+	memset(&nh, 0, sizeof(nh));
+	nh.nal_ref_idc = 1;
+	nh.nal_unit_type = H264_NALU_TYPE_SLICE_IDR;
+	res = h264_ctx_set_nalu_header(ctx, &nh);
+	if (res < 0)
+		return res;
+
+	memset(&sh, 0, sizeof(sh));
+	sh.slice_type = H264_SLICE_TYPE_I;
+	sh.pic_parameter_set_id = pps_id;
+	res = h264_ctx_set_slice_header(ctx, &sh);
+	if (res < 0)
+		return res;
+
+	h264_bs_init(&bs, NULL, 0, 1);
+	res = h264_write_grey_i_slice(&bs, ctx, 1);
+	if (res == 0)
+		res = h264_test_stream_add(stream, bs.data, bs.off);
+	h264_bs_clear(&bs);
+	return res;
+}
+
+
+int h264_test_peek(void)
+{
+	int res = 0;
+	struct h264_ctx *ctx = NULL;
+	struct h264_ctx *rctx = NULL;
+	struct h264_reader *reader = NULL;
+	struct h264_test_stream stream, peeked;
+	struct h264_ctx_cbs cbs;
+	struct h264_nalu_peek info;
+	struct ctx_state *state = NULL;
+	uint32_t count = 0, slices = 0;
+	size_t off = 0, start = 0, end = 0, len = 0;
+
+	memset(&stream, 0, sizeof(stream));
+	memset(&peeked, 0, sizeof(peeked));
+	memset(&cbs, 0, sizeof(cbs));
+	cbs.au_end = &au_end_cb;
+	cbs.nalu_begin = &nalu_cb;
+	cbs.nalu_end = &nalu_cb;
+	cbs.slice = &slice_cb;
+	cbs.sps = &sps_cb;
+	cbs.pps = &pps_cb;
+
+	state = calloc(1, sizeof(*state));
+	if (state == NULL)
+		return -ENOMEM;
+	res = h264_test_ctx_new(0, WIDTH, HEIGHT, &ctx);
+	if (res < 0)
+		goto out;
+	res = h264_reader_new(&cbs, &count, &reader);
+	if (res < 0)
+		goto out;
+	rctx = h264_reader_get_ctx(reader);
+
+	/* Current slice using the parameter sets 0 */
+	res = add_ps(&stream, ctx, 0, WIDTH);
+	if (res < 0)
+		goto out;
+	res = add_slice(&stream, ctx, 0);
+	if (res < 0)
+		goto out;
+	res = h264_reader_parse(reader,
+				H264_READER_FLAGS_SLICE_DATA,
+				stream.buf,
+				stream.len,
+				&off);
+	if (res < 0)
+		goto out;
+
+	/* Parameter sets 0 again and new parameter sets 1 for a wider
+	 * picture, then a slice using the latter */
+	res = add_ps(&peeked, ctx, 0, WIDTH);
+	if (res < 0)
+		goto out;
+	res = add_ps(&peeked, ctx, 1, 2 * WIDTH);
+	if (res < 0)
+		goto out;
+	res = add_slice(&peeked, ctx, 1);
+	if (res < 0)
+		goto out;
+
+	save_state(rctx, state);
+	count = 0;
+	off = 0;
+	while (off < peeked.len) {
+		res = h264_find_nalu(
+			peeked.buf + off, peeked.len - off, &start, &end);
+		if (res < 0 && res != -EAGAIN)
+			goto out;
+		len = end - start;
+		res = h264_reader_peek_nalu(
+			reader, peeked.buf + off + start, len, &info);
+		if (res < 0)
+			goto out;
+		off += end;
+
+		if (info.type != H264_NALU_TYPE_SLICE_IDR) {
+			H264_TEST_CHECK(count == 0,
+					"%u callback functions called",
+					count);
+			res = check_state(rctx, state);
+			if (res < 0)
+				goto out;
+			continue;
+		}
+
+		/* The peeked parameter sets can be used */
+		H264_TEST_CHECK(info.pic_parameter_set_id == 1 &&
+					info.first_vcl,
+				"slice: PPS %u, first VCL %d",
+				info.pic_parameter_set_id,
+				info.first_vcl);
+		slices++;
+	}
+	H264_TEST_CHECK(slices == 1, "%u slices peeked", slices);
+	H264_TEST_CHECK(rctx->sps_table[1] != NULL &&
+				rctx->sps_table[1]->pic_width_in_mbs_minus1 ==
+					2 * WIDTH - 1 &&
+				rctx->pps_table[1] != NULL &&
+				rctx->pps_table[1]->seq_parameter_set_id == 1,
+			"parameter sets 1 not stored");
+	res = 0;
+
+out:
+	h264_reader_destroy(reader);
+	h264_ctx_destroy(ctx);
+	h264_test_stream_clear(&stream);
+	h264_test_stream_clear(&peeked);
+	free(state);
+	return res;
+}
@@ -0,0 +1,348 @@
+/**
+ * Copyright (c) 2016 Parrot Drones SAS
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *   * Redistributions of source code must retain the above copyright
+ *     notice, this list of conditions and the following disclaimer.
+ *   * Redistributions in binary form must reproduce the above copyright
+ *     notice, this list of conditions and the following disclaimer in the
+ *     documentation and/or other materials provided with the distribution.
+ *   * Neither the name of the Parrot Drones SAS Company nor the
+ *     names of its contributors may be used to endorse or promote products
+ *     derived from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE PARROT DRONES SAS COMPANY BE LIABLE FOR
+ * ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+ * OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+/*
+ * Chunk-fed byte stream: h264_reader_push() with the stream split at random
+ * positions (down to one byte per buffer), then h264_reader_flush(), must
+ * call the same callback functions with the same NAL units as
+ * h264_reader_parse() of the whole stream followed by h264_reader_flush().
+ */
+
+#include "h264_test.h"
+
+
+#define WIDTH 5
+#define HEIGHT 3
+#define MB_COUNT (WIDTH * HEIGHT)
+#define FRAME_COUNT 12
+#define SPLIT_COUNT 100
+#define TRACE_MAX_LEN 2048
+
+#define TRACE_NALU 1
+#define TRACE_AU_END 2
+#define TRACE_SLICE_DATA_END 3
+
+
+/* Callback functions called, with their NAL unit type, length and content
+ * hash or their macroblock count */
+struct trace {
+	uint32_t ev[TRACE_MAX_LEN];
+	size_t len;
+	int overflow;
+};
+
+
+static void trace_add(struct trace *trace, uint32_t v)
+{
+	if (trace->len < TRACE_MAX_LEN)
+		trace->ev[trace->len++] = v;
+	else
+		trace->overflow = 1;
+}
+
+
+static void au_end_cb(struct h264_ctx *ctx, void *userdata)
+{
+	trace_add(userdata, TRACE_AU_END);
+}
+
+
+static void nalu_begin_cb(struct h264_ctx *ctx,
+			  enum h264_nalu_type type,
+			  const uint8_t *buf,
+			  size_t len,
+			  const struct h264_nalu_header *nh,
+			  void *userdata)
+{
+	uint32_t hash = 2166136261u;
+	size_t i = 0;
+
+	/* FNV-1a */
+	for (i = 0; i < len; i++)
+		hash = (hash ^ buf[i]) * 16777619u;
+
+	trace_add(userdata, TRACE_NALU);
+	trace_add(userdata, type);
+	trace_add(userdata, (uint32_t)len);
+	trace_add(userdata, hash);
+}
+
+
+static void slice_data_end_cb(struct h264_ctx *ctx,
+			      const struct h264_slice_header *sh,
+			      uint32_t mb_count,
+			      void *userdata)
+{
+	trace_add(userdata, TRACE_SLICE_DATA_END);
+	trace_add(userdata, mb_count);
+}
+
+
+static int add_nalu(struct h264_test_stream *stream,
+		    struct h264_ctx *ctx,
+		    enum h264_nalu_type type,
+		    uint32_t nal_ref_idc)
+{
+	int res = 0;
+	struct h264_nalu_header nh;
+	struct h264_bitstream bs;
+
+	memset(&nh, 0, sizeof(nh));
+	nh.nal_ref_idc = nal_ref_idc;
+	nh.nal_unit_type = type;
+	res = h264_ctx_set_nalu_header(ctx, &nh);
+	if (res < 0)
+		return res;
+	h264_bs_init(&bs, NULL, 0, 1);
+	res = h264_write_nalu(&bs, ctx);
+	if (res == 0)
+		res = h264_test_stream_add(stream, bs.data, bs.off);
+	h264_bs_clear(&bs);
+	return res;
+}
+
+
+static int add_slice(struct h264_test_stream *stream,
+		     struct h264_ctx *ctx,
+		     uint32_t frame_num,
+		     uint32_t first_mb,
+		     uint32_t mb_count)
+{
+	int res = 0;
+	struct h264_nalu_header nh;
+	struct h264_slice_header sh;
+	struct h264_bitstream bs;
+
+	memset(&nh, 0, sizeof(nh));
+	nh.nal_ref_idc = 1;
+	nh.nal_unit_type = frame_num == 0 ? H264_NALU_TYPE_SLICE_IDR
+					  : H264_NALU_TYPE_SLICE;
+	res = h264_ctx_set_nalu_header(ctx, &nh);
+	if (res < 0)
+		return res;
+
+	memset(&sh, 0, sizeof(sh));
+	sh.first_mb_in_slice = first_mb;
+	sh.slice_type = frame_num == 0 ? H264_SLICE_TYPE_I : H264_SLICE_TYPE_P;
+	sh.frame_num = frame_num;
+	res = h264_ctx_set_slice_header(ctx, &sh);
+	if (res < 0)
+		return res;
+
+	h264_bs_init(&bs, NULL, 0, 1);
+	if (frame_num == 0)
+		res = h264_write_grey_i_slice(&bs, ctx, mb_count);
+	else
+		res = h264_write_skipped_p_slice(&bs, ctx, mb_count);
+	if (res == 0)
+		res = h264_test_stream_add(stream, bs.data, bs.off);
+	h264_bs_clear(&bs);
+	return res;
+}
+
+
+/* SPS, PPS, then a grey IDR frame and skipped P frames of one to three
+ * slices, some of them followed by filler data */
+static int make_stream(struct h264_test_stream *stream,
+		       int cabac,
+		       uint32_t *seed)
+{
+	int res = 0;
+	struct h264_ctx *ctx = NULL;
+	uint32_t frame_num = 0, first_mb = 0, mb_count = 0;
+	uint32_t r = 0;
+
+	res = h264_test_ctx_new(cabac, WIDTH, HEIGHT, &ctx);
+	if (res < 0)
+		return res;
+	res = h264_test_stream_add_ps(stream, ctx);
+	if (res < 0)
+		goto out;
+
+	for (frame_num = 0; frame_num < FRAME_COUNT; frame_num++) {
+		for (first_mb = 0; first_mb < MB_COUNT; first_mb += mb_count) {
+			r = h264_test_random(seed);
+			mb_count = 1 + r % (MB_COUNT - first_mb);
+			if ((r >> 8) % 2)
+				mb_count = MB_COUNT - first_mb;
+			res = add_slice(
+				stream, ctx, frame_num, first_mb, mb_count);
+			if (res < 0)
+				goto out;
+		}
+		if ((r >> 16) % 3 == 0) {
+			/* Up to a few kB */
+			res = h264_ctx_set_filler(ctx, (r >> 18) % 4096);
+			if (res < 0)
+				goto out;
+			res = add_nalu(stream, ctx, H264_NALU_TYPE_FILLER, 0);
+			if (res < 0)
+				goto out;
+		}
+	}
+
+out:
+	h264_ctx_destroy(ctx);
+	return res;
+}
+
+
+static int read_stream(const struct h264_test_stream *stream,
+		       uint32_t max_chunk_len,
+		       uint32_t *seed,
+		       struct trace *trace)
+{
+	int res = 0;
+	struct h264_reader *reader = NULL;
+	struct h264_ctx_cbs cbs;
+	size_t pos = 0, len = 0, off = 0;
+
+	memset(&cbs, 0, sizeof(cbs));
+	cbs.au_end = &au_end_cb;
+	cbs.nalu_begin = &nalu_begin_cb;
+	cbs.slice_data_end = &slice_data_end_cb;
+	memset(trace, 0, sizeof(*trace));
+
+	res = h264_reader_new(&cbs, trace, &reader);
+	if (res < 0)
+		return res;
+
+	if (max_chunk_len == 0) {
+		res = h264_reader_parse(reader,
+					H264_READER_FLAGS_SLICE_DATA,
+					stream->buf,
+					stream->len,
+					&off);
+		if (res == 0 && off != stream->len)
+			res = -EPROTO;
+	}
+	while (max_chunk_len != 0 && res == 0 && pos < stream->len) {
+		len = 1 + h264_test_random(seed) % max_chunk_len;
+		if (len > stream->len - pos)
+			len = stream->len - pos;
+		res = h264_reader_push(reader,
+				       H264_READER_FLAGS_SLICE_DATA,
+				       stream->buf + pos,
+				       len,
+				       &off);
+		if (res == 0 && off != len)
+			res = -EPROTO;
+		pos += len;
+	}
+	if (res == 0)
+		res = h264_reader_flush(reader);
+	if (res == 0 && trace->overflow)
+		res = -ENOBUFS;
+
+	h264_reader_destroy(reader);
+	return res;
+}
+
+
+static void print_split(int cabac, uint32_t max_chunk_len, const char *msg)
+{
+	fprintf(stderr,
+		"%s stream, chunks of up to %u bytes: %s\n",
+		cabac ? "CABAC" : "CAVLC",
+		max_chunk_len,
+		msg);
+}
+
+
+static int check_split(const struct h264_test_stream *stream,
+		       int cabac,
+		       uint32_t max_chunk_len,
+		       uint32_t *seed,
+		       const struct trace *ref,
+		       struct trace *trace)
+{
+	int res = 0;
+
+	res = read_stream(stream, max_chunk_len, seed, trace);
+	if (res < 0) {
+		print_split(cabac, max_chunk_len, "push failed");
+		return res;
+	}
+	if (trace->len != ref->len ||
+	    memcmp(trace->ev, ref->ev, ref->len * sizeof(ref->ev[0])) != 0) {
+		print_split(cabac, max_chunk_len, "callbacks differ");
+		return -EPROTO;
+	}
+
+	return 0;
+}
+
+
+int h264_test_push(void)
+{
+	int res = 0;
+	uint32_t seed = 0x2468ace1;
+	struct h264_test_stream stream;
+	struct trace *ref = NULL, *trace = NULL;
+	uint32_t max_chunk_len = 0;
+	uint32_t i = 0;
+	int cabac = 0;
+
+	memset(&stream, 0, sizeof(stream));
+	ref = calloc(2, sizeof(*ref));
+	if (ref == NULL)
+		return -ENOMEM;
+	trace = &ref[1];
+
+	for (cabac = 0; cabac < 2; cabac++) {
+		h264_test_stream_clear(&stream);
+		res = make_stream(&stream, cabac, &seed);
+		if (res < 0)
+			goto out;
+		res = read_stream(&stream, 0, &seed, ref);
+		if (res < 0) {
+			print_split(cabac, 0, "parsing failed");
+			goto out;
+		}
+
+		for (i = 0; i < SPLIT_COUNT; i++) {
+			/* Tiny buffers split the start codes and NAL unit
+			 * headers, large ones keep complete NAL units */
+			if (i % 2)
+				max_chunk_len = 1 + i % 5;
+			else
+				max_chunk_len = 1 + h264_test_random(&seed) %
+							    stream.len;
+			res = check_split(&stream,
+					  cabac,
+					  max_chunk_len,
+					  &seed,
+					  ref,
+					  trace);
+			if (res < 0)
+				goto out;
+		}
+	}
+
+out:
+	h264_test_stream_clear(&stream);
+	free(ref);
+	return res;
+}
@@ -0,0 +1,290 @@
+/**
+ * Copyright (c) 2016 Parrot Drones SAS
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *   * Redistributions of source code must retain the above copyright
+ *     notice, this list of conditions and the following disclaimer.
+ *   * Redistributions in binary form must reproduce the above copyright
+ *     notice, this list of conditions and the following disclaimer in the
+ *     documentation and/or other materials provided with the distribution.
+ *   * Neither the name of the Parrot Drones SAS Company nor the
+ *     names of its contributors may be used to endorse or promote products
+ *     derived from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE PARROT DRONES SAS COMPANY BE LIABLE FOR
+ * ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+ * OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+/*
+ * SEI zero copy: with H264_READER_FLAGS_SEI_ZERO_COPY, the payloads that
+ * contain no emulation prevention byte must be referenced in the input NAL
+ * unit, the others must be copied; in both cases the payloads must be those
+ * given by the copying path, with or without H264_READER_FLAGS_UNESCAPE.
+ */
+
+#include "h264_test.h"
+
+
+#define NALU_COUNT 300
+#define PAYLOAD_MAX_COUNT 3
+#define PAYLOAD_MAX_LEN 64
+#define NALU_MAX_LEN 512
+
+
+struct nalu {
+	/* Escaped by hand */
+	uint8_t *buf;
+	size_t len;
+
+	/* Offset in buf of each RBSP byte */
+	size_t map[NALU_MAX_LEN];
+
+	/* Payloads (user data unregistered) and their RBSP offsets */
+	uint32_t count;
+	uint8_t payload[PAYLOAD_MAX_COUNT][PAYLOAD_MAX_LEN];
+	size_t off[PAYLOAD_MAX_COUNT];
+	size_t len_[PAYLOAD_MAX_COUNT];
+};
+
+
+struct parse_check {
+	uint32_t count;
+	uint32_t user_data_count;
+	const uint8_t *buf[PAYLOAD_MAX_COUNT];
+	uint8_t payload[PAYLOAD_MAX_COUNT][PAYLOAD_MAX_LEN];
+	size_t len[PAYLOAD_MAX_COUNT];
+	uint32_t errors;
+};
+
+
+/* Mostly zeros and small values, to get emulation prevention bytes, or
+ * any value */
+static uint8_t random_byte(uint32_t *seed, int zeros)
+{
+	uint32_t r = h264_test_random(seed);
+
+	if (!zeros)
+		return r >> 8;
+	return r % 3 ? 0x00 : (r >> 8) % 5;
+}
+
+
+/* SEI NAL unit with user data unregistered payloads, whose type and size
+ * are coded on one byte; the buffer has the exact NAL unit size, for ASan to
+ * catch reads past its end */
+static int make_nalu(struct nalu *nalu, uint32_t *seed)
+{
+	uint8_t rbsp[NALU_MAX_LEN];
+	uint8_t buf[NALU_MAX_LEN];
+	size_t len = 0, i = 0, zeros = 0;
+	uint32_t p = 0;
+
+	rbsp[len++] = H264_NALU_TYPE_SEI;
+	nalu->count = 1 + h264_test_random(seed) % PAYLOAD_MAX_COUNT;
+	for (p = 0; p < nalu->count; p++) {
+		zeros = h264_test_random(seed) & 1;
+		nalu->len_[p] =
+			16 + h264_test_random(seed) % (PAYLOAD_MAX_LEN - 15);
+		for (i = 0; i < nalu->len_[p]; i++)
+			nalu->payload[p][i] = random_byte(seed, zeros);
+		rbsp[len++] = H264_SEI_TYPE_USER_DATA_UNREGISTERED;
+		rbsp[len++] = nalu->len_[p];
+		nalu->off[p] = len;
+		memcpy(&rbsp[len], nalu->payload[p], nalu->len_[p]);
+		len += nalu->len_[p];
+	}
+	rbsp[len++] = 0x80;
+	zeros = 0;
+
+	/* 7.4.1: an emulation_prevention_three_byte before any 00, 01, 02 or
+	 * 03 byte following two 0x00 bytes */
+	nalu->len = 0;
+	for (i = 0; i < len; i++) {
+		if (zeros >= 2 && rbsp[i] <= 0x03) {
+			buf[nalu->len++] = 0x03;
+			zeros = 0;
+		}
+		nalu->map[i] = nalu->len;
+		buf[nalu->len++] = rbsp[i];
+		zeros = rbsp[i] == 0x00 ? zeros + 1 : 0;
+	}
+
+	free(nalu->buf);
+	nalu->buf = malloc(nalu->len);
+	if (nalu->buf == NULL)
+		return -ENOMEM;
+	memcpy(nalu->buf, buf, nalu->len);
+	return 0;
+}
+
+
+static void sei_cb(struct h264_ctx *ctx,
+		   enum h264_sei_type type,
+		   const uint8_t *buf,
+		   size_t len,
+		   void *userdata)
+{
+	struct parse_check *check = userdata;
+	uint32_t n = check->count++;
+
+	if (n >= PAYLOAD_MAX_COUNT || len > PAYLOAD_MAX_LEN) {
+		check->errors++;
+		return;
+	}
+	check->buf[n] = buf;
+	check->len[n] = len;
+	memcpy(check->payload[n], buf, len);
+}
+
+
+static void sei_user_data_unregistered_cb(
+	struct h264_ctx *ctx,
+	const uint8_t *buf,
+	size_t len,
+	const struct h264_sei_user_data_unregistered *sei,
+	void *userdata)
+{
+	struct parse_check *check = userdata;
+	uint32_t n = check->user_data_count++;
+
+	if (n >= check->count || memcmp(sei->uuid, check->payload[n], 16) ||
+	    sei->len != check->len[n] - 16 ||
+	    memcmp(sei->buf, check->payload[n] + 16, sei->len))
+		check->errors++;
+}
+
+
+static int check_nalu(struct h264_reader *reader,
+		      uint32_t flags,
+		      const struct nalu *nalu,
+		      struct parse_check *check,
+		      uint32_t *ref_count,
+		      uint32_t *esc_count)
+{
+	int res = 0;
+	const uint8_t *first = NULL, *last = NULL;
+	uint32_t p = 0;
+	int inside = 0;
+
+	memset(check, 0, sizeof(*check));
+	res = h264_reader_parse_nalu(reader, flags, nalu->buf, nalu->len);
+	if (res < 0)
+		return res;
+
+	H264_TEST_CHECK(check->count == nalu->count &&
+				check->user_data_count == nalu->count &&
+				check->errors == 0,
+			"flags 0x%x: %u payloads, %u user data, %u errors, "
+			"expected %u",
+			flags,
+			check->count,
+			check->user_data_count,
+			check->errors,
+			nalu->count);
+
+	for (p = 0; p < nalu->count; p++) {
+		H264_TEST_CHECK(check->len[p] == nalu->len_[p] &&
+					memcmp(check->payload[p],
+					       nalu->payload[p],
+					       nalu->len_[p]) == 0,
+				"flags 0x%x: payload %u differs",
+				flags,
+				p);
+
+		if (!(flags & H264_READER_FLAGS_SEI_ZERO_COPY))
+			continue;
+		first = nalu->buf + nalu->map[nalu->off[p]];
+		last = nalu->buf + nalu->map[nalu->off[p] + nalu->len_[p] - 1];
+		inside = check->buf[p] >= nalu->buf &&
+			 check->buf[p] < nalu->buf + nalu->len;
+		if (last - first == (ptrdiff_t)nalu->len_[p] - 1) {
+			/* No emulation prevention byte in the payload */
+			H264_TEST_CHECK(check->buf[p] == first,
+					"flags 0x%x: payload %u not "
+					"referenced (%td)",
+					flags,
+					p,
+					check->buf[p] - nalu->buf);
+			(*ref_count)++;
+		} else {
+			H264_TEST_CHECK(!inside,
+					"flags 0x%x: escaped payload %u "
+					"referenced",
+					flags,
+					p);
+			(*esc_count)++;
+		}
+	}
+
+	return 0;
+}
+
+
+int h264_test_sei_zero_copy(void)
+{
+	static const uint32_t flags[] = {
+		0,
+		H264_READER_FLAGS_SEI_ZERO_COPY,
+		H264_READER_FLAGS_UNESCAPE,
+		H264_READER_FLAGS_UNESCAPE | H264_READER_FLAGS_SEI_ZERO_COPY,
+	};
+	int res = 0;
+	uint32_t seed = 0x5eed0021;
+	struct h264_reader *reader = NULL;
+	struct h264_ctx_cbs cbs;
+	struct nalu *nalu = NULL;
+	struct parse_check check;
+	uint32_t i = 0, ref_count = 0, esc_count = 0;
+	size_t f = 0;
+
+	memset(&cbs, 0, sizeof(cbs));
+	cbs.sei = &sei_cb;
+	cbs.sei_user_data_unregistered = &sei_user_data_unregistered_cb;
+
+	nalu = calloc(1, sizeof(*nalu));
+	if (nalu == NULL)
+		return -ENOMEM;
+	res = h264_reader_new(&cbs, &check, &reader);
+	if (res < 0)
+		goto out;
+
+	for (i = 0; i < NALU_COUNT; i++) {
+		res = make_nalu(nalu, &seed);
+		if (res < 0)
+			goto out;
+		for (f = 0; f < ARRAY_SIZE(flags); f++) {
+			res = check_nalu(reader,
+					 flags[f],
+					 nalu,
+					 &check,
+					 &ref_count,
+					 &esc_count);
+			if (res < 0)
+				goto out;
+		}
+	}
+
+	/* Make sure that both cases have been exercised */
+	if (ref_count == 0 || esc_count == 0) {
+		fprintf(stderr,
+			"%u referenced, %u escaped payloads\n",
+			ref_count,
+			esc_count);
+		res = -EPROTO;
+	}
+
+out:
+	h264_reader_destroy(reader);
+	if (nalu != NULL)
+		free(nalu->buf);
+	free(nalu);
+	return res;
+}
@@ -0,0 +1,292 @@
+/**
+ * Copyright (c) 2016 Parrot Drones SAS
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *   * Redistributions of source code must retain the above copyright
+ *     notice, this list of conditions and the following disclaimer.
+ *   * Redistributions in binary form must reproduce the above copyright
+ *     notice, this list of conditions and the following disclaimer in the
+ *     documentation and/or other materials provided with the distribution.
+ *   * Neither the name of the Parrot Drones SAS Company nor the
+ *     names of its contributors may be used to endorse or promote products
+ *     derived from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE PARROT DRONES SAS COMPANY BE LIABLE FOR
+ * ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+ * OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+/*
+ * Unescaped parsing: slices whose header and data contain many 00 00 03
+ * sequences, parsed with H264_READER_FLAGS_UNESCAPE, must give the NAL unit
+ * buffers, slice header length and raw slice data of the escaped NAL unit,
+ * as computed on a NAL unit escaped by hand.
+ */
+
+#include "h264_test.h"
+
+
+#define WIDTH 20
+#define HEIGHT 15
+#define SLICE_COUNT 300
+#define PAYLOAD_MAX_LEN 64
+#define NALU_MAX_LEN 256
+
+
+struct nalu {
+	/* Escaped by hand */
+	uint8_t buf[NALU_MAX_LEN];
+	size_t len;
+
+	/* Offset in buf of each RBSP byte, and of the RBSP end */
+	size_t map[NALU_MAX_LEN];
+
+	/* Slice header length in bits, in the RBSP and in buf */
+	size_t rbsp_hdr_len;
+	size_t hdr_len;
+	uint32_t hdr_escapes;
+};
+
+
+struct parse_check {
+	const struct nalu *nalu;
+	uint32_t nalu_count;
+	uint32_t slice_count;
+	uint32_t errors;
+};
+
+
+/* 7.4.1: an emulation_prevention_three_byte before any 00, 01, 02 or 03
+ * byte following two 0x00 bytes */
+static void escape(struct nalu *nalu, const uint8_t *rbsp, size_t len)
+{
+	size_t i = 0, zeros = 0;
+
+	nalu->len = 0;
+	nalu->hdr_escapes = 0;
+	for (i = 0; i < len; i++) {
+		if (zeros >= 2 && rbsp[i] <= 0x03) {
+			nalu->buf[nalu->len++] = 0x03;
+			nalu->hdr_escapes += i * 8 < nalu->rbsp_hdr_len;
+			zeros = 0;
+		}
+		nalu->map[i] = nalu->len;
+		nalu->buf[nalu->len++] = rbsp[i];
+		zeros = rbsp[i] == 0x00 ? zeros + 1 : 0;
+	}
+	nalu->map[len] = nalu->len;
+	nalu->hdr_len =
+		nalu->map[nalu->rbsp_hdr_len / 8] * 8 + nalu->rbsp_hdr_len % 8;
+}
+
+
+/* IDR slice header with long runs of zero bits (frame_num 0, idr_pic_id
+ * 65535) shifted by first_mb_in_slice, followed by slice data bytes made of
+ * zeros and small values; the slice data is not parsed */
+static int make_nalu(struct h264_ctx *ctx, struct nalu *nalu, uint32_t *seed)
+{
+	int res = 0;
+	struct h264_nalu_header nh;
+	struct h264_slice_header sh;
+	struct h264_bitstream bs, hdr, rbsp;
+	uint32_t i = 0, n = 0, v = 0, r = 0;
+
+	memset(&nh, 0, sizeof(nh));
+	nh.nal_ref_idc = 1;
+	nh.nal_unit_type = H264_NALU_TYPE_SLICE_IDR;
+	res = h264_ctx_set_nalu_header(ctx, &nh);
+	if (res < 0)
+		return res;
+
+	memset(&sh, 0, sizeof(sh));
+	sh.first_mb_in_slice = h264_test_random(seed) % (WIDTH * HEIGHT);
+	sh.slice_type = H264_SLICE_TYPE_I;
+	sh.idr_pic_id = 65535;
+	sh.slice_qp_delta = (int32_t)(h264_test_random(seed) % 9) - 4;
+	res = h264_ctx_set_slice_header(ctx, &sh);
+	if (res < 0)
+		return res;
+
+	/* Slice header, without emulation prevention */
+	h264_bs_init(&bs, NULL, 0, 0);
+	h264_bs_init(&rbsp, NULL, 0, 0);
+	res = h264_write_grey_i_slice(&bs, ctx, 1);
+	if (res < 0)
+		goto out;
+	nalu->rbsp_hdr_len = ctx->slice.hdr_len;
+	h264_bs_cinit(&hdr, bs.data, bs.off, 0);
+	for (i = 0; i < nalu->rbsp_hdr_len; i += n) {
+		n = Min(nalu->rbsp_hdr_len - i, 8);
+		res = h264_bs_read_bits(&hdr, &v, n);
+		if (res >= 0)
+			res = h264_bs_write_bits(&rbsp, v, n);
+		if (res < 0)
+			goto out;
+	}
+
+	/* Slice data */
+	n = h264_test_random(seed) % PAYLOAD_MAX_LEN;
+	for (i = 0; i < n; i++) {
+		r = h264_test_random(seed);
+		res = h264_bs_write_bits(&rbsp, r % 3 ? 0 : (r >> 8) % 5, 8);
+		if (res < 0)
+			goto out;
+	}
+	res = h264_bs_write_rbsp_trailing_bits(&rbsp);
+	if (res < 0)
+		goto out;
+
+	escape(nalu, rbsp.data, rbsp.off);
+	res = 0;
+
+out:
+	h264_bs_clear(&bs);
+	h264_bs_clear(&rbsp);
+	return res;
+}
+
+
+static void nalu_begin_cb(struct h264_ctx *ctx,
+			  enum h264_nalu_type type,
+			  const uint8_t *buf,
+			  size_t len,
+			  const struct h264_nalu_header *nh,
+			  void *userdata)
+{
+	struct parse_check *check = userdata;
+
+	check->errors += buf != check->nalu->buf || len != check->nalu->len;
+	check->nalu_count++;
+}
+
+
+static void slice_cb(struct h264_ctx *ctx,
+		     const uint8_t *buf,
+		     size_t len,
+		     const struct h264_slice_header *sh,
+		     void *userdata)
+{
+	struct parse_check *check = userdata;
+
+	check->errors += buf != check->nalu->buf || len != check->nalu->len;
+	check->errors += ctx->slice.hdr_len != check->nalu->hdr_len;
+	check->slice_count++;
+}
+
+
+static int check_nalu(struct h264_reader *reader,
+		      uint32_t flags,
+		      const struct nalu *nalu,
+		      struct parse_check *check)
+{
+	int res = 0;
+	struct h264_ctx *ctx = h264_reader_get_ctx(reader);
+	size_t off = (nalu->hdr_len + 7) / 8;
+
+	memset(check, 0, sizeof(*check));
+	check->nalu = nalu;
+	res = h264_reader_parse_nalu(reader, flags, nalu->buf, nalu->len);
+	if (res < 0)
+		return res;
+
+	H264_TEST_CHECK(check->nalu_count == 1 && check->slice_count == 1 &&
+				check->errors == 0,
+			"flags 0x%x: %u NAL units, %u slices, %u errors "
+			"(header length %zu, expected %zu)",
+			flags,
+			check->nalu_count,
+			check->slice_count,
+			check->errors,
+			ctx->slice.hdr_len,
+			nalu->hdr_len);
+
+	/* The slice data starts after the header, the bits of its first
+	 * byte being kept apart */
+	H264_TEST_CHECK(ctx->slice.rawdata.buf == nalu->buf + off &&
+				ctx->slice.rawdata.len == nalu->len - off &&
+				ctx->slice.rawdata.partialbits ==
+					(8 - nalu->hdr_len % 8) % 8,
+			"flags 0x%x: raw data at %td (%zu bytes, %u bits), "
+			"expected %zu (%zu bytes, %zu bits)",
+			flags,
+			ctx->slice.rawdata.buf - nalu->buf,
+			ctx->slice.rawdata.len,
+			ctx->slice.rawdata.partialbits,
+			off,
+			nalu->len - off,
+			(8 - nalu->hdr_len % 8) % 8);
+
+	return 0;
+}
+
+
+int h264_test_unescape(void)
+{
+	int res = 0;
+	uint32_t seed = 0x5eed0006;
+	struct h264_ctx *ctx = NULL;
+	struct h264_reader *reader = NULL;
+	struct h264_test_stream stream;
+	struct h264_ctx_cbs cbs;
+	struct parse_check check;
+	struct nalu *nalu = NULL;
+	uint32_t i = 0, hdr_escapes = 0;
+	size_t off = 0;
+
+	memset(&stream, 0, sizeof(stream));
+	memset(&cbs, 0, sizeof(cbs));
+	cbs.nalu_begin = &nalu_begin_cb;
+	cbs.slice = &slice_cb;
+
+	nalu = calloc(1, sizeof(*nalu));
+	if (nalu == NULL)
+		return -ENOMEM;
+	res = h264_test_ctx_new(0, WIDTH, HEIGHT, &ctx);
+	if (res < 0)
+		goto out;
+	res = h264_reader_new(&cbs, &check, &reader);
+	if (res < 0)
+		goto out;
+
+	/* Parameter sets */
+	res = h264_test_stream_add_ps(&stream, ctx);
+	if (res < 0)
+		goto out;
+	res = h264_reader_parse(reader, 0, stream.buf, stream.len, &off);
+	if (res < 0)
+		goto out;
+
+	for (i = 0; i < SLICE_COUNT; i++) {
+		res = make_nalu(ctx, nalu, &seed);
+		if (res < 0)
+			goto out;
+		hdr_escapes += nalu->hdr_escapes;
+		res = check_nalu(reader, 0, nalu, &check);
+		if (res < 0)
+			goto out;
+		res = check_nalu(
+			reader, H264_READER_FLAGS_UNESCAPE, nalu, &check);
+		if (res < 0)
+			goto out;
+	}
+
+	/* Make sure that the header mapping has been exercised */
+	if (hdr_escapes == 0) {
+		fprintf(stderr, "no escaped slice header\n");
+		res = -EPROTO;
+	}
+
+out:
+	h264_reader_destroy(reader);
+	h264_ctx_destroy(ctx);
+	h264_test_stream_clear(&stream);
+	free(nalu);
+	return res;
+}
@@ -0,0 +1,103 @@
+/**
+ * Copyright (c) 2016 Parrot Drones SAS
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *   * Redistributions of source code must retain the above copyright
+ *     notice, this list of conditions and the following disclaimer.
+ *   * Redistributions in binary form must reproduce the above copyright
+ *     notice, this list of conditions and the following disclaimer in the
+ *     documentation and/or other materials provided with the distribution.
+ *   * Neither the name of the Parrot Drones SAS Company nor the
+ *     names of its contributors may be used to endorse or promote products
+ *     derived from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE PARROT DRONES SAS COMPANY BE LIABLE FOR
+ * ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+ * OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/*
+ * CAVLC tables: the multi-bit lookup tables of h264_read_vlc() against the
+ * bit-by-bit decoding of the spec tables, for every table and every 16-bit
+ * prefix, including truncated streams.
+ */
+
+#include "h264_test.h"
+
+
+static int check_code(enum h264_vlc_table id, const uint8_t *buf, size_t len)
+{
+	int res1, res2;
+	uint32_t code1 = 0, code2 = 0;
+	struct h264_bitstream bs1, bs2;
+
+	h264_bs_cinit(&bs1, buf, len, 0);
+	h264_bs_cinit(&bs2, buf, len, 0);
+	res1 = h264_read_vlc(&bs1, id, &code1);
+	res2 = h264_read_vlc_bitwise(&bs2, id, &code2);
+
+	/* The bit-by-bit decoder may have consumed bits of an invalid code */
+	H264_TEST_CHECK((res1 < 0) == (res2 < 0),
+			"table %d, %02x%02x (len %zu): res %d, expected %d",
+			id,
+			buf[0],
+			len > 1 ? buf[1] : 0,
+			len,
+			res1,
+			res2);
+	if (res1 < 0)
+		return 0;
+	H264_TEST_CHECK(code1 == code2 && h264_bs_rem_raw_bits(&bs1) ==
+						  h264_bs_rem_raw_bits(&bs2),
+			"table %d, %02x%02x (len %zu): code %u/%zu bits, "
+			"expected %u/%zu bits",
+			id,
+			buf[0],
+			len > 1 ? buf[1] : 0,
+			len,
+			code1,
+			h264_bs_rem_raw_bits(&bs1),
+			code2,
+			h264_bs_rem_raw_bits(&bs2));
+	return 0;
+}
+
+
+int h264_test_vlc(void)
+{
+	int res = 0;
+	uint32_t id, prefix;
+	uint8_t buf[3];
+
+	res = h264_vlc_lut_init();
+	H264_TEST_CHECK(res == 0, "h264_vlc_lut_init: %d", res);
+
+	for (id = 0; id < H264_VLC_TABLE_COUNT; id++) {
+		for (prefix = 0; prefix < (1 << 16); prefix++) {
+			buf[0] = prefix >> 8;
+			buf[1] = prefix & 0xff;
+			buf[2] = (prefix * 0x9d) & 0xff;
+			res = check_code(id, buf, sizeof(buf));
+			if (res < 0)
+				return res;
+			res = check_code(id, buf, 2);
+			if (res < 0)
+				return res;
+			if (buf[1] != 0)
+				continue;
+			res = check_code(id, buf, 1);
+			if (res < 0)
+				return res;
+		}
+	}
+
+	return 0;
+}
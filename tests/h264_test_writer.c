@@ -0,0 +1,293 @@
+/**
+ * Copyright (c) 2016 Parrot Drones SAS
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *   * Redistributions of source code must retain the above copyright
+ *     notice, this list of conditions and the following disclaimer.
+ *   * Redistributions in binary form must reproduce the above copyright
+ *     notice, this list of conditions and the following disclaimer in the
+ *     documentation and/or other materials provided with the distribution.
+ *   * Neither the name of the Parrot Drones SAS Company nor the
+ *     names of its contributors may be used to endorse or promote products
+ *     derived from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE PARROT DRONES SAS COMPANY BE LIABLE FOR
+ * ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+ * OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/*
+ * Slice writer: grey I and skipped P slices written by a context whose
+ * slice data templates are already cached (and evicted) by other slices must
+ * be byte-identical to the slices written by a new context, for slice
+ * headers of various lengths; the slices are then parsed back.
+ */
+
+#include "h264_test.h"
+
+
+#define WIDTH 6
+#define HEIGHT 4
+#define MB_COUNT (WIDTH * HEIGHT)
+#define VARIANT_COUNT 200
+#define WARM_PASSES 3
+
+
+struct variant {
+	int cabac;
+	int grey_i;
+	uint32_t first_mb;
+	uint32_t mb_count;
+	int32_t slice_qp_delta;
+	uint32_t frame_num;
+	uint32_t cabac_init_idc;
+
+	/* Output of a new context */
+	uint8_t *data;
+	size_t len;
+};
+
+
+struct parse_check {
+	const struct variant *v;
+	uint32_t mb_count;
+	uint32_t slice_mb_count;
+	uint32_t errors;
+};
+
+
+static void make_variant(struct variant *v, uint32_t *seed)
+{
+	static const uint32_t first_mbs[] = {0, 1, 5, MB_COUNT - 1};
+	static const uint32_t frame_nums[] = {0, 1, 9, 200};
+	uint32_t r = h264_test_random(seed);
+
+	memset(v, 0, sizeof(*v));
+	v->cabac = r & 1;
+	v->grey_i = (r >> 1) & 1;
+	v->first_mb = first_mbs[(r >> 2) % ARRAY_SIZE(first_mbs)];
+	/* One, some or all of the remaining macroblocks */
+	switch ((r >> 4) % 3) {
+	case 0:
+		v->mb_count = 1;
+		break;
+	case 1:
+		v->mb_count = (r >> 6) % (MB_COUNT - v->first_mb) + 1;
+		break;
+	default:
+		v->mb_count = MB_COUNT - v->first_mb;
+		break;
+	}
+	/* Small changes of the slice header length and of SliceQPLuma */
+	v->slice_qp_delta = (int32_t)((r >> 12) % 9) - 4;
+	v->frame_num = frame_nums[(r >> 16) % ARRAY_SIZE(frame_nums)];
+	/* cabac_init_idc is only present in CABAC P slices */
+	if (v->cabac && !v->grey_i)
+		v->cabac_init_idc = (r >> 20) % 3;
+}
+
+
+static int write_slice(struct h264_ctx *ctx,
+		       const struct variant *v,
+		       struct h264_bitstream *bs)
+{
+	int res = 0;
+	struct h264_nalu_header nh;
+	struct h264_slice_header sh;
+
+	memset(&nh, 0, sizeof(nh));
+	nh.nal_ref_idc = 1;
+	nh.nal_unit_type =
+		v->grey_i ? H264_NALU_TYPE_SLICE_IDR : H264_NALU_TYPE_SLICE;
+	res = h264_ctx_set_nalu_header(ctx, &nh);
+	if (res < 0)
+		return res;
+
+	memset(&sh, 0, sizeof(sh));
+	sh.first_mb_in_slice = v->first_mb;
+	sh.slice_type = v->grey_i ? H264_SLICE_TYPE_I : H264_SLICE_TYPE_P;
+	sh.frame_num = v->frame_num;
+	sh.idr_pic_id = v->frame_num;
+	sh.slice_qp_delta = v->slice_qp_delta;
+	sh.cabac_init_idc = v->cabac_init_idc;
+	res = h264_ctx_set_slice_header(ctx, &sh);
+	if (res < 0)
+		return res;
+
+	h264_bs_init(bs, NULL, 0, 1);
+	if (v->grey_i)
+		res = h264_write_grey_i_slice(bs, ctx, v->mb_count);
+	else
+		res = h264_write_skipped_p_slice(bs, ctx, v->mb_count);
+	if (res < 0)
+		h264_bs_clear(bs);
+	return res;
+}
+
+
+static void slice_data_mb_cb(struct h264_ctx *ctx,
+			     const struct h264_slice_header *sh,
+			     uint32_t mb_addr,
+			     enum h264_mb_type mb_type,
+			     void *userdata)
+{
+	struct parse_check *check = userdata;
+	const struct variant *v = check->v;
+
+	check->errors += mb_addr != v->first_mb + check->mb_count;
+	check->errors += mb_type != (v->grey_i ? H264_MB_TYPE_I_16x16
+					       : H264_MB_TYPE_P_SKIP);
+	check->mb_count++;
+}
+
+
+static void slice_data_end_cb(struct h264_ctx *ctx,
+			      const struct h264_slice_header *sh,
+			      uint32_t mb_count,
+			      void *userdata)
+{
+	struct parse_check *check = userdata;
+	check->slice_mb_count = mb_count;
+}
+
+
+static int parse_slice(const struct variant *v)
+{
+	int res = 0;
+	struct h264_ctx *ctx = NULL;
+	struct h264_reader *reader = NULL;
+	struct h264_test_stream stream;
+	struct h264_ctx_cbs cbs;
+	struct parse_check check;
+	size_t off = 0;
+
+	memset(&stream, 0, sizeof(stream));
+	memset(&cbs, 0, sizeof(cbs));
+	memset(&check, 0, sizeof(check));
+	cbs.slice_data_mb = &slice_data_mb_cb;
+	cbs.slice_data_end = &slice_data_end_cb;
+	check.v = v;
+
+	res = h264_test_ctx_new(v->cabac, WIDTH, HEIGHT, &ctx);
+	if (res < 0)
+		goto out;
+	res = h264_test_stream_add_ps(&stream, ctx);
+	if (res < 0)
+		goto out;
+	res = h264_test_stream_add(&stream, v->data, v->len);
+	if (res < 0)
+		goto out;
+
+	res = h264_reader_new(&cbs, &check, &reader);
+	if (res < 0)
+		goto out;
+	res = h264_reader_parse(reader,
+				H264_READER_FLAGS_SLICE_DATA,
+				stream.buf,
+				stream.len,
+				&off);
+	if (res < 0)
+		goto out;
+	if (check.mb_count != v->mb_count ||
+	    check.slice_mb_count != v->mb_count || check.errors != 0)
+		res = -EPROTO;
+
+out:
+	h264_reader_destroy(reader);
+	h264_ctx_destroy(ctx);
+	h264_test_stream_clear(&stream);
+	return res;
+}
+
+
+static void print_variant(const struct variant *v, const char *msg)
+{
+	fprintf(stderr,
+		"%s %s slice, first_mb %u, %u MBs, qp_delta %d, "
+		"frame_num %u, cabac_init_idc %u: %s\n",
+		v->cabac ? "CABAC" : "CAVLC",
+		v->grey_i ? "grey I" : "skipped P",
+		v->first_mb,
+		v->mb_count,
+		v->slice_qp_delta,
+		v->frame_num,
+		v->cabac_init_idc,
+		msg);
+}
+
+
+int h264_test_writer(void)
+{
+	int res = 0;
+	uint32_t seed = 0x13579bd;
+	struct variant *variants = NULL;
+	struct variant *v = NULL;
+	struct h264_ctx *ctx = NULL;
+	struct h264_ctx *warm[2] = {NULL, NULL};
+	struct h264_bitstream bs;
+	uint32_t i;
+
+	variants = calloc(VARIANT_COUNT, sizeof(*variants));
+	if (variants == NULL)
+		return -ENOMEM;
+
+	/* Reference: one new context per slice */
+	for (i = 0; i < VARIANT_COUNT; i++) {
+		v = &variants[i];
+		make_variant(v, &seed);
+		res = h264_test_ctx_new(v->cabac, WIDTH, HEIGHT, &ctx);
+		if (res < 0)
+			goto out;
+		res = write_slice(ctx, v, &bs);
+		h264_ctx_destroy(ctx);
+		if (res < 0) {
+			print_variant(v, "write failed");
+			goto out;
+		}
+		v->data = bs.data;
+		v->len = bs.off;
+		res = parse_slice(v);
+		if (res < 0) {
+			print_variant(v, "parsing failed");
+			goto out;
+		}
+	}
+
+	/* Same slices in random order, by contexts reused for all of them */
+	for (i = 0; i < 2; i++) {
+		res = h264_test_ctx_new(i, WIDTH, HEIGHT, &warm[i]);
+		if (res < 0)
+			goto out;
+	}
+	for (i = 0; i < WARM_PASSES * VARIANT_COUNT; i++) {
+		v = &variants[h264_test_random(&seed) % VARIANT_COUNT];
+		res = write_slice(warm[v->cabac], v, &bs);
+		if (res < 0) {
+			print_variant(v, "write failed");
+			goto out;
+		}
+		if (bs.off != v->len || memcmp(bs.data, v->data, v->len) != 0)
+			res = -EPROTO;
+		h264_bs_clear(&bs);
+		if (res < 0) {
+			print_variant(v, "output differs");
+			goto out;
+		}
+	}
+
+out:
+	for (i = 0; i < 2; i++)
+		h264_ctx_destroy(warm[i]);
+	for (i = 0; i < VARIANT_COUNT; i++)
+		free(variants[i].data);
+	free(variants);
+	return res;
+}
@@ -0,0 +1,304 @@
+/**
+ * Copyright (c) 2016 Parrot Drones SAS
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *   * Redistributions of source code must retain the above copyright
+ *     notice, this list of conditions and the following disclaimer.
+ *   * Redistributions in binary form must reproduce the above copyright
+ *     notice, this list of conditions and the following disclaimer in the
+ *     documentation and/or other materials provided with the distribution.
+ *   * Neither the name of the Parrot Drones SAS Company nor the
+ *     names of its contributors may be used to endorse or promote products
+ *     derived from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE PARROT DRONES SAS COMPANY BE LIABLE FOR
+ * ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+ * OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/*
+ * Benchmark of the CABAC bypass decoding: a bitstream made of runs of bypass
+ * bins, each run preceded by a regular bin so that codIRange varies as in a
+ * real slice, is decoded bin by bin and with the multi-bin primitive, and the
+ * two results are compared.
+ */
+
+#include <getopt.h>
+#include <time.h>
+
+#include "h264_priv.h"
+ULOG_DECLARE_TAG(h264);
+
+
+/* clang-format off */
+#define CHECK(_x) do { if ((res = (_x)) < 0) goto out; } while (0)
+/* clang-format on */
+
+#define DEFAULT_RUN_COUNT 1000000
+#define DEFAULT_LOOP_COUNT 10
+#define MAX_RUN_LEN 32
+
+
+struct run {
+	uint8_t decision;
+	uint8_t len;
+	uint32_t val;
+};
+
+
+struct app {
+	uint32_t run_count;
+	uint32_t run_len;
+	uint32_t loop_count;
+	struct run *runs;
+	struct run *decoded;
+	struct h264_bitstream bs;
+};
+
+
+static uint32_t next_random(uint32_t *seed)
+{
+	/* xorshift32 */
+	*seed ^= *seed << 13;
+	*seed ^= *seed >> 17;
+	*seed ^= *seed << 5;
+	return *seed;
+}
+
+
+static int encode(struct app *app)
+{
+	int res = 0;
+	uint32_t seed = 0x2545f491;
+	struct h264_bac_enc enc;
+	struct h264_bac_state state;
+	uint32_t bit = 0;
+
+	h264_bs_init(&app->bs, NULL, 0, 0);
+	h264_bac_state_init(&state, 26, 0, 64);
+	CHECK(h264_bac_encode_init(&enc, &app->bs, 1));
+
+	for (uint32_t i = 0; i < app->run_count; i++) {
+		struct run *run = &app->runs[i];
+		run->decision = (next_random(&seed) & 7) == 0;
+		run->len = app->run_len != 0
+				   ? app->run_len
+				   : 1 + next_random(&seed) % MAX_RUN_LEN;
+		run->val = next_random(&seed);
+		if (run->len < 32)
+			run->val &= (1u << run->len) - 1;
+
+		CHECK(h264_bac_encode_bin(&enc, &state, run->decision));
+		for (uint32_t j = run->len; j > 0; j--) {
+			bit = (run->val >> (j - 1)) & 1;
+			CHECK(h264_bac_encode_bypass(&enc, bit));
+		}
+	}
+	CHECK(h264_bac_encode_terminate(&enc, 1));
+
+	/* The last bits written by the flushing are still in the cache, the
+	 * decoder reads whole bytes */
+	if (app->bs.cachebits != 0)
+		CHECK(h264_bs_write_bits(&app->bs, 0, 8 - app->bs.cachebits));
+
+out:
+	return res;
+}
+
+
+static uint32_t decode_bypass_per_bin(struct h264_bac_dec *dec, uint32_t n)
+{
+	uint32_t v = 0;
+	while (n-- > 0)
+		v = (v << 1) | h264_bac_decode_bypass(dec);
+	return v;
+}
+
+
+static int decode(struct app *app, int multi, uint64_t *ns)
+{
+	int res = 0;
+	struct h264_bitstream bs;
+	struct h264_bac_dec dec;
+	struct h264_bac_state state;
+	struct timespec start, end;
+
+	clock_gettime(CLOCK_MONOTONIC, &start);
+
+	h264_bs_cinit(&bs, app->bs.data, app->bs.off, 0);
+	h264_bac_state_init(&state, 26, 0, 64);
+	CHECK(h264_bac_decode_init(&dec, &bs));
+
+	for (uint32_t i = 0; i < app->run_count; i++) {
+		struct run *run = &app->decoded[i];
+		run->decision = h264_bac_decode_bin(&dec, &state);
+		run->len = app->runs[i].len;
+		run->val = multi ? h264_bac_decode_bypass_bits(&dec, run->len)
+				 : decode_bypass_per_bin(&dec, run->len);
+	}
+	if (!h264_bac_decode_terminate(&dec)) {
+		res = -EPROTO;
+		goto out;
+	}
+
+	clock_gettime(CLOCK_MONOTONIC, &end);
+	*ns = (uint64_t)(end.tv_sec - start.tv_sec) * 1000000000 +
+	      end.tv_nsec - start.tv_nsec;
+
+	for (uint32_t i = 0; i < app->run_count; i++) {
+		if (app->decoded[i].decision != app->runs[i].decision ||
+		    app->decoded[i].val != app->runs[i].val) {
+			res = -EPROTO;
+			break;
+		}
+	}
+
+out:
+	return res;
+}
+
+
+static int bench(struct app *app, int multi, uint64_t *best_ns)
+{
+	int res = 0;
+	uint64_t ns = 0;
+
+	*best_ns = UINT64_MAX;
+	for (uint32_t i = 0; i < app->loop_count; i++) {
+		res = decode(app, multi, &ns);
+		if (res < 0) {
+			fprintf(stderr,
+				"%s decoding mismatch\n",
+				multi ? "multi-bin" : "per-bin");
+			return res;
+		}
+		if (ns < *best_ns)
+			*best_ns = ns;
+	}
+
+	return 0;
+}
+
+
+static const char short_options[] = "hn:l:r:";
+
+
+static const struct option long_options[] = {
+	{"help", no_argument, NULL, 'h'},
+	{"runs", required_argument, NULL, 'n'},
+	{"length", required_argument, NULL, 'l'},
+	{"loops", required_argument, NULL, 'r'},
+	{0, 0, 0, 0},
+};
+
+
+static void usage(char *prog_name)
+{
+	printf("Usage: %s [options]\n"
+	       "\n"
+	       "Options:\n"
+	       "-h | --help                        Print this message\n"
+	       "-n | --runs <count>                Number of bypass runs "
+	       "(default %u)\n"
+	       "-l | --length <bins>               Bins per run, 1 to %u, "
+	       "0 for random (default 0)\n"
+	       "-r | --loops <count>               Number of decoding loops, "
+	       "the best is kept (default %u)\n"
+	       "\n",
+	       prog_name,
+	       DEFAULT_RUN_COUNT,
+	       MAX_RUN_LEN,
+	       DEFAULT_LOOP_COUNT);
+}
+
+
+int main(int argc, char *argv[])
+{
+	int res = 0;
+	int idx, c;
+	uint64_t bins = 0, per_bin_ns = 0, multi_ns = 0;
+	struct app app;
+
+	memset(&app, 0, sizeof(app));
+	app.run_count = DEFAULT_RUN_COUNT;
+	app.loop_count = DEFAULT_LOOP_COUNT;
+
+	while ((c = getopt_long(
+			argc, argv, short_options, long_options, &idx)) != -1) {
+		switch (c) {
+		case 0:
+			break;
+
+		case 'h':
+			usage(argv[0]);
+			exit(EXIT_SUCCESS);
+			break;
+
+		case 'n':
+			app.run_count = atoi(optarg);
+			break;
+
+		case 'l':
+			app.run_len = atoi(optarg);
+			break;
+
+		case 'r':
+			app.loop_count = atoi(optarg);
+			break;
+
+		default:
+			usage(argv[0]);
+			exit(EXIT_FAILURE);
+			break;
+		}
+	}
+	if (app.run_count == 0 || app.loop_count == 0 ||
+	    app.run_len > MAX_RUN_LEN) {
+		usage(argv[0]);
+		exit(EXIT_FAILURE);
+	}
+
+	app.runs = calloc(app.run_count, sizeof(*app.runs));
+	app.decoded = calloc(app.run_count, sizeof(*app.decoded));
+	if (app.runs == NULL || app.decoded == NULL) {
+		res = -ENOMEM;
+		ULOG_ERRNO("calloc", -res);
+		goto out;
+	}
+
+	res = encode(&app);
+	if (res < 0) {
+		ULOG_ERRNO("encode", -res);
+		goto out;
+	}
+	for (uint32_t i = 0; i < app.run_count; i++)
+		bins += app.runs[i].len;
+
+	CHECK(bench(&app, 0, &per_bin_ns));
+	CHECK(bench(&app, 1, &multi_ns));
+
+	printf("%u runs, %" PRIu64 " bypass bins, %zu bytes\n",
+	       app.run_count,
+	       bins,
+	       app.bs.off);
+	printf("per-bin:   %8.3f ms (%.2f ns/bin)\n",
+	       per_bin_ns / 1e6,
+	       (double)per_bin_ns / bins);
+	printf("multi-bin: %8.3f ms (%.2f ns/bin)\n",
+	       multi_ns / 1e6,
+	       (double)multi_ns / bins);
+
+out:
+	h264_bs_clear(&app.bs);
+	free(app.runs);
+	free(app.decoded);
+	return res < 0 ? EXIT_FAILURE : EXIT_SUCCESS;
+}